@@ -0,0 +1,356 @@
+#include "Simulation.h"
+#include "Scenarios.h"
+#include "FieldSolver.h"
+#include "ThreadPool.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cmath>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Benchmark Parameters
+const size_t BENCH_DEFAULT_SIZES[] = { 1000, 10000, 100000, 1000000 };	// Body counts run by default
+const size_t BENCH_DIRECT_LIMIT = 100000;		// Largest body count run with direct summation by default (O(n^2) per step)
+const double BENCH_MIN_SECONDS = 1.0;			// Keep stepping until a run took at least this long...
+const unsigned long long BENCH_MIN_STEPS = 3;	// ...and took at least this many steps
+const unsigned long long BENCH_MAX_STEPS = 200;	// Never take more steps than this per run
+const size_t BENCH_ERROR_SAMPLES = 64;			// Bodies whose force is checked against an extended precision sum after each run
+
+// Command line settings of a benchmark session
+struct BenchOptions {
+	std::vector<Scenario> scenarios = { Scenario::UNIFORM, Scenario::DISK, Scenario::PLUMMER, Scenario::CLUSTERS, Scenario::MERGE_STORM };
+	std::vector<Solver> solvers = { Solver::DIRECT, Solver::BARNES_HUT, Solver::PARTICLE_MESH };
+	std::vector<size_t> sizes = { std::begin(BENCH_DEFAULT_SIZES), std::end(BENCH_DEFAULT_SIZES) };
+	size_t directLimit = BENCH_DIRECT_LIMIT;
+	double minSeconds = BENCH_MIN_SECONDS;
+	unsigned long long maxSteps = BENCH_MAX_STEPS;
+	unsigned int seed = 1;
+	size_t threads = 0;
+	float theta = 0.5f;
+	int meshSize = PM_GRID_SIZE;
+	Boundary boundary = Boundary::PERIODIC;
+	bool field = true;
+	std::string output;
+};
+
+// Measurements of one scenario / solver / size combination
+struct BenchResult {
+	Scenario scenario;
+	Solver solver;
+	size_t bodies = 0;
+	bool skipped = false;
+	unsigned long long steps = 0;
+	double seconds = 0.0;
+	double interactions = 0.0;		// Body-body (or body-node for Barnes-Hut) interactions evaluated
+	unsigned long long merges = 0;
+	size_t bodiesRemaining = 0;
+	double forceErrorMax = 0.0;		// Relative force error of the final state on BENCH_ERROR_SAMPLES bodies
+	double forceErrorMean = 0.0;
+	double fieldMilliseconds = 0.0;	// One full field level at FIELD_CELL_SIZE for the final state
+	size_t peakMemory = 0;			// Peak resident memory of the process so far
+};
+
+// Peak resident memory of this process in bytes
+static size_t peakMemoryBytes() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+	return (size_t)usage.ru_maxrss;
+#else
+	return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+// Recompute the forces of the final state with the solver under test and compare a sample of bodies against
+// direct summation in long double. Shows what the build's precision (and the approximate solvers) cost.
+static void measureForceError(Simulation& sim, double& maxError, double& meanError) {
+	const BodyArrays& bodies = sim.bodies;
+	const size_t count = bodies.size();
+	const size_t samples = count < BENCH_ERROR_SAMPLES ? count : BENCH_ERROR_SAMPLES;
+	if (samples == 0) return;
+	sim.computeForces();
+
+	double sum = 0.0;
+	for (size_t k = 0; k < samples; k++) {
+		size_t i = k * count / samples;
+		long double ax = 0.0L, ay = 0.0L;
+		for (size_t j = 0; j < count; j++) {
+			long double dx = (long double)bodies.x[j] - bodies.x[i];
+			long double dy = (long double)bodies.y[j] - bodies.y[i];
+			if (sim.boundary == Boundary::PERIODIC) {
+				if (dx > SIM_WIDTH_HALF) dx -= SIM_WIDTH;
+				else if (dx < -SIM_WIDTH_HALF) dx += SIM_WIDTH;
+				if (dy > SIM_HEIGHT_HALF) dy -= SIM_HEIGHT;
+				else if (dy < -SIM_HEIGHT_HALF) dy += SIM_HEIGHT;
+			}
+			long double distanceSquared = dx * dx + dy * dy;
+			if (distanceSquared < MIN_DISTANCE_SQUARED) continue;
+			long double strength = bodies.m[j] / (distanceSquared * std::sqrt(distanceSquared));
+			ax += strength * dx;
+			ay += strength * dy;
+		}
+		long double scale = (long double)G * bodies.m[i];
+		long double referenceX = scale * ax, referenceY = scale * ay;
+		long double reference = std::sqrt(referenceX * referenceX + referenceY * referenceY);
+		if (reference == 0.0L) continue;
+		long double errorX = bodies.fx[i] - referenceX, errorY = bodies.fy[i] - referenceY;
+		double error = (double)(std::sqrt(errorX * errorX + errorY * errorY) / reference);
+		if (error > maxError) maxError = error;
+		sum += error;
+	}
+	meanError = sum / samples;
+}
+
+// Run one combination
+static BenchResult runOne(const BenchOptions& options, Scenario scenario, Solver solver, size_t count, ThreadPool& fieldPool) {
+	BenchResult result;
+	result.scenario = scenario;
+	result.solver = solver;
+	result.bodies = count;
+	if (solver == Solver::DIRECT && count > options.directLimit) {
+		result.skipped = true;
+		return result;
+	}
+
+	Simulation sim;
+	sim.solver = solver;
+	sim.theta = options.theta;
+	sim.mesh.gridSize = options.meshSize;
+	sim.boundary = options.boundary;
+	sim.setThreads(options.threads > 0 ? options.threads : ThreadPool::hardwareThreads());
+	addScenario(sim, scenario, count, options.seed);
+
+	// Steps from the very first one, so the merges of crowded scenes are part of the measurement
+	auto start = std::chrono::steady_clock::now();
+	while (result.steps < options.maxSteps) {
+		sim.step();
+		result.steps++;
+		result.interactions += (double)sim.interactions;
+
+		result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (result.seconds >= options.minSeconds && result.steps >= BENCH_MIN_STEPS) break;
+	}
+
+	result.merges = sim.merges;
+	result.bodiesRemaining = sim.bodies.size();
+	measureForceError(sim, result.forceErrorMax, result.forceErrorMean);
+
+	if (options.field) {
+		QuadTree tree;
+		tree.build(sim.bodies, sim.boundary);
+		FieldLevel level;
+		level.cellSize = FIELD_CELL_SIZE;
+		level.columns = (int)(SIM_WIDTH / FIELD_CELL_SIZE);
+		level.rows = (int)(SIM_HEIGHT / FIELD_CELL_SIZE);
+		auto fieldStart = std::chrono::steady_clock::now();
+		computeFieldLevel(sim.bodies, tree, level, fieldPool);
+		result.fieldMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - fieldStart).count();
+	}
+
+	result.peakMemory = peakMemoryBytes();
+	return result;
+}
+
+// One result as a JSON object
+static void writeResult(std::ostream& out, const BenchResult& result) {
+	out << "{\"scenario\": \"" << scenarioName(result.scenario) << "\", \"solver\": \"" << solverKey(result.solver)
+		<< "\", \"bodies\": " << result.bodies;
+	if (result.skipped) {
+		out << ", \"skipped\": true}";
+		return;
+	}
+	double seconds = result.seconds > 0.0 ? result.seconds : 1e-12;
+	out << ", \"steps\": " << result.steps
+		<< ", \"seconds\": " << result.seconds
+		<< ", \"steps_per_sec\": " << result.steps / seconds
+		<< ", \"interactions\": " << result.interactions
+		<< ", \"ns_per_interaction\": " << (result.interactions > 0.0 ? result.seconds * 1e9 / result.interactions : 0.0)
+		<< ", \"merges\": " << result.merges
+		<< ", \"merges_per_sec\": " << result.merges / seconds
+		<< ", \"bodies_remaining\": " << result.bodiesRemaining
+		<< ", \"force_error_max\": " << result.forceErrorMax
+		<< ", \"force_error_mean\": " << result.forceErrorMean
+		<< ", \"field_ms\": " << result.fieldMilliseconds
+		<< ", \"peak_memory_bytes\": " << result.peakMemory << "}";
+}
+
+// Split a comma separated list
+static std::vector<std::string> splitList(const std::string& list) {
+	std::vector<std::string> items;
+	std::stringstream stream(list);
+	std::string item;
+	while (std::getline(stream, item, ',')) {
+		if (!item.empty()) items.push_back(item);
+	}
+	return items;
+}
+
+// Read a whole string as an unsigned number
+static bool parseCount(const std::string& text, unsigned long long& value) {
+	char* end = nullptr;
+	value = std::strtoull(text.c_str(), &end, 10);
+	return !text.empty() && *end == '\0';
+}
+
+// Print the supported arguments
+static void printUsage(const char* program) {
+	std::cerr << "Usage: " << program << " [--scenarios LIST] [--solvers LIST] [--sizes LIST] [--direct-limit N] [--min-time S]\n"
+		<< "          [--max-steps N] [--seed S] [--threads N] [--theta T] [--mesh-size N] [--boundary NAME] [--no-field] [--output FILE]\n"
+		<< "  --scenarios LIST  Comma separated: uniform, disk, plummer, clusters, merge-storm (default all)\n"
+		<< "  --solvers LIST    Comma separated: direct, bh, pm, p3m (default direct,bh,pm)\n"
+		<< "  --sizes LIST      Comma separated body counts (default 1000,10000,100000,1000000)\n"
+		<< "  --direct-limit N  Skip direct summation above N bodies (default 100000)\n"
+		<< "  --min-time S      Seconds each run steps for, at least 3 steps (default 1)\n"
+		<< "  --max-steps N     Most steps per run (default 200)\n"
+		<< "  --seed S          Seed of every scenario (default 1)\n"
+		<< "  --threads N       Force phase threads, 0 uses every hardware thread (default 0)\n"
+		<< "  --theta T         Barnes-Hut opening angle (default 0.5)\n"
+		<< "  --mesh-size N     Particle-mesh cells per side (default 256)\n"
+		<< "  --boundary NAME   periodic, open or reflective (default periodic)\n"
+		<< "  --no-field        Don't time the gravity field\n"
+		<< "  --output FILE     Write the JSON report to FILE instead of stdout\n";
+}
+
+// Parse argv into benchmark options, returns false if the arguments are invalid
+static bool parseBenchOptions(int argc, char** argv, BenchOptions& options) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		std::string value = (i + 1 < argc) ? argv[i + 1] : "";
+		unsigned long long number = 0;
+		bool valid = true;
+
+		if (arg == "--no-field") {
+			options.field = false;
+			continue;
+		}
+		if (i + 1 >= argc) valid = false;
+		else if (arg == "--scenarios") {
+			options.scenarios.clear();
+			for (const std::string& name : splitList(value)) {
+				Scenario scenario;
+				valid = valid && parseScenario(name, scenario);
+				options.scenarios.push_back(scenario);
+			}
+		}
+		else if (arg == "--solvers") {
+			options.solvers.clear();
+			for (const std::string& name : splitList(value)) {
+				Solver solver;
+				valid = valid && parseSolver(name, solver);
+				options.solvers.push_back(solver);
+			}
+		}
+		else if (arg == "--sizes") {
+			options.sizes.clear();
+			for (const std::string& size : splitList(value)) {
+				valid = valid && parseCount(size, number) && number > 0;
+				options.sizes.push_back((size_t)number);
+			}
+		}
+		else if (arg == "--direct-limit") {
+			valid = parseCount(value, number);
+			options.directLimit = (size_t)number;
+		}
+		else if (arg == "--min-time") {
+			options.minSeconds = std::atof(value.c_str());
+		}
+		else if (arg == "--max-steps") {
+			valid = parseCount(value, number) && number > 0;
+			options.maxSteps = number;
+		}
+		else if (arg == "--seed") {
+			valid = parseCount(value, number);
+			options.seed = (unsigned int)number;
+		}
+		else if (arg == "--threads") {
+			valid = parseCount(value, number);
+			options.threads = (size_t)number;
+		}
+		else if (arg == "--theta") {
+			options.theta = (float)std::atof(value.c_str());
+			valid = options.theta > 0.0f;
+		}
+		else if (arg == "--mesh-size") {
+			valid = parseCount(value, number) && number >= PM_MIN_GRID_SIZE && number <= 8192;
+			options.meshSize = (int)number;
+		}
+		else if (arg == "--boundary") {
+			if (value == "periodic") options.boundary = Boundary::PERIODIC;
+			else if (value == "open") options.boundary = Boundary::OPEN;
+			else if (value == "reflective") options.boundary = Boundary::REFLECTIVE;
+			else valid = false;
+		}
+		else if (arg == "--output") {
+			options.output = value;
+		}
+		else {
+			valid = false;
+		}
+		i++;
+
+		if (!valid) {
+			std::cerr << "Invalid argument: " << arg << "\n";
+			printUsage(argv[0]);
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char** argv) {
+	BenchOptions options;
+	if (!parseBenchOptions(argc, argv, options)) return 1;
+
+	std::ofstream file;
+	if (!options.output.empty()) {
+		file.open(options.output);
+		if (!file) {
+			std::cerr << "Could not write " << options.output << "\n";
+			return 1;
+		}
+	}
+	std::ostream& out = options.output.empty() ? std::cout : file;
+
+	size_t threads = options.threads > 0 ? options.threads : ThreadPool::hardwareThreads();
+	ThreadPool fieldPool(threads);
+
+	out << "{\n  \"version\": 1,\n  \"precision\": \"" << GRAVITY_PRECISION_NAME << "\",\n  \"seed\": " << options.seed << ",\n  \"threads\": " << threads
+		<< ",\n  \"kernel\": \"" << kernelIsaName(resolveKernelIsa(KernelIsa::AUTO)) << "\",\n  \"theta\": " << options.theta
+		<< ",\n  \"boundary\": \"" << boundaryName(options.boundary) << "\""
+		<< ",\n  \"results\": [";
+
+	// Results are written as they finish, progress goes to stderr so stdout stays valid JSON
+	bool first = true;
+	for (Scenario scenario : options.scenarios) {
+		for (Solver solver : options.solvers) {
+			for (size_t count : options.sizes) {
+				std::cerr << scenarioName(scenario) << " / " << solverName(solver) << " / " << count << " bodies\n";
+				BenchResult result = runOne(options, scenario, solver, count, fieldPool);
+				out << (first ? "\n    " : ",\n    ");
+				writeResult(out, result);
+				out.flush();
+				first = false;
+			}
+		}
+	}
+
+	out << "\n  ]\n}\n";
+	return 0;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "Precision.h"
+
+// The simulation engine is deliberately free of raylib so it can be built and run
+// on machines without a window or OpenGL context (see --headless in Main.cpp).
+
+// Sim Parameters
+const int SIM_WIDTH = 1000;										// Width of simulation space
+const int SIM_HEIGHT = 1000;									// Height of simulation space
+const float SIM_WIDTH_HALF = SIM_WIDTH / 2.0f;					// Half of simulation width
+const float SIM_HEIGHT_HALF = SIM_HEIGHT / 2.0f;				// Half of simulation height
+const Real G = (Real)6.67430e-8;								// Gravitational Constant (Modified to fit simulation scale)
+const float SIM_DT = 1.0f;										// Default timestep, one frame of the original 60 FPS loop
+const float MIN_DISTANCE_SQUARED = 0.1f;						// Threshold to avoid division by zero in force calculations.
+const float SIM_PI = 3.14159265358979323846f;					// Pi, independent of raylib's PI macro
+
+// Plain 2D vector used by the engine in place of raylib's Vector2
+struct Vec2 {
+	Real x;
+	Real y;
+};
+
+// Defines Body Simulation Element. The simulation stores bodies as separate arrays (see BodyArrays),
+// this struct is used to pass a single body in and out of it.
+struct Body {
+	Real mass;
+	Real radius;
+	Vec2 velocity;
+	Vec2 location;
+
+	// Constructor
+	Body(Real mass, Real radius, Vec2 velocity, Vec2 location) : mass(mass), radius(radius), velocity(velocity), location(location) {};
+};
@@ -0,0 +1,68 @@
+#include "BodyArrays.h"
+#include <cmath>
+#include <algorithm>
+
+void BodyArrays::reserve(size_t count) {
+	for (AlignedReals* array : { &x, &y, &vx, &vy, &m, &r, &fx, &fy }) array->reserve(count);
+}
+
+void BodyArrays::clear() {
+	for (AlignedReals* array : { &x, &y, &vx, &vy, &m, &r, &fx, &fy }) array->clear();
+}
+
+void BodyArrays::push(const Body& body) {
+	x.push_back(body.location.x);
+	y.push_back(body.location.y);
+	vx.push_back(body.velocity.x);
+	vy.push_back(body.velocity.y);
+	m.push_back(body.mass);
+	r.push_back(body.radius);
+	fx.push_back(0.0f);
+	fy.push_back(0.0f);
+}
+
+void BodyArrays::moveBody(size_t from, size_t to) {
+	for (AlignedReals* array : { &x, &y, &vx, &vy, &m, &r, &fx, &fy }) (*array)[to] = (*array)[from];
+}
+
+void BodyArrays::resize(size_t count) {
+	for (AlignedReals* array : { &x, &y, &vx, &vy, &m, &r, &fx, &fy }) array->resize(count);
+}
+
+// Euler update of one block of bodies, instantiated per boundary policy
+template <typename Policy>
+static void integrateWith(BodyArrays& bodies, size_t begin, size_t end, float dt) {
+	for (size_t i = begin; i < end; i++) {
+		// Apply accumulated force to velocity
+		bodies.vx[i] += bodies.fx[i] / bodies.m[i] * dt;
+		bodies.vy[i] += bodies.fy[i] / bodies.m[i] * dt;
+
+		bodies.x[i] += bodies.vx[i] * dt;
+		bodies.y[i] += bodies.vy[i] * dt;
+
+		// Reset accumulated force for next step
+		bodies.fx[i] = 0.0f;
+		bodies.fy[i] = 0.0f;
+
+		Policy::confine(bodies.x[i], bodies.vx[i], (Real)SIM_WIDTH);
+		Policy::confine(bodies.y[i], bodies.vy[i], (Real)SIM_HEIGHT);
+	}
+}
+
+template <typename Policy>
+static void driftWith(BodyArrays& bodies, size_t begin, size_t end, float dt) {
+	for (size_t i = begin; i < end; i++) {
+		bodies.x[i] += bodies.vx[i] * dt;
+		bodies.y[i] += bodies.vy[i] * dt;
+		Policy::confine(bodies.x[i], bodies.vx[i], (Real)SIM_WIDTH);
+		Policy::confine(bodies.y[i], bodies.vy[i], (Real)SIM_HEIGHT);
+	}
+}
+
+void BodyArrays::integrate(size_t begin, size_t end, float dt, Boundary boundary) {
+	withBoundary(boundary, [&](auto policy) { integrateWith<decltype(policy)>(*this, begin, end, dt); });
+}
+
+void BodyArrays::drift(size_t begin, size_t end, float dt, Boundary boundary) {
+	withBoundary(boundary, [&](auto policy) { driftWith<decltype(policy)>(*this, begin, end, dt); });
+}
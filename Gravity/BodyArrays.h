@@ -0,0 +1,122 @@
+#pragma once
+#include "Body.h"
+#include "Boundary.h"
+#include <vector>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+const size_t BODY_ARRAY_ALIGNMENT = 64;		// Byte alignment of every body array (one cache line, enough for AVX)
+
+// Allocator returning BODY_ARRAY_ALIGNMENT aligned storage so SIMD kernels can use aligned loads
+template <typename T>
+struct AlignedAllocator {
+	using value_type = T;
+
+	AlignedAllocator() = default;
+	template <typename U> AlignedAllocator(const AlignedAllocator<U>&) {}
+
+	T* allocate(size_t count) {
+		size_t bytes = ((count * sizeof(T) + BODY_ARRAY_ALIGNMENT - 1) / BODY_ARRAY_ALIGNMENT) * BODY_ARRAY_ALIGNMENT;
+#ifdef _MSC_VER
+		void* memory = _aligned_malloc(bytes, BODY_ARRAY_ALIGNMENT);
+#else
+		void* memory = std::aligned_alloc(BODY_ARRAY_ALIGNMENT, bytes);
+#endif
+		if (!memory) throw std::bad_alloc();
+		return static_cast<T*>(memory);
+	}
+
+	void deallocate(T* memory, size_t) {
+#ifdef _MSC_VER
+		_aligned_free(memory);
+#else
+		std::free(memory);
+#endif
+	}
+
+	template <typename U> bool operator==(const AlignedAllocator<U>&) const { return true; }
+	template <typename U> bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+using AlignedFloats = std::vector<float, AlignedAllocator<float>>;
+using AlignedReals = std::vector<Real, AlignedAllocator<Real>>;		// Body state in the build's precision (see Precision.h)
+
+// Structure-of-arrays body storage. Index i of every array describes the same body.
+struct BodyArrays {
+	AlignedReals x;			// Location
+	AlignedReals y;
+	AlignedReals vx;		// Velocity
+	AlignedReals vy;
+	AlignedReals m;			// Mass
+	AlignedReals r;			// Radius
+	AlignedReals fx;		// Force from the last evaluation
+	AlignedReals fy;
+
+	// Number of bodies
+	size_t size() const { return x.size(); }
+
+	// Reserve room for "count" bodies in every array
+	void reserve(size_t count);
+
+	// Remove every body
+	void clear();
+
+	// Append a body
+	void push(const Body& body);
+
+	// Copy body i out of the arrays
+	Body get(size_t i) const { return Body(m[i], r[i], { vx[i], vy[i] }, { x[i], y[i] }); }
+
+	// Copy body "from" over body "to"
+	void moveBody(size_t from, size_t to);
+
+	// Shrink or grow every array to "count" bodies
+	void resize(size_t count);
+
+	// Calculate the force body j exerts on body i, taking the offset between them as the boundary policy does
+	template <typename Policy>
+	Vec2 gravitationalForce(size_t i, size_t j) const;
+
+	// Check if bodies i and j are colliding
+	template <typename Policy>
+	bool checkCollision(size_t i, size_t j) const;
+
+	// Apply the accumulated forces to bodies [begin, end) over a timestep of dt, move them and reset their forces
+	void integrate(size_t begin, size_t end, float dt, Boundary boundary);
+
+	// Change the velocity of body i by its force over dt, leaving the force in place
+	void kick(size_t i, float dt) {
+		vx[i] += fx[i] / m[i] * dt;
+		vy[i] += fy[i] / m[i] * dt;
+	}
+
+	// Move bodies [begin, end) along their velocities for dt, wrapping around or bouncing off the edges as the boundary requires
+	void drift(size_t begin, size_t end, float dt, Boundary boundary);
+};
+
+template <typename Policy>
+Vec2 BodyArrays::gravitationalForce(size_t i, size_t j) const {
+	Real dx = Policy::offset(x[j] - x[i], (Real)SIM_WIDTH, SIM_WIDTH_HALF);
+	Real dy = Policy::offset(y[j] - y[i], (Real)SIM_HEIGHT, SIM_HEIGHT_HALF);
+	Real distanceSquared = (dx * dx) + (dy * dy);
+
+	if (distanceSquared < MIN_DISTANCE_SQUARED) return { 0, 0 }; // Avoid division by zero
+
+	Real forceMag = G * (m[i] * m[j]) / distanceSquared; // Newton's Law of Gravitation, F = (G * (m1 * m2)) / r^2
+	Real distanceMag = std::sqrt(distanceSquared); // Magnitude of distance vector
+
+	return { (forceMag * dx / distanceMag), (forceMag * dy / distanceMag) };
+}
+
+template <typename Policy>
+bool BodyArrays::checkCollision(size_t i, size_t j) const {
+	Real dx = Policy::offset(x[j] - x[i], (Real)SIM_WIDTH, SIM_WIDTH_HALF);
+	Real dy = Policy::offset(y[j] - y[i], (Real)SIM_HEIGHT, SIM_HEIGHT_HALF);
+	Real distanceSquared = (dx * dx) + (dy * dy);
+
+	// Precompute sum of radii to avoid redundant calculation
+	Real radiiSum = r[i] + r[j];
+
+	return distanceSquared <= (radiiSum) * (radiiSum); // Compare this to the minimum collision distance squared.
+}
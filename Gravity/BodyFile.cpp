@@ -0,0 +1,219 @@
+#include "BodyFile.h"
+#include "MappedFile.h"
+#include "ByteOrder.h"
+#include "ThreadPool.h"
+#include <charconv>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+
+static const char BODY_FILE_MAGIC[8] = { 'G', 'R', 'A', 'V', 'B', 'O', 'D', 'Y' };
+static const char* const BODY_FILE_CSV_HEADER = "mass,radius,x,y,vx,vy\n";
+
+// Body arrays in record and column order
+static AlignedReals BodyArrays::* const BODY_FILE_FIELDS[6] = {
+	&BodyArrays::m, &BodyArrays::r, &BodyArrays::x, &BodyArrays::y, &BodyArrays::vx, &BodyArrays::vy
+};
+
+// Set *error if the caller asked for it, always returns false
+static bool fail(std::string* error, const std::string& message) {
+	if (error) *error = message;
+	return false;
+}
+
+BodyFileFormat bodyFileFormat(const std::string& path) {
+	if (path.size() >= 4) {
+		std::string extension = path.substr(path.size() - 4);
+		for (char& c : extension) c = (char)std::tolower((unsigned char)c);
+		if (extension == ".csv") return BodyFileFormat::CSV;
+	}
+	return BodyFileFormat::BINARY;
+}
+
+// Binary records: every task converts BODY_FILE_CHUNK_BYTES worth of records from rows to the arrays
+static bool loadBinary(const MappedFile& file, const std::string& path, BodyArrays& bodies, size_t first, ThreadPool& pool, std::string* error) {
+	const unsigned char* bytes = file.data();
+	if (file.size() < BODY_FILE_HEADER_BYTES || std::memcmp(bytes, BODY_FILE_MAGIC, 8) != 0) return fail(error, path + " is not a body file");
+	if (getU32(bytes + 8) != BODY_FILE_VERSION) return fail(error, "Unsupported body file version " + std::to_string(getU32(bytes + 8)));
+
+	const uint64_t headerBytes = getU32(bytes + 12);
+	const uint64_t count = getU64(bytes + 16);
+	const uint64_t recordBytes = getU32(bytes + 24);
+	if (headerBytes < BODY_FILE_HEADER_BYTES || headerBytes > file.size() || recordBytes < BODY_FILE_RECORD_BYTES || count > (file.size() - headerBytes) / recordBytes) {
+		return fail(error, path + " is truncated or corrupt");
+	}
+
+	bodies.resize(first + (size_t)count);
+	const size_t perTask = BODY_FILE_CHUNK_BYTES / BODY_FILE_RECORD_BYTES;
+	pool.run(((size_t)count + perTask - 1) / perTask, [&](size_t task, size_t) {
+		const size_t begin = task * perTask;
+		const size_t end = std::min((size_t)count, begin + perTask);
+		const unsigned char* record = bytes + headerBytes + begin * recordBytes;
+		for (size_t i = first + begin; i < first + end; i++, record += recordBytes) {
+			for (int field = 0; field < 6; field++) (bodies.*BODY_FILE_FIELDS[field])[i] = (Real)getF32(record + 4 * field);
+		}
+	});
+	return true;
+}
+
+// True for the first character of a number
+static bool startsNumber(char c) {
+	return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.';
+}
+
+// Lines of one CSV chunk. A line belongs to the chunk it starts in.
+struct CsvChunk {
+	size_t begin = 0;
+	size_t end = 0;
+	size_t records = 0;		// Body lines, counted in the first pass
+	size_t lines = 0;		// All lines, for error messages
+	size_t errorLine = 0;	// Line within the chunk of the first malformed body, 0 if none
+};
+
+// Call line(start, end) for every line of [begin, end), without the line break
+template <typename Line>
+static void forEachLine(const char* text, size_t begin, size_t end, Line&& line) {
+	size_t start = begin;
+	while (start < end) {
+		const char* newline = (const char*)std::memchr(text + start, '\n', end - start);
+		size_t stop = newline ? (size_t)(newline - text) : end;
+		size_t trimmed = stop > start && text[stop - 1] == '\r' ? stop - 1 : stop;
+		line(start, trimmed);
+		start = stop + 1;
+	}
+}
+
+// Parse one body line into index i of the arrays, returns false if it doesn't hold six numbers
+static bool parseRecord(const char* at, const char* end, BodyArrays& bodies, size_t i) {
+	for (int field = 0; field < 6; field++) {
+		while (at < end && (*at == ' ' || *at == '\t')) at++;
+		if (at < end && *at == '+') at++;
+		Real value;
+		std::from_chars_result result = std::from_chars(at, end, value);
+		if (result.ec != std::errc()) return false;
+		(bodies.*BODY_FILE_FIELDS[field])[i] = value;
+		at = result.ptr;
+		while (at < end && (*at == ' ' || *at == '\t')) at++;
+		if (field < 5) {
+			if (at == end || *at != ',') return false;
+			at++;
+		}
+	}
+	return at == end;
+}
+
+// CSV in two parallel passes over the mapped text: count the body lines of every chunk, then parse each chunk
+// into its own range of the arrays
+static bool loadCsv(const MappedFile& file, const std::string& path, BodyArrays& bodies, size_t first, ThreadPool& pool, std::string* error) {
+	const char* text = (const char*)file.data();
+	const size_t size = file.size();
+
+	std::vector<CsvChunk> chunks((size + BODY_FILE_CHUNK_BYTES - 1) / BODY_FILE_CHUNK_BYTES);
+	for (size_t k = 1; k < chunks.size(); k++) {
+		const char* newline = (const char*)std::memchr(text + k * BODY_FILE_CHUNK_BYTES - 1, '\n', size - (k * BODY_FILE_CHUNK_BYTES - 1));
+		chunks[k].begin = std::max(chunks[k - 1].begin, newline ? (size_t)(newline - text) + 1 : size);
+		chunks[k - 1].end = chunks[k].begin;
+	}
+	chunks.back().end = size;
+
+	// Only the file's first line may be a header, every other line holds a body or is blank or a comment
+	auto isBody = [&](size_t start, size_t end) {
+		while (start < end && (text[start] == ' ' || text[start] == '\t')) start++;
+		if (start == end || text[start] == '#') return false;
+		return start != 0 || startsNumber(text[start]);
+	};
+
+	pool.run(chunks.size(), [&](size_t task, size_t) {
+		CsvChunk& chunk = chunks[task];
+		forEachLine(text, chunk.begin, chunk.end, [&](size_t start, size_t end) {
+			chunk.lines++;
+			if (isBody(start, end)) chunk.records++;
+		});
+	});
+
+	size_t count = 0;
+	std::vector<size_t> firstRecord(chunks.size());
+	for (size_t k = 0; k < chunks.size(); k++) {
+		firstRecord[k] = first + count;
+		count += chunks[k].records;
+	}
+
+	bodies.resize(first + count);
+	pool.run(chunks.size(), [&](size_t task, size_t) {
+		CsvChunk& chunk = chunks[task];
+		size_t i = firstRecord[task];
+		size_t line = 0;
+		forEachLine(text, chunk.begin, chunk.end, [&](size_t start, size_t end) {
+			line++;
+			if (chunk.errorLine != 0 || !isBody(start, end)) return;
+			if (!parseRecord(text + start, text + end, bodies, i++)) chunk.errorLine = line;
+		});
+	});
+
+	size_t lines = 0;
+	for (const CsvChunk& chunk : chunks) {
+		if (chunk.errorLine != 0) return fail(error, path + ":" + std::to_string(lines + chunk.errorLine) + ": expected mass,radius,x,y,vx,vy");
+		lines += chunk.lines;
+	}
+	return true;
+}
+
+bool loadBodies(const std::string& path, Simulation& sim, std::string* error) {
+	MappedFile file;
+	if (!file.open(path)) return fail(error, "Could not open " + path);
+
+	ThreadPool pool(ThreadPool::hardwareThreads());
+	const size_t first = sim.bodies.size();
+	bool loaded = bodyFileFormat(path) == BodyFileFormat::CSV
+		? loadCsv(file, path, sim.bodies, first, pool, error)
+		: loadBinary(file, path, sim.bodies, first, pool, error);
+	if (!loaded) {
+		sim.bodies.resize(first);
+		return false;
+	}
+	sim.adoptBodies();
+	return true;
+}
+
+bool saveBodies(const std::string& path, const BodyArrays& bodies, std::string* error) {
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file) return fail(error, "Could not create " + path);
+
+	std::vector<unsigned char> bytes;
+	if (bodyFileFormat(path) == BodyFileFormat::BINARY) {
+		bytes.insert(bytes.end(), BODY_FILE_MAGIC, BODY_FILE_MAGIC + 8);
+		putU32(bytes, BODY_FILE_VERSION);
+		putU32(bytes, (uint32_t)BODY_FILE_HEADER_BYTES);
+		putU64(bytes, bodies.size());
+		putU32(bytes, (uint32_t)BODY_FILE_RECORD_BYTES);
+		bytes.resize(BODY_FILE_HEADER_BYTES, 0);
+		for (size_t i = 0; i < bodies.size(); i++) {
+			for (auto field : BODY_FILE_FIELDS) putF32(bytes, (float)(bodies.*field)[i]);
+			if (bytes.size() >= BODY_FILE_CHUNK_BYTES) {
+				file.write((const char*)bytes.data(), bytes.size());
+				bytes.clear();
+			}
+		}
+	}
+	else {
+		// Shortest text that reads back as the same value
+		bytes.insert(bytes.end(), BODY_FILE_CSV_HEADER, BODY_FILE_CSV_HEADER + std::strlen(BODY_FILE_CSV_HEADER));
+		char number[32];
+		for (size_t i = 0; i < bodies.size(); i++) {
+			for (int field = 0; field < 6; field++) {
+				std::to_chars_result result = std::to_chars(number, number + sizeof(number), (bodies.*BODY_FILE_FIELDS[field])[i]);
+				bytes.insert(bytes.end(), number, result.ptr);
+				bytes.push_back(field < 5 ? ',' : '\n');
+			}
+			if (bytes.size() >= BODY_FILE_CHUNK_BYTES) {
+				file.write((const char*)bytes.data(), bytes.size());
+				bytes.clear();
+			}
+		}
+	}
+	file.write((const char*)bytes.data(), bytes.size());
+	if (!file) return fail(error, "Could not write " + path);
+	return true;
+}
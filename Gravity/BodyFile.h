@@ -0,0 +1,30 @@
+#pragma once
+#include "Simulation.h"
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+const uint32_t BODY_FILE_VERSION = 1;				// Bumped whenever the binary layout changes
+const size_t BODY_FILE_HEADER_BYTES = 32;			// Fixed header size of the binary format, the records start right after it
+const size_t BODY_FILE_RECORD_BYTES = 24;			// mass, radius, x, y, vx, vy as f32
+const size_t BODY_FILE_CHUNK_BYTES = 1 << 20;		// Bytes of a file one loader task parses
+
+// Initial conditions written by scripts or other tools, one body per record or line
+enum class BodyFileFormat {
+	CSV,		// Text, one "mass,radius,x,y,vx,vy" line per body. '#' lines, blank lines and a header line are skipped.
+	BINARY		// Compact little-endian records:
+				//   0  magic "GRAVBODY"   8  version (u32)   12  header bytes (u32)   16  body count (u64)
+				//   24 bytes per record (u32)   28  reserved
+				//   then one record per body: mass, radius, x, y, vx, vy (f32)
+};
+
+// Format of a body file by its extension, ".csv" is CSV and anything else binary
+BodyFileFormat bodyFileFormat(const std::string& path);
+
+// Append the bodies of a CSV or binary file to the simulation. The file is memory mapped and parsed in parallel
+// chunks straight into the body arrays. Returns false and sets *error if it can't be read, leaving the simulation
+// as it was.
+bool loadBodies(const std::string& path, Simulation& sim, std::string* error = nullptr);
+
+// Write bodies as CSV or binary, picked by the extension of "path"
+bool saveBodies(const std::string& path, const BodyArrays& bodies, std::string* error = nullptr);
@@ -0,0 +1,77 @@
+#include "BodyHandles.h"
+
+void BodyHandles::clear() {
+	for (size_t i = 0; i < slotOf.size(); i++) release(i);
+	slotOf.clear();
+}
+
+void BodyHandles::reset(size_t count) {
+	clear();
+	for (size_t i = 0; i < count; i++) append();
+}
+
+BodyHandle BodyHandles::append() {
+	uint32_t slot;
+	if (!freeSlots.empty()) {
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else {
+		slot = (uint32_t)slots.size();
+		slots.push_back({ BODY_HANDLE_NONE, 0 });
+	}
+	slots[slot].index = (uint32_t)slotOf.size();
+	slotOf.push_back(slot);
+	return { slot, slots[slot].generation };
+}
+
+size_t BodyHandles::indexOf(BodyHandle handle) const {
+	if (handle.slot >= slots.size()) return NONE;
+	const Slot& slot = slots[handle.slot];
+	if (slot.generation != handle.generation || slot.index == BODY_HANDLE_NONE) return NONE;
+	return slot.index;
+}
+
+void BodyHandles::release(size_t i) {
+	Slot& slot = slots[slotOf[i]];
+	if (slot.index == BODY_HANDLE_NONE) return;
+	slot.index = BODY_HANDLE_NONE;
+	slot.generation++;
+	freeSlots.push_back(slotOf[i]);
+}
+
+void BodyHandles::move(size_t from, size_t to) {
+	slotOf[to] = slotOf[from];
+	slots[slotOf[to]].index = (uint32_t)to;
+}
+
+void BodyHandles::compact(const std::vector<unsigned char>& removed) {
+	size_t write = 0;
+	for (size_t i = 0; i < slotOf.size(); i++) {
+		if (removed[i]) {
+			release(i);
+			continue;
+		}
+		move(i, write);
+		write++;
+	}
+	slotOf.resize(write);
+}
+
+bool BodyHandles::restore(const std::vector<uint32_t>& bodySlots, const std::vector<uint32_t>& generations, const std::vector<uint32_t>& freeList) {
+	if (bodySlots.size() + freeList.size() != generations.size()) return false;
+	std::vector<unsigned char> used(generations.size(), 0);
+	for (const std::vector<uint32_t>* entries : { &bodySlots, &freeList }) {
+		for (uint32_t slot : *entries) {
+			if (slot >= used.size() || used[slot]) return false;
+			used[slot] = 1;
+		}
+	}
+
+	slots.resize(generations.size());
+	for (size_t slot = 0; slot < slots.size(); slot++) slots[slot] = { BODY_HANDLE_NONE, generations[slot] };
+	for (size_t i = 0; i < bodySlots.size(); i++) slots[bodySlots[i]].index = (uint32_t)i;
+	slotOf = bodySlots;
+	freeSlots = freeList;
+	return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+const uint32_t BODY_HANDLE_NONE = ~0u;		// Slot of a handle that refers to no body
+
+// Stable reference to one body. It keeps pointing at the same body while the body arrays are compacted
+// or reordered, survives merges the body survives, and never refers to another body once its own is gone.
+struct BodyHandle {
+	uint32_t slot = BODY_HANDLE_NONE;		// Entry in the handle table
+	uint32_t generation = 0;				// Bumped every time the entry is freed, so stale handles miss
+
+	bool operator==(const BodyHandle& other) const { return slot == other.slot && generation == other.generation; }
+	bool operator!=(const BodyHandle& other) const { return !(*this == other); }
+};
+
+// Generational slot map from handles to the current index of a body in BodyArrays, kept index-aligned with
+// the arrays by mirroring every append, removal and compaction. Freed slots go on a free list and are
+// reused for new bodies with a higher generation. Every operation except compact() is O(1).
+struct BodyHandles {
+	static const size_t NONE = ~(size_t)0;		// indexOf() of a stale handle
+
+	// Number of bodies
+	size_t size() const { return slotOf.size(); }
+
+	// Forget every body, handles issued so far become stale
+	void clear();
+
+	// Forget every body and issue new handles for bodies [0, count), for arrays replaced wholesale
+	void reset(size_t count);
+
+	// Handle for a body appended at index size()
+	BodyHandle append();
+
+	// Index of the body a handle refers to, NONE if that body no longer exists
+	size_t indexOf(BodyHandle handle) const;
+
+	// Handle of the body at index i
+	BodyHandle handleAt(size_t i) const { return { slotOf[i], slots[slotOf[i]].generation }; }
+
+	// Free the handle of the body at index i, before that index is overwritten or dropped
+	void release(size_t i);
+
+	// Body "from" was copied over body "to" (see BodyArrays::moveBody)
+	void move(size_t from, size_t to);
+
+	// Shrink to "count" bodies after their handles were released or moved
+	void resize(size_t count) { slotOf.resize(count); }
+
+	// Release every body flagged in "removed" and slide the rest down in order, like CollisionResolver compacts
+	void compact(const std::vector<unsigned char>& removed);
+
+	// Entries in the handle table, in use or free
+	size_t slotCount() const { return slots.size(); }
+
+	// Generation of entry "slot"
+	uint32_t generation(uint32_t slot) const { return slots[slot].generation; }
+
+	// Free entries, the last one is reused first
+	const std::vector<uint32_t>& freeList() const { return freeSlots; }
+
+	// Replace the table with a saved one: entry bodySlots[i] for body i, the generation of every entry and the free
+	// list, so handles issued before the save keep referring to the same bodies. Returns false and changes nothing
+	// unless every entry is used by exactly one body or free list position.
+	bool restore(const std::vector<uint32_t>& bodySlots, const std::vector<uint32_t>& generations, const std::vector<uint32_t>& freeList);
+
+private:
+	struct Slot {
+		uint32_t index;				// Index of the body, BODY_HANDLE_NONE while the slot is free
+		uint32_t generation;
+	};
+
+	std::vector<Slot> slots;
+	std::vector<uint32_t> freeSlots;	// Slots ready for reuse
+	std::vector<uint32_t> slotOf;		// Slot of the body at each index
+};
@@ -0,0 +1,63 @@
+#pragma once
+#include "Body.h"
+#include <cmath>
+#include <algorithm>
+
+// What happens at the edges of the SIM_WIDTH x SIM_HEIGHT simulation space, selected at runtime
+enum class Boundary {
+	PERIODIC,		// Torus: bodies leaving one edge come back at the opposite one, forces act along the shortest wrapped path
+	OPEN,			// Unbounded: nothing wraps, bodies may travel anywhere
+	REFLECTIVE		// Walls: bodies bounce off the edges, forces do not wrap
+};
+
+// Every loop that depends on the boundary is a template over one of the policies below and is instantiated
+// once per policy, so the open and reflective paths contain no wrap code at all:
+//   WRAPS                        offsets between bodies are minimum-image offsets on the torus
+//   offset(delta, size, half)    signed distance along one axis from a raw coordinate difference, |delta| < size
+//   confine(p, v, size)          bring a coordinate that just moved (and its velocity) back into the space
+
+struct PeriodicBoundary {
+	static const bool WRAPS = true;
+
+	// Branchless minimum image: the two comparisons count the whole widths to remove (-1, 0 or 1)
+	static Real offset(Real delta, Real size, Real halfSize) {
+		return delta - size * (Real)((delta > halfSize) - (delta < -halfSize));
+	}
+
+	static void confine(Real& p, Real&, Real size) { p = std::fmod(size + p, size); }
+};
+
+struct OpenBoundary {
+	static const bool WRAPS = false;
+	static Real offset(Real delta, Real, Real) { return delta; }
+	static void confine(Real&, Real&, Real) {}
+};
+
+struct ReflectiveBoundary {
+	static const bool WRAPS = false;
+	static Real offset(Real delta, Real, Real) { return delta; }
+
+	// Mirror a body that crossed a wall back inside and point its velocity away from the wall
+	static void confine(Real& p, Real& v, Real size) {
+		if (p < 0) {
+			p = std::min(-p, size);
+			v = std::fabs(v);
+		}
+		else if (p > size) {
+			p = std::max(size + size - p, (Real)0);
+			v = -std::fabs(v);
+		}
+	}
+};
+
+// Call fn(policy) with a default-constructed value of the policy type for "boundary", which lets a caller
+// pick a template instantiation with one runtime switch outside its loops
+template <typename Fn>
+auto withBoundary(Boundary boundary, Fn&& fn) {
+	switch (boundary) {
+	case Boundary::OPEN: return fn(OpenBoundary());
+	case Boundary::REFLECTIVE: return fn(ReflectiveBoundary());
+	default: return fn(PeriodicBoundary());
+	}
+}
+
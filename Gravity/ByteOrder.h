@@ -0,0 +1,94 @@
+#pragma once
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+// Every file format of the simulation is little-endian. These helpers write and read fixed-size values
+// in that byte order on any machine, and tell whether whole float arrays can be copied as they are.
+
+// True when the machine stores multi-byte numbers little-endian
+inline bool hostIsLittleEndian() {
+	const uint32_t probe = 1;
+	unsigned char first;
+	std::memcpy(&first, &probe, 1);
+	return first == 1;
+}
+
+// Append the lowest "bytes" bytes of a value, least significant first
+inline void putBytes(std::vector<unsigned char>& out, uint64_t value, int bytes) {
+	for (int i = 0; i < bytes; i++) out.push_back((unsigned char)(value >> (8 * i)));
+}
+
+inline void putU8(std::vector<unsigned char>& out, uint8_t value) { out.push_back(value); }
+inline void putU16(std::vector<unsigned char>& out, uint16_t value) { putBytes(out, value, 2); }
+inline void putU32(std::vector<unsigned char>& out, uint32_t value) { putBytes(out, value, 4); }
+inline void putU64(std::vector<unsigned char>& out, uint64_t value) { putBytes(out, value, 8); }
+
+inline void putF32(std::vector<unsigned char>& out, float value) {
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	putU32(out, bits);
+}
+
+inline void putF64(std::vector<unsigned char>& out, double value) {
+	uint64_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	putU64(out, bits);
+}
+
+// Read "bytes" bytes stored least significant first
+inline uint64_t getBytes(const unsigned char* in, int bytes) {
+	uint64_t value = 0;
+	for (int i = 0; i < bytes; i++) value |= (uint64_t)in[i] << (8 * i);
+	return value;
+}
+
+inline uint8_t getU8(const unsigned char* in) { return in[0]; }
+inline uint16_t getU16(const unsigned char* in) { return (uint16_t)getBytes(in, 2); }
+inline uint32_t getU32(const unsigned char* in) { return (uint32_t)getBytes(in, 4); }
+inline uint64_t getU64(const unsigned char* in) { return getBytes(in, 8); }
+
+inline float getF32(const unsigned char* in) {
+	uint32_t bits = getU32(in);
+	float value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+inline double getF64(const unsigned char* in) {
+	uint64_t bits = getU64(in);
+	double value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+// Append "count" floats in file byte order, a single copy on little-endian machines
+inline void putF32Array(std::vector<unsigned char>& out, const float* values, size_t count) {
+	if (hostIsLittleEndian()) {
+		size_t start = out.size();
+		out.resize(start + count * sizeof(float));
+		std::memcpy(out.data() + start, values, count * sizeof(float));
+		return;
+	}
+	for (size_t i = 0; i < count; i++) putF32(out, values[i]);
+}
+
+// Append "count" doubles as f32, each rounded to float
+inline void putF32Array(std::vector<unsigned char>& out, const double* values, size_t count) {
+	for (size_t i = 0; i < count; i++) putF32(out, (float)values[i]);
+}
+
+// Read "count" floats in file byte order, a single copy on little-endian machines
+inline void getF32Array(const unsigned char* in, float* values, size_t count) {
+	if (hostIsLittleEndian()) {
+		std::memcpy(values, in, count * sizeof(float));
+		return;
+	}
+	for (size_t i = 0; i < count; i++) values[i] = getF32(in + i * sizeof(float));
+}
+
+// Read "count" f32 values into doubles
+inline void getF32Array(const unsigned char* in, double* values, size_t count) {
+	for (size_t i = 0; i < count; i++) values[i] = getF32(in + i * sizeof(float));
+}
@@ -0,0 +1,326 @@
+#include "Checkpoint.h"
+#include "MappedFile.h"
+#include "ByteOrder.h"
+#include <fstream>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+
+static const char CHECKPOINT_MAGIC[8] = { 'G', 'R', 'A', 'V', 'C', 'K', 'P', 'T' };
+
+// Bytes from the start of one array to the next for "count" bodies of "scalarBytes" each
+static uint64_t arrayStride(uint64_t count, uint64_t scalarBytes) {
+	uint64_t bytes = count * scalarBytes;
+	return (bytes + CHECKPOINT_ARRAY_ALIGNMENT - 1) / CHECKPOINT_ARRAY_ALIGNMENT * CHECKPOINT_ARRAY_ALIGNMENT;
+}
+
+// Body arrays in file order
+static AlignedReals BodyArrays::* const CHECKPOINT_ARRAYS[CHECKPOINT_ARRAY_COUNT] = {
+	&BodyArrays::x, &BodyArrays::y, &BodyArrays::vx, &BodyArrays::vy, &BodyArrays::m, &BodyArrays::r
+};
+
+// Set *error if the caller asked for it, always returns false
+static bool fail(std::string* error, const std::string& message) {
+	if (error) *error = message;
+	return false;
+}
+
+CheckpointParams checkpointParams(const Simulation& sim) {
+	CheckpointParams params;
+	params.steps = sim.steps;
+	params.merges = sim.merges;
+	params.time = sim.time;
+	params.dt = sim.dt;
+	params.theta = sim.theta;
+	params.solver = sim.solver;
+	params.boundary = sim.boundary;
+	params.integrator = sim.integrator;
+	params.meshSize = sim.mesh.gridSize;
+	return params;
+}
+
+CheckpointParams checkpointParams(const Snapshot& snapshot) {
+	CheckpointParams params;
+	params.steps = snapshot.steps;
+	params.merges = snapshot.merges;
+	params.time = snapshot.time;
+	params.dt = snapshot.dt;
+	params.theta = snapshot.theta;
+	params.solver = snapshot.solver;
+	params.boundary = snapshot.boundary;
+	params.integrator = snapshot.integrator;
+	params.meshSize = snapshot.meshSize;
+	return params;
+}
+
+bool writeCheckpoint(const std::string& path, const BodyArrays& bodies, const BodyHandles& handles, const CheckpointParams& params, std::string* error) {
+	const uint64_t count = bodies.size();
+	const uint64_t stride = arrayStride(count, sizeof(Real));
+	const bool saveHandles = handles.size() == count;
+	const uint32_t handleSlots = saveHandles ? (uint32_t)handles.slotCount() : 0;
+	const uint32_t freeHandles = saveHandles ? (uint32_t)handles.freeList().size() : 0;
+
+	std::vector<unsigned char> header;
+	header.reserve(CHECKPOINT_HEADER_BYTES);
+	header.insert(header.end(), CHECKPOINT_MAGIC, CHECKPOINT_MAGIC + 8);
+	putU32(header, CHECKPOINT_VERSION);
+	putU32(header, (uint32_t)CHECKPOINT_HEADER_BYTES);
+	putU64(header, count);
+	putU64(header, params.steps);
+	putU64(header, params.merges);
+	putF64(header, params.time);
+	putF32(header, params.dt);
+	putF32(header, params.theta);
+	putF32(header, (float)G);
+	putF32(header, (float)SIM_WIDTH);
+	putF32(header, (float)SIM_HEIGHT);
+	putU32(header, (uint32_t)params.solver);
+	putU32(header, (uint32_t)params.fieldScalar);
+	putF32(header, params.fieldCellSize);
+	putU32(header, CHECKPOINT_ARRAY_COUNT);
+	putU32(header, (uint32_t)sizeof(Real));
+	putU64(header, CHECKPOINT_HEADER_BYTES);
+	putU64(header, stride);
+	putU32(header, (uint32_t)params.boundary);
+	putU32(header, (uint32_t)params.integrator);
+	putU32(header, (uint32_t)params.meshSize);
+	putU32(header, handleSlots);
+	putU32(header, freeHandles);
+	header.resize(CHECKPOINT_HEADER_BYTES, 0);
+
+	// Write to a temporary file and rename it, so a crash mid-save never leaves a half written checkpoint behind
+	std::string temporary = path + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		if (!file) return fail(error, "Could not create " + temporary);
+		file.write((const char*)header.data(), header.size());
+
+		std::vector<unsigned char> bytes;
+		const char padding[CHECKPOINT_ARRAY_ALIGNMENT] = {};
+		for (auto array : CHECKPOINT_ARRAYS) {
+			const Real* values = (bodies.*array).data();
+			if (hostIsLittleEndian()) {
+				file.write((const char*)values, count * sizeof(Real));
+			}
+			else {
+				bytes.clear();
+				for (uint64_t i = 0; i < count; i++) {
+					if (sizeof(Real) == 8) putF64(bytes, values[i]);
+					else putF32(bytes, (float)values[i]);
+				}
+				file.write((const char*)bytes.data(), bytes.size());
+			}
+			file.write(padding, stride - count * sizeof(Real));
+		}
+		if (handleSlots > 0) {
+			bytes.clear();
+			for (uint64_t i = 0; i < count; i++) putU32(bytes, handles.handleAt(i).slot);
+			for (uint32_t slot = 0; slot < handleSlots; slot++) putU32(bytes, handles.generation(slot));
+			for (uint32_t slot : handles.freeList()) putU32(bytes, slot);
+			file.write((const char*)bytes.data(), bytes.size());
+		}
+		if (!file) return fail(error, "Could not write " + temporary);
+	}
+
+	std::remove(path.c_str());
+	if (std::rename(temporary.c_str(), path.c_str()) != 0) return fail(error, "Could not replace " + path);
+	return true;
+}
+
+// Where the bodies and their handles are in a checkpoint file
+struct CheckpointLayout {
+	uint64_t count = 0;				// Bodies
+	uint64_t offset = 0;			// Start of the first array
+	uint64_t stride = 0;			// Bytes from one array to the next
+	uint32_t scalarBytes = 4;		// Bytes per array element
+	uint32_t handleSlots = 0;		// Handle table entries, 0 if the handles were not saved
+	uint32_t freeHandles = 0;		// Free handle table entries
+
+	// Start of the handle table, right after the last array
+	uint64_t handlesOffset() const { return offset + stride * CHECKPOINT_ARRAY_COUNT; }
+
+	// Bytes of the handle table
+	uint64_t handlesBytes() const { return handleSlots > 0 ? 4 * (count + handleSlots + freeHandles) : 0; }
+};
+
+// Check the header of a mapped checkpoint and read its settings
+static bool parseHeader(const MappedFile& file, CheckpointParams& params, CheckpointLayout& layout, std::string* error) {
+	const unsigned char* bytes = file.data();
+	if (file.size() < CHECKPOINT_HEADER_BYTES || std::memcmp(bytes, CHECKPOINT_MAGIC, 8) != 0) return fail(error, "Not a checkpoint file");
+	const uint32_t version = getU32(bytes + 8);
+	if (version < 1 || version > CHECKPOINT_VERSION) return fail(error, "Unsupported checkpoint version " + std::to_string(version));
+	if (getF32(bytes + 56) != (float)G || getF32(bytes + 60) != (float)SIM_WIDTH || getF32(bytes + 64) != (float)SIM_HEIGHT) {
+		return fail(error, "Checkpoint was saved with a different G or simulation size");
+	}
+
+	layout.count = getU64(bytes + 16);
+	params.steps = getU64(bytes + 24);
+	params.merges = getU64(bytes + 32);
+	params.time = getF64(bytes + 40);
+	params.dt = getF32(bytes + 48);
+	params.theta = getF32(bytes + 52);
+	params.solver = (Solver)getU32(bytes + 68);
+	params.fieldScalar = (int)getU32(bytes + 72);
+	params.fieldCellSize = getF32(bytes + 76);
+	layout.scalarBytes = getU32(bytes + 84) == 0 ? 4 : getU32(bytes + 84);
+	layout.offset = getU64(bytes + 88);
+	layout.stride = getU64(bytes + 96);
+	params.boundary = (Boundary)getU32(bytes + 104);
+	params.integrator = version >= 2 ? (Integrator)getU32(bytes + 108) : Integrator::LEAPFROG;
+	params.meshSize = version >= 3 ? (int)getU32(bytes + 112) : PM_GRID_SIZE;
+	layout.handleSlots = version >= 4 ? getU32(bytes + 116) : 0;
+	layout.freeHandles = version >= 4 ? getU32(bytes + 120) : 0;
+
+	const uint64_t count = layout.count, offset = layout.offset, stride = layout.stride;
+	const uint32_t scalarBytes = layout.scalarBytes;
+	if (scalarBytes != 4 && scalarBytes != 8) return fail(error, "Unsupported checkpoint precision");
+	if ((uint32_t)params.solver > (uint32_t)Solver::P3M) return fail(error, "Checkpoint has an unknown solver");
+	if (params.boundary != Boundary::PERIODIC && params.boundary != Boundary::OPEN && params.boundary != Boundary::REFLECTIVE) {
+		return fail(error, "Checkpoint has an unknown boundary");
+	}
+	if (params.integrator != Integrator::EULER && params.integrator != Integrator::LEAPFROG && params.integrator != Integrator::BLOCK) {
+		return fail(error, "Checkpoint has an unknown integrator");
+	}
+	if (params.meshSize < PM_MIN_GRID_SIZE || params.meshSize > PM_MAX_GRID_SIZE) return fail(error, "Checkpoint has an unsupported mesh size");
+	if (getU32(bytes + 80) != CHECKPOINT_ARRAY_COUNT || stride < count * scalarBytes || offset % scalarBytes != 0 || stride % scalarBytes != 0 ||
+		layout.handlesOffset() + layout.handlesBytes() > file.size()) {
+		return fail(error, "Checkpoint is truncated or corrupt");
+	}
+	return true;
+}
+
+bool readCheckpointParams(const std::string& path, CheckpointParams& params, size_t* bodyCount, std::string* error) {
+	MappedFile file;
+	if (!file.open(path)) return fail(error, "Could not open " + path);
+	CheckpointLayout layout;
+	if (!parseHeader(file, params, layout, error)) return false;
+	if (bodyCount) *bodyCount = (size_t)layout.count;
+	return true;
+}
+
+bool loadCheckpoint(const std::string& path, Simulation& sim, CheckpointParams* params, std::string* error) {
+	MappedFile file;
+	if (!file.open(path)) return fail(error, "Could not open " + path);
+
+	CheckpointParams header;
+	CheckpointLayout layout;
+	if (!parseHeader(file, header, layout, error)) return false;
+	const uint64_t count = layout.count;
+
+	// The saved handle table is checked before the simulation is touched, files without one get new handles
+	BodyHandles handles;
+	if (layout.handleSlots > 0) {
+		std::vector<uint32_t> bodySlots((size_t)count), generations(layout.handleSlots), freeList(layout.freeHandles);
+		const unsigned char* source = file.data() + layout.handlesOffset();
+		for (std::vector<uint32_t>* entries : { &bodySlots, &generations, &freeList }) {
+			for (uint32_t& entry : *entries) {
+				entry = getU32(source);
+				source += 4;
+			}
+		}
+		if (!handles.restore(bodySlots, generations, freeList)) return fail(error, "Checkpoint has an inconsistent handle table");
+	}
+	else handles.reset((size_t)count);
+
+	// Each array is one bulk copy out of the mapping, pages are read from disk as the copy touches them.
+	// Checkpoints saved by a build of another precision are converted value by value.
+	BodyArrays& bodies = sim.bodies;
+	for (int k = 0; k < CHECKPOINT_ARRAY_COUNT; k++) {
+		AlignedReals& array = bodies.*CHECKPOINT_ARRAYS[k];
+		const unsigned char* source = file.data() + layout.offset + k * layout.stride;
+		if (hostIsLittleEndian() && layout.scalarBytes == sizeof(Real)) {
+			const Real* values = reinterpret_cast<const Real*>(source);
+			array.assign(values, values + count);
+		}
+		else {
+			array.resize(count);
+			for (uint64_t i = 0; i < count; i++) array[i] = (Real)(layout.scalarBytes == 8 ? getF64(source + 8 * i) : getF32(source + 4 * i));
+		}
+	}
+	bodies.fx.assign(count, 0.0f);
+	bodies.fy.assign(count, 0.0f);
+	sim.handles = std::move(handles);
+
+	sim.steps = header.steps;
+	sim.merges = header.merges;
+	sim.time = header.time;
+	sim.dt = header.dt;
+	sim.theta = header.theta;
+	sim.solver = header.solver;
+	sim.boundary = header.boundary;
+	sim.integrator = header.integrator;
+	sim.mesh.gridSize = header.meshSize;
+	sim.interactions = 0;
+	sim.forcesCurrent = false;
+	sim.previousX = bodies.x;
+	sim.previousY = bodies.y;
+
+	if (params) *params = header;
+	return true;
+}
+
+// <--- BACKGROUND WRITER --->
+
+CheckpointWriter::CheckpointWriter() {
+	thread = std::thread(&CheckpointWriter::run, this);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+	}
+	wake.notify_one();
+	thread.join();
+}
+
+void CheckpointWriter::save(const std::string& path, const BodyArrays& bodies, const BodyHandles& handles, const CheckpointParams& params) {
+	Job job;
+	job.path = path;
+	job.bodies.x = bodies.x;
+	job.bodies.y = bodies.y;
+	job.bodies.vx = bodies.vx;
+	job.bodies.vy = bodies.vy;
+	job.bodies.m = bodies.m;
+	job.bodies.r = bodies.r;
+	job.handles = handles;
+	job.params = params;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(std::move(job));
+	}
+	wake.notify_one();
+}
+
+bool CheckpointWriter::busy() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return writing || !jobs.empty();
+}
+
+std::string CheckpointWriter::status() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return lastStatus;
+}
+
+void CheckpointWriter::run() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		// Queued saves are finished before shutting down
+		wake.wait(lock, [&] { return !jobs.empty() || !running; });
+		if (jobs.empty()) return;
+
+		Job job = std::move(jobs.front());
+		jobs.pop_front();
+		writing = true;
+		lock.unlock();
+
+		auto start = std::chrono::steady_clock::now();
+		std::string error;
+		bool saved = writeCheckpoint(job.path, job.bodies, job.handles, job.params, &error);
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		lock.lock();
+		writing = false;
+		lastStatus = saved ? "Saved " + std::to_string(job.bodies.size()) + " bodies to " + job.path + " (" + std::to_string((int)milliseconds) + " ms)" : error;
+	}
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include "Simulation.h"
+#include "Snapshot.h"
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cstdint>
+
+const uint32_t CHECKPOINT_VERSION = 4;				// Bumped whenever the layout changes, older versions still load
+const size_t CHECKPOINT_HEADER_BYTES = 128;			// Fixed header size, the body arrays start right after it
+const size_t CHECKPOINT_ARRAY_ALIGNMENT = 64;		// Every body array starts on this byte boundary of the file
+const int CHECKPOINT_ARRAY_COUNT = 6;				// x, y, vx, vy, m, r
+
+// Simulation and display settings stored next to the bodies
+struct CheckpointParams {
+	unsigned long long steps = 0;
+	unsigned long long merges = 0;
+	double time = 0.0;
+	float dt = SIM_DT;
+	float theta = 0.5f;
+	Solver solver = Solver::DIRECT;
+	Boundary boundary = Boundary::PERIODIC;
+	Integrator integrator = Integrator::LEAPFROG;
+	int meshSize = PM_GRID_SIZE;			// Particle-mesh cells per side
+	int fieldScalar = 6;					// GUI gravity field sensitivity
+	float fieldCellSize = 5.0f;				// GUI finest gravity field cell
+};
+
+// Settings of a simulation or snapshot, display settings left at their defaults
+CheckpointParams checkpointParams(const Simulation& sim);
+CheckpointParams checkpointParams(const Snapshot& snapshot);
+
+// Write bodies and settings to "path". Layout (all little-endian):
+//   0   magic "GRAVCKPT"          8   version            12  header bytes
+//   16  body count (u64)          24  steps (u64)        32  merges (u64)       40  time (f64)
+//   48  dt    52  theta    56  G    60  SIM_WIDTH    64  SIM_HEIGHT (f32)
+//   68  solver (u32)   72  field scalar (i32)   76  field cell size (f32)   80  array count (u32)
+//   84  bytes per array element (u32, 4 = f32, 8 = f64, files from before it existed hold 0 = f32)
+//   88  offset of the first array (u64)   96  bytes from one array to the next (u64)
+//   104 Boundary (u32, 0 = periodic in files from before it existed)   108 Integrator (u32, since version 2, leapfrog for version 1)
+//   112 particle-mesh cells per side (u32, since version 3, PM_GRID_SIZE for older versions)
+//   116 body handle table entries (u32, since version 4, 0 = no handles saved)   120 free handle table entries (u32)
+// followed by the arrays x, y, vx, vy, m, r, each starting on a CHECKPOINT_ARRAY_ALIGNMENT boundary.
+// Arrays are written in the build's Real precision, and any build loads either precision.
+// After the last array come the handle table entry of every body, the generation of every entry and the free list
+// (u32 each), so handles held outside the simulation stay valid across a save and load. "handles" that are not
+// index-aligned with "bodies", e.g. those of a replay, are not saved and the loaded bodies get new ones.
+bool writeCheckpoint(const std::string& path, const BodyArrays& bodies, const BodyHandles& handles, const CheckpointParams& params, std::string* error = nullptr);
+
+// Read only the header of a checkpoint
+bool readCheckpointParams(const std::string& path, CheckpointParams& params, size_t* bodyCount = nullptr, std::string* error = nullptr);
+
+// Replace the simulation's bodies and settings with a checkpoint. The file is memory-mapped and every
+// array is copied straight from the mapping into body storage, there is no per-body parsing.
+bool loadCheckpoint(const std::string& path, Simulation& sim, CheckpointParams* params = nullptr, std::string* error = nullptr);
+
+// Writes checkpoints on a background thread so saving never pauses the simulation or the renderer
+struct CheckpointWriter {
+	CheckpointWriter();
+	~CheckpointWriter();
+
+	CheckpointWriter(const CheckpointWriter&) = delete;
+	CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+	// Queue a copy of the bodies and their handles to be written to "path"
+	void save(const std::string& path, const BodyArrays& bodies, const BodyHandles& handles, const CheckpointParams& params);
+
+	// True while a checkpoint is queued or being written
+	bool busy() const;
+
+	// Message describing the last finished save
+	std::string status() const;
+
+private:
+	struct Job {
+		std::string path;
+		BodyArrays bodies;
+		BodyHandles handles;
+		CheckpointParams params;
+	};
+
+	mutable std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<Job> jobs;
+	bool writing = false;
+	bool running = true;
+	std::string lastStatus;
+	std::thread thread;
+
+	// Worker main loop
+	void run();
+};
@@ -0,0 +1,1000 @@
+#include "Cluster.h"
+#include "PhysicsThread.h"
+#include "ByteOrder.h"
+#include "ThreadPool.h"
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <unordered_map>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+extern char** environ;
+#endif
+
+// Messages between the coordinator, its workers and viewers
+enum class ClusterMessage : uint32_t {
+	HELLO = 1,		// To the coordinator on connecting: role, protocol version, size of Real, and a worker's rank and peer address
+	SETUP,			// Coordinator to worker: settings, layout, every worker's peer address and the bodies of its tile
+	PEER,			// Worker to worker on connecting: rank of the connecting worker
+	READY,			// Worker to coordinator: initial forces computed
+	STEP,			// Coordinator to worker: take one step, and whether to send the bodies afterwards
+	STEP_DONE,		// Worker to coordinator: counters of the step, and the bodies if asked for
+	HALO,			// Worker to worker: ghosts with velocity and force, for merges, including every body that could touch one of the receiver's
+	MERGE_GROUPS,	// Worker to worker: merge group labels of the bodies both see that changed, repeated until no worker has any
+	MERGE_TOTALS,	// Worker to worker: the sender's part of every merge group reaching other tiles
+	MIGRANTS,		// Worker to worker: bodies that drifted into the receiver's tile
+	FORCE_HALO,		// Worker to worker: ghost locations and masses after the drift, the sender's cell summaries and its largest radius
+	STOP,			// Coordinator to worker: send the final bodies and exit
+	FINAL,			// Worker to coordinator: the final bodies
+	FRAME			// Coordinator to viewer: every body after one step
+};
+
+enum class ClusterRole : uint8_t {
+	WORKER,
+	VIEWER
+};
+
+// Parts of a body sent along with its location and mass
+static const int BODY_IDS = 1;			// Global id: index in the scene the coordinator started from
+static const int BODY_MOTION = 2;		// Velocity and radius
+static const int BODY_FORCES = 4;		// Force from the last evaluation
+static const int BODY_ALL = BODY_IDS | BODY_MOTION | BODY_FORCES;
+
+static AlignedReals BodyArrays::* const LOCATION_FIELDS[] = { &BodyArrays::x, &BodyArrays::y, &BodyArrays::m };
+static AlignedReals BodyArrays::* const MOTION_FIELDS[] = { &BodyArrays::vx, &BodyArrays::vy, &BodyArrays::r };
+static AlignedReals BodyArrays::* const FORCE_FIELDS[] = { &BodyArrays::fx, &BodyArrays::fy };
+static AlignedReals BodyArrays::* const ALL_FIELDS[] = {
+	&BodyArrays::x, &BodyArrays::y, &BodyArrays::vx, &BodyArrays::vy, &BodyArrays::m, &BodyArrays::r, &BodyArrays::fx, &BodyArrays::fy
+};
+
+static const size_t FAR_FIELD_BLOCK = 1024;		// Bodies per far-field task
+static const size_t NO_PART = ~(size_t)0;		// Merge part of a body that merges with nothing
+
+// New merge group of a body another worker also sees, as sent in MERGE_GROUPS
+struct MergeLabel {
+	uint32_t position;		// In the list of bodies the sender and the receiver exchanged in HALO
+	uint32_t shared;		// 1 if the group reaches another tile
+	uint64_t label;			// Lowest id in the group
+};
+
+// Sums over some members of a merge group
+struct MergePart {
+	uint64_t label = 0;				// Lowest id in the group
+	double mass = 0.0;
+	double momentumX = 0.0;
+	double momentumY = 0.0;
+	double forceX = 0.0;
+	double forceY = 0.0;
+	double volume = 0.0;			// Summed cubed radii
+	uint64_t heaviestId = 0;		// Heaviest member, the lowest id of equally heavy ones, like CollisionResolver keeps
+	Real heaviestMass = 0;
+	uint32_t members = 0;
+
+	void add(const BodyArrays& bodies, size_t i, uint64_t id) {
+		mass += bodies.m[i];
+		momentumX += (double)bodies.m[i] * bodies.vx[i];
+		momentumY += (double)bodies.m[i] * bodies.vy[i];
+		forceX += bodies.fx[i];
+		forceY += bodies.fy[i];
+		volume += (double)bodies.r[i] * bodies.r[i] * bodies.r[i];
+		addMember(bodies.m[i], id, 1);
+	}
+
+	void add(const MergePart& other) {
+		mass += other.mass;
+		momentumX += other.momentumX;
+		momentumY += other.momentumY;
+		forceX += other.forceX;
+		forceY += other.forceY;
+		volume += other.volume;
+		addMember(other.heaviestMass, other.heaviestId, other.members);
+	}
+
+	void addMember(Real memberMass, uint64_t id, uint32_t count) {
+		if (members == 0 || memberMass > heaviestMass || (memberMass == heaviestMass && id < heaviestId)) {
+			heaviestMass = memberMass;
+			heaviestId = id;
+		}
+		members += count;
+	}
+};
+
+// Set *error if the caller asked for it, always returns false
+static bool fail(std::string* error, const std::string& message) {
+	if (error) *error = message;
+	return false;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Copy every array of body i in "from" to body k in "to"
+static void copyBody(const BodyArrays& from, size_t i, BodyArrays& to, size_t k) {
+	for (auto field : ALL_FIELDS) (to.*field)[k] = (from.*field)[i];
+}
+
+// Append values[indices[k]] for every k, or all values if indices is null
+template <typename Values>
+static void putGathered(MessageWriter& out, const Values& values, const std::vector<unsigned int>* indices) {
+	typedef typename Values::value_type Value;
+	if (!indices) {
+		out.putArray(values.data(), values.size());
+		return;
+	}
+	size_t start = out.bytes.size();
+	out.bytes.resize(start + indices->size() * sizeof(Value));
+	unsigned char* at = out.bytes.data() + start;
+	for (unsigned int i : *indices) {
+		std::memcpy(at, &values[i], sizeof(Value));
+		at += sizeof(Value);
+	}
+}
+
+// Append the listed bodies (all if indices is null): count, then ids, locations, masses and the other "fields"
+static void putBodies(MessageWriter& out, const BodyArrays& bodies, const std::vector<uint64_t>& ids, const std::vector<unsigned int>* indices, int fields) {
+	out.put<uint64_t>(indices ? indices->size() : bodies.size());
+	if (fields & BODY_IDS) putGathered(out, ids, indices);
+	for (auto field : LOCATION_FIELDS) putGathered(out, bodies.*field, indices);
+	if (fields & BODY_MOTION) for (auto field : MOTION_FIELDS) putGathered(out, bodies.*field, indices);
+	if (fields & BODY_FORCES) for (auto field : FORCE_FIELDS) putGathered(out, bodies.*field, indices);
+}
+
+// Append bodies written by putBodies() with the same fields to the arrays, returns false if the payload is short
+static bool getBodies(MessageReader& in, BodyArrays& bodies, std::vector<uint64_t>& ids, int fields) {
+	const uint64_t count = in.get<uint64_t>();
+	if (!in.ok() || count > in.remaining()) return false;
+	const size_t start = bodies.size();
+	bodies.resize(start + (size_t)count);
+	if (fields & BODY_IDS) {
+		ids.resize(start + (size_t)count);
+		in.getArray(ids.data() + start, (size_t)count);
+	}
+	for (auto field : LOCATION_FIELDS) in.getArray((bodies.*field).data() + start, (size_t)count);
+	if (fields & BODY_MOTION) for (auto field : MOTION_FIELDS) in.getArray((bodies.*field).data() + start, (size_t)count);
+	if (fields & BODY_FORCES) for (auto field : FORCE_FIELDS) in.getArray((bodies.*field).data() + start, (size_t)count);
+	return in.ok();
+}
+
+// One worker process: owns the bodies of its tile and steps them in lockstep with the other workers
+struct ClusterWorker {
+	int rank = 0;
+	int workers = 1;
+	DomainLayout layout;
+	float theta = 0.5f;
+	float dt = SIM_DT;
+	std::unique_ptr<Channel> coordinator;
+	std::vector<std::unique_ptr<Channel>> peers;	// By rank, null for this worker
+	BodyArrays bodies;								// Owned bodies in id order, forces at their current location
+	std::vector<uint64_t> ids;
+	Simulation local;								// Solver, collisions and threads, run over owned bodies followed by ghosts
+	FarField farField;
+	std::vector<unsigned char> exact;				// Cells of the space summed exactly: the tile and its halo
+	std::vector<std::vector<int>> ghostTiles;		// Per cell of the tile, row-major: other tiles holding its bodies as ghosts
+	std::vector<CellMoment> tileMoments;			// Summaries of the tile's cells
+	std::vector<CellMoment> peerMoments;			// Summaries of another tile's cells, as received
+	std::vector<CellMoment> cellMoments;			// Summaries of every cell of the space
+	std::vector<Real> tileRadius;					// Largest radius of every tile's bodies, as of the last FORCE_HALO
+	std::vector<unsigned int> activeBodies;			// 0 .. owned count, the bodies the local solver computes forces for
+	std::vector<size_t> ghostStart;					// Merge ghosts from tile t are ghosts[ghostStart[t] .. ghostStart[t + 1])
+
+	// Merge groups during collide(), indexed like local.bodies: owned bodies, then ghosts
+	std::vector<uint64_t> groupLabel;				// Lowest id in the group as far as known
+	std::vector<unsigned char> groupShared;			// 1 once the group is known to reach another tile
+	std::vector<uint64_t> sentLabel;				// State the other worker seeing the body has, so only changes are sent
+	std::vector<unsigned char> sentShared;
+	std::vector<unsigned int> groupSize;			// Members here, by group root
+	std::vector<MergePart> mergeParts;				// Owned members of every group with a merge, then the sums over all tiles
+	std::vector<unsigned char> partShared;			// 1 for the parts of groups reaching other tiles
+	std::vector<size_t> partOf;						// Part of every owned body, NO_PART if it merges with nothing
+
+	// Scratch reused between steps
+	BodyArrays ghosts;
+	std::vector<uint64_t> ghostIds;
+	BodyArrays sorted;
+	std::vector<uint64_t> sortedIds;
+	std::vector<std::vector<unsigned int>> perTile;
+	std::vector<unsigned char> flags;
+
+	// Counters of the current step
+	double exchangeSeconds = 0.0;
+	unsigned long long merged = 0;
+	unsigned long long interactions = 0;
+	unsigned long long ghostCount = 0;
+	unsigned long long migrants = 0;
+
+	// Connect to the coordinator and the other workers, take in the tile's bodies and compute their first forces
+	bool start(const Options& options, std::string* error);
+
+	// One kick-drift-kick leapfrog step, returns false if a peer was lost
+	bool step();
+
+	// Send every peer its message, then receive one of the same type from every peer
+	bool exchange(ClusterMessage type, std::vector<MessageWriter>& outgoing, std::vector<Message>& incoming);
+
+	// List the owned bodies every other tile holds as ghosts. For merges ("touching"), also every body that could
+	// touch one of a tile's bodies, however large the two are: closer to the tile than its radius plus the tile's
+	// largest radius. Then every touching pair is seen by at least one of its owners.
+	void selectGhosts(bool touching);
+
+	// Merge every group of touching bodies, also groups spread over several tiles: each worker groups its own bodies
+	// and the ghosts around them, settleGroups() joins the groups sharing a body into one, and every owner of a
+	// member applies the same merge from the totals of all of them
+	bool collide();
+
+	// Give the members of every local group the group's lowest label and its shared flag, and trade the changes with
+	// the workers that see the same bodies until no worker has any. Returns false if a peer was lost.
+	bool settleGroups(bool& anyShared);
+
+	// Hand the bodies that drifted out of the tile to their new owners and take in the ones that arrived
+	bool migrate();
+
+	// Forces on the owned bodies: the local solver over owned bodies and ghosts, plus the far field
+	bool computeForces();
+};
+
+bool ClusterWorker::exchange(ClusterMessage type, std::vector<MessageWriter>& outgoing, std::vector<Message>& incoming) {
+	for (int peer = 0; peer < workers; peer++) {
+		if (peer != rank && !peers[peer]->send((uint32_t)type, std::move(outgoing[peer].bytes))) return false;
+	}
+	auto start = std::chrono::steady_clock::now();
+	incoming.resize(workers);
+	for (int peer = 0; peer < workers; peer++) {
+		if (peer == rank) continue;
+		if (!peers[peer]->receive(incoming[peer]) || incoming[peer].type != (uint32_t)type) return false;
+	}
+	exchangeSeconds += secondsSince(start);
+	return true;
+}
+
+void ClusterWorker::selectGhosts(bool touching) {
+	perTile.resize(workers);
+	for (auto& list : perTile) list.clear();
+	const int firstColumn = layout.firstColumn(rank);
+	const int firstRow = layout.firstRow(rank);
+	const int width = layout.tileColumns();
+	const Real halo = DOMAIN_HALO_CELLS * layout.cellSize();
+	for (size_t i = 0; i < bodies.size(); i++) {
+		int column = std::min(std::max(layout.cellColumn(bodies.x[i]) - firstColumn, 0), width - 1);
+		int row = std::min(std::max(layout.cellRow(bodies.y[i]) - firstRow, 0), layout.tileRows() - 1);
+		const std::vector<int>& near = ghostTiles[(size_t)row * width + column];
+		if (!touching) {
+			for (int tile : near) perTile[tile].push_back((unsigned int)i);
+			continue;
+		}
+		for (int tile = 0; tile < workers; tile++) {
+			if (tile == rank) continue;
+			Real reach = bodies.r[i] + tileRadius[tile] + DOMAIN_MERGE_MARGIN;
+			if (std::find(near.begin(), near.end(), tile) != near.end() || (reach > halo && layout.distanceToTile(tile, bodies.x[i], bodies.y[i]) < reach)) {
+				perTile[tile].push_back((unsigned int)i);
+			}
+		}
+	}
+}
+
+bool ClusterWorker::collide() {
+	selectGhosts(true);
+	std::vector<MessageWriter> outgoing(workers);
+	for (int peer = 0; peer < workers; peer++) {
+		if (peer != rank) putBodies(outgoing[peer], bodies, ids, &perTile[peer], BODY_ALL);
+	}
+	std::vector<Message> incoming;
+	if (!exchange(ClusterMessage::HALO, outgoing, incoming)) return false;
+
+	ghosts.clear();
+	ghostIds.clear();
+	ghostStart.assign(workers + 1, 0);
+	for (int peer = 0; peer < workers; peer++) {
+		ghostStart[peer] = ghosts.size();
+		if (peer == rank) continue;
+		MessageReader in(incoming[peer].payload);
+		if (!getBodies(in, ghosts, ghostIds, BODY_ALL)) return false;
+	}
+	ghostStart[workers] = ghosts.size();
+	ghostCount += ghosts.size();
+
+	const size_t owned = bodies.size();
+	BodyArrays& combined = local.bodies;
+	combined.resize(owned + ghosts.size());
+	for (size_t i = 0; i < owned; i++) copyBody(bodies, i, combined, i);
+	for (size_t g = 0; g < ghosts.size(); g++) copyBody(ghosts, g, combined, owned + g);
+	local.collisions.findGroups(combined, Boundary::PERIODIC);
+
+	bool anyShared = false;
+	if (!settleGroups(anyShared)) return false;
+
+	// Sum the owned members of every group with a merge, one part per label: two groups here may be one group
+	// joined through another tile
+	mergeParts.clear();
+	partShared.clear();
+	partOf.assign(owned, NO_PART);
+	std::unordered_map<uint64_t, size_t> partByLabel;
+	for (size_t i = 0; i < owned; i++) {
+		if (!groupShared[i] && groupSize[local.collisions.groupOf((unsigned int)i)] < 2) continue;
+		auto found = partByLabel.emplace(groupLabel[i], mergeParts.size());
+		if (found.second) {
+			mergeParts.emplace_back();
+			mergeParts.back().label = groupLabel[i];
+			partShared.push_back(groupShared[i]);
+		}
+		partOf[i] = found.first->second;
+		mergeParts[partOf[i]].add(bodies, i, ids[i]);
+	}
+
+	// Groups reaching other tiles add up every tile's part, in rank order, so all their owners get the same totals
+	if (anyShared) {
+		std::vector<MergePart> sharedParts;
+		for (size_t part = 0; part < mergeParts.size(); part++) {
+			if (partShared[part]) sharedParts.push_back(mergeParts[part]);
+		}
+		for (int peer = 0; peer < workers; peer++) {
+			if (peer == rank) continue;
+			outgoing[peer] = MessageWriter();
+			outgoing[peer].put<uint64_t>(sharedParts.size());
+			outgoing[peer].putArray(sharedParts.data(), sharedParts.size());
+		}
+		if (!exchange(ClusterMessage::MERGE_TOTALS, outgoing, incoming)) return false;
+
+		std::vector<MergePart> totals(mergeParts.size());
+		std::vector<MergePart> received;
+		for (int tile = 0; tile < workers; tile++) {
+			if (tile == rank) {
+				for (size_t part = 0; part < mergeParts.size(); part++) totals[part].add(mergeParts[part]);
+				continue;
+			}
+			MessageReader in(incoming[tile].payload);
+			const uint64_t count = in.get<uint64_t>();
+			if (!in.ok() || count > in.remaining()) return false;
+			received.resize((size_t)count);
+			if (!in.getArray(received.data(), received.size())) return false;
+			for (const MergePart& part : received) {
+				auto found = partByLabel.find(part.label);
+				if (found != partByLabel.end()) totals[found->second].add(part);
+			}
+		}
+		mergeParts.swap(totals);
+	}
+
+	// The heaviest member takes the combined mass and momentum, the others are removed. Members owned by other
+	// workers are merged the same way by their owners.
+	if (mergeParts.empty()) return true;
+	sorted.resize(owned);
+	sortedIds.clear();
+	for (size_t i = 0; i < owned; i++) {
+		if (partOf[i] != NO_PART && mergeParts[partOf[i]].members > 1) {
+			const MergePart& total = mergeParts[partOf[i]];
+			if (ids[i] != total.heaviestId) {
+				merged++;
+				continue;
+			}
+			bodies.m[i] = (Real)total.mass;
+			bodies.vx[i] = (Real)(total.momentumX / total.mass);
+			bodies.vy[i] = (Real)(total.momentumY / total.mass);
+			bodies.r[i] = local.collisions.mergedRadius(bodies.m[i], total.volume, bodies.r[i]);
+			bodies.fx[i] = (Real)total.forceX;
+			bodies.fy[i] = (Real)total.forceY;
+		}
+		copyBody(bodies, i, sorted, sortedIds.size());
+		sortedIds.push_back(ids[i]);
+	}
+	sorted.resize(sortedIds.size());
+	std::swap(bodies, sorted);
+	ids.swap(sortedIds);
+	return true;
+}
+
+bool ClusterWorker::settleGroups(bool& anyShared) {
+	const size_t owned = bodies.size();
+	const size_t count = owned + ghosts.size();
+	CollisionResolver& groups = local.collisions;
+	groupLabel.resize(count);
+	for (size_t i = 0; i < owned; i++) groupLabel[i] = ids[i];
+	for (size_t g = 0; g < ghosts.size(); g++) groupLabel[owned + g] = ghostIds[g];
+	groupShared.assign(count, 0);
+	sentLabel = groupLabel;
+	sentShared = groupShared;
+	groupSize.assign(count, 0);
+	for (size_t k = 0; k < count; k++) groupSize[groups.groupOf((unsigned int)k)]++;
+
+	std::vector<uint64_t> rootLabel(count);
+	std::vector<unsigned char> rootShared(count);
+	std::vector<MergeLabel> changedGhosts, changedOwned, updates;
+	std::vector<MessageWriter> outgoing(workers);
+	std::vector<Message> incoming;
+	while (true) {
+		// A group is shared once it holds a ghost and another body, or a member another worker found shared
+		std::fill(rootLabel.begin(), rootLabel.end(), ~(uint64_t)0);
+		std::fill(rootShared.begin(), rootShared.end(), 0);
+		for (size_t k = 0; k < count; k++) {
+			unsigned int root = groups.groupOf((unsigned int)k);
+			rootLabel[root] = std::min(rootLabel[root], groupLabel[k]);
+			rootShared[root] |= groupShared[k] | (k >= owned && groupSize[root] > 1);
+		}
+		bool sending = false;
+		anyShared = false;
+		for (size_t k = 0; k < count; k++) {
+			unsigned int root = groups.groupOf((unsigned int)k);
+			groupLabel[k] = rootLabel[root];
+			groupShared[k] = rootShared[root];
+			if (k < owned && groupShared[k]) anyShared = true;
+		}
+
+		// Tell every peer about the changes to the ghosts it owns and to the owned bodies it holds as ghosts
+		auto changed = [&](size_t k) { return groupLabel[k] != sentLabel[k] || groupShared[k] != sentShared[k]; };
+		for (int peer = 0; peer < workers; peer++) {
+			if (peer == rank) continue;
+			changedGhosts.clear();
+			changedOwned.clear();
+			for (size_t g = ghostStart[peer]; g < ghostStart[peer + 1]; g++) {
+				if (changed(owned + g)) changedGhosts.push_back({ (uint32_t)(g - ghostStart[peer]), groupShared[owned + g], groupLabel[owned + g] });
+			}
+			for (size_t n = 0; n < perTile[peer].size(); n++) {
+				unsigned int i = perTile[peer][n];
+				if (changed(i)) changedOwned.push_back({ (uint32_t)n, groupShared[i], groupLabel[i] });
+			}
+			sending |= !changedGhosts.empty() || !changedOwned.empty();
+			outgoing[peer] = MessageWriter();
+			outgoing[peer].put<uint64_t>(changedGhosts.size());
+			outgoing[peer].putArray(changedGhosts.data(), changedGhosts.size());
+			outgoing[peer].put<uint64_t>(changedOwned.size());
+			outgoing[peer].putArray(changedOwned.data(), changedOwned.size());
+		}
+		sentLabel = groupLabel;
+		sentShared = groupShared;
+		for (int peer = 0; peer < workers; peer++) {
+			if (peer == rank) continue;
+			outgoing[peer].put<uint8_t>(sending);
+			outgoing[peer].put<uint8_t>(anyShared);
+		}
+		if (!exchange(ClusterMessage::MERGE_GROUPS, outgoing, incoming)) return false;
+
+		// Owned bodies take the lowest label any peer found for them, ghosts the state their owner has
+		bool anySending = sending;
+		for (int peer = 0; peer < workers; peer++) {
+			if (peer == rank) continue;
+			MessageReader in(incoming[peer].payload);
+			for (bool ownedHere : { true, false }) {
+				const size_t available = ownedHere ? perTile[peer].size() : ghostStart[peer + 1] - ghostStart[peer];
+				const uint64_t entries = in.get<uint64_t>();
+				if (!in.ok() || entries > available) return false;
+				updates.resize((size_t)entries);
+				if (!in.getArray(updates.data(), updates.size())) return false;
+				for (const MergeLabel& update : updates) {
+					if (update.position >= available) return false;
+					size_t k = ownedHere ? perTile[peer][update.position] : owned + ghostStart[peer] + update.position;
+					groupLabel[k] = std::min(groupLabel[k], update.label);
+					groupShared[k] |= (unsigned char)update.shared;
+					if (!ownedHere) {
+						sentLabel[k] = update.label;
+						sentShared[k] = (unsigned char)update.shared;
+					}
+				}
+			}
+			anySending |= in.get<uint8_t>() != 0;
+			anyShared |= in.get<uint8_t>() != 0;
+			if (!in.ok()) return false;
+		}
+		if (!anySending) return true;
+	}
+}
+
+bool ClusterWorker::migrate() {
+	perTile.resize(workers);
+	for (auto& list : perTile) list.clear();
+	flags.assign(bodies.size(), 0);
+	for (size_t i = 0; i < bodies.size(); i++) {
+		int tile = layout.tileOf(bodies.x[i], bodies.y[i]);
+		if (tile == rank) continue;
+		perTile[tile].push_back((unsigned int)i);
+		flags[i] = 1;
+		migrants++;
+	}
+
+	std::vector<MessageWriter> outgoing(workers);
+	for (int peer = 0; peer < workers; peer++) {
+		if (peer != rank) putBodies(outgoing[peer], bodies, ids, &perTile[peer], BODY_ALL);
+	}
+	std::vector<Message> incoming;
+	if (!exchange(ClusterMessage::MIGRANTS, outgoing, incoming)) return false;
+
+	size_t kept = 0;
+	for (size_t i = 0; i < bodies.size(); i++) {
+		if (flags[i]) continue;
+		copyBody(bodies, i, bodies, kept);
+		ids[kept++] = ids[i];
+	}
+	bodies.resize(kept);
+	ids.resize(kept);
+	for (int peer = 0; peer < workers; peer++) {
+		if (peer == rank) continue;
+		MessageReader in(incoming[peer].payload);
+		if (!getBodies(in, bodies, ids, BODY_ALL)) return false;
+	}
+	if (bodies.size() == kept) return true;
+
+	// Merge the arrivals into id order
+	std::vector<unsigned int> order(bodies.size());
+	std::iota(order.begin(), order.end(), 0u);
+	auto byId = [&](unsigned int a, unsigned int b) { return ids[a] < ids[b]; };
+	std::sort(order.begin() + kept, order.end(), byId);
+	std::inplace_merge(order.begin(), order.begin() + kept, order.end(), byId);
+	sorted.resize(order.size());
+	sortedIds.resize(order.size());
+	for (size_t k = 0; k < order.size(); k++) {
+		copyBody(bodies, order[k], sorted, k);
+		sortedIds[k] = ids[order[k]];
+	}
+	std::swap(bodies, sorted);
+	ids.swap(sortedIds);
+	return true;
+}
+
+bool ClusterWorker::computeForces() {
+	summarizeTile(layout, rank, bodies, bodies.size(), tileMoments);
+	selectGhosts(false);
+	tileRadius.assign(workers, 0);
+	for (size_t i = 0; i < bodies.size(); i++) tileRadius[rank] = std::max(tileRadius[rank], bodies.r[i]);
+	std::vector<MessageWriter> outgoing(workers);
+	for (int peer = 0; peer < workers; peer++) {
+		if (peer == rank) continue;
+		putBodies(outgoing[peer], bodies, ids, &perTile[peer], 0);
+		outgoing[peer].putArray(tileMoments.data(), tileMoments.size());
+		outgoing[peer].put<Real>(tileRadius[rank]);
+	}
+	std::vector<Message> incoming;
+	if (!exchange(ClusterMessage::FORCE_HALO, outgoing, incoming)) return false;
+
+	// Place every tile's summaries into the grid of the whole space
+	cellMoments.assign((size_t)layout.cells * layout.cells, CellMoment());
+	ghosts.clear();
+	for (int tile = 0; tile < workers; tile++) {
+		if (tile != rank) {
+			MessageReader in(incoming[tile].payload);
+			peerMoments.resize(tileMoments.size());
+			if (!getBodies(in, ghosts, ghostIds, 0) || !in.getArray(peerMoments.data(), peerMoments.size())) return false;
+			tileRadius[tile] = in.get<Real>();
+			if (!in.ok()) return false;
+		}
+		const std::vector<CellMoment>& moments = tile == rank ? tileMoments : peerMoments;
+		for (int row = 0; row < layout.tileRows(); row++) {
+			std::copy_n(moments.begin() + (size_t)row * layout.tileColumns(), layout.tileColumns(),
+				cellMoments.begin() + (size_t)(layout.firstRow(tile) + row) * layout.cells + layout.firstColumn(tile));
+		}
+	}
+	farField.build(layout, cellMoments, exact);
+
+	// Near field from the local solver, over the owned bodies followed by the ghosts
+	const size_t count = bodies.size();
+	local.bodies.resize(count + ghosts.size());
+	for (auto field : LOCATION_FIELDS) {
+		std::copy((bodies.*field).begin(), (bodies.*field).end(), (local.bodies.*field).begin());
+		std::copy((ghosts.*field).begin(), (ghosts.*field).end(), (local.bodies.*field).begin() + count);
+	}
+	activeBodies.resize(count);
+	std::iota(activeBodies.begin(), activeBodies.end(), 0u);
+	local.steps++; // A new step for the solver, the Barnes-Hut tree is rebuilt rather than refit
+	local.interactions = 0;
+	local.computeForces(activeBodies);
+	interactions += local.interactions;
+
+	std::atomic<unsigned long long> visits{ 0 };
+	auto addFarField = [&](size_t task, size_t) {
+		size_t blockVisits = 0;
+		for (size_t i = task * FAR_FIELD_BLOCK; i < std::min(count, (task + 1) * FAR_FIELD_BLOCK); i++) {
+			Vec2 force = farField.force(local.bodies, i, theta, blockVisits);
+			bodies.fx[i] = local.bodies.fx[i] + force.x;
+			bodies.fy[i] = local.bodies.fy[i] + force.y;
+		}
+		visits += blockVisits;
+	};
+	const size_t tasks = (count + FAR_FIELD_BLOCK - 1) / FAR_FIELD_BLOCK;
+	if (local.threadPool()) local.threadPool()->run(tasks, addFarField);
+	else for (size_t task = 0; task < tasks; task++) addFarField(task, 0);
+	interactions += visits;
+	return true;
+}
+
+bool ClusterWorker::step() {
+	exchangeSeconds = 0.0;
+	merged = interactions = ghostCount = migrants = 0;
+	if (!collide()) return false;
+
+	for (size_t i = 0; i < bodies.size(); i++) bodies.kick(i, dt / 2.0f);
+	bodies.drift(0, bodies.size(), dt, Boundary::PERIODIC);
+	if (!migrate() || !computeForces()) return false;
+	for (size_t i = 0; i < bodies.size(); i++) bodies.kick(i, dt / 2.0f);
+	return true;
+}
+
+bool ClusterWorker::start(const Options& options, std::string* error) {
+	rank = options.workerRank;
+	Transport* transport = transportFor(options.connect);
+	if (!transport) return fail(error, "Unsupported address " + options.connect);
+	coordinator = transport->connect(options.connect, error);
+	if (!coordinator) return false;
+	std::unique_ptr<Listener> listener = transport->listen(transport->siblingAddress(options.connect, rank), error);
+	if (!listener) return false;
+
+	MessageWriter hello;
+	hello.put<uint8_t>((uint8_t)ClusterRole::WORKER);
+	hello.put<uint32_t>(CLUSTER_PROTOCOL_VERSION);
+	hello.put<uint32_t>((uint32_t)sizeof(Real));
+	hello.put<int32_t>(rank);
+	hello.putString(listener->address());
+	coordinator->send((uint32_t)ClusterMessage::HELLO, std::move(hello.bytes));
+
+	Message setup;
+	if (!coordinator->receive(setup) || setup.type != (uint32_t)ClusterMessage::SETUP) return fail(error, "Lost the coordinator");
+	MessageReader in(setup.payload);
+	workers = in.get<int32_t>();
+	layout.columns = in.get<int32_t>();
+	layout.rows = in.get<int32_t>();
+	layout.cells = in.get<int32_t>();
+	local.solver = (Solver)in.get<uint8_t>();
+	theta = in.get<float>();
+	local.mesh.gridSize = in.get<int32_t>();
+	dt = in.get<float>();
+	local.kernelIsa = (KernelIsa)in.get<uint8_t>();
+	local.theta = theta;
+	local.boundary = Boundary::PERIODIC;
+	local.setThreads(options.threads > 0 ? options.threads : 1);
+	std::vector<std::string> addresses(workers > 0 ? workers : 0);
+	for (std::string& address : addresses) address = in.getString();
+	if (!getBodies(in, bodies, ids, BODY_IDS | BODY_MOTION) || workers != layout.tiles() || rank >= workers) return fail(error, "Malformed setup from the coordinator");
+
+	// Lower ranks are connected to, higher ones connect here, so every pair has exactly one connection
+	peers.resize(workers);
+	for (int peer = 0; peer < rank; peer++) {
+		peers[peer] = transport->connect(addresses[peer], error);
+		if (!peers[peer]) return false;
+		MessageWriter introduction;
+		introduction.put<int32_t>(rank);
+		peers[peer]->send((uint32_t)ClusterMessage::PEER, std::move(introduction.bytes));
+	}
+	for (int waiting = workers - 1 - rank; waiting > 0; waiting--) {
+		std::unique_ptr<Channel> channel = listener->accept(CLUSTER_CONNECT_TIMEOUT_MS);
+		Message introduction;
+		if (!channel || !channel->receive(introduction) || introduction.type != (uint32_t)ClusterMessage::PEER) return fail(error, "Timed out waiting for the other workers");
+		int peer = MessageReader(introduction.payload).get<int32_t>();
+		if (peer <= rank || peer >= workers || peers[peer]) return fail(error, "Unexpected worker " + std::to_string(peer));
+		peers[peer] = std::move(channel);
+	}
+
+	exact = layout.exactCells(rank);
+	ghostTiles.assign((size_t)layout.tileColumns() * layout.tileRows(), std::vector<int>());
+	for (int tile = 0; tile < workers; tile++) {
+		if (tile == rank) continue;
+		std::vector<unsigned char> theirs = layout.exactCells(tile);
+		for (int row = 0; row < layout.tileRows(); row++) {
+			for (int column = 0; column < layout.tileColumns(); column++) {
+				size_t cell = (size_t)(layout.firstRow(rank) + row) * layout.cells + layout.firstColumn(rank) + column;
+				if (theirs[cell]) ghostTiles[(size_t)row * layout.tileColumns() + column].push_back(tile);
+			}
+		}
+	}
+
+	if (!computeForces()) return fail(error, "Lost a worker");
+	coordinator->send((uint32_t)ClusterMessage::READY, std::vector<unsigned char>());
+	return true;
+}
+
+int runClusterWorker(const Options& options) {
+	ClusterWorker worker;
+	std::string error;
+	if (!worker.start(options, &error)) {
+		std::cerr << "Worker " << options.workerRank << ": " << error << "\n";
+		return 1;
+	}
+
+	Message message;
+	while (worker.coordinator->receive(message)) {
+		if (message.type == (uint32_t)ClusterMessage::STEP) {
+			bool sendBodies = MessageReader(message.payload).get<uint8_t>() != 0;
+			auto start = std::chrono::steady_clock::now();
+			if (!worker.step()) {
+				std::cerr << "Worker " << worker.rank << ": lost a worker\n";
+				return 1;
+			}
+			double seconds = secondsSince(start);
+
+			MessageWriter done;
+			done.put<uint64_t>(worker.merged);
+			done.put<uint64_t>(worker.interactions);
+			done.put<uint64_t>(worker.ghostCount);
+			done.put<uint64_t>(worker.migrants);
+			done.put<double>(seconds - worker.exchangeSeconds);
+			done.put<double>(worker.exchangeSeconds);
+			if (sendBodies) putBodies(done, worker.bodies, worker.ids, nullptr, BODY_MOTION);
+			worker.coordinator->send((uint32_t)ClusterMessage::STEP_DONE, std::move(done.bytes));
+		}
+		else if (message.type == (uint32_t)ClusterMessage::STOP) {
+			MessageWriter final;
+			putBodies(final, worker.bodies, worker.ids, nullptr, BODY_IDS | BODY_MOTION);
+			worker.coordinator->send((uint32_t)ClusterMessage::FINAL, std::move(final.bytes));
+			return 0;
+		}
+		else {
+			break;
+		}
+	}
+	std::cerr << "Worker " << worker.rank << ": lost the coordinator\n";
+	return 1;
+}
+
+// Worker processes started by the coordinator, waited for when it goes out of scope. Declared before the
+// connections to them, so those are closed first and the workers see the coordinator leave.
+struct WorkerProcesses {
+	~WorkerProcesses() {
+#ifdef _WIN32
+		for (HANDLE process : processes) {
+			WaitForSingleObject(process, INFINITE);
+			CloseHandle(process);
+		}
+#else
+		for (pid_t process : processes) waitpid(process, nullptr, 0);
+#endif
+	}
+
+	// Start "program" with "arguments", returns false and sets *error if it could not be started
+	bool start(const std::string& program, const std::vector<std::string>& arguments, std::string* error) {
+#ifdef _WIN32
+		char path[MAX_PATH];
+		DWORD length = GetModuleFileNameA(nullptr, path, MAX_PATH);
+		std::string commandLine = "\"" + (length > 0 && length < MAX_PATH ? std::string(path, length) : program) + "\"";
+		for (const std::string& argument : arguments) commandLine += " \"" + argument + "\"";
+		STARTUPINFOA startup = {};
+		startup.cb = sizeof(startup);
+		PROCESS_INFORMATION process = {};
+		if (!CreateProcessA(nullptr, &commandLine[0], nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startup, &process)) {
+			return fail(error, "Could not start a worker process");
+		}
+		CloseHandle(process.hThread);
+		processes.push_back(process.hProcess);
+#else
+		std::vector<char*> argv;
+		argv.push_back(const_cast<char*>(program.c_str()));
+		for (const std::string& argument : arguments) argv.push_back(const_cast<char*>(argument.c_str()));
+		argv.push_back(nullptr);
+		pid_t process;
+		if (posix_spawnp(&process, program.c_str(), nullptr, nullptr, argv.data(), environ) != 0) {
+			return fail(error, "Could not start a worker process from " + program);
+		}
+		processes.push_back(process);
+#endif
+		return true;
+	}
+
+private:
+#ifdef _WIN32
+	std::vector<HANDLE> processes;
+#else
+	std::vector<pid_t> processes;
+#endif
+};
+
+// Every body of a step for viewers, as little-endian f32 so a GUI of any precision can show it
+static std::vector<unsigned char> encodeFrame(const Simulation& sim, const BodyArrays& bodies) {
+	std::vector<unsigned char> frame;
+	putU64(frame, sim.steps);
+	putU64(frame, sim.merges);
+	putF64(frame, sim.time);
+	putF32(frame, sim.dt);
+	putU8(frame, (uint8_t)sim.solver);
+	putF32(frame, sim.theta);
+	putU64(frame, bodies.size());
+	for (auto field : LOCATION_FIELDS) putF32Array(frame, (bodies.*field).data(), bodies.size());
+	for (auto field : MOTION_FIELDS) putF32Array(frame, (bodies.*field).data(), bodies.size());
+	return frame;
+}
+
+// Read a HELLO and file the connection as a worker or a viewer. Returns false if it is an incompatible worker.
+static bool admit(std::unique_ptr<Channel> channel, std::vector<std::unique_ptr<Channel>>& workers, std::vector<std::string>& peerAddresses,
+	std::vector<std::unique_ptr<Channel>>& viewers, std::string* error) {
+	Message hello;
+	if (!channel->receive(hello) || hello.type != (uint32_t)ClusterMessage::HELLO) return true;
+	MessageReader in(hello.payload);
+	ClusterRole role = (ClusterRole)in.get<uint8_t>();
+	uint32_t version = in.get<uint32_t>();
+	uint32_t realBytes = in.get<uint32_t>();
+	if (role == ClusterRole::VIEWER) {
+		if (in.ok() && version == CLUSTER_PROTOCOL_VERSION) viewers.push_back(std::move(channel));
+		return true;
+	}
+
+	int rank = in.get<int32_t>();
+	std::string address = in.getString();
+	if (!in.ok() || version != CLUSTER_PROTOCOL_VERSION || realBytes != sizeof(Real)) return fail(error, "A worker is a different build");
+	if (rank < 0 || rank >= (int)workers.size() || workers[rank]) return fail(error, "Unexpected worker " + std::to_string(rank));
+	workers[rank] = std::move(channel);
+	peerAddresses[rank] = address;
+	return true;
+}
+
+bool runCluster(const Options& options, Simulation& sim, ClusterStats& stats, std::string* error, std::ostream* log) {
+	const int workers = options.workers;
+	stats = ClusterStats();
+	stats.layout = DomainLayout::make(workers, options.decomposition);
+	const DomainLayout& layout = stats.layout;
+
+	const std::string address = options.listen.empty() ? defaultListenAddress() : options.listen;
+	Transport* transport = transportFor(address);
+	if (!transport) return fail(error, "Unsupported address " + address);
+	WorkerProcesses processes;
+	std::unique_ptr<Listener> listener = transport->listen(address, error);
+	if (!listener) return false;
+	stats.address = listener->address();
+	if (log) *log << "Coordinator listening on " << stats.address << ", attach a GUI with --attach " << stats.address << std::endl;
+
+	const size_t threads = options.threads > 0 ? options.threads : std::max<size_t>(1, ThreadPool::hardwareThreads() / workers);
+	for (int rank = 0; rank < workers; rank++) {
+		std::vector<std::string> arguments = { "--worker", std::to_string(rank), "--connect", stats.address, "--threads", std::to_string(threads) };
+		if (!processes.start(options.program, arguments, error)) return false;
+	}
+
+	std::vector<std::unique_ptr<Channel>> channels(workers);
+	std::vector<std::string> peerAddresses(workers);
+	std::vector<std::unique_ptr<Channel>> viewers;
+	auto connected = [&] { return std::count(channels.begin(), channels.end(), nullptr) == 0; };
+	while (!connected()) {
+		std::unique_ptr<Channel> channel = listener->accept(CLUSTER_CONNECT_TIMEOUT_MS);
+		if (!channel) return fail(error, "Timed out waiting for the workers to connect");
+		if (!admit(std::move(channel), channels, peerAddresses, viewers, error)) return false;
+	}
+
+	// Every body goes to the tile it is in, with its index as its id
+	std::vector<std::vector<unsigned int>> tileBodies(workers);
+	for (size_t i = 0; i < sim.bodies.size(); i++) tileBodies[layout.tileOf(sim.bodies.x[i], sim.bodies.y[i])].push_back((unsigned int)i);
+	std::vector<uint64_t> ids(sim.bodies.size());
+	std::iota(ids.begin(), ids.end(), 0ull);
+	for (int rank = 0; rank < workers; rank++) {
+		MessageWriter setup;
+		setup.put<int32_t>(workers);
+		setup.put<int32_t>(layout.columns);
+		setup.put<int32_t>(layout.rows);
+		setup.put<int32_t>(layout.cells);
+		setup.put<uint8_t>((uint8_t)sim.solver);
+		setup.put<float>(sim.theta);
+		setup.put<int32_t>(sim.mesh.gridSize);
+		setup.put<float>(sim.dt);
+		setup.put<uint8_t>((uint8_t)sim.kernelIsa);
+		for (const std::string& peer : peerAddresses) setup.putString(peer);
+		putBodies(setup, sim.bodies, ids, &tileBodies[rank], BODY_IDS | BODY_MOTION);
+		channels[rank]->send((uint32_t)ClusterMessage::SETUP, std::move(setup.bytes));
+	}
+	Message reply;
+	for (int rank = 0; rank < workers; rank++) {
+		if (!channels[rank]->receive(reply) || reply.type != (uint32_t)ClusterMessage::READY) return fail(error, "Worker " + std::to_string(rank) + " failed to start");
+	}
+
+	BodyArrays frameBodies;
+	std::vector<uint64_t> frameIds;
+	double lastFrame = -1.0;
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned long long n = 0; n < options.steps; n++) {
+		// Viewers may attach at any time
+		while (std::unique_ptr<Channel> channel = listener->accept(0)) admit(std::move(channel), channels, peerAddresses, viewers, nullptr);
+
+		double now = PhysicsThread::now();
+		bool frame = !viewers.empty() && now - lastFrame >= 1.0 / CLUSTER_VIEW_RATE;
+		for (auto& channel : channels) {
+			MessageWriter step;
+			step.put<uint8_t>(frame ? 1 : 0);
+			channel->send((uint32_t)ClusterMessage::STEP, std::move(step.bytes));
+		}
+
+		frameBodies.resize(0);
+		for (int rank = 0; rank < workers; rank++) {
+			if (!channels[rank]->receive(reply) || reply.type != (uint32_t)ClusterMessage::STEP_DONE) return fail(error, "Lost worker " + std::to_string(rank));
+			MessageReader in(reply.payload);
+			sim.merges += in.get<uint64_t>();
+			stats.interactions += in.get<uint64_t>();
+			stats.ghosts += in.get<uint64_t>();
+			stats.migrants += in.get<uint64_t>();
+			stats.computeSeconds += in.get<double>() / workers;
+			stats.exchangeSeconds += in.get<double>() / workers;
+			if (frame && !getBodies(in, frameBodies, frameIds, BODY_MOTION)) return fail(error, "Malformed step from worker " + std::to_string(rank));
+		}
+		sim.steps++;
+		sim.time += sim.dt;
+
+		if (frame) {
+			std::vector<unsigned char> payload = encodeFrame(sim, frameBodies);
+			for (auto& viewer : viewers) {
+				if (viewer->queuedBytes() < CLUSTER_VIEW_QUEUE_BYTES && !viewer->send((uint32_t)ClusterMessage::FRAME, payload)) viewer.reset();
+			}
+			viewers.erase(std::remove(viewers.begin(), viewers.end(), nullptr), viewers.end());
+			lastFrame = now;
+			stats.framesSent++;
+		}
+	}
+	stats.seconds = secondsSince(start);
+
+	// Collect the final bodies and put them back in their original order
+	BodyArrays gathered;
+	std::vector<uint64_t> gatheredIds;
+	for (auto& channel : channels) channel->send((uint32_t)ClusterMessage::STOP, std::vector<unsigned char>());
+	for (int rank = 0; rank < workers; rank++) {
+		if (!channels[rank]->receive(reply) || reply.type != (uint32_t)ClusterMessage::FINAL) return fail(error, "Lost worker " + std::to_string(rank));
+		MessageReader in(reply.payload);
+		if (!getBodies(in, gathered, gatheredIds, BODY_IDS | BODY_MOTION)) return fail(error, "Malformed bodies from worker " + std::to_string(rank));
+	}
+	std::vector<unsigned int> order(gathered.size());
+	std::iota(order.begin(), order.end(), 0u);
+	std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return gatheredIds[a] < gatheredIds[b]; });
+
+	const unsigned long long steps = sim.steps;
+	const unsigned long long merges = sim.merges;
+	const double time = sim.time;
+	sim.reset();
+	sim.bodies.resize(order.size());
+	for (size_t k = 0; k < order.size(); k++) copyBody(gathered, order[k], sim.bodies, k);
+	sim.adoptBodies();
+	sim.steps = steps;
+	sim.merges = merges;
+	sim.time = time;
+	return true;
+}
+
+ClusterViewer::~ClusterViewer() {
+	if (channel) channel->close();
+	if (thread.joinable()) thread.join();
+}
+
+bool ClusterViewer::attach(const std::string& address, std::string* error) {
+	Transport* transport = transportFor(address);
+	if (!transport) return fail(error, "Unsupported address " + address);
+	channel = transport->connect(address, error);
+	if (!channel) return false;
+
+	MessageWriter hello;
+	hello.put<uint8_t>((uint8_t)ClusterRole::VIEWER);
+	hello.put<uint32_t>(CLUSTER_PROTOCOL_VERSION);
+	hello.put<uint32_t>((uint32_t)sizeof(Real));
+	channel->send((uint32_t)ClusterMessage::HELLO, std::move(hello.bytes));
+	running = true;
+	thread = std::thread(&ClusterViewer::receiveLoop, this);
+	return true;
+}
+
+void ClusterViewer::receiveLoop() {
+	Message message;
+	while (channel->receive(message)) {
+		if (message.type != (uint32_t)ClusterMessage::FRAME) continue;
+		const std::vector<unsigned char>& frame = message.payload;
+		const size_t headerBytes = 8 + 8 + 8 + 4 + 1 + 4 + 8;
+		if (frame.size() < headerBytes) continue;
+		const uint64_t count = getU64(frame.data() + headerBytes - 8);
+		if (count > (frame.size() - headerBytes) / (6 * sizeof(float))) continue;
+
+		Snapshot& snapshot = snapshots.writeBuffer();
+		snapshot.steps = getU64(frame.data());
+		snapshot.merges = getU64(frame.data() + 8);
+		snapshot.time = getF64(frame.data() + 16);
+		snapshot.dt = getF32(frame.data() + 24);
+		snapshot.solver = (Solver)getU8(frame.data() + 28);
+		snapshot.theta = getF32(frame.data() + 29);
+		snapshot.boundary = Boundary::PERIODIC;
+		snapshot.publishedAt = PhysicsThread::now();
+		snapshot.handles.clear();
+		snapshot.meshStrength.clear();
+
+		BodyArrays& bodies = snapshot.bodies;
+		bodies.resize((size_t)count);
+		const unsigned char* at = frame.data() + headerBytes;
+		for (AlignedReals* array : { &bodies.x, &bodies.y, &bodies.m, &bodies.vx, &bodies.vy, &bodies.r }) {
+			getF32Array(at, array->data(), (size_t)count);
+			at += count * sizeof(float);
+		}
+		snapshot.previousX = bodies.x;
+		snapshot.previousY = bodies.y;
+		snapshots.publish();
+	}
+	running = false;
+}
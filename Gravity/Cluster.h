@@ -0,0 +1,71 @@
+#pragma once
+#include "Options.h"
+#include "Simulation.h"
+#include "Snapshot.h"
+#include "Transport.h"
+#include "Domain.h"
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <ostream>
+
+const uint32_t CLUSTER_PROTOCOL_VERSION = 3;		// Bumped whenever a message layout changes
+const int CLUSTER_CONNECT_TIMEOUT_MS = 30000;		// Longest wait for a worker to start and connect
+const double CLUSTER_VIEW_RATE = 60.0;				// Most frames per second sent to an attached viewer
+const size_t CLUSTER_VIEW_QUEUE_BYTES = 64 << 20;	// Frames are skipped while a viewer has this much left to read
+
+// Totals of a run on worker processes
+struct ClusterStats {
+	std::string address;					// Where the coordinator listened, for workers and viewers
+	DomainLayout layout;					// How the space was split
+	double seconds = 0.0;					// Wall clock time of the steps
+	double computeSeconds = 0.0;			// Time a worker spent in collisions, forces and integration, averaged over workers
+	double exchangeSeconds = 0.0;			// Time a worker spent waiting for halos, migrants and summaries, averaged over workers
+	unsigned long long interactions = 0;	// Body-body and body-node interactions of every worker
+	unsigned long long ghosts = 0;			// Ghost bodies held by all workers, summed over steps
+	unsigned long long migrants = 0;		// Bodies that moved to another tile
+	unsigned long long framesSent = 0;		// Frames sent to viewers
+};
+
+// Run options.steps steps of the bodies in "sim" on options.workers worker processes started from options.program.
+// The periodic space is split into one tile per worker (see DomainLayout). Every step each worker exchanges ghost
+// bodies within DOMAIN_HALO_CELLS of its tile with its neighbors (further for bodies large enough to touch one of
+// theirs), settles with them the groups of touching bodies that reach across tiles, merges and integrates the bodies
+// it owns, hands the ones that left its tile to their new owner, and adds the far field of everyone else from per-cell
+// mass summaries it receives from all workers. The coordinator only relays the step and collects counters, and sends
+// frames to GUIs started with --attach on its address. On return "sim" holds the final bodies in their original
+// order. The address to attach to is written to *log once the coordinator listens. Returns false and sets *error
+// if a worker could not be started or was lost.
+bool runCluster(const Options& options, Simulation& sim, ClusterStats& stats, std::string* error, std::ostream* log = nullptr);
+
+// Main of a worker process, started by runCluster() with --worker RANK --connect ADDRESS. Returns the exit code.
+int runClusterWorker(const Options& options);
+
+// GUI side of --attach: receives the frames of a running cluster on a background thread and publishes them as
+// snapshots, the way PhysicsThread publishes the steps of a local simulation
+struct ClusterViewer {
+	ClusterViewer() = default;
+	~ClusterViewer();
+
+	ClusterViewer(const ClusterViewer&) = delete;
+	ClusterViewer& operator=(const ClusterViewer&) = delete;
+
+	// Connect to the coordinator at "address", returns false and sets *error if it can't be reached
+	bool attach(const std::string& address, std::string* error);
+
+	// Latest frame received, lock-free. Valid until the next call to latest().
+	const Snapshot& latest() { return snapshots.read(); }
+
+	// False once the coordinator closed the connection, e.g. at the end of its run
+	bool connected() const { return running; }
+
+private:
+	std::unique_ptr<Channel> channel;
+	SnapshotBuffer snapshots;
+	std::atomic<bool> running{ false };
+	std::thread thread;
+
+	// Receive frames until the connection closes
+	void receiveLoop();
+};
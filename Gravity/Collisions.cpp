@@ -0,0 +1,256 @@
+#include "Collisions.h"
+#include <cmath>
+#include <algorithm>
+
+// <--- UNION FIND --->
+
+void UnionFind::reset(size_t count) {
+	parent.resize(count);
+	for (size_t i = 0; i < count; i++) parent[i] = (unsigned int)i;
+}
+
+unsigned int UnionFind::find(unsigned int i) {
+	// Path halving keeps the trees flat without recursion
+	while (parent[i] != i) {
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+
+void UnionFind::unite(unsigned int a, unsigned int b) {
+	a = find(a);
+	b = find(b);
+	if (a == b) return;
+
+	// Lower index becomes the root so the result does not depend on the order pairs are found in
+	if (a < b) parent[b] = a;
+	else parent[a] = b;
+}
+
+// <--- COLLISION RESOLVER --->
+
+size_t CollisionResolver::resolve(BodyArrays& bodies, Boundary boundary) {
+	merges.clear();
+	if (findGroups(bodies, boundary) == 0) return 0;
+	return mergeGroups(bodies);
+}
+
+size_t CollisionResolver::findGroups(const BodyArrays& bodies, Boundary boundary) {
+	if (bodies.size() < 2) {
+		groups.reset(bodies.size());
+		return 0;
+	}
+	buildGrid(bodies, boundary);
+	return withBoundary(boundary, [&](auto policy) { return findContacts<decltype(policy)>(bodies); });
+}
+
+Real CollisionResolver::mergedRadius(Real mass, double volume, Real heaviestRadius) const {
+	if (rule == MergeRule::DENSITY) return std::cbrt((3.0f * mass) / (4.0f * SIM_PI * density));
+	if (rule == MergeRule::VOLUME) return (Real)std::cbrt(volume);
+	return heaviestRadius;
+}
+
+int CollisionResolver::columnOf(float x) const {
+	return std::clamp((int)((x - originX) / cellWidth), 0, columns - 1);
+}
+
+int CollisionResolver::rowOf(float y) const {
+	return std::clamp((int)((y - originY) / cellHeight), 0, rows - 1);
+}
+
+void CollisionResolver::buildGrid(const BodyArrays& bodies, Boundary boundary) {
+	const size_t count = bodies.size();
+
+	// Cells fit most bodies, so touching grid bodies are always in neighbouring cells
+	radiusScratch.assign(bodies.r.begin(), bodies.r.end());
+	auto percentile = radiusScratch.begin() + (size_t)(COLLISION_CELL_PERCENTILE * (count - 1));
+	std::nth_element(radiusScratch.begin(), percentile, radiusScratch.end());
+	float cellSize = std::max(COLLISION_MIN_CELL_SIZE, 2.0f * *percentile);
+
+	// The grid covers the simulation space, or in open space the box around every body
+	float width = (float)SIM_WIDTH;
+	float height = (float)SIM_HEIGHT;
+	originX = 0.0f;
+	originY = 0.0f;
+	if (boundary == Boundary::OPEN) {
+		auto [minX, maxX] = std::minmax_element(bodies.x.begin(), bodies.x.end());
+		auto [minY, maxY] = std::minmax_element(bodies.y.begin(), bodies.y.end());
+		originX = (float)*minX;
+		originY = (float)*minY;
+		width = std::max((float)(*maxX - *minX), cellSize);
+		height = std::max((float)(*maxY - *minY), cellSize);
+	}
+
+	columns = std::clamp((int)(width / cellSize), 1, COLLISION_MAX_CELLS_PER_AXIS);
+	rows = std::clamp((int)(height / cellSize), 1, COLLISION_MAX_CELLS_PER_AXIS);
+	cellWidth = width / columns;
+	cellHeight = height / rows;
+	const float smallLimit = std::min(cellWidth, cellHeight) / 2.0f;
+
+	// Counting sort of the grid bodies by cell
+	cellStart.assign((size_t)columns * rows + 1, 0);
+	bodyCell.resize(count);
+	largeBodies.clear();
+	largestSmallRadius = 0.0f;
+	for (size_t i = 0; i < count; i++) {
+		if (bodies.r[i] > smallLimit) {
+			largeBodies.push_back((unsigned int)i);
+			bodyCell[i] = ~0u;
+			continue;
+		}
+		largestSmallRadius = std::max(largestSmallRadius, (float)bodies.r[i]);
+		bodyCell[i] = (unsigned int)(rowOf(bodies.y[i]) * columns + columnOf(bodies.x[i]));
+		cellStart[bodyCell[i] + 1]++;
+	}
+	for (size_t c = 1; c < cellStart.size(); c++) cellStart[c] += cellStart[c - 1];
+
+	cellBodies.resize(cellStart.back());
+	cellFill.assign(cellStart.begin(), cellStart.end() - 1);
+	for (size_t i = 0; i < count; i++) {
+		if (bodyCell[i] != ~0u) cellBodies[cellFill[bodyCell[i]]++] = (unsigned int)i;
+	}
+}
+
+template <typename Policy>
+size_t CollisionResolver::testCells(const BodyArrays& bodies, unsigned int i, int column, int row, int reachColumns, int reachRows, bool onlyHigherIndex) {
+	size_t contacts = 0;
+
+	// Never visit a wrapped cell twice when the reach covers the whole grid, without wrapping stop at the edges
+	int spanColumns, spanRows, firstColumn, firstRow;
+	if (Policy::WRAPS) {
+		spanColumns = std::min(2 * reachColumns + 1, columns);
+		spanRows = std::min(2 * reachRows + 1, rows);
+		firstColumn = column - std::min(reachColumns, (columns - 1) / 2);
+		firstRow = row - std::min(reachRows, (rows - 1) / 2);
+	}
+	else {
+		firstColumn = std::max(column - reachColumns, 0);
+		firstRow = std::max(row - reachRows, 0);
+		spanColumns = std::min(column + reachColumns, columns - 1) - firstColumn + 1;
+		spanRows = std::min(row + reachRows, rows - 1) - firstRow + 1;
+	}
+
+	for (int dr = 0; dr < spanRows; dr++) {
+		int r = Policy::WRAPS ? ((firstRow + dr) % rows + rows) % rows : firstRow + dr;
+		for (int dc = 0; dc < spanColumns; dc++) {
+			int c = Policy::WRAPS ? ((firstColumn + dc) % columns + columns) % columns : firstColumn + dc;
+			size_t cell = (size_t)r * columns + c;
+			for (unsigned int k = cellStart[cell]; k < cellStart[cell + 1]; k++) {
+				unsigned int j = cellBodies[k];
+				if (j == i || (onlyHigherIndex && j < i)) continue;
+				if (bodies.checkCollision<Policy>(i, j)) {
+					groups.unite(i, j);
+					contacts++;
+				}
+			}
+		}
+	}
+	return contacts;
+}
+
+template <typename Policy>
+size_t CollisionResolver::findContacts(const BodyArrays& bodies) {
+	const size_t count = bodies.size();
+	groups.reset(count);
+	size_t contacts = 0;
+
+	// Grid bodies only need the 3x3 block of cells around their own
+	for (size_t i = 0; i < count; i++) {
+		if (bodyCell[i] == ~0u) continue;
+		int column = (int)(bodyCell[i] % columns);
+		int row = (int)(bodyCell[i] / columns);
+		contacts += testCells<Policy>(bodies, (unsigned int)i, column, row, 1, 1, true);
+	}
+
+	// Large bodies search every cell their radius (plus the largest grid body) can reach
+	for (size_t n = 0; n < largeBodies.size(); n++) {
+		unsigned int i = largeBodies[n];
+		float reach = bodies.r[i] + largestSmallRadius;
+		int reachColumns = (int)std::ceil(reach / cellWidth);
+		int reachRows = (int)std::ceil(reach / cellHeight);
+		contacts += testCells<Policy>(bodies, i, columnOf(bodies.x[i]), rowOf(bodies.y[i]), reachColumns, reachRows, false);
+
+		// There are few large bodies, so test them against each other directly
+		for (size_t other = n + 1; other < largeBodies.size(); other++) {
+			if (bodies.checkCollision<Policy>(i, largeBodies[other])) {
+				groups.unite(i, largeBodies[other]);
+				contacts++;
+			}
+		}
+	}
+
+	return contacts;
+}
+
+size_t CollisionResolver::mergeGroups(BodyArrays& bodies) {
+	const size_t count = bodies.size();
+
+	// Total mass and momentum of every group, in double so chains of mergers conserve both exactly
+	groupMass.assign(count, 0.0);
+	groupMomentumX.assign(count, 0.0);
+	groupMomentumY.assign(count, 0.0);
+	groupForceX.assign(count, 0.0);
+	groupForceY.assign(count, 0.0);
+	groupSize.assign(count, 0);
+	groupHeaviest.assign(count, 0);
+	if (rule == MergeRule::VOLUME) groupVolume.assign(count, 0.0);
+	for (size_t i = 0; i < count; i++) {
+		unsigned int root = groups.find((unsigned int)i);
+		groupMass[root] += bodies.m[i];
+		groupMomentumX[root] += (double)bodies.m[i] * bodies.vx[i];
+		groupMomentumY[root] += (double)bodies.m[i] * bodies.vy[i];
+		groupForceX[root] += bodies.fx[i];
+		groupForceY[root] += bodies.fy[i];
+		if (rule == MergeRule::VOLUME) groupVolume[root] += (double)bodies.r[i] * bodies.r[i] * bodies.r[i];
+		if (groupSize[root] == 0 || bodies.m[i] > bodies.m[groupHeaviest[root]]) groupHeaviest[root] = (unsigned int)i;
+		groupSize[root]++;
+	}
+
+	// Keep the heaviest body of every group where it is, with the combined mass and momentum,
+	// and slide the survivors down over the removed bodies in a single pass. The forces on the members
+	// add up to the force on the merged body (the pulls between members cancel), so integrators that
+	// keep forces from one step to the next don't need to recompute it.
+	size_t write = 0;
+	for (size_t i = 0; i < count; i++) {
+		unsigned int root = groups.find((unsigned int)i);
+		if (groupHeaviest[root] != i) {
+			merges.push_back({ groupHeaviest[root], (unsigned int)i });
+			continue;
+		}
+
+		if (groupSize[root] > 1) {
+			bodies.m[i] = (Real)groupMass[root];
+			bodies.vx[i] = (Real)(groupMomentumX[root] / groupMass[root]);
+			bodies.vy[i] = (Real)(groupMomentumY[root] / groupMass[root]);
+			bodies.r[i] = mergedRadius(bodies.m[i], rule == MergeRule::VOLUME ? groupVolume[root] : 0.0, bodies.r[i]);
+			bodies.fx[i] = (Real)groupForceX[root];
+			bodies.fy[i] = (Real)groupForceY[root];
+		}
+		bodies.moveBody(i, write);
+		write++;
+	}
+	bodies.resize(write);
+
+	return count - write;
+}
+
+const char* mergeRuleName(MergeRule rule) {
+	switch (rule) {
+	case MergeRule::DENSITY: return "density";
+	case MergeRule::VOLUME: return "volume";
+	case MergeRule::LARGEST: return "largest";
+	}
+	return "unknown";
+}
+
+bool parseMergeRule(const std::string& name, MergeRule& rule) {
+	const MergeRule all[] = { MergeRule::DENSITY, MergeRule::VOLUME, MergeRule::LARGEST };
+	for (MergeRule candidate : all) {
+		if (name == mergeRuleName(candidate)) {
+			rule = candidate;
+			return true;
+		}
+	}
+	return false;
+}
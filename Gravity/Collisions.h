@@ -0,0 +1,112 @@
+#pragma once
+#include "BodyArrays.h"
+#include <vector>
+#include <string>
+#include <cstddef>
+
+const float COLLISION_MIN_CELL_SIZE = 4.0f;			// Smallest broad-phase cell, keeps the grid small for tiny bodies
+const int COLLISION_MAX_CELLS_PER_AXIS = 1024;		// Upper bound on grid resolution
+const float COLLISION_CELL_PERCENTILE = 0.9f;		// Cells fit bodies up to this radius percentile, larger ones are handled separately
+const float MERGE_DENSITY = 10000.0f;				// Mass per cubic pixel that sets merged bodies' radii with MergeRule::DENSITY
+
+// How the radius of a merged body follows from the bodies it absorbed
+enum class MergeRule {
+	DENSITY,	// Sphere of the combined mass at the merge density, the original rule
+	VOLUME,		// Sphere of the members' combined volume
+	LARGEST		// The radius of the heaviest member, bodies don't grow
+};
+
+// Disjoint-set forest grouping bodies that touch, directly or through a chain of other bodies
+struct UnionFind {
+	std::vector<unsigned int> parent;
+
+	// Start with "count" groups of one
+	void reset(size_t count);
+
+	// Representative of the group containing i
+	unsigned int find(unsigned int i);
+
+	// Join the groups of a and b
+	void unite(unsigned int a, unsigned int b);
+};
+
+// One body absorbed by another, as indices into the body arrays from before the merge compacted them
+struct MergeEvent {
+	unsigned int survivor;		// Heaviest body of the group, keeps its place and takes the combined mass and momentum
+	unsigned int absorbed;		// Body removed by the merge
+};
+
+// Broad-phase collision detection on a uniform grid over the simulation space (wrapping around on a periodic
+// boundary, over the bodies' bounding box on an open one), followed by merging every group of touching bodies
+// in one pass and compacting the body arrays once
+struct CollisionResolver {
+	MergeRule rule = MergeRule::DENSITY;	// Radius of merged bodies
+	float density = MERGE_DENSITY;			// Mass per cubic pixel of merged bodies with MergeRule::DENSITY
+
+	// Merge every group of touching bodies into its heaviest member, returns the number of bodies removed
+	size_t resolve(BodyArrays& bodies, Boundary boundary);
+
+	// Group touching bodies without merging them, returns the number of touching pairs. Until the next call,
+	// groupOf(i) is then the lowest index in the group of body i.
+	size_t findGroups(const BodyArrays& bodies, Boundary boundary);
+	unsigned int groupOf(unsigned int i) { return groups.find(i); }
+
+	// Radius of a body merged from members of total "mass" and summed cubed radii "volume", the heaviest of which
+	// had radius "heaviestRadius"
+	Real mergedRadius(Real mass, double volume, Real heaviestRadius) const;
+
+	// Every merge performed by the last resolve(), in order of the absorbed body
+	const std::vector<MergeEvent>& lastMerges() const { return merges; }
+
+private:
+	float originX = 0.0f;					// Top left corner of the grid
+	float originY = 0.0f;
+	float cellWidth = 0.0f;
+	float cellHeight = 0.0f;
+	int columns = 0;
+	int rows = 0;
+	float largestSmallRadius = 0.0f;		// Largest radius of a body stored in the grid
+	std::vector<unsigned int> cellStart;	// Bodies of cell c are cellBodies[cellStart[c] .. cellStart[c + 1])
+	std::vector<unsigned int> cellBodies;
+	std::vector<unsigned int> largeBodies;	// Bodies too large for a grid cell
+	UnionFind groups;
+	std::vector<MergeEvent> merges;
+
+	// Scratch space reused between steps
+	std::vector<float> radiusScratch;
+	std::vector<unsigned int> bodyCell;
+	std::vector<unsigned int> cellFill;
+	std::vector<double> groupMass;
+	std::vector<double> groupMomentumX;
+	std::vector<double> groupMomentumY;
+	std::vector<double> groupForceX;
+	std::vector<double> groupForceY;
+	std::vector<double> groupVolume;		// Summed cubed radii, for MergeRule::VOLUME
+	std::vector<unsigned int> groupSize;
+	std::vector<unsigned int> groupHeaviest;
+
+	// Size the grid for the current radii and bucket the bodies into cells
+	void buildGrid(const BodyArrays& bodies, Boundary boundary);
+
+	// Grid column or row of a coordinate
+	int columnOf(float x) const;
+	int rowOf(float y) const;
+
+	// Test body i against every grid body in the block of cells around (column, row), wrapped around the grid
+	// edges when the policy wraps, returns contacts found
+	template <typename Policy>
+	size_t testCells(const BodyArrays& bodies, unsigned int i, int column, int row, int reachColumns, int reachRows, bool onlyHigherIndex);
+
+	// Unite every pair of touching bodies, returns the number of touching pairs
+	template <typename Policy>
+	size_t findContacts(const BodyArrays& bodies);
+
+	// Combine each group into its heaviest member and compact the arrays, returns the number of bodies removed
+	size_t mergeGroups(BodyArrays& bodies);
+};
+
+// Name of a merge rule as accepted by parseMergeRule: density, volume or largest
+const char* mergeRuleName(MergeRule rule);
+
+// Merge rule by name, returns false if there is none
+bool parseMergeRule(const std::string& name, MergeRule& rule);
@@ -0,0 +1,168 @@
+#include "Domain.h"
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+
+DomainLayout DomainLayout::make(int workers, Decomposition decomposition) {
+	DomainLayout layout;
+	layout.columns = std::max(workers, 1);
+	layout.rows = 1;
+	if (decomposition == Decomposition::TILES) {
+		for (int rows = (int)std::sqrt((double)workers); rows > 1; rows--) {
+			if (workers % rows != 0) continue;
+			layout.rows = rows;
+			layout.columns = workers / rows;
+			break;
+		}
+	}
+
+	// Smallest multiple of both tile counts with enough cells for the far field to be worth having
+	int step = std::lcm(layout.columns, layout.rows);
+	layout.cells = ((DOMAIN_MIN_CELLS + step - 1) / step) * step;
+	return layout;
+}
+
+int DomainLayout::cellColumn(Real x) const {
+	return std::min(std::max((int)(x / cellSize()), 0), cells - 1);
+}
+
+int DomainLayout::cellRow(Real y) const {
+	return std::min(std::max((int)(y / cellSize()), 0), cells - 1);
+}
+
+// Distance along one periodic axis of length "size" from "value" to the span [start, start + length)
+static Real axisDistance(Real value, Real start, Real length, Real size) {
+	Real offset = std::fmod(value - start, size);
+	if (offset < 0) offset += size;
+	if (offset < length) return 0;
+	return std::min(offset - length, size - offset);
+}
+
+Real DomainLayout::distanceToTile(int tile, Real x, Real y) const {
+	Real dx = axisDistance(x, firstColumn(tile) * cellSize(), tileColumns() * cellSize(), (Real)SIM_WIDTH);
+	Real dy = axisDistance(y, firstRow(tile) * cellSize(), tileRows() * cellSize(), (Real)SIM_HEIGHT);
+	return std::sqrt(dx * dx + dy * dy);
+}
+
+std::vector<unsigned char> DomainLayout::exactCells(int tile) const {
+	std::vector<unsigned char> exact((size_t)cells * cells, 0);
+	int spanColumns = std::min(tileColumns() + 2 * DOMAIN_HALO_CELLS, cells);
+	int spanRows = std::min(tileRows() + 2 * DOMAIN_HALO_CELLS, cells);
+	for (int r = 0; r < spanRows; r++) {
+		int row = ((firstRow(tile) - DOMAIN_HALO_CELLS + r) % cells + cells) % cells;
+		for (int c = 0; c < spanColumns; c++) {
+			int column = ((firstColumn(tile) - DOMAIN_HALO_CELLS + c) % cells + cells) % cells;
+			exact[(size_t)row * cells + column] = 1;
+		}
+	}
+	return exact;
+}
+
+void summarizeTile(const DomainLayout& layout, int tile, const BodyArrays& bodies, size_t count, std::vector<CellMoment>& moments) {
+	const int width = layout.tileColumns();
+	const int firstColumn = layout.firstColumn(tile);
+	const int firstRow = layout.firstRow(tile);
+	moments.assign((size_t)width * layout.tileRows(), CellMoment());
+
+	// Weighted sums first, divided into centers of mass at the end
+	for (size_t i = 0; i < count; i++) {
+		int column = std::min(std::max(layout.cellColumn(bodies.x[i]) - firstColumn, 0), width - 1);
+		int row = std::min(std::max(layout.cellRow(bodies.y[i]) - firstRow, 0), layout.tileRows() - 1);
+		CellMoment& moment = moments[(size_t)row * width + column];
+		moment.mass += bodies.m[i];
+		moment.x += (double)bodies.m[i] * bodies.x[i];
+		moment.y += (double)bodies.m[i] * bodies.y[i];
+	}
+	for (CellMoment& moment : moments) {
+		if (moment.mass <= 0.0) continue;
+		moment.x /= moment.mass;
+		moment.y /= moment.mass;
+	}
+}
+
+void FarField::build(const DomainLayout& layout, const std::vector<CellMoment>& cells, const std::vector<unsigned char>& exact) {
+	levels.resize(1);
+	levels[0].size = layout.cells;
+	levels[0].nodeSize = layout.cellSize();
+	levels[0].nodes = cells;
+	levels[0].exact.resize(exact.size());
+	for (size_t i = 0; i < exact.size(); i++) levels[0].exact[i] = exact[i] ? EXACT_SOME | EXACT_ALL : 0;
+
+	// Every coarser node combines up to 2 x 2 nodes of the level below, the last column or row may have only one
+	while (levels.back().size > 1) {
+		const Level& fine = levels.back();
+		Level coarse;
+		coarse.size = (fine.size + 1) / 2;
+		coarse.nodeSize = fine.nodeSize * 2;
+		coarse.nodes.assign((size_t)coarse.size * coarse.size, CellMoment());
+		coarse.exact.assign(coarse.nodes.size(), EXACT_ALL);
+		for (int row = 0; row < fine.size; row++) {
+			for (int column = 0; column < fine.size; column++) {
+				const size_t from = (size_t)row * fine.size + column;
+				const size_t to = (size_t)(row / 2) * coarse.size + column / 2;
+				CellMoment& node = coarse.nodes[to];
+				node.mass += fine.nodes[from].mass;
+				node.x += fine.nodes[from].mass * fine.nodes[from].x;
+				node.y += fine.nodes[from].mass * fine.nodes[from].y;
+				if (!(fine.exact[from] & EXACT_ALL)) coarse.exact[to] &= ~EXACT_ALL;
+				coarse.exact[to] |= fine.exact[from] & EXACT_SOME;
+			}
+		}
+		for (CellMoment& node : coarse.nodes) {
+			if (node.mass <= 0.0) continue;
+			node.x /= node.mass;
+			node.y /= node.mass;
+		}
+		levels.push_back(std::move(coarse));
+	}
+}
+
+Vec2 FarField::force(const BodyArrays& bodies, size_t i, float theta, size_t& interactions) const {
+	struct Entry {
+		int level;
+		int column;
+		int row;
+	};
+
+	Vec2 force = { 0, 0 };
+	if (levels.empty()) return force;
+	const Real bodyX = bodies.x[i];
+	const Real bodyY = bodies.y[i];
+	const Real bodyMass = bodies.m[i];
+	const Real thetaSquared = (Real)theta * theta;
+
+	// Depth first, each level adds at most three entries beyond the one it pops
+	Entry stack[4 * 32];
+	int depth = 0;
+	stack[depth++] = { (int)levels.size() - 1, 0, 0 };
+	while (depth > 0) {
+		const Entry entry = stack[--depth];
+		const Level& level = levels[entry.level];
+		const size_t index = (size_t)entry.row * level.size + entry.column;
+		const CellMoment& node = level.nodes[index];
+		if (node.mass <= 0.0 || (level.exact[index] & EXACT_ALL)) continue; // Empty, or summed exactly by the caller
+
+		if (!level.exact[index]) {
+			Real dx = PeriodicBoundary::offset((Real)node.x - bodyX, (Real)SIM_WIDTH, SIM_WIDTH_HALF);
+			Real dy = PeriodicBoundary::offset((Real)node.y - bodyY, (Real)SIM_HEIGHT, SIM_HEIGHT_HALF);
+			Real distanceSquared = dx * dx + dy * dy;
+			if (entry.level == 0 || level.nodeSize * level.nodeSize < thetaSquared * distanceSquared) {
+				interactions++;
+				if (distanceSquared < MIN_DISTANCE_SQUARED) continue;
+				Real forceMag = G * (bodyMass * (Real)node.mass) / distanceSquared;
+				Real distanceMag = std::sqrt(distanceSquared);
+				force.x += forceMag * dx / distanceMag;
+				force.y += forceMag * dy / distanceMag;
+				continue;
+			}
+		}
+
+		const Level& finer = levels[entry.level - 1];
+		for (int row = entry.row * 2; row < std::min(entry.row * 2 + 2, finer.size); row++) {
+			for (int column = entry.column * 2; column < std::min(entry.column * 2 + 2, finer.size); column++) {
+				stack[depth++] = { entry.level - 1, column, row };
+			}
+		}
+	}
+	return force;
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include "BodyArrays.h"
+#include <vector>
+#include <cstddef>
+
+const int DOMAIN_MIN_CELLS = 64;		// Summary cells per side of the whole space, at least
+const int DOMAIN_HALO_CELLS = 2;		// Cells around a tile whose bodies it holds as ghosts. Bodies closer than this to a tile
+										// feel each other exactly and may merge, everything further away is far field.
+const float DOMAIN_MERGE_MARGIN = 1.0f;	// Extra reach of merge ghosts beyond touching distance, for rounding
+
+// How the periodic space is cut into one tile per worker
+enum class Decomposition {
+	STRIPS,		// Vertical strips, each worker has two neighbors
+	TILES		// A grid of tiles as close to square as the worker count allows
+};
+
+// Equal tiles of the periodic simulation space on a grid of square summary cells, tiles numbered row by row.
+// Tile edges fall on cell edges, so every cell belongs to exactly one tile.
+struct DomainLayout {
+	int columns = 1;				// Tiles across
+	int rows = 1;					// Tiles down
+	int cells = DOMAIN_MIN_CELLS;	// Summary cells per side of the whole space, a multiple of columns and rows
+
+	// Layout for "workers" tiles
+	static DomainLayout make(int workers, Decomposition decomposition);
+
+	// Number of tiles
+	int tiles() const { return columns * rows; }
+
+	// Side of a summary cell
+	Real cellSize() const { return (Real)SIM_WIDTH / cells; }
+
+	// Cell column and row of a location inside the space
+	int cellColumn(Real x) const;
+	int cellRow(Real y) const;
+
+	// Tile owning a location, bodies outside the space count as being in the nearest cell
+	int tileOf(Real x, Real y) const { return tileOfCell(cellColumn(x), cellRow(y)); }
+
+	// Tile owning a cell
+	int tileOfCell(int column, int row) const { return (row / (cells / rows)) * columns + column / (cells / columns); }
+
+	// First cell column and row of a tile, and its size in cells
+	int firstColumn(int tile) const { return (tile % columns) * (cells / columns); }
+	int firstRow(int tile) const { return (tile / columns) * (cells / rows); }
+	int tileColumns() const { return cells / columns; }
+	int tileRows() const { return cells / rows; }
+
+	// Shortest distance from a location to a tile in the periodic space, 0 inside it
+	Real distanceToTile(int tile, Real x, Real y) const;
+
+	// One flag per cell of the space, row-major: set for the cells of the tile and the DOMAIN_HALO_CELLS around it,
+	// wrapped around the edges. The tile sums the bodies of these cells exactly and the rest as far field.
+	std::vector<unsigned char> exactCells(int tile) const;
+};
+
+// Mass and center of mass of the bodies in one summary cell
+struct CellMoment {
+	double mass = 0.0;
+	double x = 0.0;
+	double y = 0.0;
+};
+
+// Sum bodies [0, count) into one moment per cell of "tile", row-major over the tile
+void summarizeTile(const DomainLayout& layout, int tile, const BodyArrays& bodies, size_t count, std::vector<CellMoment>& moments);
+
+// Far-field gravity on one tile's bodies from the summaries of every tile. The cells are combined into a pyramid
+// of ever coarser nodes, like a quadtree over the whole space, that every body walks Barnes-Hut style with the
+// minimum image offset. Nodes holding a cell the tile sums exactly are always opened and such cells skipped, so
+// no body is counted twice.
+struct FarField {
+	// Build the pyramid over every cell of the space, "exact" as returned by DomainLayout::exactCells
+	void build(const DomainLayout& layout, const std::vector<CellMoment>& cells, const std::vector<unsigned char>& exact);
+
+	// Force on body i from every cell not summed exactly, a node is used whole once its size is below theta times
+	// its distance. Adds the nodes evaluated to "interactions".
+	Vec2 force(const BodyArrays& bodies, size_t i, float theta, size_t& interactions) const;
+
+private:
+	enum : unsigned char {
+		EXACT_SOME = 1,						// Node contains a cell summed exactly
+		EXACT_ALL = 2						// Every cell of the node is summed exactly, it is skipped without opening it
+	};
+
+	struct Level {
+		int size = 1;						// Nodes per side
+		Real nodeSize = 0;					// Side of a node
+		std::vector<CellMoment> nodes;		// Row-major, centers of mass in space coordinates
+		std::vector<unsigned char> exact;	// EXACT_ flags of each node
+	};
+
+	std::vector<Level> levels;				// Finest (the cells) first, a single node last
+};
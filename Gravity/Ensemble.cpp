@@ -0,0 +1,262 @@
+#include "Ensemble.h"
+#include "Scenarios.h"
+#include "BodyFile.h"
+#include "ThreadPool.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+size_t EnsembleSpec::runCount() const {
+	return seeds.size() * gravity.size() * velocity.size() * density.size() * mergeRules.size();
+}
+
+EnsembleParams EnsembleSpec::params(size_t index) const {
+	EnsembleParams run;
+	run.mergeRule = mergeRules[index % mergeRules.size()];
+	index /= mergeRules.size();
+	run.density = density[index % density.size()];
+	index /= density.size();
+	run.velocity = velocity[index % velocity.size()];
+	index /= velocity.size();
+	run.gravity = gravity[index % gravity.size()];
+	index /= gravity.size();
+	run.seed = seeds[index];
+	return run;
+}
+
+static std::string trim(const std::string& text) {
+	size_t begin = text.find_first_not_of(" \t\r");
+	if (begin == std::string::npos) return "";
+	return text.substr(begin, text.find_last_not_of(" \t\r") + 1 - begin);
+}
+
+static bool parseDouble(const std::string& text, double& value) {
+	char* end = nullptr;
+	value = std::strtod(text.c_str(), &end);
+	return !text.empty() && end != nullptr && *end == '\0';
+}
+
+// Comma-separated numbers and start:stop:step ranges
+static bool parseNumbers(const std::string& list, std::vector<double>& values) {
+	std::stringstream items(list);
+	std::string item;
+	while (std::getline(items, item, ',')) {
+		item = trim(item);
+		size_t first = item.find(':');
+		if (first == std::string::npos) {
+			double value = 0.0;
+			if (!parseDouble(item, value)) return false;
+			values.push_back(value);
+			continue;
+		}
+
+		size_t second = item.find(':', first + 1);
+		double start = 0.0, stop = 0.0, step = 0.0;
+		if (second == std::string::npos || !parseDouble(trim(item.substr(0, first)), start)
+			|| !parseDouble(trim(item.substr(first + 1, second - first - 1)), stop) || !parseDouble(trim(item.substr(second + 1)), step)
+			|| step <= 0.0 || stop < start || (stop - start) / step >= ENSEMBLE_MAX_RUNS) return false;
+		// Counted rather than accumulated, so 0.1 steps end exactly on "stop"
+		size_t count = (size_t)std::floor((stop - start) / step + 1e-9) + 1;
+		for (size_t n = 0; n < count; n++) values.push_back(start + n * step);
+	}
+	return !values.empty();
+}
+
+bool readEnsembleSpec(const std::string& path, unsigned int seed, EnsembleSpec& spec, std::string* error) {
+	std::ifstream file(path);
+	if (!file) {
+		if (error) *error = "Can't open " + path;
+		return false;
+	}
+
+	spec = EnsembleSpec();
+	std::string line;
+	for (int number = 1; std::getline(file, line); number++) {
+		line = trim(line.substr(0, line.find('#')));
+		if (line.empty()) continue;
+
+		auto fail = [&](const std::string& message) {
+			if (error) *error = path + ":" + std::to_string(number) + ": " + message;
+			return false;
+		};
+		size_t equals = line.find('=');
+		if (equals == std::string::npos) return fail("expected name = values");
+		std::string name = trim(line.substr(0, equals));
+		std::string list = trim(line.substr(equals + 1));
+
+		if (name == "merge-rule") {
+			spec.mergeRules.clear();
+			std::stringstream items(list);
+			std::string item;
+			while (std::getline(items, item, ',')) {
+				MergeRule rule;
+				if (!parseMergeRule(trim(item), rule)) return fail("merge rules are density, volume or largest");
+				spec.mergeRules.push_back(rule);
+			}
+			if (spec.mergeRules.empty()) return fail("no merge rules");
+			continue;
+		}
+
+		std::vector<double> values;
+		if (!parseNumbers(list, values)) return fail("expected numbers or start:stop:step ranges");
+		if (name == "seed") {
+			spec.seeds.clear();
+			for (double value : values) {
+				if (value < 0.0 || value > 4294967295.0 || value != std::floor(value)) return fail("seeds are whole numbers");
+				spec.seeds.push_back((unsigned int)value);
+			}
+		}
+		else if (name == "gravity" || name == "velocity" || name == "density") {
+			std::vector<float>& target = name == "gravity" ? spec.gravity : name == "velocity" ? spec.velocity : spec.density;
+			target.clear();
+			for (double value : values) {
+				if (value < 0.0 || (value == 0.0 && name != "velocity")) return fail(name + " must be positive");
+				target.push_back((float)value);
+			}
+		}
+		else {
+			return fail("unknown parameter " + name + ", expected seed, gravity, velocity, density or merge-rule");
+		}
+	}
+
+	EnsembleParams defaults;
+	if (spec.seeds.empty()) spec.seeds.push_back(seed);
+	if (spec.gravity.empty()) spec.gravity.push_back(defaults.gravity);
+	if (spec.velocity.empty()) spec.velocity.push_back(defaults.velocity);
+	if (spec.density.empty()) spec.density.push_back(defaults.density);
+	if (spec.mergeRules.empty()) spec.mergeRules.push_back(defaults.mergeRule);
+
+	double runs = (double)spec.seeds.size() * spec.gravity.size() * spec.velocity.size() * spec.density.size() * spec.mergeRules.size();
+	if (runs > ENSEMBLE_MAX_RUNS) {
+		if (error) *error = path + " describes more than " + std::to_string(ENSEMBLE_MAX_RUNS) + " runs";
+		return false;
+	}
+	return true;
+}
+
+// Step one run from the shared starting bodies and summarize its final state.
+// G is a compile-time constant of the kernels, so a gravity multiplier k scales every mass by k instead: the
+// accelerations G m / r^2 are the same, and so are merges since momentum is weighted by mass ratios. The merge
+// density scales with it so merged radii match too, and the summary divides k back out.
+static EnsembleSummary runOne(const Options& options, const BodyArrays& start, const EnsembleParams& params) {
+	auto begin = std::chrono::steady_clock::now();
+	const Real massScale = (Real)((double)params.gravity * params.density / SCENARIO_DENSITY);
+	const Real velocityScale = (Real)params.velocity;
+
+	Simulation sim;
+	applyOptions(options, sim);
+	sim.collisions.rule = params.mergeRule;
+	sim.collisions.density = MERGE_DENSITY * params.gravity;
+	sim.bodies.resize(start.size());
+	for (size_t i = 0; i < start.size(); i++) {
+		sim.bodies.x[i] = start.x[i];
+		sim.bodies.y[i] = start.y[i];
+		sim.bodies.vx[i] = start.vx[i] * velocityScale;
+		sim.bodies.vy[i] = start.vy[i] * velocityScale;
+		sim.bodies.m[i] = start.m[i] * massScale;
+		sim.bodies.r[i] = start.r[i];
+		sim.bodies.fx[i] = 0;
+		sim.bodies.fy[i] = 0;
+	}
+	sim.adoptBodies();
+
+	for (unsigned long long n = 0; n < options.steps; n++) sim.step();
+
+	EnsembleSummary summary;
+	summary.params = params;
+	summary.startBodies = start.size();
+	summary.endBodies = sim.bodies.size();
+	summary.merges = sim.merges;
+	double totalMass = 0.0;
+	double massSpeedSquared = 0.0;
+	for (size_t i = 0; i < sim.bodies.size(); i++) {
+		double mass = (double)sim.bodies.m[i] / params.gravity;
+		double speedSquared = (double)sim.bodies.vx[i] * sim.bodies.vx[i] + (double)sim.bodies.vy[i] * sim.bodies.vy[i];
+		totalMass += mass;
+		summary.largestMass = std::max(summary.largestMass, mass);
+		massSpeedSquared += mass * speedSquared;
+	}
+	summary.largestFraction = totalMass > 0.0 ? summary.largestMass / totalMass : 0.0;
+	summary.kineticEnergy = 0.5 * massSpeedSquared;
+	summary.rmsSpeed = totalMass > 0.0 ? std::sqrt(massSpeedSquared / totalMass) : 0.0;
+	summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	return summary;
+}
+
+bool runEnsemble(const Options& options, const EnsembleSpec& spec, EnsembleStats& stats, std::string* error, std::ostream* log) {
+	auto begin = std::chrono::steady_clock::now();
+	const size_t runs = spec.runCount();
+	stats.runs = runs;
+	stats.threads = options.threads > 0 ? options.threads : ThreadPool::hardwareThreads();
+	ThreadPool pool(stats.threads);
+
+	// Each run steps on its own thread of the pool, the runs are the parallelism
+	Options runOptions = options;
+	runOptions.threads = 1;
+
+	// Starting bodies, built once and only read by the runs
+	std::vector<std::unique_ptr<const BodyArrays>> starts(spec.seeds.size());
+	if (!options.bodiesFile.empty()) {
+		if (spec.seeds.size() > 1) {
+			if (error) *error = "Seeds can't be swept over the bodies of --bodies-file";
+			return false;
+		}
+		Simulation sim;
+		if (!loadBodies(options.bodiesFile, sim, error)) return false;
+		starts[0].reset(new BodyArrays(std::move(sim.bodies)));
+	}
+	else {
+		pool.run(spec.seeds.size(), [&](size_t n, size_t) {
+			Simulation sim;
+			applyOptions(runOptions, sim);
+			addScenario(sim, options.scenario, options.bodies, spec.seeds[n]);
+			starts[n].reset(new BodyArrays(std::move(sim.bodies)));
+		});
+	}
+
+	std::ofstream results(options.ensembleResults);
+	if (!results) {
+		if (error) *error = "Can't create " + options.ensembleResults;
+		return false;
+	}
+	results << "run,seed,gravity,velocity,density,merge_rule,steps,start_bodies,end_bodies,merges,largest_mass,largest_fraction,kinetic_energy,rms_speed,seconds\n";
+	results << std::setprecision(9);
+	results.flush();
+
+	if (log) *log << "Ensemble: " << runs << " runs of " << options.steps << " steps, " << starts[0]->size() << " bodies, " << stats.threads << " at a time\n";
+
+	// One run per task: the pool hands out runs in order and idle workers steal the remaining ones, so long and
+	// short runs still keep every core busy. Lines are written in the order runs finish.
+	std::mutex resultsMutex;
+	size_t finished = 0;
+	const size_t seedRuns = runs / spec.seeds.size();
+	pool.run(runs, [&](size_t run, size_t) {
+		EnsembleParams params = spec.params(run);
+		EnsembleSummary summary = runOne(runOptions, *starts[run / seedRuns], params);
+		summary.run = run;
+
+		std::lock_guard<std::mutex> lock(resultsMutex);
+		results << summary.run << "," << params.seed << "," << params.gravity << "," << params.velocity << "," << params.density << ","
+			<< mergeRuleName(params.mergeRule) << "," << options.steps << "," << summary.startBodies << "," << summary.endBodies << ","
+			<< summary.merges << "," << summary.largestMass << "," << summary.largestFraction << "," << summary.kineticEnergy << ","
+			<< summary.rmsSpeed << "," << summary.seconds << "\n";
+		results.flush();
+		stats.runSeconds += summary.seconds;
+		finished++;
+		if (log) *log << "Run " << summary.run << " finished (" << finished << " / " << runs << "): " << summary.endBodies << " bodies, "
+			<< summary.merges << " merges, " << summary.seconds << " s\n";
+	});
+
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	if (!results) {
+		if (error) *error = "Writing " + options.ensembleResults + " failed";
+		return false;
+	}
+	return true;
+}
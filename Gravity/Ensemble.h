@@ -0,0 +1,71 @@
+#pragma once
+#include "Options.h"
+#include "Collisions.h"
+#include <vector>
+#include <string>
+#include <ostream>
+#include <cstddef>
+
+const size_t ENSEMBLE_MAX_RUNS = 1000000;		// Largest sweep a spec may describe
+
+// Parameters of one run of a sweep
+struct EnsembleParams {
+	unsigned int seed = 1;					// Seed of the generated starting scene
+	float gravity = 1.0f;					// Multiplier of G
+	float velocity = 1.0f;					// Multiplier of the starting velocities
+	float density = SCENARIO_DENSITY;		// Mass per cubic pixel of the starting bodies, the spawner's 20000 by default
+	MergeRule mergeRule = MergeRule::DENSITY;	// Radius of merged bodies
+};
+
+// Values of every swept parameter. Runs are all combinations, the seed varying slowest and the merge rule fastest.
+struct EnsembleSpec {
+	std::vector<unsigned int> seeds;
+	std::vector<float> gravity;
+	std::vector<float> velocity;
+	std::vector<float> density;
+	std::vector<MergeRule> mergeRules;
+
+	// Number of combinations
+	size_t runCount() const;
+
+	// Parameters of run "index" in [0, runCount())
+	EnsembleParams params(size_t index) const;
+};
+
+// Summary of one finished run. Masses and energies are those of the bodies at the density of the run, without the
+// gravity multiplier (see runEnsemble), so runs with different multipliers compare directly.
+struct EnsembleSummary {
+	size_t run = 0;							// Index in the sweep
+	EnsembleParams params;
+	size_t startBodies = 0;
+	size_t endBodies = 0;
+	unsigned long long merges = 0;
+	double largestMass = 0.0;				// Heaviest body at the end
+	double largestFraction = 0.0;			// Its share of the total mass
+	double kineticEnergy = 0.0;				// Sum of m v^2 / 2 at the end
+	double rmsSpeed = 0.0;					// Mass-weighted root mean square speed at the end
+	double seconds = 0.0;					// Wall clock time of the run
+};
+
+// Totals of a sweep
+struct EnsembleStats {
+	size_t runs = 0;
+	size_t threads = 0;						// Runs in parallel
+	double seconds = 0.0;					// Wall clock time of the whole sweep
+	double runSeconds = 0.0;				// Wall clock time of the runs, summed
+};
+
+// Read a sweep spec: one "name = values" line per parameter (seed, gravity, velocity, density, merge-rule), values
+// separated by commas, numbers also as an inclusive "start:stop:step" range. Blank lines and # comments are
+// skipped, parameters that aren't listed keep a single default value (the seed "seed"). Returns false and sets
+// *error if the file can't be read or holds anything else.
+bool readEnsembleSpec(const std::string& path, unsigned int seed, EnsembleSpec& spec, std::string* error);
+
+// Run every combination of "spec" for options.steps steps on the scene options describe (generated once per seed,
+// or the --bodies-file bodies), one single-threaded simulation per run and options.threads runs at a time (0 uses
+// every hardware thread). Each run starts from a copy of the shared starting bodies with its parameters applied.
+// G is a constant of the force kernels, so a gravity multiplier scales every mass by it instead, which gives the
+// same accelerations and merges.
+// A CSV line per finished run is appended to options.ensembleResults as soon as it completes, and progress goes to
+// *log. Returns false and sets *error if the scene or the results file can't be opened.
+bool runEnsemble(const Options& options, const EnsembleSpec& spec, EnsembleStats& stats, std::string* error, std::ostream* log = nullptr);
@@ -0,0 +1,123 @@
+#include "FieldImage.h"
+#include "ForceKernels.h"
+#include "Simd.h"
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+
+const size_t FIELD_RASTER_ROWS_PER_TASK = 16;	// Image rows colored by one task
+
+// Pack a normalized color (components 0 to 1, opaque) into RGBA8 memory order
+static uint32_t packColor(float r, float g, float b) {
+	unsigned char bytes[4] = { (unsigned char)(r * 255.0f), (unsigned char)(g * 255.0f), (unsigned char)(b * 255.0f), 255 };
+	uint32_t packed;
+	std::memcpy(&packed, bytes, sizeof(packed));
+	return packed;
+}
+
+// Heat map color of a normalized strength
+static uint32_t heatColor(float norm) {
+
+	// Because the normalized force follows the inverse square law, halving the distance between bodies increases the force by a factor of 4
+	// so we visualize based on the cube root of this force. This creates a more even distribution of values for the heatmap.
+	norm = std::cbrt(norm);
+
+	if (norm <= 0.2f) return packColor(0.0f, 0.0f, norm * 5); // black to blue
+	if (norm <= 0.4f) return packColor(0.0f, (norm - 0.2f) * 5, 1.0f); // blue to cyan
+	if (norm <= 0.6f) return packColor(0.0f, 1.0f, 1.0f - (norm - 0.4f) * 5); // cyan to green
+	if (norm <= 0.8f) return packColor((norm - 0.6f) * 5, 1.0f, 0.0f); // green to yellow
+	if (norm <= 0.95f) return packColor(1.0f, 1.0f - (norm - 0.8f) / 0.15f, 0.0f); // yellow to red
+	return packColor(1.0f, 0.0f, std::min((norm - 0.95f) / 0.05f, 1.0f)); // red to pink
+}
+
+FieldColormap::FieldColormap() {
+	for (int i = 0; i < FIELD_COLORMAP_SIZE; i++) {
+		colors[i] = heatColor(std::max((float)i / (FIELD_COLORMAP_SIZE - 1), FIELD_MIN_NORMALIZED));
+	}
+}
+
+const FieldColormap& FieldColormap::get() {
+	static const FieldColormap colormap;
+	return colormap;
+}
+
+// <--- ROW FILL --->
+
+// Colormap index of a strength: clamp the scaled value to [FIELD_MIN_NORMALIZED, 1] and round to the nearest entry
+static inline int colormapIndex(float strength, float scale) {
+	float norm = std::min(std::max(strength * scale, FIELD_MIN_NORMALIZED), 1.0f);
+	return (int)(norm * (FIELD_COLORMAP_SIZE - 1) + 0.5f);
+}
+
+static void fillRowScalar(const float* strength, uint32_t* out, int count, float scale, const uint32_t* colors) {
+	for (int i = 0; i < count; i++) out[i] = colors[colormapIndex(strength[i], scale)];
+}
+
+#ifdef GRAVITY_X86
+
+// Same as fillRowScalar, 8 cells at a time with a gather from the lookup table
+GRAVITY_TARGET_AVX2 static void fillRowAvx2(const float* strength, uint32_t* out, int count, float scale, const uint32_t* colors) {
+	const __m256 scales = _mm256_set1_ps(scale);
+	const __m256 lowest = _mm256_set1_ps(FIELD_MIN_NORMALIZED);
+	const __m256 highest = _mm256_set1_ps(1.0f);
+	const __m256 entries = _mm256_set1_ps((float)(FIELD_COLORMAP_SIZE - 1));
+	const __m256 half = _mm256_set1_ps(0.5f);
+
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 norm = _mm256_mul_ps(_mm256_loadu_ps(strength + i), scales);
+		norm = _mm256_min_ps(_mm256_max_ps(norm, lowest), highest);
+		__m256i index = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(norm, entries), half));
+		__m256i color = _mm256_i32gather_epi32((const int*)colors, index, 4);
+		_mm256_storeu_si256((__m256i*)(out + i), color);
+	}
+	fillRowScalar(strength + i, out + i, count - i, scale, colors);
+}
+
+#endif
+
+void FieldImage::rasterize(const FieldLevel& level, float scale, ThreadPool* pool) {
+	width = level.columns;
+	height = level.rows;
+	pixels.resize((size_t)width * height);
+
+	auto fill = fillRowScalar;
+#ifdef GRAVITY_X86
+	if (resolveKernelIsa(KernelIsa::AUTO) == KernelIsa::AVX2) fill = fillRowAvx2;
+#endif
+	const uint32_t* colors = FieldColormap::get().colors;
+
+	auto fillRows = [&](size_t begin, size_t end) {
+		for (size_t row = begin; row < end; row++) {
+			fill(&level.strength[row * width], &pixels[row * width], width, scale, colors);
+		}
+	};
+
+	if (!pool) {
+		fillRows(0, height);
+		return;
+	}
+	size_t tasks = (height + FIELD_RASTER_ROWS_PER_TASK - 1) / FIELD_RASTER_ROWS_PER_TASK;
+	pool->run(tasks, [&](size_t task, size_t) {
+		fillRows(task * FIELD_RASTER_ROWS_PER_TASK, std::min((size_t)height, (task + 1) * FIELD_RASTER_ROWS_PER_TASK));
+	});
+}
+
+bool FieldImage::writePpm(const std::string& path) const {
+	std::ofstream file(path, std::ios::binary);
+	if (!file) return false;
+
+	file << "P6\n" << width << " " << height << "\n255\n";
+	std::vector<unsigned char> row((size_t)width * 3);
+	for (int y = 0; y < height; y++) {
+		const unsigned char* rgba = (const unsigned char*)&pixels[(size_t)y * width];
+		for (int x = 0; x < width; x++) {
+			row[x * 3 + 0] = rgba[x * 4 + 0];
+			row[x * 3 + 1] = rgba[x * 4 + 1];
+			row[x * 3 + 2] = rgba[x * 4 + 2];
+		}
+		file.write((const char*)row.data(), row.size());
+	}
+	return (bool)file;
+}
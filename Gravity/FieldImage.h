@@ -0,0 +1,37 @@
+#pragma once
+#include "FieldSolver.h"
+#include "ThreadPool.h"
+#include <vector>
+#include <string>
+#include <cstdint>
+
+const int FIELD_SCALAR = 6;					// Default gravity field visualization sensitivity, strengths are scaled by its square
+const int FIELD_COLORMAP_SIZE = 4096;		// Entries of the colormap lookup table
+const float FIELD_MIN_NORMALIZED = 0.01f;	// Scaled strengths are clamped to [FIELD_MIN_NORMALIZED, 1]
+
+// Heatmap colors precomputed for evenly spaced normalized strengths, as RGBA8 in memory order
+struct FieldColormap {
+	uint32_t colors[FIELD_COLORMAP_SIZE];
+
+	FieldColormap();
+
+	// Shared table, built on first use
+	static const FieldColormap& get();
+};
+
+// Heatmap of a field level as RGBA8 pixels, one pixel per cell. The byte layout matches raylib's
+// PIXELFORMAT_UNCOMPRESSED_R8G8B8A8, so it can be uploaded as a texture or wrapped in an Image directly.
+struct FieldImage {
+	int width = 0;
+	int height = 0;
+	std::vector<uint32_t> pixels;			// Row-major, width * height
+
+	// Color every cell of "level" from its strength times "scale", in parallel over rows when a pool is given
+	void rasterize(const FieldLevel& level, float scale, ThreadPool* pool = nullptr);
+
+	// Start of the pixel data
+	const void* data() const { return pixels.data(); }
+
+	// Write the image as a binary PPM (alpha is dropped), returns false if the file can't be written
+	bool writePpm(const std::string& path) const;
+};
@@ -0,0 +1,122 @@
+#include "FieldSolver.h"
+#include "PhysicsThread.h"
+#include "Profiler.h"
+#include <cmath>
+#include <algorithm>
+
+void computeFieldLevel(const BodyArrays& bodies, const QuadTree& tree, FieldLevel& level, ThreadPool& pool) {
+	level.strength.assign((size_t)level.columns * level.rows, 0.0f);
+	pool.run(level.rows, [&](size_t row, size_t) {
+		float y = ((float)row + 0.5f) * level.cellSize;
+		float* out = &level.strength[row * level.columns];
+		for (int column = 0; column < level.columns; column++) {
+			float x = ((float)column + 0.5f) * level.cellSize;
+			out[column] = tree.fieldStrength(bodies, x, y, FIELD_THETA);
+		}
+	});
+}
+
+FieldSolver::FieldSolver(float finestCellSize, size_t threads) :
+	finest(std::max(finestCellSize, FIELD_MIN_CELL_SIZE)),
+	pool(threads > 0 ? threads : std::max<size_t>(1, ThreadPool::hardwareThreads() / 2))
+{
+	thread = std::thread(&FieldSolver::run, this);
+}
+
+FieldSolver::~FieldSolver() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+	}
+	wake.notify_one();
+	thread.join();
+}
+
+void FieldSolver::submit(const BodyArrays& source, unsigned long long step, Boundary boundary) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pending.x = source.x;
+		pending.y = source.y;
+		pending.m = source.m;
+		pendingStep = step;
+		pendingBoundary = boundary;
+		hasPending = true;
+	}
+	wake.notify_one();
+}
+
+std::shared_ptr<const FieldLevel> FieldSolver::latest() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return published;
+}
+
+void FieldSolver::setFinestCellSize(float cellSize) {
+	std::lock_guard<std::mutex> lock(mutex);
+	finest = std::max(cellSize, FIELD_MIN_CELL_SIZE);
+	published.reset();
+}
+
+float FieldSolver::finestCellSize() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return finest;
+}
+
+void FieldSolver::run() {
+	Profiler::get().nameThread("Field");
+	while (true) {
+		unsigned long long step = 0;
+		Boundary boundary = Boundary::PERIODIC;
+		float finestCell = FIELD_CELL_SIZE;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return hasPending || !running; });
+			if (!running) return;
+			std::swap(bodies.x, pending.x);
+			std::swap(bodies.y, pending.y);
+			std::swap(bodies.m, pending.m);
+			step = pendingStep;
+			boundary = pendingBoundary;
+			finestCell = finest;
+			hasPending = false;
+		}
+
+		tree.build(bodies, boundary);
+		passes++;
+
+		// Cell sizes finest * 2^k, evaluated from the coarsest down so a rough picture is ready quickly
+		std::vector<float> cellSizes;
+		for (float size = finestCell; ; size *= 2.0f) {
+			cellSizes.push_back(size);
+			if (size >= FIELD_COARSEST_CELL_SIZE) break;
+		}
+		std::reverse(cellSizes.begin(), cellSizes.end());
+
+		for (float cellSize : cellSizes) {
+			auto level = std::make_shared<FieldLevel>();
+			level->cellSize = cellSize;
+			level->columns = (int)std::ceil(SIM_WIDTH / cellSize);
+			level->rows = (int)std::ceil(SIM_HEIGHT / cellSize);
+			level->pass = passes;
+			level->step = step;
+			{
+				ProfileScope scope(Phase::FIELD_LEVEL);
+				computeFieldLevel(bodies, tree, *level, pool);
+			}
+			level->finishedAt = PhysicsThread::now();
+			publish(level);
+
+			// Stop refining if the finest size changed or the solver is shutting down
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!running || finest != finestCell) break;
+		}
+	}
+}
+
+void FieldSolver::publish(std::shared_ptr<const FieldLevel> level) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (level->cellSize < finest) return; // Computed for a finest size that has been changed since
+
+	bool finer = !published || level->cellSize <= published->cellSize;
+	bool stale = published && level->finishedAt - published->finishedAt > FIELD_STALE_SECONDS;
+	if (finer || stale) published = std::move(level);
+}
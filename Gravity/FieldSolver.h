@@ -0,0 +1,82 @@
+#pragma once
+#include "BodyArrays.h"
+#include "QuadTree.h"
+#include "ThreadPool.h"
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+
+const float FIELD_CELL_SIZE = 5.0f;				// Default size of the finest gravity field cell, in pixels
+const float FIELD_MIN_CELL_SIZE = 1.0f;			// Smallest supported cell, one cell per pixel
+const float FIELD_COARSEST_CELL_SIZE = 40.0f;	// Every pass starts from a level with cells at least this large
+const float FIELD_THETA = 0.5f;					// Opening angle for the far-field tree walk of every cell
+const double FIELD_STALE_SECONDS = 0.25;		// A shown level older than this is replaced even by a coarser one
+
+// One completed level of the gravity field: strength of gravitational acceleration at the center of every cell
+struct FieldLevel {
+	int columns = 0;
+	int rows = 0;
+	float cellSize = 0.0f;
+	unsigned long long pass = 0;		// Counts the body sets the worker has started on
+	unsigned long long step = 0;		// Simulation step the bodies were taken from
+	double finishedAt = 0.0;			// Wall clock time (seconds) when the level was completed
+	std::vector<float> strength;		// Row-major, columns * rows values
+
+	// Strength of the cell at (column, row)
+	float at(int column, int row) const { return strength[(size_t)row * columns + column]; }
+};
+
+// Evaluate every cell of "level" (columns, rows and cellSize set) from a tree built over "bodies", in parallel over rows
+void computeFieldLevel(const BodyArrays& bodies, const QuadTree& tree, FieldLevel& level, ThreadPool& pool);
+
+// Computes the gravity field on a background thread with progressive refinement. Every submitted body set is
+// evaluated coarse to fine, far-field contributions come from a Barnes-Hut tree walk per cell, and each
+// finished level is published so the renderer always has the latest complete level without waiting.
+struct FieldSolver {
+	// Start the worker, "threads" workers evaluate the rows of a level (0 uses half of the hardware threads)
+	explicit FieldSolver(float finestCellSize = FIELD_CELL_SIZE, size_t threads = 0);
+	~FieldSolver();
+
+	FieldSolver(const FieldSolver&) = delete;
+	FieldSolver& operator=(const FieldSolver&) = delete;
+
+	// Hand the worker a new body set, never blocks on the computation. If the worker is still busy,
+	// the previous submission that it has not started on yet is replaced.
+	void submit(const BodyArrays& bodies, unsigned long long step, Boundary boundary);
+
+	// Latest completed level, null before the first one is done. Safe to keep while the worker publishes more.
+	std::shared_ptr<const FieldLevel> latest() const;
+
+	// Change the size of the finest cells, clamped to FIELD_MIN_CELL_SIZE. Drops the published level.
+	void setFinestCellSize(float cellSize);
+
+	// Size of the finest cells
+	float finestCellSize() const;
+
+private:
+	mutable std::mutex mutex;
+	std::condition_variable wake;
+	BodyArrays pending;							// Latest submission, only positions and masses are copied
+	unsigned long long pendingStep = 0;
+	Boundary pendingBoundary = Boundary::PERIODIC;
+	bool hasPending = false;
+	bool running = true;
+	float finest;								// Guarded by mutex
+	std::shared_ptr<const FieldLevel> published;	// Guarded by mutex
+
+	// Owned by the worker thread
+	BodyArrays bodies;
+	QuadTree tree;
+	ThreadPool pool;
+	unsigned long long passes = 0;
+	std::thread thread;
+
+	// Worker main loop
+	void run();
+
+	// Publish a finished level if it is at least as fine as the shown one, or the shown one is stale
+	void publish(std::shared_ptr<const FieldLevel> level);
+};
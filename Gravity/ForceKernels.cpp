@@ -0,0 +1,513 @@
+#include "ForceKernels.h"
+#include "Simd.h"
+#include <cmath>
+
+#ifdef GRAVITY_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// <--- SCALAR --->
+
+// Reference kernel, also used for the tail that does not fill a whole SIMD register. Offsets are taken in Real,
+// the pair itself is computed in PairReal and summed in Real again (see Precision.h). Every kernel is a template
+// over the boundary policy (see Boundary.h), open space compiles without any wrap-around.
+template <typename Policy>
+static inline void accumulateRowScalar(const BodyArrays& bodies, size_t i, size_t jBegin, size_t jEnd, Real& ax, Real& ay) {
+	const Real xi = bodies.x[i];
+	const Real yi = bodies.y[i];
+	for (size_t j = jBegin; j < jEnd; j++) {
+		Real dx = Policy::offset(bodies.x[j] - xi, (Real)SIM_WIDTH, SIM_WIDTH_HALF);
+		Real dy = Policy::offset(bodies.y[j] - yi, (Real)SIM_HEIGHT, SIM_HEIGHT_HALF);
+		PairReal pairDx = (PairReal)dx;
+		PairReal pairDy = (PairReal)dy;
+		PairReal distanceSquared = (pairDx * pairDx) + (pairDy * pairDy);
+		if (distanceSquared < MIN_DISTANCE_SQUARED) continue; // Avoid division by zero, also skips body i itself
+
+		// F = G * m_i * m_j * d / |d|^3, G * m_i is applied once per row
+		PairReal inverseDistance = (PairReal)1 / std::sqrt(distanceSquared);
+		PairReal strength = (PairReal)bodies.m[j] * inverseDistance * inverseDistance * inverseDistance;
+		ax += strength * pairDx;
+		ay += strength * pairDy;
+	}
+}
+
+template <typename Policy>
+static void directForcesScalar(const BodyArrays& bodies, size_t begin, size_t end, Real* fx, Real* fy) {
+	const size_t count = bodies.size();
+	for (size_t i = begin; i < end; i++) {
+		Real ax = 0, ay = 0;
+		accumulateRowScalar<Policy>(bodies, i, 0, count, ax, ay);
+		fx[i] += G * bodies.m[i] * ax;
+		fy[i] += G * bodies.m[i] * ay;
+	}
+}
+
+// Symmetric pair loop over a tile, also used for the tail of the SIMD tile kernels
+template <typename Policy>
+static inline void accumulatePairsScalar(const BodyArrays& bodies, size_t i, size_t jBegin, size_t jEnd, Real* fx, Real* fy, Real& ax, Real& ay) {
+	const Real xi = bodies.x[i];
+	const Real yi = bodies.y[i];
+	const PairReal massG = (PairReal)(G * bodies.m[i]);
+	for (size_t j = jBegin; j < jEnd; j++) {
+		Real dx = Policy::offset(bodies.x[j] - xi, (Real)SIM_WIDTH, SIM_WIDTH_HALF);
+		Real dy = Policy::offset(bodies.y[j] - yi, (Real)SIM_HEIGHT, SIM_HEIGHT_HALF);
+		PairReal pairDx = (PairReal)dx;
+		PairReal pairDy = (PairReal)dy;
+		PairReal distanceSquared = (pairDx * pairDx) + (pairDy * pairDy);
+		if (distanceSquared < MIN_DISTANCE_SQUARED) continue; // Avoid division by zero
+
+		PairReal inverseDistance = (PairReal)1 / std::sqrt(distanceSquared);
+		PairReal strength = massG * (PairReal)bodies.m[j] * inverseDistance * inverseDistance * inverseDistance;
+		ax += strength * pairDx;
+		ay += strength * pairDy;
+		fx[j] -= strength * pairDx; // equal and opposite force
+		fy[j] -= strength * pairDy;
+	}
+}
+
+template <typename Policy>
+static void pairTileScalar(const BodyArrays& bodies, size_t iBegin, size_t iEnd, size_t jBegin, size_t jEnd, Real* fx, Real* fy) {
+	for (size_t i = iBegin; i < iEnd; i++) {
+		Real ax = 0, ay = 0;
+		accumulatePairsScalar<Policy>(bodies, i, (jBegin > i + 1) ? jBegin : i + 1, jEnd, fx, fy, ax, ay);
+		fx[i] += ax;
+		fy[i] += ay;
+	}
+}
+
+#ifdef GRAVITY_X86
+
+// The SIMD kernels are templates over a set of lanes, which loads body arrays in the build's Real type,
+// does the pair arithmetic in PairReal registers and keeps the sums in Real:
+//   Vec                          register of WIDTH pair values
+//   Sum                          running per-lane force sum
+//   set(v)                       broadcast a PairReal
+//   offsets(p, base)             p[0 .. WIDTH) - base, subtracted in Real and converted to PairReal
+//   load(p)                      p[0 .. WIDTH) converted to PairReal
+//   add, sub, mul, div, sqrt     lane-wise arithmetic
+//   greater, less, greaterEqual  lane-wise comparisons returning all-ones masks
+//   select(value, mask)          value where the mask is set, 0 elsewhere
+//   zero(), accumulate(sum, v)   start and add to a force sum
+//   total(sum)                   horizontal sum in Real
+//   subtractFrom(p, v)           p[0 .. WIDTH) -= v
+
+// <--- SSE --->
+
+GRAVITY_TARGET_SSE2 static inline float horizontalSum(__m128 v) {
+	__m128 shuffled = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+	__m128 sums = _mm_add_ps(v, shuffled);
+	shuffled = _mm_movehl_ps(shuffled, sums);
+	return _mm_cvtss_f32(_mm_add_ss(sums, shuffled));
+}
+
+GRAVITY_TARGET_SSE2 static inline double horizontalSum(__m128d v) {
+	return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+#if defined(GRAVITY_PRECISION_DOUBLE)
+
+// 2 double pairs at a time
+struct SseLanes {
+	typedef __m128d Vec;
+	typedef __m128d Sum;
+	static const size_t WIDTH = 2;
+	GRAVITY_TARGET_SSE2 static Vec set(PairReal v) { return _mm_set1_pd(v); }
+	GRAVITY_TARGET_SSE2 static Vec offsets(const Real* p, Real base) { return _mm_sub_pd(_mm_loadu_pd(p), _mm_set1_pd(base)); }
+	GRAVITY_TARGET_SSE2 static Vec load(const Real* p) { return _mm_loadu_pd(p); }
+	GRAVITY_TARGET_SSE2 static Vec add(Vec a, Vec b) { return _mm_add_pd(a, b); }
+	GRAVITY_TARGET_SSE2 static Vec sub(Vec a, Vec b) { return _mm_sub_pd(a, b); }
+	GRAVITY_TARGET_SSE2 static Vec mul(Vec a, Vec b) { return _mm_mul_pd(a, b); }
+	GRAVITY_TARGET_SSE2 static Vec div(Vec a, Vec b) { return _mm_div_pd(a, b); }
+	GRAVITY_TARGET_SSE2 static Vec sqrt(Vec a) { return _mm_sqrt_pd(a); }
+	GRAVITY_TARGET_SSE2 static Vec greater(Vec a, Vec b) { return _mm_cmpgt_pd(a, b); }
+	GRAVITY_TARGET_SSE2 static Vec less(Vec a, Vec b) { return _mm_cmplt_pd(a, b); }
+	GRAVITY_TARGET_SSE2 static Vec greaterEqual(Vec a, Vec b) { return _mm_cmpge_pd(a, b); }
+	GRAVITY_TARGET_SSE2 static Vec select(Vec value, Vec mask) { return _mm_and_pd(value, mask); }
+	GRAVITY_TARGET_SSE2 static Sum zero() { return _mm_setzero_pd(); }
+	GRAVITY_TARGET_SSE2 static Sum accumulate(Sum sum, Vec v) { return _mm_add_pd(sum, v); }
+	GRAVITY_TARGET_SSE2 static Real total(Sum sum) { return horizontalSum(sum); }
+	GRAVITY_TARGET_SSE2 static void subtractFrom(Real* p, Vec v) { _mm_storeu_pd(p, _mm_sub_pd(_mm_loadu_pd(p), v)); }
+};
+
+#elif defined(GRAVITY_PRECISION_MIXED)
+
+// 4 float pairs at a time from double arrays, summed in two double registers
+struct SseLanes {
+	struct Sum { __m128d low, high; };
+	typedef __m128 Vec;
+	static const size_t WIDTH = 4;
+	GRAVITY_TARGET_SSE2 static Vec set(PairReal v) { return _mm_set1_ps(v); }
+	GRAVITY_TARGET_SSE2 static Vec offsets(const Real* p, Real base) {
+		const __m128d b = _mm_set1_pd(base);
+		return _mm_movelh_ps(_mm_cvtpd_ps(_mm_sub_pd(_mm_loadu_pd(p), b)), _mm_cvtpd_ps(_mm_sub_pd(_mm_loadu_pd(p + 2), b)));
+	}
+	GRAVITY_TARGET_SSE2 static Vec load(const Real* p) { return _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(p)), _mm_cvtpd_ps(_mm_loadu_pd(p + 2))); }
+	GRAVITY_TARGET_SSE2 static Vec add(Vec a, Vec b) { return _mm_add_ps(a, b); }
+	GRAVITY_TARGET_SSE2 static Vec sub(Vec a, Vec b) { return _mm_sub_ps(a, b); }
+	GRAVITY_TARGET_SSE2 static Vec mul(Vec a, Vec b) { return _mm_mul_ps(a, b); }
+	GRAVITY_TARGET_SSE2 static Vec div(Vec a, Vec b) { return _mm_div_ps(a, b); }
+	GRAVITY_TARGET_SSE2 static Vec sqrt(Vec a) { return _mm_sqrt_ps(a); }
+	GRAVITY_TARGET_SSE2 static Vec greater(Vec a, Vec b) { return _mm_cmpgt_ps(a, b); }
+	GRAVITY_TARGET_SSE2 static Vec less(Vec a, Vec b) { return _mm_cmplt_ps(a, b); }
+	GRAVITY_TARGET_SSE2 static Vec greaterEqual(Vec a, Vec b) { return _mm_cmpge_ps(a, b); }
+	GRAVITY_TARGET_SSE2 static Vec select(Vec value, Vec mask) { return _mm_and_ps(value, mask); }
+	GRAVITY_TARGET_SSE2 static Sum zero() { return { _mm_setzero_pd(), _mm_setzero_pd() }; }
+	GRAVITY_TARGET_SSE2 static Sum accumulate(Sum sum, Vec v) { return { _mm_add_pd(sum.low, _mm_cvtps_pd(v)), _mm_add_pd(sum.high, _mm_cvtps_pd(_mm_movehl_ps(v, v))) }; }
+	GRAVITY_TARGET_SSE2 static Real total(Sum sum) { return horizontalSum(_mm_add_pd(sum.low, sum.high)); }
+	GRAVITY_TARGET_SSE2 static void subtractFrom(Real* p, Vec v) {
+		_mm_storeu_pd(p, _mm_sub_pd(_mm_loadu_pd(p), _mm_cvtps_pd(v)));
+		_mm_storeu_pd(p + 2, _mm_sub_pd(_mm_loadu_pd(p + 2), _mm_cvtps_pd(_mm_movehl_ps(v, v))));
+	}
+};
+
+#else
+
+// 4 float pairs at a time
+struct SseLanes {
+	typedef __m128 Vec;
+	typedef __m128 Sum;
+	static const size_t WIDTH = 4;
+	GRAVITY_TARGET_SSE2 static Vec set(PairReal v) { return _mm_set1_ps(v); }
+	GRAVITY_TARGET_SSE2 static Vec offsets(const Real* p, Real base) { return _mm_sub_ps(_mm_loadu_ps(p), _mm_set1_ps(base)); }
+	GRAVITY_TARGET_SSE2 static Vec load(const Real* p) { return _mm_loadu_ps(p); }
+	GRAVITY_TARGET_SSE2 static Vec add(Vec a, Vec b) { return _mm_add_ps(a, b); }
+	GRAVITY_TARGET_SSE2 static Vec sub(Vec a, Vec b) { return _mm_sub_ps(a, b); }
+	GRAVITY_TARGET_SSE2 static Vec mul(Vec a, Vec b) { return _mm_mul_ps(a, b); }
+	GRAVITY_TARGET_SSE2 static Vec div(Vec a, Vec b) { return _mm_div_ps(a, b); }
+	GRAVITY_TARGET_SSE2 static Vec sqrt(Vec a) { return _mm_sqrt_ps(a); }
+	GRAVITY_TARGET_SSE2 static Vec greater(Vec a, Vec b) { return _mm_cmpgt_ps(a, b); }
+	GRAVITY_TARGET_SSE2 static Vec less(Vec a, Vec b) { return _mm_cmplt_ps(a, b); }
+	GRAVITY_TARGET_SSE2 static Vec greaterEqual(Vec a, Vec b) { return _mm_cmpge_ps(a, b); }
+	GRAVITY_TARGET_SSE2 static Vec select(Vec value, Vec mask) { return _mm_and_ps(value, mask); }
+	GRAVITY_TARGET_SSE2 static Sum zero() { return _mm_setzero_ps(); }
+	GRAVITY_TARGET_SSE2 static Sum accumulate(Sum sum, Vec v) { return _mm_add_ps(sum, v); }
+	GRAVITY_TARGET_SSE2 static Real total(Sum sum) { return horizontalSum(sum); }
+	GRAVITY_TARGET_SSE2 static void subtractFrom(Real* p, Vec v) { _mm_storeu_ps(p, _mm_sub_ps(_mm_loadu_ps(p), v)); }
+};
+
+#endif
+
+// <--- AVX2 --->
+
+GRAVITY_TARGET_AVX2 static inline float horizontalSum(__m256 v) {
+	__m128 sums = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	__m128 shuffled = _mm_shuffle_ps(sums, sums, _MM_SHUFFLE(2, 3, 0, 1));
+	sums = _mm_add_ps(sums, shuffled);
+	shuffled = _mm_movehl_ps(shuffled, sums);
+	return _mm_cvtss_f32(_mm_add_ss(sums, shuffled));
+}
+
+GRAVITY_TARGET_AVX2 static inline double horizontalSum(__m256d v) {
+	__m128d sums = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+	return _mm_cvtsd_f64(_mm_add_sd(sums, _mm_unpackhi_pd(sums, sums)));
+}
+
+#if defined(GRAVITY_PRECISION_DOUBLE)
+
+// 4 double pairs at a time
+struct Avx2Lanes {
+	typedef __m256d Vec;
+	typedef __m256d Sum;
+	static const size_t WIDTH = 4;
+	GRAVITY_TARGET_AVX2 static Vec set(PairReal v) { return _mm256_set1_pd(v); }
+	GRAVITY_TARGET_AVX2 static Vec offsets(const Real* p, Real base) { return _mm256_sub_pd(_mm256_loadu_pd(p), _mm256_set1_pd(base)); }
+	GRAVITY_TARGET_AVX2 static Vec load(const Real* p) { return _mm256_loadu_pd(p); }
+	GRAVITY_TARGET_AVX2 static Vec add(Vec a, Vec b) { return _mm256_add_pd(a, b); }
+	GRAVITY_TARGET_AVX2 static Vec sub(Vec a, Vec b) { return _mm256_sub_pd(a, b); }
+	GRAVITY_TARGET_AVX2 static Vec mul(Vec a, Vec b) { return _mm256_mul_pd(a, b); }
+	GRAVITY_TARGET_AVX2 static Vec div(Vec a, Vec b) { return _mm256_div_pd(a, b); }
+	GRAVITY_TARGET_AVX2 static Vec sqrt(Vec a) { return _mm256_sqrt_pd(a); }
+	GRAVITY_TARGET_AVX2 static Vec greater(Vec a, Vec b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+	GRAVITY_TARGET_AVX2 static Vec less(Vec a, Vec b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+	GRAVITY_TARGET_AVX2 static Vec greaterEqual(Vec a, Vec b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+	GRAVITY_TARGET_AVX2 static Vec select(Vec value, Vec mask) { return _mm256_and_pd(value, mask); }
+	GRAVITY_TARGET_AVX2 static Sum zero() { return _mm256_setzero_pd(); }
+	GRAVITY_TARGET_AVX2 static Sum accumulate(Sum sum, Vec v) { return _mm256_add_pd(sum, v); }
+	GRAVITY_TARGET_AVX2 static Real total(Sum sum) { return horizontalSum(sum); }
+	GRAVITY_TARGET_AVX2 static void subtractFrom(Real* p, Vec v) { _mm256_storeu_pd(p, _mm256_sub_pd(_mm256_loadu_pd(p), v)); }
+};
+
+#elif defined(GRAVITY_PRECISION_MIXED)
+
+// 8 float pairs at a time from double arrays, summed in two double registers
+struct Avx2Lanes {
+	struct Sum { __m256d low, high; };
+	typedef __m256 Vec;
+	static const size_t WIDTH = 8;
+	GRAVITY_TARGET_AVX2 static Vec combine(__m256d low, __m256d high) { return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(low)), _mm256_cvtpd_ps(high), 1); }
+	GRAVITY_TARGET_AVX2 static Vec set(PairReal v) { return _mm256_set1_ps(v); }
+	GRAVITY_TARGET_AVX2 static Vec offsets(const Real* p, Real base) {
+		const __m256d b = _mm256_set1_pd(base);
+		return combine(_mm256_sub_pd(_mm256_loadu_pd(p), b), _mm256_sub_pd(_mm256_loadu_pd(p + 4), b));
+	}
+	GRAVITY_TARGET_AVX2 static Vec load(const Real* p) { return combine(_mm256_loadu_pd(p), _mm256_loadu_pd(p + 4)); }
+	GRAVITY_TARGET_AVX2 static Vec add(Vec a, Vec b) { return _mm256_add_ps(a, b); }
+	GRAVITY_TARGET_AVX2 static Vec sub(Vec a, Vec b) { return _mm256_sub_ps(a, b); }
+	GRAVITY_TARGET_AVX2 static Vec mul(Vec a, Vec b) { return _mm256_mul_ps(a, b); }
+	GRAVITY_TARGET_AVX2 static Vec div(Vec a, Vec b) { return _mm256_div_ps(a, b); }
+	GRAVITY_TARGET_AVX2 static Vec sqrt(Vec a) { return _mm256_sqrt_ps(a); }
+	GRAVITY_TARGET_AVX2 static Vec greater(Vec a, Vec b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+	GRAVITY_TARGET_AVX2 static Vec less(Vec a, Vec b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	GRAVITY_TARGET_AVX2 static Vec greaterEqual(Vec a, Vec b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+	GRAVITY_TARGET_AVX2 static Vec select(Vec value, Vec mask) { return _mm256_and_ps(value, mask); }
+	GRAVITY_TARGET_AVX2 static Sum zero() { return { _mm256_setzero_pd(), _mm256_setzero_pd() }; }
+	GRAVITY_TARGET_AVX2 static Sum accumulate(Sum sum, Vec v) {
+		return { _mm256_add_pd(sum.low, _mm256_cvtps_pd(_mm256_castps256_ps128(v))), _mm256_add_pd(sum.high, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1))) };
+	}
+	GRAVITY_TARGET_AVX2 static Real total(Sum sum) { return horizontalSum(_mm256_add_pd(sum.low, sum.high)); }
+	GRAVITY_TARGET_AVX2 static void subtractFrom(Real* p, Vec v) {
+		_mm256_storeu_pd(p, _mm256_sub_pd(_mm256_loadu_pd(p), _mm256_cvtps_pd(_mm256_castps256_ps128(v))));
+		_mm256_storeu_pd(p + 4, _mm256_sub_pd(_mm256_loadu_pd(p + 4), _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1))));
+	}
+};
+
+#else
+
+// 8 float pairs at a time
+struct Avx2Lanes {
+	typedef __m256 Vec;
+	typedef __m256 Sum;
+	static const size_t WIDTH = 8;
+	GRAVITY_TARGET_AVX2 static Vec set(PairReal v) { return _mm256_set1_ps(v); }
+	GRAVITY_TARGET_AVX2 static Vec offsets(const Real* p, Real base) { return _mm256_sub_ps(_mm256_loadu_ps(p), _mm256_set1_ps(base)); }
+	GRAVITY_TARGET_AVX2 static Vec load(const Real* p) { return _mm256_loadu_ps(p); }
+	GRAVITY_TARGET_AVX2 static Vec add(Vec a, Vec b) { return _mm256_add_ps(a, b); }
+	GRAVITY_TARGET_AVX2 static Vec sub(Vec a, Vec b) { return _mm256_sub_ps(a, b); }
+	GRAVITY_TARGET_AVX2 static Vec mul(Vec a, Vec b) { return _mm256_mul_ps(a, b); }
+	GRAVITY_TARGET_AVX2 static Vec div(Vec a, Vec b) { return _mm256_div_ps(a, b); }
+	GRAVITY_TARGET_AVX2 static Vec sqrt(Vec a) { return _mm256_sqrt_ps(a); }
+	GRAVITY_TARGET_AVX2 static Vec greater(Vec a, Vec b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+	GRAVITY_TARGET_AVX2 static Vec less(Vec a, Vec b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	GRAVITY_TARGET_AVX2 static Vec greaterEqual(Vec a, Vec b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+	GRAVITY_TARGET_AVX2 static Vec select(Vec value, Vec mask) { return _mm256_and_ps(value, mask); }
+	GRAVITY_TARGET_AVX2 static Sum zero() { return _mm256_setzero_ps(); }
+	GRAVITY_TARGET_AVX2 static Sum accumulate(Sum sum, Vec v) { return _mm256_add_ps(sum, v); }
+	GRAVITY_TARGET_AVX2 static Real total(Sum sum) { return horizontalSum(sum); }
+	GRAVITY_TARGET_AVX2 static void subtractFrom(Real* p, Vec v) { _mm256_storeu_ps(p, _mm256_sub_ps(_mm256_loadu_ps(p), v)); }
+};
+
+#endif
+
+// The kernels are written once over the lanes and stamped out per instruction set, since GCC and Clang need
+// the target attribute on the function that contains the intrinsics. Policy::WRAPS is a compile time constant,
+// so the wrap-around is folded away in the open instantiations.
+#define GRAVITY_DIRECT_FORCES_BODY(L)																				\
+	typedef typename L::Vec Vec;																					\
+	const size_t count = bodies.size();																				\
+	const size_t vectorEnd = count - count % L::WIDTH;																\
+	const Vec width = L::set((PairReal)SIM_WIDTH);																	\
+	const Vec height = L::set((PairReal)SIM_HEIGHT);																\
+	const Vec halfWidth = L::set((PairReal)SIM_WIDTH_HALF);															\
+	const Vec halfHeight = L::set((PairReal)SIM_HEIGHT_HALF);														\
+	const Vec negHalfWidth = L::set(-(PairReal)SIM_WIDTH_HALF);														\
+	const Vec negHalfHeight = L::set(-(PairReal)SIM_HEIGHT_HALF);													\
+	const Vec minDistance = L::set((PairReal)MIN_DISTANCE_SQUARED);													\
+	const Vec one = L::set((PairReal)1);																			\
+																													\
+	for (size_t i = begin; i < end; i++) {																			\
+		typename L::Sum ax = L::zero();																				\
+		typename L::Sum ay = L::zero();																				\
+																													\
+		for (size_t j = 0; j < vectorEnd; j += L::WIDTH) {															\
+			Vec dx = L::offsets(&bodies.x[j], bodies.x[i]);															\
+			Vec dy = L::offsets(&bodies.y[j], bodies.y[i]);															\
+																													\
+			/* Branchless wrap-around: subtract the width where dx > half, add it where dx < -half */				\
+			if (Policy::WRAPS) {																					\
+				dx = L::sub(dx, L::select(width, L::greater(dx, halfWidth)));										\
+				dx = L::add(dx, L::select(width, L::less(dx, negHalfWidth)));										\
+				dy = L::sub(dy, L::select(height, L::greater(dy, halfHeight)));										\
+				dy = L::add(dy, L::select(height, L::less(dy, negHalfHeight)));										\
+			}																										\
+																													\
+			Vec distanceSquared = L::add(L::mul(dx, dx), L::mul(dy, dy));											\
+			Vec inRange = L::greaterEqual(distanceSquared, minDistance);											\
+																													\
+			/* Full precision 1 / sqrt instead of rsqrt, this kernel is the exact reference */						\
+			Vec inverseDistance = L::div(one, L::sqrt(distanceSquared));											\
+			Vec inverseCubed = L::mul(inverseDistance, L::mul(inverseDistance, inverseDistance));					\
+			Vec strength = L::select(L::mul(L::load(&bodies.m[j]), inverseCubed), inRange);							\
+																													\
+			ax = L::accumulate(ax, L::mul(strength, dx));															\
+			ay = L::accumulate(ay, L::mul(strength, dy));															\
+		}																											\
+																													\
+		Real sumX = L::total(ax);																					\
+		Real sumY = L::total(ay);																					\
+		accumulateRowScalar<Policy>(bodies, i, vectorEnd, count, sumX, sumY);										\
+		fx[i] += G * bodies.m[i] * sumX;																			\
+		fy[i] += G * bodies.m[i] * sumY;																			\
+	}
+
+#define GRAVITY_PAIR_TILE_BODY(L)																					\
+	typedef typename L::Vec Vec;																					\
+	const Vec width = L::set((PairReal)SIM_WIDTH);																	\
+	const Vec height = L::set((PairReal)SIM_HEIGHT);																\
+	const Vec halfWidth = L::set((PairReal)SIM_WIDTH_HALF);															\
+	const Vec halfHeight = L::set((PairReal)SIM_HEIGHT_HALF);														\
+	const Vec negHalfWidth = L::set(-(PairReal)SIM_WIDTH_HALF);														\
+	const Vec negHalfHeight = L::set(-(PairReal)SIM_HEIGHT_HALF);													\
+	const Vec minDistance = L::set((PairReal)MIN_DISTANCE_SQUARED);													\
+	const Vec one = L::set((PairReal)1);																			\
+																													\
+	for (size_t i = iBegin; i < iEnd; i++) {																		\
+		const Vec massG = L::set((PairReal)(G * bodies.m[i]));														\
+		typename L::Sum ax = L::zero();																				\
+		typename L::Sum ay = L::zero();																				\
+																													\
+		size_t j = (jBegin > i + 1) ? jBegin : i + 1;																\
+		for (; j + L::WIDTH <= jEnd; j += L::WIDTH) {																\
+			Vec dx = L::offsets(&bodies.x[j], bodies.x[i]);															\
+			Vec dy = L::offsets(&bodies.y[j], bodies.y[i]);															\
+																													\
+			if (Policy::WRAPS) {																					\
+				dx = L::sub(dx, L::select(width, L::greater(dx, halfWidth)));										\
+				dx = L::add(dx, L::select(width, L::less(dx, negHalfWidth)));										\
+				dy = L::sub(dy, L::select(height, L::greater(dy, halfHeight)));										\
+				dy = L::add(dy, L::select(height, L::less(dy, negHalfHeight)));										\
+			}																										\
+																													\
+			Vec distanceSquared = L::add(L::mul(dx, dx), L::mul(dy, dy));											\
+			Vec inRange = L::greaterEqual(distanceSquared, minDistance);											\
+			Vec inverseDistance = L::div(one, L::sqrt(distanceSquared));											\
+			Vec inverseCubed = L::mul(inverseDistance, L::mul(inverseDistance, inverseDistance));					\
+			Vec strength = L::select(L::mul(L::mul(massG, L::load(&bodies.m[j])), inverseCubed), inRange);			\
+																													\
+			Vec forceX = L::mul(strength, dx);																		\
+			Vec forceY = L::mul(strength, dy);																		\
+			ax = L::accumulate(ax, forceX);																			\
+			ay = L::accumulate(ay, forceY);																			\
+			L::subtractFrom(&fx[j], forceX); /* equal and opposite force */											\
+			L::subtractFrom(&fy[j], forceY);																		\
+		}																											\
+																													\
+		Real sumX = L::total(ax);																					\
+		Real sumY = L::total(ay);																					\
+		accumulatePairsScalar<Policy>(bodies, i, j, jEnd, fx, fy, sumX, sumY);										\
+		fx[i] += sumX;																								\
+		fy[i] += sumY;																								\
+	}
+
+template <typename Lanes, typename Policy>
+GRAVITY_TARGET_SSE2 static void directForcesSse(const BodyArrays& bodies, size_t begin, size_t end, Real* fx, Real* fy) {
+	GRAVITY_DIRECT_FORCES_BODY(Lanes)
+}
+
+template <typename Lanes, typename Policy>
+GRAVITY_TARGET_SSE2 static void pairTileSse(const BodyArrays& bodies, size_t iBegin, size_t iEnd, size_t jBegin, size_t jEnd, Real* fx, Real* fy) {
+	GRAVITY_PAIR_TILE_BODY(Lanes)
+}
+
+template <typename Lanes, typename Policy>
+GRAVITY_TARGET_AVX2 static void directForcesAvx2(const BodyArrays& bodies, size_t begin, size_t end, Real* fx, Real* fy) {
+	GRAVITY_DIRECT_FORCES_BODY(Lanes)
+}
+
+template <typename Lanes, typename Policy>
+GRAVITY_TARGET_AVX2 static void pairTileAvx2(const BodyArrays& bodies, size_t iBegin, size_t iEnd, size_t jBegin, size_t jEnd, Real* fx, Real* fy) {
+	GRAVITY_PAIR_TILE_BODY(Lanes)
+}
+
+// <--- CPU DETECTION --->
+
+// Run the cpuid instruction for a leaf and subleaf
+static void cpuid(unsigned int leaf, unsigned int subleaf, unsigned int registers[4]) {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuidex(info, (int)leaf, (int)subleaf);
+	for (int k = 0; k < 4; k++) registers[k] = (unsigned int)info[k];
+#else
+	__cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+// AVX state must be enabled by the operating system as well as supported by the CPU
+static bool osSavesAvxState() {
+#ifdef _MSC_VER
+	unsigned long long xcr0 = _xgetbv(0);
+#else
+	unsigned int low, high;
+	__asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+	unsigned long long xcr0 = ((unsigned long long)high << 32) | low;
+#endif
+	return (xcr0 & 0x6) == 0x6;
+}
+
+KernelIsa detectKernelIsa() {
+	unsigned int registers[4];
+	cpuid(0, 0, registers);
+	unsigned int maxLeaf = registers[0];
+
+	cpuid(1, 0, registers);
+	bool sse2 = (registers[3] & (1u << 26)) != 0;
+	bool osxsave = (registers[2] & (1u << 27)) != 0;
+	bool avx = (registers[2] & (1u << 28)) != 0;
+
+	if (maxLeaf >= 7 && osxsave && avx && osSavesAvxState()) {
+		cpuid(7, 0, registers);
+		if (registers[1] & (1u << 5)) return KernelIsa::AVX2;
+	}
+	return sse2 ? KernelIsa::SSE : KernelIsa::SCALAR;
+}
+
+#else
+
+KernelIsa detectKernelIsa() {
+	return KernelIsa::SCALAR;
+}
+
+#endif
+
+KernelIsa resolveKernelIsa(KernelIsa isa) {
+	static const KernelIsa best = detectKernelIsa();
+	if (isa == KernelIsa::AUTO || (int)isa > (int)best) return best;
+	return isa;
+}
+
+template <typename Policy>
+static DirectForceKernel directForceKernelFor(KernelIsa isa) {
+	switch (resolveKernelIsa(isa)) {
+#ifdef GRAVITY_X86
+	case KernelIsa::AVX2: return directForcesAvx2<Avx2Lanes, Policy>;
+	case KernelIsa::SSE: return directForcesSse<SseLanes, Policy>;
+#endif
+	default: return directForcesScalar<Policy>;
+	}
+}
+
+template <typename Policy>
+static PairTileKernel pairTileKernelFor(KernelIsa isa) {
+	switch (resolveKernelIsa(isa)) {
+#ifdef GRAVITY_X86
+	case KernelIsa::AVX2: return pairTileAvx2<Avx2Lanes, Policy>;
+	case KernelIsa::SSE: return pairTileSse<SseLanes, Policy>;
+#endif
+	default: return pairTileScalar<Policy>;
+	}
+}
+
+// Reflective walls only change how bodies move, forces between them are the same as in open space,
+// so both share the open instantiations
+DirectForceKernel directForceKernel(KernelIsa isa, Boundary boundary) {
+	if (boundary == Boundary::PERIODIC) return directForceKernelFor<PeriodicBoundary>(isa);
+	return directForceKernelFor<OpenBoundary>(isa);
+}
+
+PairTileKernel pairTileKernel(KernelIsa isa, Boundary boundary) {
+	if (boundary == Boundary::PERIODIC) return pairTileKernelFor<PeriodicBoundary>(isa);
+	return pairTileKernelFor<OpenBoundary>(isa);
+}
+
+const char* kernelIsaName(KernelIsa isa) {
+	switch (isa) {
+	case KernelIsa::AUTO: return "Auto";
+	case KernelIsa::SCALAR: return "Scalar";
+	case KernelIsa::SSE: return "SSE";
+	case KernelIsa::AVX2: return "AVX2";
+	}
+	return "Unknown";
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "BodyArrays.h"
+#include <cstddef>
+
+// Instruction sets a direct summation kernel can be built for
+enum class KernelIsa {
+	AUTO,			// Best one supported by this CPU
+	SCALAR,			// Plain C++, works everywhere
+	SSE,			// 4 bodies at a time
+	AVX2			// 8 bodies at a time
+};
+
+// Direct summation kernel: adds the exact force exerted by every body on each body in [begin, end) to fx/fy.
+// Unlike the pairwise loop it does not use Newton's third law, so each row can be computed independently.
+// Every kernel computes pairs in PairReal and sums them in Real (see Precision.h).
+typedef void (*DirectForceKernel)(const BodyArrays& bodies, size_t begin, size_t end, Real* fx, Real* fy);
+
+// Pair tile kernel: for every pair (i, j) with i in [iBegin, iEnd), j in [jBegin, jEnd) and j > i, adds the force
+// to body i and the equal and opposite force to body j in fx/fy. Each pair is computed once, so a multithreaded
+// caller gives every worker its own fx/fy and reduces them afterwards.
+typedef void (*PairTileKernel)(const BodyArrays& bodies, size_t iBegin, size_t iEnd, size_t jBegin, size_t jEnd, Real* fx, Real* fy);
+
+// Best instruction set supported by this CPU and operating system
+KernelIsa detectKernelIsa();
+
+// Kernel for the requested instruction set and boundary, AUTO or an unsupported request falls back to the best supported one
+DirectForceKernel directForceKernel(KernelIsa isa, Boundary boundary);
+
+// Pair tile kernel for the requested instruction set and boundary, with the same fallback rules as directForceKernel
+PairTileKernel pairTileKernel(KernelIsa isa, Boundary boundary);
+
+// Instruction set that directForceKernel(isa) actually uses
+KernelIsa resolveKernelIsa(KernelIsa isa);
+
+// Name of an instruction set for display
+const char* kernelIsaName(KernelIsa isa);
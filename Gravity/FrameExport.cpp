@@ -0,0 +1,207 @@
+#include "FrameExport.h"
+#include "Png.h"
+#include <filesystem>
+#include <chrono>
+#include <algorithm>
+#include <fstream>
+#ifndef _WIN32
+#include <csignal>
+#endif
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+FrameExporter::~FrameExporter() {
+	if (!workers.empty()) close(nullptr);
+}
+
+bool FrameExporter::open(const ExportTarget& target, const FrameSettings& settings, size_t workerCount, std::string* error) {
+	this->target = target;
+	this->settings = settings;
+
+	if (!target.directory.empty()) {
+		std::error_code code;
+		std::filesystem::create_directories(target.directory, code);
+		if (code) {
+			if (error) *error = "Can't create " + target.directory + ": " + code.message();
+			return false;
+		}
+	}
+	else {
+#ifdef _WIN32
+		pipe = _popen(target.pipe.c_str(), "wb");
+#else
+		// A command that exits early should fail the export, not end the process
+		std::signal(SIGPIPE, SIG_IGN);
+		pipe = popen(target.pipe.c_str(), "w");
+#endif
+		if (!pipe) {
+			if (error) *error = "Can't start " + target.pipe;
+			return false;
+		}
+	}
+
+	if (workerCount == 0) workerCount = std::max(1u, std::thread::hardware_concurrency());
+	capacity = workerCount * EXPORT_FRAMES_PER_WORKER;
+	for (size_t i = 0; i < workerCount; i++) workers.emplace_back([this] { run(); });
+	return true;
+}
+
+bool FrameExporter::submit(const Simulation& sim) {
+	auto waitStart = std::chrono::steady_clock::now();
+	std::unique_lock<std::mutex> lock(mutex);
+	freed.wait(lock, [&] { return inFlight < capacity; });
+	totals.waitSeconds += secondsSince(waitStart);
+	if (failed) return false;
+
+	std::unique_ptr<Frame> frame;
+	if (!spare.empty()) {
+		frame = std::move(spare.back());
+		spare.pop_back();
+	}
+	else frame = std::make_unique<Frame>();
+	frame->index = submitted++;
+	inFlight++;
+	lock.unlock();
+
+	// The copy is the only part the simulation waits for, the frame is ours until it is queued
+	const BodyArrays& bodies = sim.bodies;
+	frame->bodies.x.assign(bodies.x.begin(), bodies.x.end());
+	frame->bodies.y.assign(bodies.y.begin(), bodies.y.end());
+	frame->bodies.vx.assign(bodies.vx.begin(), bodies.vx.end());
+	frame->bodies.vy.assign(bodies.vy.begin(), bodies.vy.end());
+	frame->bodies.m.assign(bodies.m.begin(), bodies.m.end());
+	frame->bodies.r.assign(bodies.r.begin(), bodies.r.end());
+	frame->bodies.fx.assign(bodies.size(), 0);
+	frame->bodies.fy.assign(bodies.size(), 0);
+	frame->boundary = sim.boundary;
+
+	lock.lock();
+	queue.push_back(std::move(frame));
+	wake.notify_one();
+	return true;
+}
+
+void FrameExporter::run() {
+	FrameRenderer renderer;
+	FrameCanvas canvas;
+	std::vector<unsigned char> png;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		wake.wait(lock, [&] { return stopping || !queue.empty(); });
+		if (queue.empty()) return;
+		std::unique_ptr<Frame> frame = std::move(queue.front());
+		queue.pop_front();
+		lock.unlock();
+
+		auto renderStart = std::chrono::steady_clock::now();
+		renderer.render(frame->bodies, frame->boundary, settings, canvas);
+		double renderSeconds = secondsSince(renderStart);
+
+		if (!target.directory.empty()) {
+			auto encodeStart = std::chrono::steady_clock::now();
+			char name[32];
+			std::snprintf(name, sizeof(name), "frame_%06llu.png", frame->index);
+			encodePng(canvas.pixels.data(), canvas.width, canvas.height, png);
+			std::filesystem::path path = std::filesystem::path(target.directory) / name;
+			std::ofstream file(path, std::ios::binary);
+			file.write((const char*)png.data(), png.size());
+			bool written = (bool)file;
+			double encodeSeconds = secondsSince(encodeStart);
+
+			lock.lock();
+			totals.renderSeconds += renderSeconds;
+			totals.encodeSeconds += encodeSeconds;
+			if (written) {
+				totals.frames++;
+				totals.bytes += png.size();
+			}
+			else if (!failed) {
+				failed = true;
+				failure = "Can't write " + path.string();
+			}
+			release(std::move(frame));
+		}
+		else {
+			// The canvas takes the frame's old buffer, so pixel buffers circulate instead of being allocated
+			frame->pixels.swap(canvas.pixels);
+			lock.lock();
+			totals.renderSeconds += renderSeconds;
+			unsigned long long index = frame->index;
+			rendered[index] = std::move(frame);
+			if (!writing) writeInOrder(lock);
+		}
+	}
+}
+
+void FrameExporter::writeInOrder(std::unique_lock<std::mutex>& lock) {
+	writing = true;
+	while (true) {
+		auto next = rendered.find(nextWrite);
+		if (next == rendered.end()) break;
+		std::unique_ptr<Frame> frame = std::move(next->second);
+		rendered.erase(next);
+		bool skip = failed;
+		lock.unlock();
+
+		auto writeStart = std::chrono::steady_clock::now();
+		size_t bytes = frame->pixels.size() * sizeof(uint32_t);
+		bool written = skip || std::fwrite(frame->pixels.data(), 1, bytes, pipe) == bytes;
+		double writeSeconds = secondsSince(writeStart);
+
+		lock.lock();
+		nextWrite++;
+		totals.encodeSeconds += writeSeconds;
+		if (!skip && written) {
+			totals.frames++;
+			totals.bytes += bytes;
+		}
+		else if (!failed) {
+			failed = true;
+			failure = "Writing to " + target.pipe + " failed";
+		}
+		release(std::move(frame));
+	}
+	writing = false;
+}
+
+void FrameExporter::release(std::unique_ptr<Frame> frame) {
+	spare.push_back(std::move(frame));
+	inFlight--;
+	freed.notify_all();
+}
+
+bool FrameExporter::close(std::string* error) {
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		freed.wait(lock, [&] { return inFlight == 0; });
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread& worker : workers) worker.join();
+	workers.clear();
+
+	if (pipe) {
+		std::fflush(pipe);
+#ifdef _WIN32
+		int status = _pclose(pipe);
+#else
+		int status = pclose(pipe);
+#endif
+		pipe = nullptr;
+		if (status != 0 && !failed) {
+			failed = true;
+			failure = target.pipe + " exited with status " + std::to_string(status);
+		}
+	}
+
+	if (failed && error) *error = failure;
+	return !failed;
+}
+
+ExportStats FrameExporter::stats() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return totals;
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include "FrameRender.h"
+#include "Simulation.h"
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <map>
+#include <deque>
+#include <cstdio>
+
+const int EXPORT_FRAMES_PER_WORKER = 2;		// Frames waiting or in progress per worker before submit() blocks
+
+// Where exported frames go: a numbered PNG sequence in a directory, or raw RGBA8 frames (width * height * 4 bytes
+// each, in order) written to the standard input of a command such as a video encoder
+struct ExportTarget {
+	std::string directory;		// Writes frame_000000.png, frame_000001.png ... if set
+	std::string pipe;			// Command started with popen() otherwise
+};
+
+// Totals of an export
+struct ExportStats {
+	unsigned long long frames = 0;		// Frames written
+	unsigned long long bytes = 0;		// Bytes written to files or the pipe
+	double renderSeconds = 0.0;			// Rendering time summed over workers
+	double encodeSeconds = 0.0;			// PNG encoding and file or pipe writing time summed over workers
+	double waitSeconds = 0.0;			// Time submit() spent waiting for a free slot, i.e. the simulation waited for the workers
+};
+
+// Offline frame pipeline. The simulation thread hands over copies of the bodies with submit(), which only waits when
+// the bounded queue is full; a pool of workers renders every frame into its own CPU canvas and encodes it, so the
+// frame rate is limited by the cores rather than a display. Frames for a pipe are written in order by whichever
+// worker finished the oldest pending one.
+struct FrameExporter {
+	FrameExporter() = default;
+	~FrameExporter();
+
+	FrameExporter(const FrameExporter&) = delete;
+	FrameExporter& operator=(const FrameExporter&) = delete;
+
+	// Create the directory or start the command and the workers (0 uses every hardware thread).
+	// Returns false and sets *error if the target can't be opened.
+	bool open(const ExportTarget& target, const FrameSettings& settings, size_t workerCount, std::string* error);
+
+	// Queue the current bodies of "sim" as the next frame. Returns false once a frame could not be written.
+	bool submit(const Simulation& sim);
+
+	// Wait for every queued frame and close the target, returns false and sets *error if any frame failed
+	bool close(std::string* error);
+
+	// Totals so far, complete after close()
+	ExportStats stats() const;
+
+private:
+	struct Frame {
+		unsigned long long index = 0;
+		BodyArrays bodies;
+		Boundary boundary = Boundary::PERIODIC;
+		std::vector<uint32_t> pixels;	// Rendered image, for the pipe
+	};
+
+	ExportTarget target;
+	FrameSettings settings;
+	FILE* pipe = nullptr;
+	size_t capacity = 0;
+
+	mutable std::mutex mutex;
+	std::condition_variable wake;		// Workers wait for frames
+	std::condition_variable freed;		// submit() and close() wait for a slot
+	std::deque<std::unique_ptr<Frame>> queue;			// Frames to render, oldest first
+	std::vector<std::unique_ptr<Frame>> spare;			// Finished frames whose buffers are reused
+	std::map<unsigned long long, std::unique_ptr<Frame>> rendered;	// Frames waiting for their turn in the pipe
+	unsigned long long submitted = 0;
+	unsigned long long nextWrite = 0;	// Next frame the pipe expects
+	size_t inFlight = 0;				// Frames submitted and not yet written
+	bool writing = false;				// A worker is writing to the pipe
+	bool stopping = false;
+	bool failed = false;
+	std::string failure;
+	ExportStats totals;
+	std::vector<std::thread> workers;
+
+	// Worker main loop
+	void run();
+
+	// Write the rendered frames that are next in line to the pipe, called with the lock held by "lock"
+	void writeInOrder(std::unique_lock<std::mutex>& lock);
+
+	// Return a finished frame's slot
+	void release(std::unique_ptr<Frame> frame);
+};
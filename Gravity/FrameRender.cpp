@@ -0,0 +1,239 @@
+#include "FrameRender.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+// Colors of the GUI (see Main.cpp and Renderer.h)
+static const uint32_t FRAME_BACKGROUND = frameColor(0x02, 0x02, 0x02);
+static const uint32_t FRAME_BODY = frameColor(0xC9, 0xC9, 0xC9);
+static const uint32_t FRAME_LABEL_TEXT = frameColor(0xE0, 0xE0, 0xE0);
+static const uint32_t FRAME_BLACK = frameColor(0, 0, 0);
+static const uint32_t FRAME_WHITE = frameColor(0xFF, 0xFF, 0xFF);
+static const uint32_t FRAME_RED = frameColor(0xE6, 0x29, 0x37);
+static const uint32_t FRAME_BLUE = frameColor(0x00, 0x79, 0xF1);
+
+uint32_t frameColor(unsigned char r, unsigned char g, unsigned char b) {
+	unsigned char bytes[4] = { r, g, b, 255 };
+	uint32_t packed;
+	std::memcpy(&packed, bytes, sizeof(packed));
+	return packed;
+}
+
+// <--- CANVAS --->
+
+void FrameCanvas::clear(int newWidth, int newHeight, uint32_t color) {
+	width = newWidth;
+	height = newHeight;
+	pixels.assign((size_t)width * height, color);
+}
+
+void FrameCanvas::blend(int x, int y, uint32_t color, float opacity) {
+	if (x < 0 || y < 0 || x >= width || y >= height || opacity <= 0.0f) return;
+	uint32_t& pixel = pixels[(size_t)y * width + x];
+	if (opacity >= 1.0f) {
+		pixel = color;
+		return;
+	}
+	unsigned char to[4], from[4];
+	std::memcpy(to, &pixel, 4);
+	std::memcpy(from, &color, 4);
+	for (int c = 0; c < 3; c++) to[c] = (unsigned char)(to[c] + (from[c] - to[c]) * opacity + 0.5f);
+	std::memcpy(&pixel, to, 4);
+}
+
+void FrameCanvas::blit(const FieldImage& image, float x, float y, float w, float h) {
+	if (image.width == 0 || image.height == 0) return;
+	const int left = std::max(0, (int)std::floor(x));
+	const int top = std::max(0, (int)std::floor(y));
+	const int right = std::min(width, (int)std::ceil(x + w));
+	const int bottom = std::min(height, (int)std::ceil(y + h));
+	for (int py = top; py < bottom; py++) {
+		int row = std::min((int)((py + 0.5f - y) / h * image.height), image.height - 1);
+		for (int px = left; px < right; px++) {
+			int column = std::min((int)((px + 0.5f - x) / w * image.width), image.width - 1);
+			pixels[(size_t)py * width + px] = image.pixels[(size_t)row * image.width + column];
+		}
+	}
+}
+
+void FrameCanvas::fillCircle(float x, float y, float radius, uint32_t color, float opacity) {
+	// Circles smaller than a pixel fade out with their area instead of vanishing
+	if (radius < 0.5f) {
+		opacity *= radius * radius * 4.0f;
+		radius = 0.5f;
+	}
+	const int left = std::max(0, (int)std::floor(x - radius - 1.0f));
+	const int top = std::max(0, (int)std::floor(y - radius - 1.0f));
+	const int right = std::min(width - 1, (int)std::ceil(x + radius + 1.0f));
+	const int bottom = std::min(height - 1, (int)std::ceil(y + radius + 1.0f));
+	for (int py = top; py <= bottom; py++) {
+		float dy = py + 0.5f - y;
+		for (int px = left; px <= right; px++) {
+			float dx = px + 0.5f - x;
+			float coverage = std::clamp(radius + 0.5f - std::sqrt(dx * dx + dy * dy), 0.0f, 1.0f);
+			if (coverage > 0.0f) blend(px, py, color, coverage * opacity);
+		}
+	}
+}
+
+void FrameCanvas::fillRect(float x, float y, float w, float h, uint32_t color, float opacity) {
+	const int left = std::max(0, (int)std::lround(x));
+	const int top = std::max(0, (int)std::lround(y));
+	const int right = std::min(width, (int)std::lround(x + w));
+	const int bottom = std::min(height, (int)std::lround(y + h));
+	for (int py = top; py < bottom; py++) {
+		for (int px = left; px < right; px++) blend(px, py, color, opacity);
+	}
+}
+
+void FrameCanvas::drawLine(float x0, float y0, float x1, float y1, float thickness, uint32_t color) {
+	// Square stamps every pixel along the line
+	const float length = std::sqrt((x1 - x0) * (x1 - x0) + (y1 - y0) * (y1 - y0));
+	const int samples = (int)std::ceil(length) + 1;
+	for (int k = 0; k < samples; k++) {
+		float t = samples > 1 ? (float)k / (samples - 1) : 0.0f;
+		fillRect(x0 + (x1 - x0) * t - thickness / 2.0f, y0 + (y1 - y0) * t - thickness / 2.0f, thickness, thickness, color);
+	}
+}
+
+// Rows of a 5 x 7 glyph top to bottom, the most significant of the 5 bits is the leftmost pixel
+static const unsigned char* glyph(char c) {
+	static const unsigned char DIGITS[10][FRAME_GLYPH_HEIGHT] = {
+		{ 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E }, { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E },
+		{ 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F }, { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E },
+		{ 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 }, { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E },
+		{ 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E }, { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },
+		{ 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E }, { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C },
+	};
+	static const unsigned char DOT[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C };
+	static const unsigned char PLUS[] = { 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 };
+	static const unsigned char MINUS[] = { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 };
+	static const unsigned char COLON[] = { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 };
+	static const unsigned char E[] = { 0x00, 0x00, 0x0E, 0x11, 0x1F, 0x10, 0x0E };
+	static const unsigned char M[] = { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 };
+	static const unsigned char V[] = { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 };
+
+	if (c >= '0' && c <= '9') return DIGITS[c - '0'];
+	switch (c) {
+	case '.': return DOT;
+	case '+': return PLUS;
+	case '-': return MINUS;
+	case ':': return COLON;
+	case 'e': return E;
+	case 'M': return M;
+	case 'V': return V;
+	default: return nullptr;
+	}
+}
+
+void FrameCanvas::drawText(float x, float y, const char* text, int scale, uint32_t color) {
+	const int left = (int)std::lround(x);
+	const int top = (int)std::lround(y);
+	for (int k = 0; text[k] != '\0'; k++) {
+		const unsigned char* rows = glyph(text[k]);
+		if (!rows) continue;
+		const int glyphLeft = left + k * (FRAME_GLYPH_WIDTH + 1) * scale;
+		for (int row = 0; row < FRAME_GLYPH_HEIGHT; row++) {
+			for (int column = 0; column < FRAME_GLYPH_WIDTH; column++) {
+				if (!(rows[row] & (0x10 >> column))) continue;
+				fillRect((float)(glyphLeft + column * scale), (float)(top + row * scale), (float)scale, (float)scale, color);
+			}
+		}
+	}
+}
+
+int FrameCanvas::textWidth(const char* text, int scale) {
+	int length = (int)std::strlen(text);
+	return length > 0 ? (length * (FRAME_GLYPH_WIDTH + 1) - 1) * scale : 0;
+}
+
+// <--- FRAMES --->
+
+void FrameRenderer::render(const BodyArrays& bodies, Boundary boundary, const FrameSettings& settings, FrameCanvas& canvas) {
+	canvas.clear(settings.width, settings.height, FRAME_BACKGROUND);
+	const float scale = std::min((float)settings.width / SIM_WIDTH, (float)settings.height / SIM_HEIGHT);
+	const float originX = (settings.width - SIM_WIDTH * scale) / 2.0f;
+	const float originY = (settings.height - SIM_HEIGHT * scale) / 2.0f;
+
+	if (settings.field && bodies.size() > 0) {
+		tree.build(bodies, boundary);
+		level.cellSize = settings.fieldCellSize;
+		level.columns = (int)std::ceil(SIM_WIDTH / level.cellSize);
+		level.rows = (int)std::ceil(SIM_HEIGHT / level.cellSize);
+		computeFieldLevel(bodies, tree, level, pool);
+		fieldImage.rasterize(level, (float)(settings.fieldScalar * settings.fieldScalar));
+		canvas.blit(fieldImage, originX, originY, level.columns * level.cellSize * scale, level.rows * level.cellSize * scale);
+	}
+
+	if (settings.bodies) {
+		for (size_t i = 0; i < bodies.size(); i++) {
+			canvas.fillCircle(originX + bodies.x[i] * scale, originY + bodies.y[i] * scale, bodies.r[i] * scale, FRAME_BODY);
+		}
+	}
+
+	if (settings.vectors) {
+		const float thickness = std::max(1.0f, scale);
+		for (size_t i = 0; i < bodies.size(); i++) {
+			float x = originX + bodies.x[i] * scale;
+			float y = originY + bodies.y[i] * scale;
+			float vx = bodies.vx[i] * settings.vectorScalar * scale;
+			float vy = bodies.vy[i] * settings.vectorScalar * scale;
+
+			// Each component of the velocity and the velocity, like the GUI
+			canvas.drawLine(x, y, x + vx, y, thickness, FRAME_RED);
+			canvas.drawLine(x, y, x, y + vy, thickness, FRAME_BLUE);
+			canvas.drawLine(x, y, x + vx, y + vy, thickness, FRAME_WHITE);
+		}
+	}
+
+	if (settings.labels) drawLabels(bodies, scale, originX, originY, canvas);
+}
+
+void FrameRenderer::drawLabels(const BodyArrays& bodies, float scale, float originX, float originY, FrameCanvas& canvas) {
+	const int fontScale = std::max(1, (int)std::lround(FRAME_FONT_SCALE * scale));
+	const float boxHeight = (float)(FRAME_GLYPH_HEIGHT + 4) * fontScale;
+	const float offset = FRAME_LABEL_OFFSET * scale;
+
+	// Heaviest bodies get the first chance at a label
+	order.resize(bodies.size());
+	for (size_t i = 0; i < order.size(); i++) order[i] = i;
+	size_t count = std::min(order.size(), (size_t)FRAME_MAX_LABELS);
+	std::partial_sort(order.begin(), order.begin() + count, order.end(), [&](size_t a, size_t b) { return bodies.m[a] > bodies.m[b]; });
+	placed.clear();
+
+	for (size_t k = 0; k < count; k++) {
+		const size_t i = order[k];
+		const float x = originX + bodies.x[i] * scale;
+		const float y = originY + bodies.y[i] * scale;
+		if (x < 0.0f || y < 0.0f || x >= canvas.width || y >= canvas.height) continue;
+
+		char text[48];
+		std::snprintf(text, sizeof(text), "M: %.2e V: %.2e", (double)bodies.m[i], std::sqrt((double)bodies.vx[i] * bodies.vx[i] + (double)bodies.vy[i] * bodies.vy[i]));
+		const float width = (float)(FrameCanvas::textWidth(text, fontScale) + 4 * fontScale);
+		const float radius = bodies.r[i] * scale;
+
+		// Up and to the right of the body, flipped left and/or down where that would leave the image
+		const bool flipX = x + radius + offset + width > canvas.width;
+		const bool flipY = y - radius - offset - boxHeight < 0.0f;
+		const float startX = x + (flipX ? -radius : radius);
+		const float startY = y + (flipY ? radius : -radius);
+		const float endX = startX + (flipX ? -offset : offset);
+		const float endY = startY + (flipY ? offset : -offset);
+		const Box box = { flipX ? endX - width : endX, flipY ? endY : endY - boxHeight, width, boxHeight };
+
+		bool overlaps = false;
+		for (const Box& other : placed) {
+			if (box.x < other.x + other.width && other.x < box.x + box.width && box.y < other.y + other.height && other.y < box.y + box.height) {
+				overlaps = true;
+				break;
+			}
+		}
+		if (overlaps) continue;
+		placed.push_back(box);
+
+		canvas.drawLine(startX, startY, endX, endY, std::max(1.0f, scale), FRAME_WHITE);
+		canvas.fillRect(box.x, box.y, box.width, box.height, FRAME_BLACK, 0.5f);
+		canvas.drawText(box.x + 2 * fontScale, box.y + 2 * fontScale, text, fontScale, FRAME_LABEL_TEXT);
+	}
+}
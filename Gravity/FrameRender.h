@@ -0,0 +1,87 @@
+#pragma once
+#include "BodyArrays.h"
+#include "FieldSolver.h"
+#include "FieldImage.h"
+#include "QuadTree.h"
+#include "ThreadPool.h"
+#include <vector>
+#include <cstdint>
+
+const int FRAME_MAX_LABELS = 256;			// Labels considered per frame, heaviest bodies first, like the GUI
+const float FRAME_LABEL_OFFSET = 20.0f;		// Distance from a body's edge to its label, in simulation units
+const int FRAME_GLYPH_WIDTH = 5;			// Size of the built-in font's glyphs in font pixels, one more column between glyphs
+const int FRAME_GLYPH_HEIGHT = 7;
+const float FRAME_FONT_SCALE = 2.0f;		// Font pixels per simulation unit, so labels grow with the image
+
+// Layers and sizes of an offline frame. The whole SIM_WIDTH x SIM_HEIGHT space is scaled to fit the image
+// and centered, colors match the GUI.
+struct FrameSettings {
+	int width = SIM_WIDTH;				// Image size in pixels
+	int height = SIM_HEIGHT;
+	bool field = false;					// Gravity field heatmap under the bodies
+	bool bodies = true;
+	bool vectors = false;				// Velocity vectors
+	bool labels = true;					// Mass and speed of the heaviest bodies
+	int vectorScalar = 50;				// Scalar to draw vectors at visible lengths
+	int fieldScalar = FIELD_SCALAR;		// Field sensitivity, strengths are scaled by its square
+	float fieldCellSize = FIELD_CELL_SIZE;	// Field cell size in simulation units
+};
+
+// RGBA8 image in memory order (like FieldImage) with the few primitives a frame needs, all clipped to the image
+// and blended in software, so frames render on machines without a display or GPU
+struct FrameCanvas {
+	int width = 0;
+	int height = 0;
+	std::vector<uint32_t> pixels;		// Row-major, width * height
+
+	// Resize and fill with one color
+	void clear(int width, int height, uint32_t color);
+
+	// Scale an image over the rectangle (x, y, w, h) without filtering
+	void blit(const FieldImage& image, float x, float y, float w, float h);
+
+	// Filled circle with an anti-aliased edge, "opacity" 0 to 1
+	void fillCircle(float x, float y, float radius, uint32_t color, float opacity = 1.0f);
+
+	// Filled rectangle blended with "opacity"
+	void fillRect(float x, float y, float w, float h, uint32_t color, float opacity = 1.0f);
+
+	// Line of the given thickness in pixels
+	void drawLine(float x0, float y0, float x1, float y1, float thickness, uint32_t color);
+
+	// Text in the built-in font with glyph pixels "scale" pixels wide, top left at (x, y). Digits, '.', '+', '-', ':',
+	// 'e', 'M', 'V' and space are defined, anything else is left blank.
+	void drawText(float x, float y, const char* text, int scale, uint32_t color);
+
+	// Width in pixels of drawText's output
+	static int textWidth(const char* text, int scale);
+
+private:
+	// Blend a color into one pixel, skipped outside the image
+	void blend(int x, int y, uint32_t color, float opacity);
+};
+
+// Pack an opaque color into RGBA8 memory order
+uint32_t frameColor(unsigned char r, unsigned char g, unsigned char b);
+
+// Draws frames of body sets into a canvas. Holds the tree and buffers the field layer needs, so one renderer per
+// thread renders frame after frame without allocating.
+struct FrameRenderer {
+	// Render "bodies" (positions, velocities, masses and radii) with the layers of "settings"
+	void render(const BodyArrays& bodies, Boundary boundary, const FrameSettings& settings, FrameCanvas& canvas);
+
+private:
+	QuadTree tree;
+	FieldLevel level;
+	FieldImage fieldImage;
+	ThreadPool pool{ 1 };				// The field runs on the calling thread, frames are rendered in parallel instead
+	std::vector<size_t> order;			// Bodies by label priority
+
+	struct Box {
+		float x, y, width, height;
+	};
+	std::vector<Box> placed;			// Label boxes drawn this frame
+
+	// Mass and speed labels of the heaviest bodies that fit without overlapping each other
+	void drawLabels(const BodyArrays& bodies, float scale, float originX, float originY, FrameCanvas& canvas);
+};
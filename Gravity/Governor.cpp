@@ -0,0 +1,207 @@
+#include "Governor.h"
+#include "Profiler.h"
+#include "FieldSolver.h"
+#include <algorithm>
+#include <cstdio>
+
+QualityCosts QualityCosts::measure(double stepPeriod, bool fieldShown, bool labelsShown) {
+	const Profiler& profiler = Profiler::get();
+	QualityCosts costs;
+	costs.frame = std::max(0.0, (double)profiler.stats(Phase::FRAME).last - profiler.stats(Phase::PRESENT).last);
+	costs.labels = labelsShown ? profiler.stats(Phase::LABELS).last : 0.0;
+	costs.fieldDraw = fieldShown ? profiler.stats(Phase::FIELD_DRAW).last : 0.0;
+	costs.fieldLevel = fieldShown ? profiler.stats(Phase::FIELD_LEVEL).last : 0.0;
+	if (stepPeriod > 0.0) {
+		costs.step = profiler.stats(Phase::STEP).last;
+		costs.stepPeriod = stepPeriod * 1000.0;
+	}
+	return costs;
+}
+
+bool QualityGovernor::update(const QualityCosts& costs, Solver solver, double now) {
+	if (!averaged) {
+		average = costs;
+		averaged = true;
+		nextDecision = now + GOVERNOR_INTERVAL; // Average over a whole interval before the first decision
+	}
+	else {
+		auto blend = [](double& average, double sample) { average += GOVERNOR_SMOOTHING * (sample - average); };
+		blend(average.frame, costs.frame);
+		blend(average.labels, costs.labels);
+		blend(average.fieldDraw, costs.fieldDraw);
+		blend(average.fieldLevel, costs.fieldLevel);
+		blend(average.step, costs.step);
+		average.stepPeriod = costs.stepPeriod; // Set by the governor itself, not noisy
+	}
+	if (isLocked) return false;
+
+	// Step costs change with the solver and its knob means something else, so start the physics knobs over
+	if (solver != lastSolver) {
+		lastSolver = solver;
+		exhausted[(int)QualityKnob::SOLVER_ACCURACY] = false;
+		exhausted[(int)QualityKnob::SUBSTEPS] = false;
+		probe = QualityKnob::COUNT;
+		if (notch(QualityKnob::SOLVER_ACCURACY) > 0) {
+			reset(QualityKnob::SOLVER_ACCURACY);
+			decision = std::string(qualityKnobName(QualityKnob::SOLVER_ACCURACY)) + " reset for the new solver";
+			return true;
+		}
+	}
+	if (now < nextDecision) return false;
+	nextDecision = now + GOVERNOR_INTERVAL;
+
+	const bool physics = average.stepPeriod > 0.0;
+	const double stepLimit = average.stepPeriod * GOVERNOR_PHYSICS_LOAD;
+
+	// A physics knob lowered at the last decision must have made stepping cheaper, or it is taken back
+	if (probe != QualityKnob::COUNT) {
+		QualityKnob knob = probe;
+		probe = QualityKnob::COUNT;
+		if (physics && physicsLoad() >= probeLoad) {
+			notches[(int)knob]--;
+			lowered.pop_back();
+			exhausted[(int)knob] = true;
+			nextRaise = now + GOVERNOR_RAISE_DELAY;
+			char text[96];
+			std::snprintf(text, sizeof(text), "%s taken back: step load %.0f%%, was %.0f%%", qualityKnobName(knob), 100.0 * physicsLoad(), 100.0 * probeLoad);
+			decision = text;
+			return true;
+		}
+	}
+
+	const bool frameOver = average.frame > budget;
+	const bool stepOver = physics && average.step > stepLimit;
+
+	if (frameOver) {
+		// The render knob whose phase costs the most, if any takes a noticeable share of the frame
+		const std::pair<QualityKnob, double> render[] = {
+			{ QualityKnob::LABELS, average.labels },
+			{ QualityKnob::FIELD_CELL, average.fieldDraw },
+			{ QualityKnob::FIELD_REFRESH, average.fieldLevel / fieldInterval() },
+		};
+		QualityKnob knob = QualityKnob::COUNT;
+		double largest = budget * GOVERNOR_MIN_SHARE;
+		for (const auto& [candidate, cost] : render) {
+			if (!canLower(candidate) || cost <= largest) continue;
+			knob = candidate;
+			largest = cost;
+		}
+		if (knob != QualityKnob::COUNT) {
+			lower(knob, now, "frame", average.frame, budget);
+			return true;
+		}
+		// Otherwise the physics threads, which share the cores with the renderer, are the ones to lighten
+	}
+
+	if (physics && (frameOver || stepOver)) {
+		const char* reason = stepOver ? "step" : "frame";
+		const double cost = stepOver ? average.step : average.frame;
+		const double limit = stepOver ? stepLimit : budget;
+		if (solver != Solver::DIRECT && solver != Solver::P3M && canLower(QualityKnob::SOLVER_ACCURACY)) {
+			lower(QualityKnob::SOLVER_ACCURACY, now, reason, cost, limit);
+			return true;
+		}
+		if (!fixedTimestep && canLower(QualityKnob::SUBSTEPS)) {
+			lower(QualityKnob::SUBSTEPS, now, reason, cost, limit);
+			return true;
+		}
+		return false;
+	}
+	if (frameOver) return false;
+
+	// Headroom on both sides: give back what was taken last
+	bool headroom = average.frame < budget * GOVERNOR_HEADROOM && (!physics || average.step < stepLimit * GOVERNOR_HEADROOM);
+	if (lowered.empty() || now < nextRaise || !headroom) return false;
+	raise(now);
+	return true;
+}
+
+bool QualityGovernor::setLocked(bool lock) {
+	if (lock == isLocked) return false;
+	isLocked = lock;
+	decision = lock ? "Locked to the chosen settings" : "Full quality";
+	std::fill(std::begin(exhausted), std::end(exhausted), false);
+	probe = QualityKnob::COUNT;
+	if (!lock || lowered.empty()) return false;
+	std::fill(std::begin(notches), std::end(notches), 0);
+	lowered.clear();
+	return true;
+}
+
+bool QualityGovernor::canLower(QualityKnob knob) const {
+	return !exhausted[(int)knob] && notch(knob) < qualityKnobNotches(knob);
+}
+
+void QualityGovernor::lower(QualityKnob knob, double now, const char* reason, double cost, double limit) {
+	notches[(int)knob]++;
+	lowered.push_back(knob);
+	nextRaise = now + GOVERNOR_RAISE_DELAY;
+	if (knob == QualityKnob::SOLVER_ACCURACY || knob == QualityKnob::SUBSTEPS) {
+		probe = knob;
+		probeLoad = physicsLoad();
+	}
+
+	char text[96];
+	std::snprintf(text, sizeof(text), "%s lowered: %s %.1f of %.1f ms", qualityKnobName(knob), reason, cost, limit);
+	decision = text;
+}
+
+void QualityGovernor::reset(QualityKnob knob) {
+	notches[(int)knob] = 0;
+	lowered.erase(std::remove(lowered.begin(), lowered.end(), knob), lowered.end());
+}
+
+void QualityGovernor::raise(double now) {
+	QualityKnob knob = lowered.back();
+	lowered.pop_back();
+	notches[(int)knob]--;
+	nextRaise = now + GOVERNOR_RAISE_DELAY;
+	decision = std::string(qualityKnobName(knob)) + " raised";
+}
+
+int QualityGovernor::labelLimit(int userLimit) const {
+	return userLimit >> (2 * notch(QualityKnob::LABELS));
+}
+
+float QualityGovernor::fieldCellSize(float userCellSize) const {
+	return std::min(userCellSize * (float)(1 << notch(QualityKnob::FIELD_CELL)), std::max(userCellSize, FIELD_COARSEST_CELL_SIZE));
+}
+
+unsigned long long QualityGovernor::fieldInterval() const {
+	return 1ull << notch(QualityKnob::FIELD_REFRESH);
+}
+
+float QualityGovernor::theta(float userTheta) const {
+	if (notch(QualityKnob::SOLVER_ACCURACY) == 0) return userTheta;
+	return std::min(userTheta + GOVERNOR_THETA_STEP * notch(QualityKnob::SOLVER_ACCURACY), std::max(userTheta, GOVERNOR_MAX_THETA));
+}
+
+int QualityGovernor::meshSize(int userMeshSize) const {
+	return std::max(userMeshSize >> notch(QualityKnob::SOLVER_ACCURACY), std::min(userMeshSize, GOVERNOR_MIN_MESH_SIZE));
+}
+
+int QualityGovernor::substeps() const {
+	return 1 << notch(QualityKnob::SUBSTEPS);
+}
+
+int qualityKnobNotches(QualityKnob knob) {
+	switch (knob) {
+	case QualityKnob::LABELS: return 2;
+	case QualityKnob::FIELD_CELL: return 2;
+	case QualityKnob::FIELD_REFRESH: return 3;
+	case QualityKnob::SOLVER_ACCURACY: return 3;
+	case QualityKnob::SUBSTEPS: return 2;
+	default: return 0;
+	}
+}
+
+const char* qualityKnobName(QualityKnob knob) {
+	switch (knob) {
+	case QualityKnob::LABELS: return "Labels";
+	case QualityKnob::FIELD_CELL: return "Field cells";
+	case QualityKnob::FIELD_REFRESH: return "Field refresh";
+	case QualityKnob::SOLVER_ACCURACY: return "Solver accuracy";
+	case QualityKnob::SUBSTEPS: return "Physics steps";
+	default: return "Unknown";
+	}
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include "Simulation.h"
+#include <vector>
+#include <string>
+
+const double GOVERNOR_FRAME_BUDGET_MS = 1000.0 / 60.0;	// Default frame budget, the frame limiter's 60 FPS
+const double GOVERNOR_INTERVAL = 0.5;					// Seconds between two decisions
+const double GOVERNOR_RAISE_DELAY = 3.0;				// Seconds after any change before quality is raised again
+const double GOVERNOR_SMOOTHING = 0.1;					// Weight of the newest sample in the averaged costs
+const double GOVERNOR_HEADROOM = 0.7;					// Quality is raised only while costs are below this share of their limit
+const double GOVERNOR_PHYSICS_LOAD = 0.8;				// Highest share of the step period the physics thread may spend stepping
+const double GOVERNOR_MIN_SHARE = 0.1;					// A render knob is only turned if its phase takes this share of the budget
+const float GOVERNOR_THETA_STEP = 0.2f;					// Opening angle added per solver accuracy notch
+const float GOVERNOR_MAX_THETA = 1.5f;					// Largest opening angle the governor sets
+const int GOVERNOR_MIN_MESH_SIZE = 64;					// Smallest mesh the governor halves down to
+
+// Settings the governor turns, each from notch 0 (what the user chose) down to its last notch
+enum class QualityKnob {
+	LABELS,				// Labels drawn: all, a quarter, a sixteenth
+	FIELD_CELL,			// Finest field cell: as chosen, 2x, 4x larger
+	FIELD_REFRESH,		// Steps between field updates: 1, 2, 4, 8
+	SOLVER_ACCURACY,	// Barnes-Hut opening angle up by GOVERNOR_THETA_STEP, or the particle mesh halved, per notch. Not used
+						// with P3M, whose short-range cutoff is a number of cells: a coarser mesh makes it slower.
+	SUBSTEPS,			// Physics steps per second halved with dt doubled, so simulated time keeps its pace: 1, 1/2, 1/4
+	COUNT
+};
+
+// Costs the governor steers by, in milliseconds. Measured from the profiler's latest samples.
+struct QualityCosts {
+	double frame = 0.0;			// CPU time of a render frame, not counting the wait for the frame limiter
+	double labels = 0.0;		// Label placement and drawing
+	double fieldDraw = 0.0;		// Field rasterization and upload
+	double fieldLevel = 0.0;	// One level of the background field solver
+	double step = 0.0;			// One physics step, 0 if no physics runs
+	double stepPeriod = 0.0;	// Wall clock time between two physics steps, 0 if no physics runs
+
+	// Latest samples of the profiler. "stepPeriod" is the physics thread's in seconds, 0 without physics. Phases
+	// that are switched off count as free, their last samples would be stale.
+	static QualityCosts measure(double stepPeriod, bool fieldShown, bool labelsShown);
+};
+
+// Feedback controller keeping the frame time within a budget. Every GOVERNOR_INTERVAL it compares the averaged
+// costs with their limits: over budget, it lowers the knob whose phase costs the most one notch; with headroom on
+// both the render and physics side, it raises the knob it lowered last. A physics knob that did not lower the
+// share of the step period spent stepping by the next decision is taken back and left alone until the solver
+// changes. Locked, every knob stays at notch 0 so runs use exactly the user's settings.
+struct QualityGovernor {
+	double budget = GOVERNOR_FRAME_BUDGET_MS;	// Frame budget in milliseconds
+	bool fixedTimestep = false;					// Leave the physics steps alone, e.g. while a trajectory with one dt is recorded
+
+	// Add one frame's costs at wall clock time "now" (seconds) and decide if the interval is over.
+	// Returns true if a knob changed and the settings below must be applied.
+	bool update(const QualityCosts& costs, Solver solver, double now);
+
+	// Keep the user's settings, returns true if a knob had to be reset
+	bool setLocked(bool lock);
+	bool locked() const { return isLocked; }
+
+	// Current notch of a knob
+	int notch(QualityKnob knob) const { return notches[(int)knob]; }
+
+	// Effective settings for the user's choices
+	int labelLimit(int userLimit) const;
+	float fieldCellSize(float userCellSize) const;
+	unsigned long long fieldInterval() const;
+	float theta(float userTheta) const;
+	int meshSize(int userMeshSize) const;
+	int substeps() const;
+
+	// Averaged costs the last decision was based on
+	const QualityCosts& averageCosts() const { return average; }
+
+	// What the governor did last, for the menu
+	const std::string& lastDecision() const { return decision; }
+
+private:
+	int notches[(int)QualityKnob::COUNT] = {};
+	bool exhausted[(int)QualityKnob::COUNT] = {};	// Knobs whose last notch did not help, not lowered again
+	std::vector<QualityKnob> lowered;		// Knobs in the order they were lowered, raised again from the back
+	Solver lastSolver = Solver::DIRECT;		// Solver of the last update
+	QualityKnob probe = QualityKnob::COUNT;	// Physics knob lowered at the last decision, checked at the next one
+	double probeLoad = 0.0;					// Share of the step period spent stepping before it was lowered
+	QualityCosts average;
+	bool averaged = false;
+	bool isLocked = false;
+	double nextDecision = 0.0;
+	double nextRaise = 0.0;
+	std::string decision = "Full quality";
+
+	// True if a knob has a notch left and its last one helped
+	bool canLower(QualityKnob knob) const;
+
+	// Share of the step period the physics thread spent stepping, on average
+	double physicsLoad() const { return average.stepPeriod > 0.0 ? average.step / average.stepPeriod : 0.0; }
+
+	// Lower a knob one notch because "reason" cost "cost" of "limit" milliseconds
+	void lower(QualityKnob knob, double now, const char* reason, double cost, double limit);
+
+	// Put a knob back to notch 0
+	void reset(QualityKnob knob);
+
+	// Raise the knob lowered last one notch
+	void raise(double now);
+};
+
+// Last notch of a knob
+int qualityKnobNotches(QualityKnob knob);
+
+// Display name of a knob
+const char* qualityKnobName(QualityKnob knob);
@@ -0,0 +1,128 @@
+#include "GravityShm.h"
+#include <atomic>
+#include <string>
+#include <cstring>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Read attempts of gravity_shm_begin() while the newest slot is being overwritten
+static const int GRAVITY_SHM_ATTEMPTS = 16;
+
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t) && std::atomic<uint64_t>::is_always_lock_free,
+	"Shared counters must be plain lock-free 64-bit words");
+
+struct gravity_shm_reader {
+	const unsigned char* memory = nullptr;
+	size_t bytes = 0;
+#ifdef _WIN32
+	HANDLE mapping = nullptr;
+#endif
+};
+
+// The fields the publisher updates while readers look, as atomics
+static const std::atomic<uint64_t>& shared(const uint64_t& value) {
+	return reinterpret_cast<const std::atomic<uint64_t>&>(value);
+}
+
+static const std::atomic<uint32_t>& shared(const uint32_t& value) {
+	return reinterpret_cast<const std::atomic<uint32_t>&>(value);
+}
+
+static const gravity_shm_header* headerOf(const gravity_shm_reader* reader) {
+	return reinterpret_cast<const gravity_shm_header*>(reader->memory);
+}
+
+extern "C" gravity_shm_reader* gravity_shm_open(const char* name) {
+	gravity_shm_reader* reader = new gravity_shm_reader();
+#ifdef _WIN32
+	std::string object = std::string("Local\\") + name;
+	reader->mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, object.c_str());
+	if (reader->mapping) reader->memory = (const unsigned char*)MapViewOfFile(reader->mapping, FILE_MAP_READ, 0, 0, 0);
+	MEMORY_BASIC_INFORMATION info;
+	if (reader->memory && VirtualQuery(reader->memory, &info, sizeof(info))) reader->bytes = info.RegionSize;
+#else
+	std::string object = std::string("/") + name;
+	int fd = shm_open(object.c_str(), O_RDONLY, 0);
+	struct stat status;
+	if (fd >= 0 && fstat(fd, &status) == 0 && (size_t)status.st_size >= sizeof(gravity_shm_header)) {
+		void* memory = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (memory != MAP_FAILED) {
+			reader->memory = (const unsigned char*)memory;
+			reader->bytes = (size_t)status.st_size;
+		}
+	}
+	if (fd >= 0) ::close(fd);
+#endif
+
+	// Only accept a complete segment of this layout
+	const gravity_shm_header* header = reader->memory ? headerOf(reader) : nullptr;
+	if (!header || reader->bytes < sizeof(gravity_shm_header) || std::memcmp(header->magic, GRAVITY_SHM_MAGIC, 8) != 0
+		|| header->version != GRAVITY_SHM_VERSION || header->slot_count == 0 || header->slot_bytes < gravity_shm_slot_bytes(header->capacity)
+		|| header->slot_offset + header->slot_count * header->slot_bytes > reader->bytes) {
+		gravity_shm_close(reader);
+		return nullptr;
+	}
+	return reader;
+}
+
+extern "C" void gravity_shm_close(gravity_shm_reader* reader) {
+	if (!reader) return;
+#ifdef _WIN32
+	if (reader->memory) UnmapViewOfFile(reader->memory);
+	if (reader->mapping) CloseHandle(reader->mapping);
+#else
+	if (reader->memory) munmap((void*)reader->memory, reader->bytes);
+#endif
+	delete reader;
+}
+
+extern "C" int gravity_shm_begin(gravity_shm_reader* reader, gravity_shm_view* view) {
+	const gravity_shm_header* header = headerOf(reader);
+	for (int attempt = 0; attempt < GRAVITY_SHM_ATTEMPTS; attempt++) {
+		bool closed = shared(header->closed).load(std::memory_order_acquire) != 0;
+		uint64_t published = shared(header->published).load(std::memory_order_acquire);
+		if (published == 0) return GRAVITY_SHM_EMPTY;
+
+		uint32_t slot = (uint32_t)((published - 1) % header->slot_count);
+		const unsigned char* base = reader->memory + header->slot_offset + slot * header->slot_bytes;
+		const gravity_shm_slot* slotHeader = reinterpret_cast<const gravity_shm_slot*>(base);
+		uint64_t sequence = shared(slotHeader->sequence).load(std::memory_order_acquire);
+		if (sequence & 1) continue; // The publisher lapped us and is rewriting this slot
+
+		view->slot = slot;
+		view->sequence = sequence;
+		view->step = slotHeader->step;
+		view->time = slotHeader->time;
+		view->total = slotHeader->total;
+		// A torn count must not point the arrays past the slot, validation rejects the view anyway
+		view->count = slotHeader->count < header->capacity ? slotHeader->count : header->capacity;
+		view->id = reinterpret_cast<const uint64_t*>(base + GRAVITY_SHM_ALIGNMENT);
+		view->mass = reinterpret_cast<const float*>(base + gravity_shm_float_offset(header->capacity, 0));
+		view->radius = reinterpret_cast<const float*>(base + gravity_shm_float_offset(header->capacity, 1));
+		view->x = reinterpret_cast<const float*>(base + gravity_shm_float_offset(header->capacity, 2));
+		view->y = reinterpret_cast<const float*>(base + gravity_shm_float_offset(header->capacity, 3));
+		view->vx = reinterpret_cast<const float*>(base + gravity_shm_float_offset(header->capacity, 4));
+		view->vy = reinterpret_cast<const float*>(base + gravity_shm_float_offset(header->capacity, 5));
+		return closed ? GRAVITY_SHM_CLOSED : GRAVITY_SHM_OK;
+	}
+	return GRAVITY_SHM_BUSY;
+}
+
+extern "C" int gravity_shm_validate(const gravity_shm_reader* reader, const gravity_shm_view* view) {
+	const gravity_shm_header* header = headerOf(reader);
+	const gravity_shm_slot* slotHeader = reinterpret_cast<const gravity_shm_slot*>(reader->memory + header->slot_offset + view->slot * header->slot_bytes);
+	// Order every read of the view before the second look at the sequence
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return shared(slotHeader->sequence).load(std::memory_order_relaxed) == view->sequence;
+}
+
+extern "C" uint64_t gravity_shm_published(const gravity_shm_reader* reader) {
+	return shared(headerOf(reader)->published).load(std::memory_order_acquire);
+}
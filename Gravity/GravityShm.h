@@ -0,0 +1,119 @@
+#pragma once
+// Shared memory ring of body snapshots published by a running simulation (--publish NAME), and a small C API to
+// read it from other processes without copying and without ever making the simulation wait.
+//
+// The segment is a header followed by GRAVITY_SHM_SLOTS slots. The publisher fills the slots in turn and guards
+// each with a sequence number that is odd while the slot is being written (a seqlock). Readers look at the newest
+// slot in place and check afterwards that its sequence did not change; if it did, the publisher lapped them and
+// they simply read again. The publisher never waits for or even knows about its readers.
+//
+// Reading a snapshot:
+//
+//     gravity_shm_reader* reader = gravity_shm_open("gravity");
+//     gravity_shm_view view;
+//     do {
+//         if (gravity_shm_begin(reader, &view) != GRAVITY_SHM_OK) break;
+//         ... read view.count entries of view.id, view.mass, view.x ...
+//     } while (!gravity_shm_validate(reader, &view));
+//     gravity_shm_close(reader);
+//
+// Values read from a view are only meaningful once gravity_shm_validate() confirmed it, so compute on them or copy
+// them, but act on the result only after validation.
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GRAVITY_SHM_MAGIC "GRAVSHM"		// First 8 bytes of the segment, including the terminating zero
+#define GRAVITY_SHM_VERSION 1			// Bumped whenever the layout changes
+#define GRAVITY_SHM_SLOTS 4				// Snapshots in the ring
+#define GRAVITY_SHM_ALIGNMENT 64		// Byte alignment of the slots and of every array in them
+
+// Start of the segment, written once by the publisher except for "published" and "closed"
+typedef struct gravity_shm_header {
+	char magic[8];					// GRAVITY_SHM_MAGIC
+	uint32_t version;				// GRAVITY_SHM_VERSION
+	uint32_t slot_count;			// Slots in the ring
+	uint64_t capacity;				// Bodies a slot holds, larger scenes are cut off (see gravity_shm_view.total)
+	uint64_t slot_offset;			// Byte offset of slot 0 from the start of the segment
+	uint64_t slot_bytes;			// Distance between slots
+	uint64_t published;				// Atomic: snapshots published so far, the newest is in slot (published - 1) % slot_count
+	uint32_t closed;				// Atomic: 1 once the publisher has stopped
+	uint32_t reserved;
+	int64_t publisher_pid;			// Process id of the publisher
+} gravity_shm_header;
+
+// Start of a slot. The arrays follow: "capacity" uint64_t ids at offset GRAVITY_SHM_ALIGNMENT, then "capacity" floats
+// each of mass, radius, x, y, vx and vy (see gravity_shm_float_offset).
+typedef struct gravity_shm_slot {
+	uint64_t sequence;				// Atomic: odd while the publisher writes the slot, bumped twice per snapshot
+	uint64_t step;					// Simulation step the snapshot was taken after
+	double time;					// Simulated time
+	uint64_t count;					// Bodies stored in the slot
+	uint64_t total;					// Bodies in the simulation, more than count if the scene outgrew the capacity
+} gravity_shm_slot;
+
+// Result of gravity_shm_begin()
+enum {
+	GRAVITY_SHM_OK = 0,				// The view points at the newest snapshot
+	GRAVITY_SHM_EMPTY = 1,			// Nothing has been published yet
+	GRAVITY_SHM_CLOSED = 2,			// The publisher has stopped, the view holds its last snapshot
+	GRAVITY_SHM_BUSY = 3			// The publisher kept overwriting the slot, try again
+};
+
+// One snapshot in place in the shared memory
+typedef struct gravity_shm_view {
+	uint64_t step;
+	double time;
+	uint64_t count;					// Entries in each array
+	uint64_t total;					// Bodies in the simulation
+	const uint64_t* id;				// Stable id of every body: handle generation in the high 32 bits, slot in the low,
+									// 0xFFFFFFFF for bodies added since the last step
+	const float* mass;
+	const float* radius;
+	const float* x;					// Position
+	const float* y;
+	const float* vx;				// Velocity
+	const float* vy;
+	uint32_t slot;					// Ring slot and its sequence number when the view was taken
+	uint64_t sequence;
+} gravity_shm_view;
+
+typedef struct gravity_shm_reader gravity_shm_reader;
+
+// Map the segment a simulation publishes as "name" read-only, NULL if there is none or it has another layout
+gravity_shm_reader* gravity_shm_open(const char* name);
+
+// Unmap the segment
+void gravity_shm_close(gravity_shm_reader* reader);
+
+// Point "view" at the newest snapshot. Returns GRAVITY_SHM_OK, or GRAVITY_SHM_CLOSED with the last snapshot of a
+// publisher that has stopped, GRAVITY_SHM_EMPTY if nothing was published yet or GRAVITY_SHM_BUSY.
+int gravity_shm_begin(gravity_shm_reader* reader, gravity_shm_view* view);
+
+// Nonzero if nothing in "view" was overwritten since gravity_shm_begin(), i.e. everything read from it is one
+// consistent snapshot
+int gravity_shm_validate(const gravity_shm_reader* reader, const gravity_shm_view* view);
+
+// Snapshots published so far, to notice new ones without taking a view
+uint64_t gravity_shm_published(const gravity_shm_reader* reader);
+
+// Bytes rounded up to GRAVITY_SHM_ALIGNMENT
+static inline uint64_t gravity_shm_padded(uint64_t bytes) {
+	return (bytes + GRAVITY_SHM_ALIGNMENT - 1) / GRAVITY_SHM_ALIGNMENT * GRAVITY_SHM_ALIGNMENT;
+}
+
+// Offset from the start of a slot of float array "index": 0 mass, 1 radius, 2 x, 3 y, 4 vx, 5 vy
+static inline uint64_t gravity_shm_float_offset(uint64_t capacity, int index) {
+	return GRAVITY_SHM_ALIGNMENT + gravity_shm_padded(capacity * sizeof(uint64_t)) + (uint64_t)index * gravity_shm_padded(capacity * sizeof(float));
+}
+
+// Byte size of a slot holding "capacity" bodies, including its arrays
+static inline uint64_t gravity_shm_slot_bytes(uint64_t capacity) {
+	return gravity_shm_float_offset(capacity, 6);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,412 @@
+#include "Headless.h"
+#include "Simulation.h"
+#include "ThreadPool.h"
+#include "FieldImage.h"
+#include "Profiler.h"
+#include "Checkpoint.h"
+#include "Trajectory.h"
+#include "BodyFile.h"
+#include "Cluster.h"
+#include "FrameExport.h"
+#include "Ensemble.h"
+#include "SharedState.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <cstring>
+#include <cmath>
+#include <memory>
+#include <algorithm>
+
+const double CONSERVATION_TOLERANCE = 1e-5;		// Largest relative change of the total mass a cluster run may show
+
+// Fill the simulation with the seeded scene, the --bodies-file bodies, or the --load checkpoint and its settings.
+// Returns false if the checkpoint or body file can't be read.
+static bool setupScene(const Options& options, Simulation& sim) {
+	std::string error;
+	if (!options.load.empty()) {
+		if (loadCheckpoint(options.load, sim, nullptr, &error)) return true;
+		std::cerr << error << "\n";
+		return false;
+	}
+	if (options.bodiesFile.empty()) {
+		addScenario(sim, options.scenario, options.bodies, options.seed);
+		return true;
+	}
+
+	if (!loadBodies(options.bodiesFile, sim, &error)) {
+		std::cerr << error << "\n";
+		return false;
+	}
+	return true;
+}
+
+// Run the scene for options.steps steps and set "seconds" to the wall time, recording every step, exporting a
+// frame every options.exportEvery steps and publishing the bodies if asked to. Returns false and stops at the
+// first frame the exporter refuses because an earlier one could not be written.
+static bool timeRun(const Options& options, Simulation& sim, double& seconds, TrajectoryRecorder* recorder = nullptr, FrameExporter* exporter = nullptr,
+	SharedStatePublisher* publisher = nullptr) {
+	auto start = std::chrono::steady_clock::now();
+	bool exported = true;
+	for (unsigned long long n = 0; n < options.steps && exported; n++) {
+		sim.step();
+		if (recorder) recorder->record(sim);
+		if (exporter && (n + 1) % options.exportEvery == 0) exported = exporter->submit(sim);
+		if (publisher) publisher->publish(sim);
+	}
+	seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return exported;
+}
+
+// Close an exporter that refused a frame and print why, returns the exit code
+static int exportFailed(FrameExporter& exporter) {
+	std::string error;
+	exporter.close(&error);
+	std::cerr << error << "\n";
+	return 1;
+}
+
+// True if both simulations hold exactly the same bits in every body array
+static bool identicalBodies(const BodyArrays& a, const BodyArrays& b) {
+	if (a.size() != b.size()) return false;
+	const AlignedReals BodyArrays::* arrays[] = { &BodyArrays::x, &BodyArrays::y, &BodyArrays::vx, &BodyArrays::vy, &BodyArrays::m, &BodyArrays::r };
+	for (auto array : arrays) {
+		if (std::memcmp((a.*array).data(), (b.*array).data(), a.size() * sizeof(Real)) != 0) return false;
+	}
+	return true;
+}
+
+// Repeat the run with 1, 2, 4 ... threads and print throughput relative to one thread
+static int runScalingReport(const Options& options) {
+	size_t maxThreads = options.threads > 0 ? options.threads : ThreadPool::hardwareThreads();
+	std::vector<size_t> threadCounts;
+	for (size_t count = 1; count < maxThreads; count *= 2) threadCounts.push_back(count);
+	threadCounts.push_back(maxThreads);
+
+	std::cout << "Scaling report: " << options.bodies << " bodies, " << options.steps << " steps, solver " << solverName(options.solver)
+		<< (options.reproducible ? ", reproducible" : "") << "\n";
+	std::cout << std::setw(8) << "threads" << std::setw(14) << "steps/sec" << std::setw(10) << "speedup" << std::setw(12) << "efficiency"
+		<< (options.reproducible ? "  matches 1 thread" : "") << "\n";
+
+	BodyArrays serialBodies;
+	double serialSeconds = 0.0;
+	for (size_t count : threadCounts) {
+		Options run = options;
+		run.threads = count;
+
+		Simulation sim;
+		applyOptions(run, sim);
+		if (!setupScene(run, sim)) return 1;
+		double seconds;
+		timeRun(run, sim, seconds);
+		if (count == 1) {
+			serialSeconds = seconds;
+			serialBodies = sim.bodies;
+		}
+
+		double speedup = seconds > 0.0 ? serialSeconds / seconds : 0.0;
+		std::cout << std::setw(8) << count << std::setw(14) << std::fixed << std::setprecision(1) << (seconds > 0.0 ? options.steps / seconds : 0.0)
+			<< std::setw(9) << std::setprecision(2) << speedup << "x" << std::setw(11) << std::setprecision(0) << (100.0 * speedup / count) << "%";
+		if (options.reproducible) std::cout << "  " << (identicalBodies(sim.bodies, serialBodies) ? "yes" : "NO");
+		std::cout << "\n";
+	}
+	return 0;
+}
+
+// Total mass and momentum of some bodies, with the summed size of their momenta to measure changes against
+struct Totals {
+	double mass = 0.0;
+	double momentumX = 0.0;
+	double momentumY = 0.0;
+	double momentumScale = 0.0;
+};
+
+static Totals totalsOf(const BodyArrays& bodies) {
+	Totals totals;
+	for (size_t i = 0; i < bodies.size(); i++) {
+		totals.mass += bodies.m[i];
+		totals.momentumX += (double)bodies.m[i] * bodies.vx[i];
+		totals.momentumY += (double)bodies.m[i] * bodies.vy[i];
+		totals.momentumScale += (double)bodies.m[i] * std::hypot((double)bodies.vx[i], (double)bodies.vy[i]);
+	}
+	return totals;
+}
+
+// Repeat the run on 1, 2, 4 ... worker processes: strong scaling keeps the scene, weak scaling grows it with the workers
+static int runClusterScalingReport(const Options& options) {
+	std::vector<int> workerCounts;
+	for (int count = 1; count < options.workers; count *= 2) workerCounts.push_back(count);
+	workerCounts.push_back(options.workers);
+	const bool generated = options.load.empty() && options.bodiesFile.empty();
+
+	std::cout << "Cluster scaling report: " << options.steps << " steps, solver " << solverName(options.solver) << ", "
+		<< (options.decomposition == Decomposition::TILES ? "tiles" : "strips") << "\n";
+	for (bool weak : { false, true }) {
+		if (weak && !generated) {
+			std::cout << "Weak scaling needs a generated scene, skipped\n";
+			break;
+		}
+		if (weak) std::cout << "Weak scaling: " << options.bodies << " bodies per worker\n";
+		else std::cout << "Strong scaling: same scene on every worker count\n";
+		std::cout << std::setw(8) << "workers" << std::setw(10) << "bodies" << std::setw(14) << "steps/sec" << std::setw(10) << (weak ? "" : "speedup")
+			<< std::setw(12) << "efficiency" << std::setw(12) << "exchange" << std::setw(14) << "ghosts/step"
+			<< std::setw(12) << "mass" << std::setw(12) << "momentum" << "  mass conserved\n";
+
+		double baseSeconds = 0.0;
+		for (int count : workerCounts) {
+			Options run = options;
+			run.workers = count;
+			if (weak) run.bodies = options.bodies * count;
+
+			Simulation sim;
+			applyOptions(run, sim);
+			if (!setupScene(run, sim)) return 1;
+			const size_t bodies = sim.bodies.size();
+			const Totals before = totalsOf(sim.bodies);
+			ClusterStats stats;
+			std::string error;
+			if (!runCluster(run, sim, stats, &error)) {
+				std::cerr << error << "\n";
+				return 1;
+			}
+			if (count == 1) baseSeconds = stats.seconds;
+
+			// Relative change of the totals. Merges conserve both, so a merge group settled differently by two workers
+			// shows up here. Mass is kept whatever the forces, momentum only as far as the far field is exact (e.g. the
+			// tile-edge scene with a small --theta), since cell summaries don't pull back on a body as hard as it pulls them.
+			const Totals after = totalsOf(sim.bodies);
+			double massChange = before.mass > 0.0 ? std::abs(after.mass - before.mass) / before.mass : 0.0;
+			double momentumScale = std::max(before.momentumScale, after.momentumScale);
+			double momentumChange = momentumScale > 0.0 ? std::hypot(after.momentumX - before.momentumX, after.momentumY - before.momentumY) / momentumScale : 0.0;
+
+			// Strong scaling ideally divides the time by the workers, weak scaling keeps it
+			double speedup = stats.seconds > 0.0 ? baseSeconds / stats.seconds : 0.0;
+			double efficiency = weak ? speedup : speedup / count;
+			double busy = stats.computeSeconds + stats.exchangeSeconds;
+			std::cout << std::setw(8) << count << std::setw(10) << bodies << std::setw(14) << std::fixed << std::setprecision(1)
+				<< (stats.seconds > 0.0 ? options.steps / stats.seconds : 0.0);
+			if (weak) std::cout << std::setw(10) << "";
+			else std::cout << std::setw(9) << std::setprecision(2) << speedup << "x";
+			std::cout << std::setw(11) << std::setprecision(0) << (100.0 * efficiency) << "%" << std::setw(11) << (busy > 0.0 ? 100.0 * stats.exchangeSeconds / busy : 0.0) << "%"
+				<< std::setw(14) << (options.steps > 0 ? stats.ghosts / options.steps : 0);
+			std::cout.unsetf(std::ios::fixed);
+			std::cout << std::setw(12) << std::setprecision(2) << massChange << std::setw(12) << momentumChange
+				<< "  " << (massChange <= CONSERVATION_TOLERANCE ? "yes" : "NO") << "\n";
+		}
+	}
+	return 0;
+}
+
+// Compute the gravity field of the current bodies at the finest cell size and write its heatmap, returns false on failure
+static bool writeFieldImage(const Options& options, const Simulation& sim) {
+	ThreadPool pool(sim.threadCount());
+	QuadTree tree;
+	tree.build(sim.bodies, sim.boundary);
+
+	FieldLevel level;
+	level.cellSize = options.fieldCellSize;
+	level.columns = (int)std::ceil(SIM_WIDTH / level.cellSize);
+	level.rows = (int)std::ceil(SIM_HEIGHT / level.cellSize);
+	computeFieldLevel(sim.bodies, tree, level, pool);
+
+	FieldImage image;
+	image.rasterize(level, (float)(FIELD_SCALAR * FIELD_SCALAR), &pool);
+	return image.writePpm(options.fieldImage);
+}
+
+// Print rolling p50 / p99 of the physics phases
+static void printPhaseSummary() {
+	const Phase phases[] = { Phase::COLLISIONS, Phase::FORCES, Phase::INTEGRATE };
+	std::cout << std::setw(12) << "phase" << std::setw(12) << "p50 ms" << std::setw(12) << "p99 ms" << "\n";
+	for (Phase phase : phases) {
+		ProfileStats stats = Profiler::get().stats(phase);
+		std::cout << std::setw(12) << phaseName(phase) << std::setw(12) << std::fixed << std::setprecision(3) << stats.p50
+			<< std::setw(12) << stats.p99 << "\n";
+	}
+	std::cout.unsetf(std::ios::fixed);
+}
+
+// Run the parameter sweep of --ensemble and print the aggregate throughput
+static int runEnsembleSweep(const Options& options) {
+	EnsembleSpec spec;
+	EnsembleStats stats;
+	std::string error;
+	if (!readEnsembleSpec(options.ensemble, options.seed, spec, &error) || !runEnsemble(options, spec, stats, &error, &std::cout)) {
+		std::cerr << error << "\n";
+		return 1;
+	}
+
+	std::cout << "Finished " << stats.runs << " runs in " << stats.seconds << " s (" << (stats.seconds > 0.0 ? stats.runs * 3600.0 / stats.seconds : 0.0)
+		<< " sims/hour), " << stats.threads << " at a time\n";
+	std::cout << "Core utilization: " << std::fixed << std::setprecision(0) << (stats.seconds > 0.0 ? 100.0 * stats.runSeconds / (stats.seconds * stats.threads) : 0.0)
+		<< "%\n" << std::defaultfloat;
+	std::cout << "Results written to " << options.ensembleResults << "\n";
+	return 0;
+}
+
+int runHeadless(const Options& options) {
+	if (options.workerRank >= 0) return runClusterWorker(options);
+
+	// Check the checkpoint once up front, every run below loads it again
+	size_t checkpointBodies = 0;
+	if (!options.load.empty()) {
+		CheckpointParams params;
+		std::string error;
+		if (!readCheckpointParams(options.load, params, &checkpointBodies, &error)) {
+			std::cerr << error << "\n";
+			return 1;
+		}
+	}
+
+	if (!options.ensemble.empty()) return runEnsembleSweep(options);
+	if (options.scalingReport) return options.workers > 0 ? runClusterScalingReport(options) : runScalingReport(options);
+	if (!options.trace.empty()) Profiler::get().startTrace();
+	Profiler::get().nameThread("Main");
+
+	Simulation sim;
+	applyOptions(options, sim);
+	auto setupStart = std::chrono::steady_clock::now();
+	if (!setupScene(options, sim)) return 1;
+	double setupSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - setupStart).count();
+
+	if (!options.writeBodies.empty()) {
+		std::string error;
+		if (!saveBodies(options.writeBodies, sim.bodies, &error)) {
+			std::cerr << error << "\n";
+			return 1;
+		}
+		std::cout << "Starting scene written to " << options.writeBodies << "\n";
+	}
+
+	if (!options.load.empty()) std::cout << "Headless run: " << checkpointBodies << " bodies (" << options.load << ")";
+	else if (!options.bodiesFile.empty()) std::cout << "Headless run: " << sim.bodies.size() << " bodies (" << options.bodiesFile << ", loaded in " << setupSeconds << " s)";
+	else std::cout << "Headless run: " << options.bodies << " bodies (" << scenarioName(options.scenario) << "), seed " << options.seed;
+	std::cout << ", " << options.steps << " steps, solver " << solverName(sim.solver) << ", " << integratorName(sim.integrator) << ", " << boundaryName(sim.boundary) << " boundary, kernel " << kernelIsaName(resolveKernelIsa(sim.kernelIsa))
+		<< " (" << GRAVITY_PRECISION_NAME << "), ";
+	if (options.workers > 0) std::cout << options.workers << " worker processes\n";
+	else std::cout << sim.threadCount() << " threads\n";
+
+	std::unique_ptr<TrajectoryRecorder> recorder;
+	if (!options.record.empty()) {
+		recorder.reset(new TrajectoryRecorder(options.record, sim.dt, sim.boundary));
+		if (!recorder->isOpen()) {
+			std::cerr << "Could not create " << options.record << "\n";
+			return 1;
+		}
+		recorder->dropWhenBehind = false; // Nothing to keep smooth here, every step is written
+		sim.recordEvents = true;
+		recorder->record(sim);
+	}
+
+	std::unique_ptr<FrameExporter> exporter;
+	auto exportStart = std::chrono::steady_clock::now();
+	if (!options.exportFrames.empty() || !options.exportPipe.empty()) {
+		ExportTarget target;
+		target.directory = options.exportFrames;
+		target.pipe = options.exportPipe;
+		exporter.reset(new FrameExporter());
+		std::string error;
+		if (!exporter->open(target, options.exportFrame, 0, &error)) {
+			std::cerr << error << "\n";
+			return 1;
+		}
+		if (!exporter->submit(sim)) return exportFailed(*exporter);
+	}
+
+	std::unique_ptr<SharedStatePublisher> publisher;
+	if (!options.publish.empty()) {
+		publisher.reset(new SharedStatePublisher());
+		publisher->rate = options.publishRate;
+		std::string error;
+		if (!publisher->open(options.publish, std::max(2 * sim.bodies.size(), SHARED_STATE_MIN_CAPACITY), &error)) {
+			std::cerr << error << "\n";
+			return 1;
+		}
+		publisher->publish(sim);
+		std::cout << "Publishing bodies as " << options.publish << "\n";
+	}
+
+	double seconds;
+	ClusterStats cluster;
+	if (options.workers > 0) {
+		// A checkpoint may bring its own solver, boundary and integrator
+		if (sim.boundary != Boundary::PERIODIC || sim.integrator != Integrator::LEAPFROG || !clusterSupports(sim.solver)) {
+			std::cerr << "--workers runs the direct or Barnes-Hut solver with the periodic boundary and the leapfrog integrator\n";
+			return 1;
+		}
+		std::string error;
+		if (!runCluster(options, sim, cluster, &error, &std::cout)) {
+			std::cerr << error << "\n";
+			return 1;
+		}
+		seconds = cluster.seconds;
+	}
+	else {
+		if (!timeRun(options, sim, seconds, recorder.get(), exporter.get(), publisher.get())) return exportFailed(*exporter);
+	}
+
+	std::cout << "Finished in " << seconds << " s (" << (seconds > 0.0 ? options.steps / seconds : 0.0) << " steps/sec)\n";
+	std::cout << "Bodies remaining: " << sim.bodies.size() << ", merges: " << sim.merges << "\n";
+	if (options.workers > 0) {
+		const DomainLayout& layout = cluster.layout;
+		std::cout << "Tiles: " << layout.columns << " x " << layout.rows << ", " << layout.tileColumns() << " x " << layout.tileRows() << " cells of " << layout.cellSize() << " each\n";
+		std::cout << "Per worker: " << cluster.computeSeconds << " s computing, " << cluster.exchangeSeconds << " s exchanging\n";
+		std::cout << "Per step: " << (options.steps > 0 ? (double)cluster.ghosts / options.steps : 0.0) << " ghosts, " << (options.steps > 0 ? (double)cluster.migrants / options.steps : 0.0)
+			<< " migrants, " << (options.steps > 0 ? (double)cluster.interactions / options.steps : 0.0) << " interactions\n";
+		if (cluster.framesSent > 0) std::cout << "Frames sent to viewers: " << cluster.framesSent << "\n";
+	}
+	else {
+		std::cout << "Force evaluations: " << sim.forceEvaluations << " (" << (options.steps > 0 ? (double)sim.forceEvaluations / options.steps : 0.0) << " per step)\n";
+	}
+	if (recorder) {
+		recorder->close();
+		std::cout << "Recorded " << recorder->framesWritten() << " frames to " << options.record << " (" << recorder->framesDropped() << " dropped)\n";
+	}
+	if (publisher) {
+		publisher->publish(sim, true); // Readers see the final state with the closed flag
+		publisher->close();
+		std::cout << "Published " << publisher->published() << " snapshots as " << options.publish << "\n";
+	}
+	if (exporter) {
+		std::string error;
+		bool exported = exporter->close(&error);
+		double exportSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - exportStart).count();
+		ExportStats stats = exporter->stats();
+		std::cout << "Exported " << stats.frames << " frames of " << options.exportFrame.width << " x " << options.exportFrame.height << " (" << stats.bytes / (1024.0 * 1024.0)
+			<< " MB) in " << exportSeconds << " s (" << (exportSeconds > 0.0 ? stats.frames / exportSeconds : 0.0) << " frames/sec)\n";
+		std::cout << "Export workers: " << stats.renderSeconds << " s rendering, " << stats.encodeSeconds << " s encoding and writing, simulation waited "
+			<< stats.waitSeconds << " s for them\n";
+		if (!exported) {
+			std::cerr << error << "\n";
+			return 1;
+		}
+	}
+	if (options.workers == 0) printPhaseSummary();
+
+	if (!options.trace.empty()) {
+		if (!Profiler::get().writeTrace(options.trace)) {
+			std::cerr << "Could not write " << options.trace << "\n";
+			return 1;
+		}
+		std::cout << "Trace written to " << options.trace << "\n";
+	}
+
+	if (!options.save.empty()) {
+		std::string error;
+		if (!writeCheckpoint(options.save, sim.bodies, sim.handles, checkpointParams(sim), &error)) {
+			std::cerr << error << "\n";
+			return 1;
+		}
+		std::cout << "Checkpoint written to " << options.save << "\n";
+	}
+
+	if (!options.fieldImage.empty()) {
+		if (!writeFieldImage(options, sim)) {
+			std::cerr << "Could not write " << options.fieldImage << "\n";
+			return 1;
+		}
+		std::cout << "Field image written to " << options.fieldImage << "\n";
+	}
+	return 0;
+}
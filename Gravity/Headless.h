@@ -0,0 +1,5 @@
+#pragma once
+#include "Options.h"
+
+// Run the simulation without a window as fast as possible and print throughput, returns the exit code
+int runHeadless(const Options& options);
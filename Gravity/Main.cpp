@@ -1,4 +1,17 @@
 #include "raylib.h"
+#include "Simulation.h"
+#include "PhysicsThread.h"
+#include "Options.h"
+#include "Headless.h"
+#include "FieldSolver.h"
+#include "FieldImage.h"
+#include "Renderer.h"
+#include "Profiler.h"
+#include "Checkpoint.h"
+#include "BodyFile.h"
+#include "Trajectory.h"
+#include "Cluster.h"
+#include "Governor.h"
 #include <string>
 #include <vector>
 #include <iostream>
@@ -6,10 +19,11 @@
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
+#include <memory>
 
 // Window Dimensions
-const int WIN_WIDTH = 1400;										// Width of Window
-const int WIN_HEIGHT = 1000;									// Height of Window
+const int WIN_WIDTH = SIM_WIDTH + 400;							// Width of Window
+const int WIN_HEIGHT = SIM_HEIGHT;								// Height of Window
 
 // UI Parameters
 const Color UI_MENU_BG = GetColor(0x262626FF);					// Menu Background Color
@@ -25,22 +39,15 @@ const Color UI_BUTTON_CLKD = GetColor(0x9E9E9EFF);				// Clicked Button Color
 const Color UI_BUTTON_CLKD_TXT = GetColor(0xFFFFFFFF);			// Clicked Button Text
 
 // Sim Parameters
-const int SIM_WIDTH = WIN_WIDTH - 400;							// Width of simulation space
-const int SIM_HEIGHT = WIN_HEIGHT;								// Height of simulation space
-const float SIM_WIDTH_HALF = SIM_WIDTH / 2.0f;					// Half of simulation width
-const float SIM_HEIGHT_HALF = SIM_HEIGHT / 2.0f;				// Half of simulation height 
-const float G = 6.67430e-8;										// Gravitational Constant (Modified to fit simulation scale)
-const float MIN_DISTANCE_SQUARED = 0.1f;						// Threshold to avoid division by zero in force calculations.
-const float FIELD_CELL_SIZE = 5.0f;								// Size of Gravity Field cell (Low values reduce performance)
 const Color SIM_BG_COL = GetColor(0x020202FF);					// Sim Space background color
-const Color SIM_BDY_COL = GetColor(0xC9C9C9FF);					// Sim Space body color
 const Color SIM_SPAWN_BDY_COL = GetColor(0xB09C02FF);			// Spawn body color
 const Color SIM_SPAWN_VEL_COL = GetColor(0xB09C02FF);			// Spawn vector color
 bool showVectors = false;										// Control vector visibility
 bool showField = false;											// Control gravity field visibility
 bool showLabels = true;										// Toggle Mass and Velocity Label
-int fieldScalar = 6;											// Gravity field visualization sensitivity
+int fieldScalar = FIELD_SCALAR;									// Gravity field visualization sensitivity
 int vectorScalar = 50;											// Scalar to draw vectors at visible lengths
+const char* CHECKPOINT_PATH = "gravity.ckpt";					// File of the Save and Load buttons unless --save is given
 enum State {													// State to track if user is spawning a body
 	DEFAULT,
 	SPAWNING
@@ -131,153 +138,6 @@ struct CheckBox {
 
 // <--- SIMULATION --->
 
-// Defines Body Simulation Element
-struct Body {
-	float mass;
-	float radius;
-	Vector2 velocity;
-	Vector2 location;
-	Vector2 accumulatedForce = { 0.0f, 0.0f }; // Forces accumulated over one frame from each body
-	
-	// Constructor
-	Body(float mass, float radius, Vector2 velocity, Vector2 location) : mass(mass), radius(radius), velocity(velocity), location(location) {};
-
-	// Draws body using raylib primitives
-	void draw() {
-
-		// Draw the body
-		DrawCircle(location.x, location.y, radius, SIM_BDY_COL);
-
-		if (showVectors) {
-
-			// Calculate endpoint of each component velocity vector, multiplied by a scalar for visibility.
-			Vector2 xVector = { location.x + velocity.x * vectorScalar, location.y };
-			Vector2 yVector = { location.x, location.y + velocity.y * vectorScalar };
-
-			// Draw each component velocity vector and the velocity vector
-			DrawLine(location.x, location.y, xVector.x, xVector.y, RED);
-			DrawLine(location.x, location.y, yVector.x, yVector.y, BLUE);
-			DrawLine(location.x, location.y, xVector.x, yVector.y, WHITE);
-		}
-
-		if (showLabels) {
-
-			// Resultant vector of velocity
-			float resultantVector = std::sqrtf((velocity.x * velocity.x) + (velocity.y * velocity.y));
-
-			// Convert mass and resultant velocity vector to scientific notation
-			std::stringstream stream;
-			stream << std::scientific << std::setprecision(2) << resultantVector;
-			std::string velScientific = stream.str();
-			stream.str("");
-			stream.clear();
-
-			stream << std::scientific << std::setprecision(2) << mass;
-			std::string massScientific = stream.str();
-
-			// Label Text
-			std::string labelText = "M: " + massScientific + " V: " + velScientific;
-			int labelWidth = MeasureText(labelText.c_str(), 20); // Width of label
-
-			
-			// Label line end point
-			Vector2 labelEndpoint = { location.x + radius + 20.0f, location.y - radius - 20.0f };
-
-			// Draw Label, ensuring it displays inside sim bounds
-			if (labelEndpoint.x + labelWidth < SIM_WIDTH && labelEndpoint.y - 25.f > 0.0f) { // Already within bounds
-				DrawLine(location.x + radius, location.y - radius, labelEndpoint.x, labelEndpoint.y, WHITE);
-				DrawRectangle(labelEndpoint.x, labelEndpoint.y - 25, labelWidth, 25, ColorFromNormalized({ 0.0f, 0.0f, 0.0f, 0.5f }));
-				DrawText(labelText.c_str(), labelEndpoint.x, labelEndpoint.y - 22, 20, UI_TEXT);
-			}
-			else if (labelEndpoint.x + labelWidth > SIM_WIDTH && labelEndpoint.y - 25.f < 0.0f) { // Crossing top and right border
-				labelEndpoint.x = location.x - radius - 20.0f;
-				labelEndpoint.y = location.y + radius + 20.0f;
-				DrawLine(location.x - radius, location.y + radius, labelEndpoint.x, labelEndpoint.y, WHITE);
-				DrawRectangle(labelEndpoint.x - labelWidth, labelEndpoint.y, labelWidth, 25, ColorFromNormalized({ 0.0f, 0.0f, 0.0f, 0.5f }));
-				DrawText(labelText.c_str(), labelEndpoint.x - labelWidth, labelEndpoint.y + 2, 20, UI_TEXT);
-			}
-			else if (labelEndpoint.x + labelWidth > SIM_WIDTH) { // Just crossing right border
-				labelEndpoint.x = location.x - radius - 20.0f;
-				DrawLine(location.x - radius, location.y - radius, labelEndpoint.x, labelEndpoint.y, WHITE);
-				DrawRectangle(labelEndpoint.x - labelWidth, labelEndpoint.y - 25, labelWidth, 25, ColorFromNormalized({ 0.0f, 0.0f, 0.0f, 0.5f }));
-				DrawText(labelText.c_str(), labelEndpoint.x - labelWidth, labelEndpoint.y - 22, 20, UI_TEXT);
-			}
-			else if (labelEndpoint.y - 25.0f < 0.0f) { // Just crossing top border
-				labelEndpoint.y = location.y + radius + 20.0f;
-				DrawLine(location.x + radius, location.y + radius, labelEndpoint.x, labelEndpoint.y, WHITE);
-				DrawRectangle(labelEndpoint.x, labelEndpoint.y, labelWidth, 25, ColorFromNormalized({ 0.0f, 0.0f, 0.0f, 0.5f }));
-				DrawText(labelText.c_str(), labelEndpoint.x, labelEndpoint.y + 2, 20, UI_TEXT);
-			}
-		}
-	}
-
-	// Apply forces to body
-	void applyForce() {
-		// Apply accumulated force to velocity
-		velocity.x += accumulatedForce.x / mass;
-		velocity.y += accumulatedForce.y / mass;
-
-		location.x += velocity.x;
-		location.y += velocity.y;
-
-		// Reset accumulated force for next frame
-		accumulatedForce = { 0.0f, 0.0f };
-
-		location.x = fmod(SIM_WIDTH + location.x, SIM_WIDTH);
-		location.y = fmod(SIM_HEIGHT + location.y, SIM_HEIGHT);
-	}
-
-	// Accumulate forces over one frame
-	void accumulateForce(Vector2 force) {
-		accumulatedForce.x += force.x;
-		accumulatedForce.y += force.y;
-	}
-
-	// Calculate forces between two bodies
-	static Vector2 calculateGravitationalForce(const Body& body1, const Body& body2) {
-
-		// Precompute raw dx and dy for performance
-		float dx = body2.location.x - body1.location.x;
-		float dy = body2.location.y - body1.location.y;
-
-		// Adjust for wrap-around while preserving direction.
-		if (fabs(dx) > SIM_WIDTH_HALF) {
-			dx = (dx > 0) ? dx - SIM_WIDTH : dx + SIM_WIDTH;
-		}
-		if (fabs(dy) > SIM_HEIGHT_HALF) {
-			dy = (dy > 0) ? dy - SIM_HEIGHT : dy + SIM_HEIGHT;
-		}
-		float distanceSquared = (dx * dx) + (dy * dy); 
-
-		if (distanceSquared < MIN_DISTANCE_SQUARED) return { 0, 0 }; // Avoid division by zero
-
-		float forceMag = G * (body1.mass * body2.mass) / distanceSquared; // Newton's Law of Gravitation, F = (G * (m1 * m2)) / r^2
-		float distanceMag = std::sqrt(distanceSquared); // Magnitude of distance vector
-
-		return { (forceMag * dx / distanceMag), (forceMag * dy / distanceMag) };
-	}
-
-	// Check if two bodies are colliding
-	static bool checkCollision(const Body& body1, const Body& body2) {
-
-		// Precompute raw dx and dy to avoid redundant calculation
-		float rawDx = body2.location.x - body1.location.x;
-		float rawDy = body2.location.y - body1.location.y;
-
-		// Find X and Y components of distance between Body 1 and Body 2,
-		// This will be the minimum of the screen-space distance or wrap-around distance.
-		float dx = std::min(std::fabs(rawDx), SIM_WIDTH - std::fabs(rawDx));
-		float dy = std::min(std::fabs(rawDy), SIM_HEIGHT - std::fabs(rawDy));
-
-		float distanceSquared = (dx * dx) + (dy * dy); // Calculate the combined distance of each component squared
-
-		// Precompute sum of radii to avoid redundant calculation
-		float radiiSum = body1.radius + body2.radius;
-
-		return distanceSquared <= (radiiSum) * (radiiSum); // Compare this to the minimum collision distance squared.
-	}
-};
-
 // Defines Body Spawing Behavior and UI
 struct bodySpawner {
 	State state = State::DEFAULT; // Determines if we create a new body or grow the current new body
@@ -292,15 +152,15 @@ struct bodySpawner {
 		velocity = { 0.0f, 0.0f };
 	};
 
-	// Draw spawning elements and create new body
-	void drawBody(std::vector<Body>& bodies) {
+	// Draw spawning elements and create new body, in simulation coordinates of the current view
+	void drawBody(PhysicsThread& physics, const ViewCamera& view) {
 
 		// Only enter spawner if user is clicking
 		if (IsMouseButtonDown(MOUSE_LEFT_BUTTON)) {
-			Vector2 currMouseLoc = GetMousePosition();
+			Vector2 currMouseLoc = view.toWorld(GetMousePosition());
 
 			// Ensure mouse is within simulation bounds
-			if (currMouseLoc.x < SIM_WIDTH) {
+			if (GetMousePosition().x < SIM_WIDTH) {
 
 				// If not spawning new body already, start spawning
 				if (state == State::DEFAULT) {
@@ -333,149 +193,341 @@ struct bodySpawner {
 		else if (state == State::SPAWNING) { 
 
 			state = State::DEFAULT; // Set state back to default
-			bodies.push_back(Body(spawnMass, spawnRad, velocity, spawnPos)); // Add new body to bodies
+			Body body(spawnMass, spawnRad, { velocity.x, velocity.y }, { spawnPos.x, spawnPos.y });
+			physics.post([body](Simulation& sim) { sim.addBody(body); }); // Add new body to the simulation
 			
 		}
 	}
-};
 
-// Defines gravity field cell
-struct fieldCell {
-	float fieldStrength = 0.0f;
-	float x;
-	float y;
-	float width = FIELD_CELL_SIZE;
-	float height = FIELD_CELL_SIZE;
+	// Remove the body under the cursor on middle click, by handle so a merge in between can't hit another body
+	void removeBody(PhysicsThread& physics, const Snapshot& snapshot, float alpha, const ViewCamera& view) {
+		if (!IsMouseButtonPressed(MOUSE_MIDDLE_BUTTON) || GetMousePosition().x >= SIM_WIDTH) return;
+		if (snapshot.handles.size() != snapshot.bodies.size()) return;
+
+		Vector2 mouse = view.toWorld(GetMousePosition());
+		size_t hit = snapshot.bodies.size();
+		float closest = 0.0f;
+		for (size_t i = 0; i < snapshot.bodies.size(); i++) {
+			Vec2 location = snapshot.interpolatedLocation(i, alpha);
+			float dx = location.x - mouse.x;
+			float dy = location.y - mouse.y;
+			float distanceSquared = (dx * dx) + (dy * dy);
+			float reach = std::max((float)snapshot.bodies.r[i], 2.0f / view.camera.zoom); // Tiny bodies stay clickable
+			if (distanceSquared <= reach * reach && (hit == snapshot.bodies.size() || distanceSquared < closest)) {
+				hit = i;
+				closest = distanceSquared;
+			}
+		}
+		if (hit == snapshot.bodies.size()) return;
 
-	fieldCell() {};
-	fieldCell(float x, float y) : x(x), y(y) {};
+		BodyHandle handle = snapshot.handles.handleAt(hit);
+		physics.post([handle](Simulation& sim) { sim.removeBody(handle); });
+	}
 };
 
 // Defines gravity field visualization
 struct fieldGrid {
 
-	int numCells = SIM_WIDTH / FIELD_CELL_SIZE; // Amount of cells that will fit in sim space
-	std::vector<std::vector<fieldCell>> fieldCells; // Vector holding all cells
-
-	// Constructer for grid
-	fieldGrid() {
-		fieldCells.resize(numCells);
-		for (size_t row = 0; row < numCells; ++row) {
-			fieldCells[row].resize(numCells);
-			for (size_t col = 0; col < numCells; ++col) {
-				fieldCells[row][col] = fieldCell(col * FIELD_CELL_SIZE, row * FIELD_CELL_SIZE);
-			}
+	FieldSolver solver; // Computes the field in the background, coarse to fine
+	unsigned long long submittedStep = ~0ull; // Step of the last snapshot handed to the solver
+	ThreadPool rasterPool; // Colors the heatmap pixels
+	FieldImage image; // Heatmap of the shown level, one pixel per cell
+	Texture2D texture = {}; // GPU copy of the image, id 0 until the first upload
+	std::shared_ptr<const FieldLevel> shownLevel; // Level and sensitivity the image was last rasterized from
+	int shownScalar = 0;
+	std::shared_ptr<const FieldLevel> meshLevel; // Field the particle-mesh solver left in the snapshot, replaces the solver's
+
+	// Constructor for grid
+	fieldGrid(float cellSize) : solver(cellSize), rasterPool(std::max<size_t>(1, ThreadPool::hardwareThreads() / 2)) {}
+
+	// Hand the solver the bodies of a snapshot once it is "interval" steps past the last one it got, never waits for
+	// the result. Snapshots of the particle-mesh solvers already carry the field of their mesh, which is shown as it
+	// is instead.
+	void update(const Snapshot& snapshot, unsigned long long interval) {
+		if (snapshot.steps == submittedStep || (snapshot.steps > submittedStep && snapshot.steps - submittedStep < interval)) return;
+		submittedStep = snapshot.steps;
+		if (snapshot.meshStrength.empty()) {
+			meshLevel.reset();
+			solver.submit(snapshot.bodies, snapshot.steps, snapshot.boundary);
+			return;
 		}
-	}
-
-	// Find strength of gravitational acceleration in the center of the field cell
-	void updateForces(std::vector<Body>& bodies) {
-		for (auto& row : fieldCells) {
-			for (auto& square : row) {
-				// Reset force to 0 for each frame
-				square.fieldStrength = 0.0f;
-				for (const auto& body : bodies) { // Get the force from each body
-
-					// Find closest distance to each body
-					float rawDx = square.x + FIELD_CELL_SIZE / 2.0f - body.location.x;
-					float rawDy = square.y + FIELD_CELL_SIZE / 2.0f -body.location.y;
-
-					// Accound for screen wrap-around if shortest distance is not screen-space.
-					float dx = std::min(std::fabs(rawDx), SIM_WIDTH - std::fabs(rawDx));
-					float dy = std::min(std::fabs(rawDy), SIM_HEIGHT - std::fabs(rawDy));
 
-					float distanceSquared = (dx * dx) + (dy * dy);
+		std::shared_ptr<FieldLevel> level = std::make_shared<FieldLevel>();
+		level->columns = level->rows = (int)std::lround(std::sqrt((double)snapshot.meshStrength.size()));
+		level->cellSize = snapshot.meshCellSize;
+		level->step = snapshot.steps;
+		level->strength = snapshot.meshStrength;
+		meshLevel = level;
+	}
 
-					// Gravitational force
-					if (distanceSquared > MIN_DISTANCE_SQUARED) {
-						square.fieldStrength += G * body.mass / distanceSquared;
-					}
-				}
-			}
-		}
+	// Level shown: the mesh field if there is one, otherwise the solver's latest
+	std::shared_ptr<const FieldLevel> latest() const {
+		return meshLevel ? meshLevel : solver.latest();
 	}
 
-	// Draw the gravity field
+	// Draw the latest completed level of the gravity field as one textured quad, in simulation coordinates
 	void draw() {
-		for (const auto& row : fieldCells) {
-			for (const auto& square : row) {
-				float scaledStrength = square.fieldStrength * fieldScalar * fieldScalar;
-				float normalizedStrength = std::clamp(scaledStrength, 0.01f, 1.0f);
-				
-				Color color = ColorFromNormalized({ normalizedStrength, 0.0f , 1.0f / normalizedStrength, 1.0f });
-				DrawRectangle(square.x, square.y, square.width, square.height, getFieldColor(normalizedStrength));
+		std::shared_ptr<const FieldLevel> level = latest();
+		if (!level) return;
+
+		// Recolor and upload only when the level or the sensitivity changed
+		if (level != shownLevel || fieldScalar != shownScalar) {
+			image.rasterize(*level, (float)(fieldScalar * fieldScalar), &rasterPool);
+			if (texture.id == 0 || texture.width != image.width || texture.height != image.height) {
+				unload();
+				texture = LoadTextureFromImage(toImage());
 			}
+			else {
+				UpdateTexture(texture, image.data());
+			}
+			shownLevel = level;
+			shownScalar = fieldScalar;
 		}
-	}
 
-	// Generate heat map colors based on normalized value
-	Color getFieldColor(float norm) {
+		Rectangle source = { 0.0f, 0.0f, (float)texture.width, (float)texture.height };
+		Rectangle dest = { 0.0f, 0.0f, texture.width * level->cellSize, texture.height * level->cellSize };
+		DrawTexturePro(texture, source, dest, { 0.0f, 0.0f }, 0.0f, WHITE);
+	}
 
-		// Because the normalized force follows the inverse square law, halving the distance between bodies increases the force by a factor of 4
-		// so we visualize based on the square root of this force, meaning that force grows linearly with distance. This creates a more even
-		// distribution of values for the heatmap.
-		norm = std::cbrtf(norm);
+	// The rasterized heatmap as a raylib Image, borrowing the pixel buffer (don't unload it)
+	Image toImage() const {
+		return { (void*)image.data(), image.width, image.height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 };
+	}
 
-		if (norm <= 0.2f) {
-			float tmp = norm * 5;  
-			return ColorFromNormalized({ 0.0f, 0.0f, tmp, 1.0f }); // black to blue
-		}
-		else if (norm <= 0.4f) {
-			float tmp = (norm - 0.2f) * 5; 
-			return ColorFromNormalized({ 0.0f, tmp, 1.0f, 1.0f }); // blue to cyan
-		}
-		else if (norm <= 0.6f) {
-			float tmp = (norm - 0.4f) * 5;
-			return ColorFromNormalized({ 0.0f, 1.0f, 1.0f - tmp, 1.0f }); // cyan to green
-		}
-		else if (norm <= 0.8f) {
-			float tmp = (norm - 0.6f) * 5;
-			return ColorFromNormalized({ tmp, 1.0f, 0.0f, 1.0f }); // green to yellow
-		}
-		else if (norm <= 0.95f) {
-			float tmp = (norm - 0.8f) / 0.15f;
-			return ColorFromNormalized({ 1.0f, 1.0f - tmp, 0.0f, 1.0f }); // yellow to red
-		}
-		else {
-			float tmp = (norm - 0.95f) / 0.05f;
-			return ColorFromNormalized({ 1.0f, 0.0f, tmp, 1.0f }); // red to pink
-		}
+	// Release the texture, must happen before the window is closed
+	void unload() {
+		if (texture.id != 0) UnloadTexture(texture);
+		texture = {};
 	}
 };
 
-int main(void) {
+// Draws rolling p50 / p99 timings of every phase and the latest counters, starting at (x, y)
+void drawProfilerPanel(int x, int y) {
+	const Profiler& profiler = Profiler::get();
+	DrawText("Phase", x, y, 16, UI_TEXT);
+	DrawText("p50 ms", x + 150, y, 16, UI_TEXT);
+	DrawText("p99 ms", x + 240, y, 16, UI_TEXT);
+	y += 18;
+
+	for (int phase = 0; phase < (int)Phase::COUNT; phase++) {
+		ProfileStats stats = profiler.stats((Phase)phase);
+		DrawText(phaseName((Phase)phase), x, y, 14, UI_TEXT);
+		DrawText(TextFormat("%.2f", stats.p50), x + 150, y, 14, UI_TEXT);
+		DrawText(TextFormat("%.2f", stats.p99), x + 240, y, 14, UI_TEXT);
+		y += 15;
+	}
+
+	DrawText(TextFormat("Interactions %.3g  Merges %.0f  Draws %.0f", profiler.stats(Counter::INTERACTIONS).last,
+		profiler.stats(Counter::MERGES).last, profiler.stats(Counter::DRAW_CALLS).last), x, y + 4, 14, UI_TEXT);
+}
+
+// Draws the governor's measured frame time and current settings on one line and its last decision below, at (x, y)
+void drawGovernorStatus(const QualityGovernor& governor, int x, int y) {
+	DrawText(TextFormat("%s %.1f / %.1f ms  Labels %i  Field 1/%i  Steps 1/%i", governor.locked() ? "Locked" : "Auto",
+		governor.averageCosts().frame, governor.budget, governor.labelLimit(RENDER_MAX_LABELS), (int)governor.fieldInterval(),
+		governor.substeps()), x, y, 14, UI_TEXT);
+	DrawText(governor.lastDecision().c_str(), x, y + 16, 14, UI_TEXT);
+}
+
+// Replay keys: Space plays or pauses, Left / Right play backward / forward (or step one frame while paused),
+// Up / Down double or halve the speed. Clicking or dragging the timeline at the bottom of the sim area seeks.
+void updateReplay(TrajectoryPlayer& player) {
+	if (IsKeyPressed(KEY_SPACE)) player.paused = !player.paused;
+	if (IsKeyPressed(KEY_UP) && player.speed < 64.0) player.speed *= 2.0;
+	if (IsKeyPressed(KEY_DOWN) && player.speed > 1.0 / 16.0) player.speed /= 2.0;
+	for (int key : { KEY_LEFT, KEY_RIGHT }) {
+		if (!IsKeyPressed(key)) continue;
+		int direction = key == KEY_LEFT ? -1 : 1;
+		if (player.paused) player.seek(std::floor(player.position) + direction);
+		player.direction = direction;
+	}
+
+	Rectangle timeline = { 20.0f, SIM_HEIGHT - 30.0f, SIM_WIDTH - 40.0f, 12.0f };
+	Vector2 mousePos = GetMousePosition();
+	if (IsMouseButtonDown(MOUSE_LEFT_BUTTON) && CheckCollisionPointRec(mousePos, { timeline.x, timeline.y - 10.0f, timeline.width, timeline.height + 20.0f })) {
+		player.seek((mousePos.x - timeline.x) / timeline.width * (player.reader.frameCount() - 1));
+	}
+	else {
+		player.advance(GetFrameTime());
+	}
+}
+
+// Draws the replay timeline and playback state over the sim area
+void drawReplayTimeline(const TrajectoryPlayer& player) {
+	Rectangle timeline = { 20.0f, SIM_HEIGHT - 30.0f, SIM_WIDTH - 40.0f, 12.0f };
+	float done = player.reader.frameCount() > 1 ? (float)(player.position / (player.reader.frameCount() - 1)) : 1.0f;
+	DrawRectangleRec(timeline, UI_CHECKBOX_BG);
+	DrawRectangle(timeline.x, timeline.y, timeline.width * done, timeline.height, UI_CHECKBOX_ACTIVE);
+	DrawText(TextFormat("REPLAY  step %llu  frame %i / %i  %s%gx%s", player.reader.snapshot().steps, (int)player.reader.currentFrame() + 1,
+		(int)player.reader.frameCount(), player.direction < 0 ? "-" : "", player.speed, player.paused ? "  PAUSED" : ""),
+		timeline.x, timeline.y - 22, 20, YELLOW);
+}
+
+// Draws the address and state of the cluster run being shown over the sim area
+void drawClusterStatus(const ClusterViewer& viewer, const Snapshot& snapshot, const std::string& address) {
+	DrawText(TextFormat("%s %s  step %llu  %i bodies", viewer.connected() ? "ATTACHED TO" : "DETACHED FROM", address.c_str(), snapshot.steps, (int)snapshot.bodies.size()),
+		20, SIM_HEIGHT - 30, 20, YELLOW);
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	if (!parseOptions(argc, argv, options)) return 1;
+
+	// Headless mode runs the engine directly and never opens a window
+	if (options.headless) return runHeadless(options);
+
+	// Record a trace of the whole session if asked to
+	if (!options.trace.empty()) Profiler::get().startTrace();
+	Profiler::get().nameThread("Render");
+
 	// Initialize simulation window
 	InitWindow(WIN_WIDTH, WIN_HEIGHT, "Gravity Toy");
 	SetTargetFPS(60);
 
 	// Initialize Sim Elements
 	bodySpawner spawner;
-	fieldGrid gravityField;
-	std::vector<Body> bodies; // Vector Containing all existing bodies
+	ViewCamera view; // Pan and zoom over the simulation space
+	BodyRenderer bodyRenderer;
+	fieldGrid gravityField(options.fieldCellSize);
+	Simulation sim; // Owns all existing bodies, only touched by the physics thread from here on
+	applyOptions(options, sim);
+	CheckpointWriter checkpointWriter; // Saves snapshots without pausing the simulation
+	std::string checkpointPath = options.save.empty() ? CHECKPOINT_PATH : options.save;
+	std::string checkpointStatus;
+	if (!options.load.empty()) {
+		CheckpointParams params;
+		if (loadCheckpoint(options.load, sim, &params, &checkpointStatus)) {
+			fieldScalar = params.fieldScalar;
+			gravityField.solver.setFinestCellSize(params.fieldCellSize);
+			checkpointStatus = "Loaded " + options.load;
+		}
+		else std::cerr << checkpointStatus << "\n";
+	}
+	if (!options.bodiesFile.empty()) {
+		if (loadBodies(options.bodiesFile, sim, &checkpointStatus)) checkpointStatus = "Loaded " + options.bodiesFile;
+		else std::cerr << checkpointStatus << "\n";
+	}
+
+	// Settings as the user chose them, the governor derives the ones in use from these
+	float userTheta = sim.theta;
+	int userMeshSize = sim.mesh.gridSize;
+	float userDt = sim.dt;
+	float userCellSize = gravityField.solver.finestCellSize();
+
+	// Replays and attached views never run physics, otherwise every step may be streamed to a trajectory file
+	std::unique_ptr<TrajectoryPlayer> player;
+	std::unique_ptr<ClusterViewer> viewer;
+	std::unique_ptr<TrajectoryRecorder> recorder;
+	std::unique_ptr<SharedStatePublisher> publisher;
+	std::unique_ptr<PhysicsThread> physics;
+	if (!options.attach.empty()) {
+		viewer.reset(new ClusterViewer());
+		std::string error;
+		if (!viewer->attach(options.attach, &error)) {
+			std::cerr << error << "\n";
+			CloseWindow();
+			return 1;
+		}
+	}
+	else if (!options.replay.empty()) {
+		player.reset(new TrajectoryPlayer(options.physicsRate));
+		std::string error;
+		if (!player->reader.open(options.replay, &error)) {
+			std::cerr << error << "\n";
+			CloseWindow();
+			return 1;
+		}
+	}
+	else {
+		if (!options.record.empty()) {
+			recorder.reset(new TrajectoryRecorder(options.record, sim.dt, sim.boundary));
+			if (!recorder->isOpen()) std::cerr << "Could not create " << options.record << "\n";
+		}
+		if (!options.publish.empty()) {
+			publisher.reset(new SharedStatePublisher());
+			publisher->rate = options.publishRate;
+			std::string error;
+			if (publisher->open(options.publish, std::max(2 * sim.bodies.size(), SHARED_STATE_MIN_CAPACITY), &error)) std::cout << "Publishing bodies as " << options.publish << "\n";
+			else {
+				std::cerr << error << "\n";
+				publisher.reset();
+			}
+		}
+		physics.reset(new PhysicsThread(sim, options.physicsRate, recorder && recorder->isOpen() ? recorder.get() : nullptr, publisher.get()));
+	}
+
+	// The quality governor trades the user's settings for speed when frames run over budget
+	QualityGovernor governor;
+	governor.budget = options.frameBudget;
+	governor.fixedTimestep = recorder != nullptr;
+	governor.setLocked(options.lockQuality);
+
+	// Hand the governed settings to the field solver and the physics thread
+	auto applyQuality = [&]() {
+		float cellSize = governor.fieldCellSize(userCellSize);
+		if (cellSize != gravityField.solver.finestCellSize()) gravityField.solver.setFinestCellSize(cellSize);
+		if (!physics) return;
+		float theta = governor.theta(userTheta);
+		int meshSize = governor.meshSize(userMeshSize);
+		float dt = userDt * governor.substeps();
+		physics->post([theta, meshSize, dt](Simulation& sim) {
+			sim.theta = theta;
+			sim.mesh.gridSize = meshSize;
+			sim.dt = dt;
+		});
+		physics->setStepsPerSecond(options.physicsRate / governor.substeps());
+	};
 
 	// Initialize UI Elements
-	CheckBox vectorCheck(SIM_WIDTH + 250, 50);
-	CheckBox fieldCheck(SIM_WIDTH + 250, 100);
-	CheckBox labelCheck(SIM_WIDTH + 250, 150);
+	CheckBox vectorCheck(SIM_WIDTH + 250, 10);
+	CheckBox fieldCheck(SIM_WIDTH + 250, 50);
+	CheckBox labelCheck(SIM_WIDTH + 250, 90);
+	CheckBox lockCheck(SIM_WIDTH + 250, 130);
+	lockCheck.active = options.lockQuality;
 	Button minusFieldStrength(SIM_WIDTH + 50, 243, 40, 40, "-");
 	Button plusFieldStrength(SIM_WIDTH + 300, 243, 40, 40, "+");
 	Button minusVectorStrength(SIM_WIDTH + 50, 343, 40, 40, "-");
 	Button plusVectorStrength(SIM_WIDTH + 300, 343, 40, 40, "+");
-	Button resetSim(SIM_WIDTH + 100, SIM_HEIGHT - 100, 50, 200, "Reset Sim");
+	Button switchSolver(SIM_WIDTH + 50, 443, 40, 290, "Switch Solver");
+	Button minusTheta(SIM_WIDTH + 50, 543, 40, 40, "-");
+	Button plusTheta(SIM_WIDTH + 300, 543, 40, 40, "+");
+	Button minusCellSize(SIM_WIDTH + 50, 643, 40, 40, "-");
+	Button plusCellSize(SIM_WIDTH + 300, 643, 40, 40, "+");
+	Button saveSim(SIM_WIDTH + 50, SIM_HEIGHT - 100, 50, 90, "Save");
+	Button loadSim(SIM_WIDTH + 150, SIM_HEIGHT - 100, 50, 90, "Load");
+	Button resetSim(SIM_WIDTH + 250, SIM_HEIGHT - 100, 50, 90, "Reset");
 
 	// Simulation Loop
 	while (!WindowShouldClose()) {
+		ProfileScope frameScope(Phase::FRAME);
 
 		// Update Sim
-		if (showField) gravityField.updateForces(bodies);
+		// Latest state published by the physics thread or the cluster, read without locking, or the frame the replay reached
+		if (player) updateReplay(*player);
+		const Snapshot& snapshot = player ? player->reader.snapshot() : viewer ? viewer->latest() : physics->latest();
+		float alpha = physics ? physics->interpolationAlpha(snapshot, PhysicsThread::now()) : 1.0f;
+
+		// Let the governor react to what the last frame and step cost
+		QualityCosts costs = QualityCosts::measure(physics ? physics->stepPeriod() : 0.0, showField, showLabels);
+		if (governor.update(costs, snapshot.solver, PhysicsThread::now())) applyQuality();
+
+		if (showField) gravityField.update(snapshot, governor.fieldInterval());
 		showVectors = vectorCheck.isChecked();
+		if (physics && fieldCheck.isChecked() != showField) {
+			bool on = fieldCheck.isChecked();
+			physics->post([on](Simulation& sim) { sim.mesh.computeStrength = on; }); // The mesh solvers fill the field only while it is shown
+		}
 		showField = fieldCheck.isChecked();
 		showLabels = labelCheck.isChecked();
 
 		// Update UI
+		view.bounded = snapshot.boundary != Boundary::OPEN;
+		view.update();
 		vectorCheck.check();
 		fieldCheck.check();
 		labelCheck.check();
+		lockCheck.check();
+		if (governor.setLocked(lockCheck.isChecked())) applyQuality();
 
 		// Listen for field scalar adjustment
 		if (minusFieldStrength.isClicked() && fieldScalar > 1) fieldScalar -= 1;
@@ -485,78 +537,103 @@ int main(void) {
 		if (minusVectorStrength.isClicked() && vectorScalar > 10) vectorScalar -= 10;
 		if (plusVectorStrength.isClicked()) vectorScalar += 10;
 
+		// Listen for force solver changes
+		if (physics && switchSolver.isClicked()) {
+			physics->post([](Simulation& sim) { sim.solver = (Solver)(((int)sim.solver + 1) % ((int)Solver::P3M + 1)); });
+		}
+		if (physics && minusTheta.isClicked() && userTheta > 0.15f) {
+			userTheta -= 0.1f;
+			applyQuality();
+		}
+		if (physics && plusTheta.isClicked() && userTheta < 1.45f) {
+			userTheta += 0.1f;
+			applyQuality();
+		}
+
+		// Listen for field resolution changes
+		if (minusCellSize.isClicked() && userCellSize > FIELD_MIN_CELL_SIZE) {
+			userCellSize -= 1.0f;
+			applyQuality();
+		}
+		if (plusCellSize.isClicked() && userCellSize < FIELD_COARSEST_CELL_SIZE) {
+			userCellSize += 1.0f;
+			applyQuality();
+		}
+
 		BeginDrawing();
 		ClearBackground(SIM_BG_COL);
 
-		// Draw Vectors or Gravity Field
-		if (showField) gravityField.draw();
-		if (resetSim.isClicked()) bodies.clear();
-		
-		// Iterate over each unique pair of bodies
-		for (size_t i = 0; i < bodies.size(); i++) {
-			
-			for (size_t j = i + 1; j < bodies.size(); ) {
-
-				// Handle Collisions
-				if (Body::checkCollision(bodies[i], bodies[j])) {
-					
-					if (bodies[i].mass >= bodies[j].mass) { // Merge body j into body i
-						
-						// Calculate attributes of merged body
-						float combinedMass = bodies[i].mass + bodies[j].mass; 
-						Vector2 combinedVelocity = { 
-							(bodies[i].mass * bodies[i].velocity.x + bodies[j].mass * bodies[j].velocity.x) / combinedMass,
-							(bodies[i].mass * bodies[i].velocity.y + bodies[j].mass * bodies[j].velocity.y) / combinedMass
-						};
-
-						// Assign attributes
-						bodies[i].mass = combinedMass;
-						bodies[i].velocity = combinedVelocity;
-						bodies[i].radius = cbrt((3.0f * bodies[i].mass) / (4.0f * PI * 10000.0f));
-
-						// Remove old body
-						bodies.erase(bodies.begin() + j);
-					}
-					else {	// Merge body i into body j
-						
-						// Calculate attributes of merged body
-						float combinedMass = bodies[i].mass + bodies[j].mass;
-						Vector2 combinedVelocity = {
-							(bodies[i].mass * bodies[i].velocity.x + bodies[j].mass * bodies[j].velocity.x) / combinedMass,
-							(bodies[i].mass * bodies[i].velocity.y + bodies[j].mass * bodies[j].velocity.y) / combinedMass
-						};
-
-						// Assign attributes
-						bodies[j].mass = combinedMass;
-						bodies[j].velocity = combinedVelocity;
-						bodies[j].radius = cbrt((3.0f * bodies[j].mass) / (4.0f * PI * 10000.0f));
-
-						// Remove old body
-						bodies.erase(bodies.begin() + i);
-
-						// Since the current i is removed, decrement i (if possible) and break out of the inner loop.
-						if (i > 0) i--;
-						break;
-					}
-				}
-				else { // No collision: apply gravitational force.
-					
-					Vector2 force = Body::calculateGravitationalForce(bodies[i], bodies[j]);
-					bodies[i].accumulateForce(force);
-					bodies[j].accumulateForce({ -force.x, -force.y }); // equal and opposite force
-					j++;
-				}
+		if (physics && resetSim.isClicked()) physics->post([](Simulation& sim) { sim.reset(); });
+
+		// Save the snapshot on screen in the background (also while replaying), load by handing the physics thread the file
+		if (saveSim.isClicked()) {
+			CheckpointParams params = checkpointParams(snapshot);
+			params.dt = userDt; // The user's settings, not what the governor made of them
+			params.theta = userTheta;
+			params.meshSize = userMeshSize;
+			params.fieldScalar = fieldScalar;
+			params.fieldCellSize = userCellSize;
+			checkpointWriter.save(checkpointPath, snapshot.bodies, snapshot.handles, params);
+			checkpointStatus.clear();
+		}
+		if (physics && loadSim.isClicked()) {
+			CheckpointParams params;
+			if (readCheckpointParams(checkpointPath, params, nullptr, &checkpointStatus)) {
+				fieldScalar = params.fieldScalar;
+				userCellSize = params.fieldCellSize;
+				userTheta = params.theta;
+				userMeshSize = params.meshSize;
+				userDt = params.dt;
+				checkpointStatus = "Loaded " + checkpointPath;
+				physics->post([checkpointPath](Simulation& sim) {
+					std::string error;
+					if (!loadCheckpoint(checkpointPath, sim, nullptr, &error)) std::cerr << error << "\n";
+				});
+				applyQuality(); // Queued after the load, so the governed settings replace the loaded ones
 			}
 		}
+		if (checkpointStatus.empty() && !checkpointWriter.busy()) checkpointStatus = checkpointWriter.status();
 
-		// Update and draw each body.
-		for (Body& body : bodies) {
-			body.applyForce();
-			body.draw();
+		// Everything in simulation space is drawn through the camera and clipped to the sim area
+		BeginScissorMode(0, 0, SIM_WIDTH, SIM_HEIGHT);
+		BeginMode2D(view.camera);
+
+		// Draw Gravity Field
+		if (showField) {
+			ProfileScope scope(Phase::FIELD_DRAW);
+			gravityField.draw();
+		}
+
+		// Outline of the original simulation space once open boundaries let the view leave it
+		if (!view.bounded) DrawRectangleLinesEx({ 0.0f, 0.0f, (float)SIM_WIDTH, (float)SIM_HEIGHT }, 1.0f / view.camera.zoom, DARKGRAY);
+
+		// Draw the bodies in view, interpolated between the last two physics steps
+		RenderSettings settings;
+		settings.showVectors = showVectors;
+		settings.vectorScalar = vectorScalar;
+		settings.maxLabels = governor.labelLimit(RENDER_MAX_LABELS);
+		{
+			ProfileScope scope(Phase::BODIES);
+			bodyRenderer.drawBodies(snapshot, alpha, view, settings);
 		}
 
 		// Draw Body Spawning
-		spawner.drawBody(bodies);
+		if (physics) {
+			spawner.drawBody(*physics, view);
+			spawner.removeBody(*physics, snapshot, alpha, view);
+		}
+
+		EndMode2D();
+
+		// Labels stay the same size at any zoom
+		if (showLabels) {
+			ProfileScope scope(Phase::LABELS);
+			bodyRenderer.drawLabels(snapshot, view, settings);
+		}
+		EndScissorMode();
+		if (player) drawReplayTimeline(*player);
+		if (viewer) drawClusterStatus(*viewer, snapshot, options.attach);
+		Profiler::get().count(Counter::DRAW_CALLS, (double)(bodyRenderer.drawCalls + (showField ? 1 : 0)));
 
 		// <--- Draw UI --->
 		
@@ -566,24 +643,31 @@ int main(void) {
 		// Show framerate
 		int fps = GetFPS();
 		DrawText(TextFormat("%i FPS", fps), 10, 10, 20, YELLOW);
+		if (recorder) DrawText(TextFormat("REC %llu", recorder->framesWritten()), 100, 10, 20, RED);
 
 		// Show body count
-		if (bodies.size() == 1) { DrawText(TextFormat("%i BODY", bodies.size()), 10, 30, 20, GREEN); }
-		else { DrawText(TextFormat("%i BODIES", bodies.size()), 10, 30, 20, GREEN); }
+		if (snapshot.bodies.size() == 1) { DrawText(TextFormat("%i BODY", snapshot.bodies.size()), 10, 30, 20, GREEN); }
+		else { DrawText(TextFormat("%i BODIES", snapshot.bodies.size()), 10, 30, 20, GREEN); }
+		if (view.camera.zoom != 1.0f) DrawText(TextFormat("%.1fx ZOOM, %i IN VIEW", view.camera.zoom, (int)bodyRenderer.drawnBodies), 10, 50, 20, GREEN);
 			
 
 		// Show Vectors option
-		DrawText("Show Vectors", SIM_WIDTH + 50, 50, 25, UI_TEXT);
+		DrawText("Show Vectors", SIM_WIDTH + 50, 10, 25, UI_TEXT);
 		vectorCheck.draw();
 
 		// Show Field Option
-		DrawText("Show Field", SIM_WIDTH + 50, 100, 25, UI_TEXT);
+		DrawText("Show Field", SIM_WIDTH + 50, 50, 25, UI_TEXT);
 		fieldCheck.draw();
 
 		// Show Label Option
-		DrawText("Show Labels", SIM_WIDTH + 50, 150, 25, UI_TEXT);
+		DrawText("Show Labels", SIM_WIDTH + 50, 90, 25, UI_TEXT);
 		labelCheck.draw();
 
+		// Show Quality Governor, its lock and what it currently does
+		DrawText("Lock Quality", SIM_WIDTH + 50, 130, 25, UI_TEXT);
+		lockCheck.draw();
+		drawGovernorStatus(governor, SIM_WIDTH + 50, 160);
+
 		// Show Field Strength
 		DrawText("Field Strength Scalar", SIM_WIDTH + 50, 200, 25, UI_TEXT);
 		minusFieldStrength.DrawButton();
@@ -596,12 +680,40 @@ int main(void) {
 		DrawText(TextFormat("%i", vectorScalar), SIM_WIDTH + 175, 350, 25, UI_TEXT);
 		plusVectorStrength.DrawButton();
 
-		// Show Reset Button
+		// Show Force Solver
+		DrawText(TextFormat("Solver: %s", solverName(snapshot.solver)), SIM_WIDTH + 50, 400, 25, UI_TEXT);
+		switchSolver.DrawButton();
+
+		// Show Barnes-Hut Opening Angle
+		DrawText("Opening Angle", SIM_WIDTH + 50, 500, 25, UI_TEXT);
+		minusTheta.DrawButton();
+		DrawText(TextFormat("%.1f", snapshot.theta), SIM_WIDTH + 175, 550, 25, UI_TEXT);
+		plusTheta.DrawButton();
+
+		// Show Field Cell Size, with the size of the level currently shown
+		std::shared_ptr<const FieldLevel> shownLevel = gravityField.latest();
+		DrawText("Field Cell Size", SIM_WIDTH + 50, 600, 25, UI_TEXT);
+		minusCellSize.DrawButton();
+		if (shownLevel && showField) DrawText(TextFormat("%.0f (%.0f)", gravityField.solver.finestCellSize(), shownLevel->cellSize), SIM_WIDTH + 150, 650, 25, UI_TEXT);
+		else DrawText(TextFormat("%.0f", gravityField.solver.finestCellSize()), SIM_WIDTH + 175, 650, 25, UI_TEXT);
+		plusCellSize.DrawButton();
+
+		// Show Profiler Overlay
+		drawProfilerPanel(SIM_WIDTH + 50, 693);
+
+		// Show Checkpoint and Reset Buttons
+		saveSim.DrawButton();
+		loadSim.DrawButton();
 		resetSim.DrawButton();
+		if (checkpointWriter.busy()) DrawText("Saving...", SIM_WIDTH + 50, SIM_HEIGHT - 40, 14, UI_TEXT);
+		else DrawText(checkpointStatus.c_str(), SIM_WIDTH + 50, SIM_HEIGHT - 40, 14, UI_TEXT);
 
+		ProfileScope presentScope(Phase::PRESENT);
 		EndDrawing();
 	}
 
+	if (!options.trace.empty() && !Profiler::get().writeTrace(options.trace)) std::cerr << "Could not write " << options.trace << "\n";
+	gravityField.unload();
 	CloseWindow();
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,33 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+// Read-only memory mapping of a whole file. The operating system pages the contents in on demand,
+// so opening a large file costs nothing until its bytes are touched.
+struct MappedFile {
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Map "path", replacing any current mapping. Returns false if the file can't be opened or mapped.
+	bool open(const std::string& path);
+
+	// Unmap the file
+	void close();
+
+	// Start of the mapped bytes, null when nothing is mapped
+	const unsigned char* data() const { return bytes; }
+
+	// Size of the file in bytes
+	size_t size() const { return length; }
+
+private:
+	const unsigned char* bytes = nullptr;
+	size_t length = 0;
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#endif
+};
@@ -0,0 +1,349 @@
+#include "Options.h"
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include "ThreadPool.h"
+
+// Print the supported arguments
+static void printUsage(const char* program) {
+	std::cerr << "Usage: " << program << " [--headless] [--steps N] [--bodies N] [--seed S] [--scenario NAME] [--solver direct|bh|pm|p3m] [--theta T]\n"
+		<< "          [--mesh-size N] [--integrator euler|leapfrog|block] [--boundary periodic|open|reflective]\n"
+		<< "          [--kernel auto|scalar|sse|avx2] [--threads N] [--reproducible] [--scaling-report]\n"
+		<< "          [--dt T] [--physics-rate HZ] [--field-cell-size PX] [--frame-budget MS] [--lock-quality]\n"
+		<< "          [--field-image PATH] [--load PATH] [--save PATH] [--record PATH] [--replay PATH]\n"
+		<< "          [--bodies-file PATH] [--write-bodies PATH] [--trace PATH]\n"
+		<< "          [--workers N] [--decomposition strips|tiles] [--listen ADDR] [--attach ADDR]\n"
+		<< "          [--publish NAME] [--publish-rate HZ] [--ensemble SPEC] [--ensemble-results PATH]\n"
+		<< "          [--export-frames DIR | --export-pipe CMD] [--export-size WxH] [--export-every N] [--export-layers LIST]\n"
+		<< "  --headless   Run the simulation without a window and report throughput\n"
+		<< "  --steps N    Number of steps to run in headless mode (default 1000)\n"
+		<< "  --bodies N   Number of random bodies in the headless scene (default 500)\n"
+		<< "  --seed S     Seed for the random headless scene (default 1)\n"
+		<< "  --scenario NAME  Headless starting scene: uniform, disk, plummer, clusters, merge-storm or tile-edge\n"
+		<< "               (default uniform)\n"
+		<< "  --solver X   Force solver: direct, bh (Barnes-Hut), pm (particle-mesh) or p3m (particle-mesh with direct\n"
+		<< "               short-range forces between close neighbors) (default direct)\n"
+		<< "  --theta T    Barnes-Hut opening angle, smaller is more accurate (default 0.5)\n"
+		<< "  --mesh-size N  Particle-mesh cells per side, rounded up to a power of two (default 256)\n"
+		<< "  --integrator X  Time integration: euler (the original first order update), leapfrog (default) or block\n"
+		<< "               (leapfrog with power-of-two timesteps per body, from 16 dt down to dt / 1024)\n"
+		<< "  --boundary X  Edges of the simulation space: periodic (wrap around, default), open (unbounded, bodies may\n"
+		<< "               leave the window, zoom out to follow them) or reflective (bodies bounce off the edges)\n"
+		<< "  --kernel X   Direct summation instruction set, auto picks the best this CPU supports\n"
+		<< "  --threads N  Threads for the force phase, 0 uses every hardware thread (default 0)\n"
+		<< "  --reproducible  Results are bit-for-bit identical for any thread count\n"
+		<< "  --dt T       Timestep of one physics step (default 1, one frame of the original 60 FPS loop)\n"
+		<< "  --physics-rate HZ  Physics steps per second in the GUI, independent of the frame rate (default 60)\n"
+		<< "  --field-cell-size PX  Finest gravity field cell in the GUI, 1 or more pixels (default 5)\n"
+		<< "  --frame-budget MS  Frame time the GUI's quality governor keeps to by coarsening labels, the field, solver\n"
+		<< "               accuracy and physics steps when a scene gets heavy (default 16.7)\n"
+		<< "  --lock-quality  Start the GUI with the governor locked, so the chosen settings are used as they are\n"
+		<< "  --field-image PATH  Headless only, write the gravity field of the final state as a PPM image\n"
+		<< "  --load PATH  Start from a checkpoint, including its solver settings, instead of a generated scene\n"
+		<< "  --bodies-file PATH  Start from the bodies in a body file instead of a generated scene, in the GUI and headless.\n"
+		<< "               PATH ending in .csv holds one mass,radius,x,y,vx,vy line per body, anything else the binary format\n"
+		<< "  --write-bodies PATH  Headless only, write the starting scene (e.g. a generated one) to a .csv or binary body file\n"
+		<< "  --save PATH  Headless: write a checkpoint of the final state. GUI: file used by the Save and Load buttons (default gravity.ckpt)\n"
+		<< "  --record PATH  Stream every step to a trajectory file, in the GUI and headless\n"
+		<< "  --replay PATH  Play back a trajectory file in the GUI without running physics\n"
+		<< "  --trace PATH  Record every timed phase and write a Chrome trace_event JSON file (open it in Perfetto) on exit\n"
+		<< "  --scaling-report  Headless only, repeat the run with 1, 2, 4 ... threads and print the speedup. With --workers,\n"
+		<< "               repeat it with 1, 2, 4 ... workers for strong scaling (same bodies) and weak scaling (--bodies per worker),\n"
+		<< "               and check that the total mass is conserved\n"
+		<< "  --workers N  Headless only, split the space into N tiles stepped by N worker processes on this machine\n"
+		<< "               (direct or bh solver, periodic boundary, leapfrog integrator). Results differ slightly from one\n"
+		<< "               process: bodies further than a halo from a tile act on it through per-cell summaries.\n"
+		<< "  --decomposition X  Tiles of --workers: strips (default) or tiles (a grid as square as the worker count allows)\n"
+		<< "  --listen ADDR  Address the workers and viewers connect to, unix:PATH or tcp:HOST:PORT (port 0 picks one)\n"
+		<< "               (default a socket file in the temporary directory, or tcp:127.0.0.1:0 on Windows)\n"
+		<< "  --attach ADDR  GUI only, show the bodies of a --workers run listening at ADDR instead of simulating\n"
+		<< "  --publish NAME  Publish the bodies and step to a shared memory ring other processes can read without slowing\n"
+		<< "               the simulation (see GravityShm.h and ShmReader), in the GUI and headless\n"
+		<< "  --publish-rate HZ  Most snapshots published per second, 0 publishes every step (default 60)\n"
+		<< "  --ensemble SPEC  Run headless simulations for every combination of the seeds, gravity and velocity multipliers,\n"
+		<< "               densities and merge rules listed in SPEC, --threads runs at a time, and stream a summary of each\n"
+		<< "               run to --ensemble-results\n"
+		<< "  --ensemble-results PATH  CSV file the --ensemble summaries are written to (default ensemble.csv)\n"
+		<< "  --export-frames DIR  Run headless and render the start and every --export-every steps to DIR/frame_000000.png ...\n"
+		<< "  --export-pipe CMD  Run headless and write the frames as raw RGBA to CMD's standard input, e.g.\n"
+		<< "               \"ffmpeg -f rawvideo -pix_fmt rgba -s 1920x1080 -r 60 -i - out.mp4\"\n"
+		<< "  --export-size WxH  Size of exported frames in pixels (default 1000x1000)\n"
+		<< "  --export-every N  Steps between exported frames (default 1)\n"
+		<< "  --export-layers LIST  Comma-separated layers of exported frames: field, bodies, vectors, labels (default bodies,labels)\n";
+}
+
+// Read the value following a flag, returns false if it is missing or not a number
+static bool readNumber(int argc, char** argv, int& i, unsigned long long& value) {
+	if (i + 1 >= argc) return false;
+	char* end = nullptr;
+	value = std::strtoull(argv[++i], &end, 10);
+	return end != nullptr && *end == '\0';
+}
+
+// Read a WxH size following a flag
+static bool readSize(int argc, char** argv, int& i, int& width, int& height) {
+	if (i + 1 >= argc) return false;
+	char* end = nullptr;
+	width = (int)std::strtol(argv[++i], &end, 10);
+	if (end == nullptr || *end != 'x') return false;
+	height = (int)std::strtol(end + 1, &end, 10);
+	return *end == '\0' && width > 0 && height > 0 && width <= 16384 && height <= 16384;
+}
+
+// Read the comma-separated layer names of exported frames
+static bool readLayers(int argc, char** argv, int& i, FrameSettings& frame) {
+	if (i + 1 >= argc) return false;
+	frame.field = frame.bodies = frame.vectors = frame.labels = false;
+	std::string list = argv[++i];
+	size_t start = 0;
+	while (start <= list.size()) {
+		size_t comma = list.find(',', start);
+		if (comma == std::string::npos) comma = list.size();
+		std::string name = list.substr(start, comma - start);
+		if (name == "field") frame.field = true;
+		else if (name == "bodies") frame.bodies = true;
+		else if (name == "vectors") frame.vectors = true;
+		else if (name == "labels") frame.labels = true;
+		else return false;
+		start = comma + 1;
+	}
+	return true;
+}
+
+// Read the value following a flag as a decimal number
+static bool readFloat(int argc, char** argv, int& i, float& value) {
+	if (i + 1 >= argc) return false;
+	char* end = nullptr;
+	value = std::strtof(argv[++i], &end);
+	return end != nullptr && *end == '\0';
+}
+
+void applyOptions(const Options& options, Simulation& sim) {
+	sim.solver = options.solver;
+	sim.theta = options.theta;
+	sim.mesh.gridSize = options.meshSize;
+	sim.integrator = options.integrator;
+	sim.boundary = options.boundary;
+	sim.kernelIsa = options.kernelIsa;
+	sim.reproducible = options.reproducible;
+	sim.dt = options.dt;
+	sim.setThreads(options.threads > 0 ? options.threads : ThreadPool::hardwareThreads());
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+	options.program = argv[0];
+	options.exportFrame.width = 1000;
+	options.exportFrame.height = 1000;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		unsigned long long value = 0;
+		bool valid = true;
+
+		if (arg == "--headless") {
+			options.headless = true;
+		}
+		else if (arg == "--steps") {
+			valid = readNumber(argc, argv, i, value);
+			options.steps = value;
+		}
+		else if (arg == "--bodies") {
+			valid = readNumber(argc, argv, i, value);
+			options.bodies = (size_t)value;
+		}
+		else if (arg == "--seed") {
+			valid = readNumber(argc, argv, i, value);
+			options.seed = (unsigned int)value;
+		}
+		else if (arg == "--solver" && i + 1 < argc) {
+			valid = parseSolver(argv[++i], options.solver);
+		}
+		else if (arg == "--mesh-size") {
+			valid = readNumber(argc, argv, i, value) && value >= PM_MIN_GRID_SIZE && value <= PM_MAX_GRID_SIZE;
+			options.meshSize = (int)value;
+		}
+		else if (arg == "--integrator" && i + 1 < argc) {
+			std::string name = argv[++i];
+			if (name == "euler") options.integrator = Integrator::EULER;
+			else if (name == "leapfrog") options.integrator = Integrator::LEAPFROG;
+			else if (name == "block") options.integrator = Integrator::BLOCK;
+			else valid = false;
+		}
+		else if (arg == "--boundary" && i + 1 < argc) {
+			std::string name = argv[++i];
+			if (name == "periodic") options.boundary = Boundary::PERIODIC;
+			else if (name == "open") options.boundary = Boundary::OPEN;
+			else if (name == "reflective") options.boundary = Boundary::REFLECTIVE;
+			else valid = false;
+		}
+		else if (arg == "--scenario" && i + 1 < argc) {
+			valid = parseScenario(argv[++i], options.scenario);
+		}
+		else if (arg == "--kernel" && i + 1 < argc) {
+			std::string name = argv[++i];
+			if (name == "auto") options.kernelIsa = KernelIsa::AUTO;
+			else if (name == "scalar") options.kernelIsa = KernelIsa::SCALAR;
+			else if (name == "sse") options.kernelIsa = KernelIsa::SSE;
+			else if (name == "avx2") options.kernelIsa = KernelIsa::AVX2;
+			else valid = false;
+		}
+		else if (arg == "--threads") {
+			valid = readNumber(argc, argv, i, value);
+			options.threads = (size_t)value;
+		}
+		else if (arg == "--reproducible") {
+			options.reproducible = true;
+		}
+		else if (arg == "--scaling-report") {
+			options.scalingReport = true;
+		}
+		else if (arg == "--dt") {
+			valid = readFloat(argc, argv, i, options.dt) && options.dt > 0.0f;
+		}
+		else if (arg == "--physics-rate") {
+			float rate = 0.0f;
+			valid = readFloat(argc, argv, i, rate) && rate > 0.0f;
+			options.physicsRate = rate;
+		}
+		else if (arg == "--field-cell-size") {
+			valid = readFloat(argc, argv, i, options.fieldCellSize) && options.fieldCellSize >= 1.0f;
+		}
+		else if (arg == "--frame-budget") {
+			float budget = 0.0f;
+			valid = readFloat(argc, argv, i, budget) && budget > 0.0f;
+			options.frameBudget = budget;
+		}
+		else if (arg == "--lock-quality") {
+			options.lockQuality = true;
+		}
+		else if (arg == "--field-image" && i + 1 < argc) {
+			options.fieldImage = argv[++i];
+		}
+		else if (arg == "--load" && i + 1 < argc) {
+			options.load = argv[++i];
+		}
+		else if (arg == "--bodies-file" && i + 1 < argc) {
+			options.bodiesFile = argv[++i];
+		}
+		else if (arg == "--write-bodies" && i + 1 < argc) {
+			options.writeBodies = argv[++i];
+		}
+		else if (arg == "--save" && i + 1 < argc) {
+			options.save = argv[++i];
+		}
+		else if (arg == "--record" && i + 1 < argc) {
+			options.record = argv[++i];
+		}
+		else if (arg == "--replay" && i + 1 < argc) {
+			options.replay = argv[++i];
+		}
+		else if (arg == "--trace" && i + 1 < argc) {
+			options.trace = argv[++i];
+		}
+		else if (arg == "--workers") {
+			valid = readNumber(argc, argv, i, value) && value >= 1 && value <= 1024;
+			options.workers = (int)value;
+		}
+		else if (arg == "--decomposition" && i + 1 < argc) {
+			std::string name = argv[++i];
+			if (name == "strips") options.decomposition = Decomposition::STRIPS;
+			else if (name == "tiles") options.decomposition = Decomposition::TILES;
+			else valid = false;
+		}
+		else if (arg == "--listen" && i + 1 < argc) {
+			options.listen = argv[++i];
+		}
+		else if (arg == "--attach" && i + 1 < argc) {
+			options.attach = argv[++i];
+		}
+		else if (arg == "--worker") {
+			valid = readNumber(argc, argv, i, value) && value < 1024;
+			options.workerRank = (int)value;
+			options.headless = true;
+		}
+		else if (arg == "--connect" && i + 1 < argc) {
+			options.connect = argv[++i];
+		}
+		else if (arg == "--publish" && i + 1 < argc) {
+			options.publish = argv[++i];
+			valid = !options.publish.empty() && options.publish.find_first_of("/\\") == std::string::npos;
+		}
+		else if (arg == "--publish-rate") {
+			float rate = 0.0f;
+			valid = readFloat(argc, argv, i, rate) && rate >= 0.0f;
+			options.publishRate = rate;
+		}
+		else if (arg == "--ensemble" && i + 1 < argc) {
+			options.ensemble = argv[++i];
+			options.headless = true;
+		}
+		else if (arg == "--ensemble-results" && i + 1 < argc) {
+			options.ensembleResults = argv[++i];
+		}
+		else if (arg == "--export-frames" && i + 1 < argc) {
+			options.exportFrames = argv[++i];
+			options.headless = true;
+		}
+		else if (arg == "--export-pipe" && i + 1 < argc) {
+			options.exportPipe = argv[++i];
+			options.headless = true;
+		}
+		else if (arg == "--export-size") {
+			valid = readSize(argc, argv, i, options.exportFrame.width, options.exportFrame.height);
+		}
+		else if (arg == "--export-every") {
+			valid = readNumber(argc, argv, i, options.exportEvery) && options.exportEvery >= 1;
+		}
+		else if (arg == "--export-layers") {
+			valid = readLayers(argc, argv, i, options.exportFrame);
+		}
+		else if (arg == "--theta") {
+			valid = readFloat(argc, argv, i, options.theta) && options.theta > 0.0f;
+		}
+		else {
+			valid = false;
+		}
+
+		if (!valid) {
+			std::cerr << "Invalid argument: " << arg << "\n";
+			printUsage(argv[0]);
+			return false;
+		}
+	}
+
+	if (!options.load.empty() && !options.bodiesFile.empty()) {
+		std::cerr << "Invalid arguments: --load and --bodies-file both set the starting scene\n";
+		printUsage(argv[0]);
+		return false;
+	}
+	if (!options.exportFrames.empty() && !options.exportPipe.empty()) {
+		std::cerr << "Invalid arguments: --export-frames and --export-pipe both set where frames go\n";
+		printUsage(argv[0]);
+		return false;
+	}
+	if (!options.ensemble.empty() && (options.workers > 0 || options.scalingReport || !options.load.empty() || !options.record.empty()
+		|| !options.exportFrames.empty() || !options.exportPipe.empty() || !options.publish.empty())) {
+		std::cerr << "Invalid arguments: --ensemble runs in this process from a generated scene or --bodies-file, without --workers,\n"
+			"--scaling-report, --load, --record, --publish or frame export\n";
+		printUsage(argv[0]);
+		return false;
+	}
+	if (!options.publish.empty() && (options.workers > 0 || options.scalingReport || !options.replay.empty() || !options.attach.empty())) {
+		std::cerr << "Invalid arguments: --publish publishes a simulation running in this process, without --workers, --scaling-report,\n"
+			"--replay or --attach\n";
+		printUsage(argv[0]);
+		return false;
+	}
+	if ((!options.exportFrames.empty() || !options.exportPipe.empty()) && (options.workers > 0 || options.scalingReport)) {
+		std::cerr << "Invalid arguments: frames are exported from runs in this process, without --workers or --scaling-report\n";
+		printUsage(argv[0]);
+		return false;
+	}
+	if (options.workers > 0 && (options.boundary != Boundary::PERIODIC || options.integrator != Integrator::LEAPFROG
+		|| !clusterSupports(options.solver) || !options.record.empty())) {
+		std::cerr << "Invalid arguments: --workers runs the direct or Barnes-Hut solver with the periodic boundary and the leapfrog\n"
+			"integrator, without --record\n";
+		printUsage(argv[0]);
+		return false;
+	}
+	return true;
+}
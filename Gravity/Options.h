@@ -0,0 +1,65 @@
+#pragma once
+#include "Simulation.h"
+#include "Scenarios.h"
+#include "Domain.h"
+#include "Governor.h"
+#include "FrameRender.h"
+#include "SharedState.h"
+#include <cstddef>
+#include <string>
+
+// Command line options shared by the GUI and headless modes
+struct Options {
+	bool headless = false;					// Run without a window (--headless)
+	unsigned long long steps = 1000;		// Steps to run in headless mode (--steps N)
+	size_t bodies = 500;					// Random bodies to start with in headless mode (--bodies N)
+	unsigned int seed = 1;					// Seed for the random starting scene (--seed S)
+	Scenario scenario = Scenario::UNIFORM;	// Starting scene in headless mode (--scenario NAME)
+	Solver solver = Solver::DIRECT;			// Force solver (--solver direct|bh|pm|p3m)
+	float theta = 0.5f;						// Barnes-Hut opening angle (--theta T)
+	int meshSize = PM_GRID_SIZE;			// Particle-mesh cells per side (--mesh-size N)
+	Integrator integrator = Integrator::LEAPFROG;	// Time integration (--integrator euler|leapfrog|block)
+	Boundary boundary = Boundary::PERIODIC;	// Edges of the simulation space (--boundary periodic|open|reflective)
+	KernelIsa kernelIsa = KernelIsa::AUTO;	// Direct summation instruction set (--kernel auto|scalar|sse|avx2)
+	size_t threads = 0;						// Force phase threads, 0 uses every hardware thread (--threads N)
+	bool reproducible = false;				// Bit-for-bit identical results for any thread count (--reproducible)
+	float dt = SIM_DT;						// Timestep of one physics step (--dt T)
+	double physicsRate = 60.0;				// GUI: physics steps per wall clock second (--physics-rate HZ)
+	float fieldCellSize = 5.0f;				// GUI: size of the finest gravity field cell in pixels, down to 1 (--field-cell-size PX)
+	double frameBudget = GOVERNOR_FRAME_BUDGET_MS;	// GUI: frame time in milliseconds the quality governor keeps to (--frame-budget MS)
+	bool lockQuality = false;				// GUI: start with the quality governor locked to the chosen settings (--lock-quality)
+	std::string fieldImage;					// Headless: write the final gravity field heatmap to this PPM file (--field-image PATH)
+	std::string load;						// Start from this checkpoint instead of a generated scene (--load PATH)
+	std::string bodiesFile;					// Start from the bodies of this CSV or binary body file instead of a generated scene (--bodies-file PATH)
+	std::string writeBodies;				// Headless: write the starting scene to this CSV or binary body file (--write-bodies PATH)
+	std::string save;						// Headless: checkpoint of the final state, GUI: file of the Save / Load buttons (--save PATH)
+	std::string record;						// Stream every step to this trajectory file (--record PATH)
+	std::string replay;						// GUI: play back a trajectory file instead of simulating (--replay PATH)
+	std::string trace;						// Write a Chrome trace_event JSON of the run to this file on exit (--trace PATH)
+	std::string publish;					// Publish the bodies to shared memory under this name, GUI and headless (--publish NAME)
+	double publishRate = SHARED_STATE_RATE;	// Most snapshots per second published, 0 for every step (--publish-rate HZ)
+	std::string ensemble;					// Headless: run every combination of the parameters swept by this spec file (--ensemble SPEC)
+	std::string ensembleResults = "ensemble.csv";	// Headless: file the ensemble's per-run summaries are streamed to (--ensemble-results PATH)
+	std::string exportFrames;				// Headless: render frames as a PNG sequence into this directory (--export-frames DIR)
+	std::string exportPipe;					// Headless: pipe raw RGBA frames to this command's standard input (--export-pipe CMD)
+	unsigned long long exportEvery = 1;		// Headless: steps between exported frames (--export-every N)
+	FrameSettings exportFrame;				// Size and layers of exported frames (--export-size WxH, --export-layers LIST)
+	bool scalingReport = false;				// Headless: repeat the run for 1, 2, 4 ... threads, or workers with --workers (--scaling-report)
+	int workers = 0;						// Headless: split the space over this many worker processes, 0 runs in this process (--workers N)
+	Decomposition decomposition = Decomposition::STRIPS;	// Shape of the workers' tiles (--decomposition strips|tiles)
+	std::string listen;						// Headless with --workers: address workers and viewers connect to, unix:PATH or tcp:HOST:PORT (--listen ADDR)
+	std::string attach;						// GUI: show the run of the coordinator at this address instead of simulating (--attach ADDR)
+	int workerRank = -1;					// Worker process started by a coordinator (--worker RANK, internal)
+	std::string connect;					// Worker process: address of its coordinator (--connect ADDR, internal)
+	std::string program;					// Path the program was started from, used to start worker processes
+};
+
+// Copy the solver settings from the options into a simulation
+void applyOptions(const Options& options, Simulation& sim);
+
+// Parse argv into options, returns false and prints usage if the arguments are invalid
+bool parseOptions(int argc, char** argv, Options& options);
+
+// Solvers --workers can run, each tile computes them over its own bodies and ghosts. The mesh solvers need every body
+// of the space on one mesh.
+inline bool clusterSupports(Solver solver) { return solver == Solver::DIRECT || solver == Solver::BARNES_HUT; }
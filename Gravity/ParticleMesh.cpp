@@ -0,0 +1,377 @@
+#include "ParticleMesh.h"
+#include <cmath>
+#include <algorithm>
+#include <functional>
+
+const size_t PM_BODY_BLOCK = 1024;		// Bodies per task when interpolating forces
+
+// Run fn(task, worker) for every task, on the pool if there is one
+static void parallelFor(ThreadPool* pool, size_t count, const std::function<void(size_t task, size_t worker)>& fn) {
+	if (!pool) {
+		for (size_t task = 0; task < count; task++) fn(task, 0);
+		return;
+	}
+	pool->run(count, fn);
+}
+
+// Complex product without the NaN handling of std::complex's operator*
+template <typename T>
+static inline std::complex<T> multiply(const std::complex<T>& a, const std::complex<T>& b) {
+	return { a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real() };
+}
+
+// Fraction of the force at distance r that the P3M split leaves to the direct short-range pass, for split scale rs
+static double shortRangeFraction(double r, double rs) {
+	const double u = r / (2.0 * rs);
+	return std::erfc(u) + 2.0 * u / std::sqrt((double)SIM_PI) * std::exp(-u * u);
+}
+
+size_t ParticleMesh::computeForces(BodyArrays& bodies, Boundary boundary, ThreadPool* pool, const std::vector<unsigned int>* active) {
+	const size_t count = bodies.size();
+	if (count == 0) {
+		strength.clear();
+		return 0;
+	}
+
+	layout(bodies, boundary);
+	prepareKernels(pool);
+	deposit(bodies, pool);
+	transform(mesh, false, pool);
+
+	// Multiply by the transformed laws, with the 1 / size^2 of the inverse transform folded in
+	const bool wantStrength = computeStrength && periodic;
+	const Real scale = (Real)1 / ((Real)size * size);
+	parallelFor(pool, size, [&](size_t row, size_t) {
+		for (size_t k = row * size; k < (row + 1) * size; k++) {
+			work[k] = multiply(mesh[k], forceKernel[k]) * scale;
+			if (wantStrength) mesh[k] = multiply(mesh[k], strengthKernel[k]) * scale;
+		}
+	});
+	transform(work, true, pool);
+
+	if (wantStrength) {
+		transform(mesh, true, pool);
+		strength.resize((size_t)cells * cells);
+		for (size_t k = 0; k < strength.size(); k++) strength[k] = (float)mesh[k].real();
+		strengthCellSize = (float)cellX;
+	}
+	else {
+		strength.clear();
+	}
+
+	if (shortRange) buildCells(bodies, boundary);
+
+	// Every listed body gets the interpolated mesh acceleration plus, with P3M, the short-range rest from its neighbors
+	const size_t targets = active ? active->size() : count;
+	std::vector<size_t> blockPairs((targets + PM_BODY_BLOCK - 1) / PM_BODY_BLOCK, 0);
+	parallelFor(pool, blockPairs.size(), [&](size_t block, size_t) {
+		size_t pairs = 0;
+		for (size_t k = block * PM_BODY_BLOCK; k < std::min(targets, (block + 1) * PM_BODY_BLOCK); k++) {
+			size_t i = active ? (*active)[k] : k;
+			Vec2 acceleration = interpolate(bodies, i);
+			if (shortRange) {
+				Vec2 near = periodic ? shortRangeAcceleration<PeriodicBoundary>(bodies, i, pairs) : shortRangeAcceleration<OpenBoundary>(bodies, i, pairs);
+				acceleration.x += near.x;
+				acceleration.y += near.y;
+			}
+			bodies.fx[i] = bodies.m[i] * acceleration.x;
+			bodies.fy[i] = bodies.m[i] * acceleration.y;
+		}
+		blockPairs[block] = pairs;
+	});
+
+	size_t interactions = count;
+	for (size_t pairs : blockPairs) interactions += pairs;
+	return interactions;
+}
+
+void ParticleMesh::layout(const BodyArrays& bodies, Boundary boundary) {
+	cells = PM_MIN_GRID_SIZE;
+	while (cells < gridSize) cells *= 2;
+	periodic = boundary == Boundary::PERIODIC;
+	size = periodic ? cells : 2 * cells;
+
+	if (periodic) {
+		originX = 0;
+		originY = 0;
+		cellX = (Real)SIM_WIDTH / cells;
+		cellY = (Real)SIM_HEIGHT / cells;
+	}
+	else {
+		// Square cells over the bounding square with a free cell on every side, so cloud-in-cell weights never leave
+		// the unpadded quarter of the transform
+		Real minX = bodies.x[0], maxX = bodies.x[0], minY = bodies.y[0], maxY = bodies.y[0];
+		for (size_t i = 1; i < bodies.size(); i++) {
+			minX = std::min(minX, bodies.x[i]);
+			maxX = std::max(maxX, bodies.x[i]);
+			minY = std::min(minY, bodies.y[i]);
+			maxY = std::max(maxY, bodies.y[i]);
+		}
+		double needed = std::max((double)std::max(maxX - minX, maxY - minY) / (cells - 2), 1e-3);
+		double cell = std::pow((double)PM_OPEN_CELL_GROWTH, std::ceil(std::log(needed) / std::log((double)PM_OPEN_CELL_GROWTH)));
+		cellX = cellY = (Real)cell;
+		originX = minX - cellX;
+		originY = minY - cellY;
+	}
+
+	mesh.resize((size_t)size * size);
+	work.resize((size_t)size * size);
+
+	if (twiddles.size() != (size_t)size / 2) {
+		twiddles.resize(size / 2);
+		for (int k = 0; k < size / 2; k++) {
+			double angle = -2.0 * 3.14159265358979323846 * k / size;
+			twiddles[k] = Complex((Real)std::cos(angle), (Real)std::sin(angle));
+		}
+		int bits = 0;
+		while ((1 << bits) < size) bits++;
+		reversed.resize(size);
+		for (int k = 0; k < size; k++) {
+			unsigned int r = 0;
+			for (int b = 0; b < bits; b++) r |= ((k >> b) & 1u) << (bits - 1 - b);
+			reversed[k] = r;
+		}
+	}
+}
+
+void ParticleMesh::prepareKernels(ThreadPool* pool) {
+	const bool wantStrength = computeStrength && periodic;
+	if (size == kernelSize && cellX == kernelCellX && cellY == kernelCellY && periodic == kernelPeriodic && shortRange == kernelShortRange &&
+		(kernelStrength || !wantStrength)) return;
+
+	const double splitScale = PM_SPLIT_CELLS * (double)std::max(cellX, cellY);
+	cutoff = (Real)(PM_CUTOFF_SPLITS * splitScale);
+	if (shortRange) {
+		shortRangeTable.resize(PM_SHORT_RANGE_TABLE + 1);
+		for (int k = 0; k <= PM_SHORT_RANGE_TABLE; k++) {
+			shortRangeTable[k] = (float)shortRangeFraction(std::sqrt((double)k / PM_SHORT_RANGE_TABLE) * cutoff, splitScale);
+		}
+	}
+
+	// Offsets in [-size / 2, size / 2) cells. The offset of exactly half the torus has no sign, so its component
+	// along that axis is left out. A body's own cell feels no force, and its strength uses the mean squared
+	// distance of a point in the cell from its center.
+	forceKernel.resize((size_t)size * size);
+	if (wantStrength) strengthKernel.resize((size_t)size * size);
+	parallelFor(pool, size, [&](size_t row, size_t) {
+		const int dj = (int)row < size / 2 ? (int)row : (int)row - size;
+		for (int column = 0; column < size; column++) {
+			const int di = column < size / 2 ? column : column - size;
+			const double dx = di * (double)cellX;
+			const double dy = dj * (double)cellY;
+			const double distanceSquared = dx * dx + dy * dy;
+
+			double acceleration = 0.0;
+			if (distanceSquared > 0.0) {
+				double distance = std::sqrt(distanceSquared);
+				acceleration = (double)G / (distanceSquared * distance);
+				if (shortRange) acceleration *= 1.0 - shortRangeFraction(distance, splitScale);
+			}
+			// The convolution sums mass(q) * law(p - q) for the cell p being evaluated, which points away from q
+			const double kx = di == -size / 2 ? 0.0 : -acceleration * dx;
+			const double ky = dj == -size / 2 ? 0.0 : -acceleration * dy;
+			forceKernel[row * size + column] = Complex((Real)kx, (Real)ky);
+
+			if (wantStrength) {
+				double squared = distanceSquared > 0.0 ? distanceSquared : ((double)cellX * cellX + (double)cellY * cellY) / 12.0;
+				strengthKernel[row * size + column] = Complex((Real)((double)G / squared), 0);
+			}
+		}
+	});
+	transform(forceKernel, false, pool);
+	if (wantStrength) transform(strengthKernel, false, pool);
+
+	kernelSize = size;
+	kernelCellX = cellX;
+	kernelCellY = cellY;
+	kernelPeriodic = periodic;
+	kernelShortRange = shortRange;
+	kernelStrength = wantStrength;
+}
+
+// Cloud-in-cell position of coordinate p: the lower of the two nearest cell centers and the weight of the upper one
+static inline void cloudInCell(Real p, Real origin, Real cell, int cells, bool periodic, int& index, Real& fraction) {
+	Real u = (p - origin) / cell - (Real)0.5;
+	Real lower = std::floor(u);
+	fraction = u - lower;
+	index = (int)lower;
+	if (periodic) index = ((index % cells) + cells) % cells;
+	else index = std::clamp(index, 0, cells - 2);
+}
+
+void ParticleMesh::deposit(const BodyArrays& bodies, ThreadPool* pool) {
+	std::fill(mesh.begin(), mesh.end(), Complex(0, 0));
+
+	// Strips of at least two rows, an even number of them so the last and the first (neighbors on the torus)
+	// land in different passes
+	const size_t workers = pool ? pool->size() : 1;
+	int strips = 2;
+	while ((size_t)strips < 4 * workers && strips * 4 <= cells) strips *= 2;
+	const int stripRows = cells / strips;
+
+	// Bodies grouped by strip in index order, so every row sums its masses in the same order for any thread count
+	stripStart.assign(strips + 1, 0);
+	stripBodies.resize(bodies.size());
+	std::vector<int> stripOf(bodies.size());
+	for (size_t i = 0; i < bodies.size(); i++) {
+		int row;
+		Real fraction;
+		cloudInCell(bodies.y[i], originY, cellY, cells, periodic, row, fraction);
+		stripOf[i] = row / stripRows;
+		stripStart[stripOf[i] + 1]++;
+	}
+	for (int s = 0; s < strips; s++) stripStart[s + 1] += stripStart[s];
+	std::vector<size_t> fill(stripStart.begin(), stripStart.end() - 1);
+	for (size_t i = 0; i < bodies.size(); i++) stripBodies[fill[stripOf[i]]++] = (unsigned int)i;
+
+	for (int pass = 0; pass < 2; pass++) {
+		parallelFor(pool, strips / 2, [&](size_t task, size_t) {
+			const int strip = 2 * (int)task + pass;
+			for (size_t k = stripStart[strip]; k < stripStart[strip + 1]; k++) {
+				const unsigned int i = stripBodies[k];
+				int column, row;
+				Real fx, fy;
+				cloudInCell(bodies.x[i], originX, cellX, cells, periodic, column, fx);
+				cloudInCell(bodies.y[i], originY, cellY, cells, periodic, row, fy);
+				const int nextColumn = column + 1 == cells ? 0 : column + 1;
+				const int nextRow = row + 1 == cells ? 0 : row + 1;
+				const Real m = bodies.m[i];
+
+				Complex* lower = &mesh[(size_t)row * size];
+				Complex* upper = &mesh[(size_t)nextRow * size];
+				lower[column] += m * (1 - fx) * (1 - fy);
+				lower[nextColumn] += m * fx * (1 - fy);
+				upper[column] += m * (1 - fx) * fy;
+				upper[nextColumn] += m * fx * fy;
+			}
+		});
+	}
+}
+
+Vec2 ParticleMesh::interpolate(const BodyArrays& bodies, size_t i) const {
+	int column, row;
+	Real fx, fy;
+	cloudInCell(bodies.x[i], originX, cellX, cells, periodic, column, fx);
+	cloudInCell(bodies.y[i], originY, cellY, cells, periodic, row, fy);
+	const int nextColumn = column + 1 == cells ? 0 : column + 1;
+	const int nextRow = row + 1 == cells ? 0 : row + 1;
+
+	const Complex* lower = &work[(size_t)row * size];
+	const Complex* upper = &work[(size_t)nextRow * size];
+	Complex a = lower[column] * ((1 - fx) * (1 - fy)) + lower[nextColumn] * (fx * (1 - fy))
+		+ upper[column] * ((1 - fx) * fy) + upper[nextColumn] * (fx * fy);
+	return { a.real(), a.imag() };
+}
+
+void ParticleMesh::transform(std::vector<Complex>& data, bool inverse, ThreadPool* pool) {
+	parallelFor(pool, size, [&](size_t row, size_t) { transform1d(&data[row * size], inverse); });
+
+	columnScratch.resize(pool ? pool->size() : 1);
+	parallelFor(pool, size / PM_FFT_COLUMNS, [&](size_t group, size_t worker) {
+		std::vector<Complex>& scratch = columnScratch[worker];
+		scratch.resize((size_t)PM_FFT_COLUMNS * size);
+		const size_t first = group * PM_FFT_COLUMNS;
+		for (int row = 0; row < size; row++) {
+			for (int c = 0; c < PM_FFT_COLUMNS; c++) scratch[(size_t)c * size + row] = data[(size_t)row * size + first + c];
+		}
+		for (int c = 0; c < PM_FFT_COLUMNS; c++) transform1d(&scratch[(size_t)c * size], inverse);
+		for (int row = 0; row < size; row++) {
+			for (int c = 0; c < PM_FFT_COLUMNS; c++) data[(size_t)row * size + first + c] = scratch[(size_t)c * size + row];
+		}
+	});
+}
+
+void ParticleMesh::transform1d(Complex* data, bool inverse) const {
+	for (int k = 0; k < size; k++) {
+		if ((int)reversed[k] > k) std::swap(data[k], data[reversed[k]]);
+	}
+
+	// Iterative radix-2 butterflies, the inverse uses conjugate twiddles and is scaled by the caller
+	for (int length = 2; length <= size; length <<= 1) {
+		const int half = length / 2;
+		const int stride = size / length;
+		for (int start = 0; start < size; start += length) {
+			for (int k = 0; k < half; k++) {
+				Complex w = twiddles[(size_t)k * stride];
+				if (inverse) w = std::conj(w);
+				Complex u = data[start + k];
+				Complex v = multiply(data[start + k + half], w);
+				data[start + k] = u + v;
+				data[start + k + half] = u - v;
+			}
+		}
+	}
+}
+
+void ParticleMesh::buildCells(const BodyArrays& bodies, Boundary boundary) {
+	// Cells at least the cutoff wide over the mesh area, so every neighbor within it is in the 3 x 3 cells around a body.
+	// With fewer than three cells across the torus a neighbor cell would be visited twice, so it becomes one cell.
+	const Real width = cells * cellX;
+	const Real height = cells * cellY;
+	cellColumns = std::max(1, (int)(width / cutoff));
+	cellRows = std::max(1, (int)(height / cutoff));
+	if (boundary == Boundary::PERIODIC) {
+		if (cellColumns < 3) cellColumns = 1;
+		if (cellRows < 3) cellRows = 1;
+	}
+	cellOriginX = originX;
+	cellOriginY = originY;
+	cellWidth = width / cellColumns;
+	cellHeight = height / cellRows;
+
+	const size_t cellCount = (size_t)cellColumns * cellRows;
+	std::vector<unsigned int> cellOf(bodies.size());
+	cellStart.assign(cellCount + 1, 0);
+	for (size_t i = 0; i < bodies.size(); i++) {
+		int column = std::clamp((int)std::floor((bodies.x[i] - cellOriginX) / cellWidth), 0, cellColumns - 1);
+		int row = std::clamp((int)std::floor((bodies.y[i] - cellOriginY) / cellHeight), 0, cellRows - 1);
+		cellOf[i] = (unsigned int)(row * cellColumns + column);
+		cellStart[cellOf[i] + 1]++;
+	}
+	for (size_t c = 0; c < cellCount; c++) cellStart[c + 1] += cellStart[c];
+	std::vector<size_t> fill(cellStart.begin(), cellStart.end() - 1);
+	cellBodies.resize(bodies.size());
+	for (size_t i = 0; i < bodies.size(); i++) cellBodies[fill[cellOf[i]]++] = (unsigned int)i;
+}
+
+template <typename Policy>
+Vec2 ParticleMesh::shortRangeAcceleration(const BodyArrays& bodies, size_t i, size_t& pairs) const {
+	const int column = std::clamp((int)std::floor((bodies.x[i] - cellOriginX) / cellWidth), 0, cellColumns - 1);
+	const int row = std::clamp((int)std::floor((bodies.y[i] - cellOriginY) / cellHeight), 0, cellRows - 1);
+	const Real cutoffSquared = cutoff * cutoff;
+	const Real tableScale = (Real)PM_SHORT_RANGE_TABLE / cutoffSquared;
+	Real ax = 0, ay = 0;
+
+	for (int dr = -1; dr <= 1; dr++) {
+		int r = row + dr;
+		if (cellRows == 1 && dr != 0) continue;
+		if (Policy::WRAPS) r = (r + cellRows) % cellRows;
+		else if (r < 0 || r >= cellRows) continue;
+
+		for (int dc = -1; dc <= 1; dc++) {
+			int c = column + dc;
+			if (cellColumns == 1 && dc != 0) continue;
+			if (Policy::WRAPS) c = (c + cellColumns) % cellColumns;
+			else if (c < 0 || c >= cellColumns) continue;
+
+			const size_t cell = (size_t)r * cellColumns + c;
+			for (size_t k = cellStart[cell]; k < cellStart[cell + 1]; k++) {
+				const unsigned int j = cellBodies[k];
+				if (j == i) continue;
+				Real dx = Policy::offset(bodies.x[j] - bodies.x[i], (Real)SIM_WIDTH, SIM_WIDTH_HALF);
+				Real dy = Policy::offset(bodies.y[j] - bodies.y[i], (Real)SIM_HEIGHT, SIM_HEIGHT_HALF);
+				Real distanceSquared = (dx * dx) + (dy * dy);
+				if (distanceSquared >= cutoffSquared || distanceSquared < MIN_DISTANCE_SQUARED) continue;
+
+				Real t = distanceSquared * tableScale;
+				int entry = std::min((int)t, PM_SHORT_RANGE_TABLE - 1);
+				Real fraction = shortRangeTable[entry] + (shortRangeTable[entry + 1] - shortRangeTable[entry]) * (t - entry);
+				Real a = G * bodies.m[j] * fraction / (distanceSquared * std::sqrt(distanceSquared));
+				ax += a * dx;
+				ay += a * dy;
+				pairs++;
+			}
+		}
+	}
+	return { ax, ay };
+}
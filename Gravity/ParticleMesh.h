@@ -0,0 +1,111 @@
+#pragma once
+#include "BodyArrays.h"
+#include "ThreadPool.h"
+#include <vector>
+#include <complex>
+#include <cstddef>
+
+const int PM_GRID_SIZE = 256;				// Default mesh cells per side
+const int PM_MIN_GRID_SIZE = 8;				// Smallest supported mesh
+const int PM_MAX_GRID_SIZE = 8192;			// Largest supported mesh
+const float PM_SPLIT_CELLS = 1.25f;			// P3M: scale of the split between mesh and direct force, in mesh cells
+const float PM_CUTOFF_SPLITS = 4.5f;		// P3M: pairs further apart than this many split scales are left to the mesh
+const int PM_SHORT_RANGE_TABLE = 1024;		// P3M: entries of the tabulated short-range factor, over the squared cutoff
+const int PM_FFT_COLUMNS = 8;				// Mesh columns transformed together, so every row access fills a cache line
+const float PM_OPEN_CELL_GROWTH = 1.0905f;	// Open boundaries: cell sizes are rounded up to powers of this (2^(1/8)),
+											// so the mesh transform of the force law is reused while the bodies spread
+
+// Particle-mesh gravity. Masses are deposited on a mesh with cloud-in-cell weights, convolved with the force law
+// through FFTs and the mesh accelerations interpolated back to the bodies with the same weights, O(n + m log m)
+// for n bodies on m cells. The force law is the direct solver's G m / r^2 between bodies in the plane, whose
+// Green's function is not the one of the 2D Poisson equation, so it is sampled on the mesh in real space and
+// transformed once instead. On a periodic boundary the mesh covers the torus and the law is the minimum image
+// like everywhere else. Other boundaries use a mesh over the bodies' bounding square, zero-padded to twice its
+// size so nothing wraps.
+//
+// With shortRange (P3M) the law is split at PM_SPLIT_CELLS cells with the erfc split of Hockney & Eastwood /
+// GADGET: the mesh carries the smooth long-range part, and neighbors within the cutoff add the short-range rest
+// directly, found through a cell list. Without it close neighbors only feel the force smoothed over a cell or two.
+struct ParticleMesh {
+	int gridSize = PM_GRID_SIZE;		// Cells per side, rounded up to a power of two
+	bool shortRange = false;			// P3M: add the direct short-range force of neighbors within the cutoff
+	bool computeStrength = false;		// Periodic boundary: also fill "strength" for the gravity field heatmap
+
+	// Summed G m / r^2 at every cell center from the last computation, gridSize^2 values row-major like FieldLevel,
+	// empty unless computeStrength is set on a periodic boundary. Comes from the same transformed mesh as the forces.
+	std::vector<float> strength;
+	float strengthCellSize = 0.0f;
+
+	// Replace the force on the listed bodies (every body if active is null) with the mesh force, parallel over the
+	// pool if given. The mesh always holds every body. Returns the number of bodies and P3M pairs evaluated.
+	size_t computeForces(BodyArrays& bodies, Boundary boundary, ThreadPool* pool, const std::vector<unsigned int>* active = nullptr);
+
+private:
+	typedef std::complex<Real> Complex;
+
+	// Mesh layout of the current computation
+	int cells = 0;				// Cells per side holding bodies (gridSize)
+	int size = 0;				// Transform size per side, cells or 2 * cells when zero-padded
+	bool periodic = true;
+	Real originX = 0;			// Position of the corner of cell (0, 0)
+	Real originY = 0;
+	Real cellX = 1;				// Cell size
+	Real cellY = 1;
+
+	std::vector<Complex> mesh;				// Masses, then their transform, then the strength
+	std::vector<Complex> work;				// Transform of the masses times the acceleration law, then accelerations (x real, y imaginary)
+	std::vector<Complex> forceKernel;		// Transform of the acceleration law, x + i y
+	std::vector<Complex> strengthKernel;	// Transform of G / r^2
+	std::vector<Complex> twiddles;			// e^(-2 pi i k / size) for k < size / 2
+	std::vector<unsigned int> reversed;		// Bit reversal permutation of [0, size)
+	std::vector<std::vector<Complex>> columnScratch;	// Per worker, PM_FFT_COLUMNS columns at a time
+
+	// Key of the cached kernels
+	int kernelSize = 0;
+	Real kernelCellX = 0;
+	Real kernelCellY = 0;
+	bool kernelPeriodic = true;
+	bool kernelShortRange = false;
+	bool kernelStrength = false;
+
+	// Deposit order: bodies sorted by strip of mesh rows
+	std::vector<unsigned int> stripBodies;
+	std::vector<size_t> stripStart;
+
+	// P3M neighbor search
+	std::vector<float> shortRangeTable;		// Short-range fraction of the force over r^2 in [0, cutoff^2]
+	Real cutoff = 0;
+	std::vector<unsigned int> cellBodies;	// Bodies sorted by neighbor cell
+	std::vector<size_t> cellStart;
+	int cellColumns = 1;
+	int cellRows = 1;
+	Real cellOriginX = 0;
+	Real cellOriginY = 0;
+	Real cellWidth = 1;
+	Real cellHeight = 1;
+
+	// Place the mesh over the simulation space or the bodies, and size the buffers
+	void layout(const BodyArrays& bodies, Boundary boundary);
+
+	// Sample and transform the acceleration (and strength) law for the current layout, unless cached
+	void prepareKernels(ThreadPool* pool);
+
+	// Cloud-in-cell deposit of every mass, strips of rows in two passes so no two tasks touch the same row
+	void deposit(const BodyArrays& bodies, ThreadPool* pool);
+
+	// Cloud-in-cell interpolation of the mesh acceleration at body i
+	Vec2 interpolate(const BodyArrays& bodies, size_t i) const;
+
+	// In-place 2D FFT of a size x size mesh, rows then columns
+	void transform(std::vector<Complex>& data, bool inverse, ThreadPool* pool);
+
+	// In-place 1D FFT of "size" consecutive values
+	void transform1d(Complex* data, bool inverse) const;
+
+	// Sort the bodies into cells at least the cutoff wide for the short-range pass
+	void buildCells(const BodyArrays& bodies, Boundary boundary);
+
+	// Short-range acceleration of body i from its neighbors, adds the pairs it evaluated to "pairs"
+	template <typename Policy>
+	Vec2 shortRangeAcceleration(const BodyArrays& bodies, size_t i, size_t& pairs) const;
+};
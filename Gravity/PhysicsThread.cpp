@@ -0,0 +1,70 @@
+#include "PhysicsThread.h"
+#include "Profiler.h"
+#include <chrono>
+#include <algorithm>
+
+PhysicsThread::PhysicsThread(Simulation& sim, double stepsPerSecond, TrajectoryRecorder* recorder, SharedStatePublisher* publisher)
+	: sim(sim), period(1.0 / stepsPerSecond), recorder(recorder), publisher(publisher) {
+	sim.recordPreviousPositions = true;
+	if (recorder) sim.recordEvents = true;
+
+	// Publish the starting state so the renderer has something to draw immediately
+	snapshots.writeBuffer().capture(sim, now());
+	snapshots.publish();
+
+	thread = std::thread(&PhysicsThread::run, this);
+}
+
+PhysicsThread::~PhysicsThread() {
+	running = false;
+	thread.join();
+}
+
+void PhysicsThread::post(std::function<void(Simulation&)> command) {
+	std::lock_guard<std::mutex> lock(commandMutex);
+	commands.push_back(std::move(command));
+}
+
+double PhysicsThread::now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+float PhysicsThread::interpolationAlpha(const Snapshot& snapshot, double now) const {
+	return (float)std::clamp((now - snapshot.publishedAt) / period, 0.0, 1.0);
+}
+
+void PhysicsThread::applyCommands() {
+	std::vector<std::function<void(Simulation&)>> pending;
+	{
+		std::lock_guard<std::mutex> lock(commandMutex);
+		pending.swap(commands);
+	}
+	for (auto& command : pending) command(sim);
+}
+
+void PhysicsThread::run() {
+	using Clock = std::chrono::steady_clock;
+	auto nextStep = Clock::now();
+	Profiler::get().nameThread("Physics");
+
+	while (running) {
+		{
+			ProfileScope scope(Phase::STEP);
+			applyCommands();
+			sim.step();
+			if (recorder) recorder->record(sim);
+			if (publisher) publisher->publish(sim);
+
+			snapshots.writeBuffer().capture(sim, now());
+			snapshots.publish();
+		}
+
+		// Fixed timestep: if a step took too long, run the next ones back to back to catch up,
+		// but give up after a few so a heavy scene slows down instead of spiralling.
+		const auto stepDuration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(period.load()));
+		nextStep += stepDuration;
+		auto current = Clock::now();
+		if (current - nextStep > stepDuration * PHYSICS_MAX_CATCH_UP_STEPS) nextStep = current;
+		std::this_thread::sleep_until(nextStep);
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "Simulation.h"
+#include "Snapshot.h"
+#include "Trajectory.h"
+#include "SharedState.h"
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <functional>
+
+const double PHYSICS_STEPS_PER_SECOND = 60.0;	// Default step rate, matches the original one step per 60 FPS frame
+const int PHYSICS_MAX_CATCH_UP_STEPS = 5;		// Steps the thread may fall behind before it gives up catching up
+
+// Runs a simulation on its own thread at a fixed number of steps per second, independent of the frame rate.
+// The render loop never touches the simulation directly: it posts commands and reads published snapshots.
+struct PhysicsThread {
+	// Take over "sim", which must not be used by anyone else until the thread is stopped.
+	// Every step is handed to "recorder" and "publisher" if they are given.
+	PhysicsThread(Simulation& sim, double stepsPerSecond = PHYSICS_STEPS_PER_SECOND, TrajectoryRecorder* recorder = nullptr,
+		SharedStatePublisher* publisher = nullptr);
+	~PhysicsThread();
+
+	PhysicsThread(const PhysicsThread&) = delete;
+	PhysicsThread& operator=(const PhysicsThread&) = delete;
+
+	// Queue a change to the simulation, applied by the physics thread before its next step
+	void post(std::function<void(Simulation&)> command);
+
+	// Latest published snapshot, lock-free. Valid until the next call to latest().
+	const Snapshot& latest() { return snapshots.read(); }
+
+	// How far (0 to 1) the renderer is between the start and end of a snapshot's step at wall clock time "now"
+	float interpolationAlpha(const Snapshot& snapshot, double now) const;
+
+	// Wall clock seconds on the clock used for snapshot timestamps
+	static double now();
+
+	// Seconds between two steps
+	double stepPeriod() const { return period; }
+
+	// Change the number of steps per second, from the next step on
+	void setStepsPerSecond(double stepsPerSecond) { period = 1.0 / stepsPerSecond; }
+
+private:
+	Simulation& sim;
+	std::atomic<double> period;
+	TrajectoryRecorder* recorder;
+	SharedStatePublisher* publisher;
+	SnapshotBuffer snapshots;
+	std::mutex commandMutex;
+	std::vector<std::function<void(Simulation&)>> commands;
+	std::atomic<bool> running{ true };
+	std::thread thread;
+
+	// Fixed timestep loop
+	void run();
+
+	// Apply queued commands
+	void applyCommands();
+};
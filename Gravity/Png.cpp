@@ -0,0 +1,244 @@
+#include "Png.h"
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+const int DEFLATE_WINDOW = 32768;			// Farthest back a match may start
+const int DEFLATE_MIN_MATCH = 3;
+const int DEFLATE_MAX_MATCH = 258;
+const int DEFLATE_HASH_BITS = 15;			// Hash table of 3-byte prefixes
+
+// Lengths 3 to 258 and distances 1 to 32768 as a base per code plus extra bits (RFC 1951, 3.2.5)
+static const int LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const int LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const int DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+	4097, 6145, 8193, 12289, 16385, 24577 };
+static const int DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// Bits are packed into bytes starting at the least significant bit
+struct BitWriter {
+	std::vector<unsigned char>& out;
+	uint64_t bits = 0;
+	int count = 0;
+
+	explicit BitWriter(std::vector<unsigned char>& out) : out(out) {}
+
+	void put(uint32_t value, int length) {
+		bits |= (uint64_t)value << count;
+		count += length;
+		while (count >= 8) {
+			out.push_back((unsigned char)bits);
+			bits >>= 8;
+			count -= 8;
+		}
+	}
+
+	// Huffman codes are defined most significant bit first
+	void putCode(uint32_t code, int length) {
+		uint32_t reversed = 0;
+		for (int i = 0; i < length; i++) reversed |= ((code >> i) & 1) << (length - 1 - i);
+		put(reversed, length);
+	}
+
+	void flush() {
+		if (count > 0) out.push_back((unsigned char)bits);
+		bits = 0;
+		count = 0;
+	}
+};
+
+// Literal/length symbol with the fixed Huffman code (RFC 1951, 3.2.6)
+static void putSymbol(BitWriter& writer, int symbol) {
+	if (symbol < 144) writer.putCode(0x30 + symbol, 8);
+	else if (symbol < 256) writer.putCode(0x190 + symbol - 144, 9);
+	else if (symbol < 280) writer.putCode(symbol - 256, 7);
+	else writer.putCode(0xC0 + symbol - 280, 8);
+}
+
+static void putMatch(BitWriter& writer, int length, int distance) {
+	int code = 28;
+	while (LENGTH_BASE[code] > length) code--;
+	putSymbol(writer, 257 + code);
+	if (LENGTH_EXTRA[code] > 0) writer.put(length - LENGTH_BASE[code], LENGTH_EXTRA[code]);
+
+	code = 29;
+	while (DISTANCE_BASE[code] > distance) code--;
+	writer.putCode(code, 5);
+	if (DISTANCE_EXTRA[code] > 0) writer.put(distance - DISTANCE_BASE[code], DISTANCE_EXTRA[code]);
+}
+
+// One fixed-Huffman deflate block over all of "data", matches found through hash chains of 3-byte prefixes
+static void deflate(const std::vector<unsigned char>& data, std::vector<unsigned char>& out) {
+	BitWriter writer(out);
+	writer.put(1, 1);	// Last block
+	writer.put(1, 2);	// Fixed Huffman codes
+
+	const int size = (int)data.size();
+	std::vector<int> head((size_t)1 << DEFLATE_HASH_BITS, -1);
+	std::vector<int> previous(DEFLATE_WINDOW, -1);
+	auto hash = [&](int i) {
+		return (int)(((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & ((1 << DEFLATE_HASH_BITS) - 1));
+	};
+	auto insert = [&](int i) {
+		if (i + DEFLATE_MIN_MATCH > size) return;
+		int h = hash(i);
+		previous[i & (DEFLATE_WINDOW - 1)] = head[h];
+		head[h] = i;
+	};
+
+	int i = 0;
+	while (i < size) {
+		int bestLength = 0;
+		int bestDistance = 0;
+		if (i + DEFLATE_MIN_MATCH <= size) {
+			const int limit = std::min(DEFLATE_MAX_MATCH, size - i);
+			int candidate = head[hash(i)];
+			for (int chain = 0; candidate >= 0 && i - candidate <= DEFLATE_WINDOW && chain < PNG_MAX_CHAIN; chain++) {
+				if (data[candidate + bestLength] == data[i + bestLength]) {
+					int length = 0;
+					while (length < limit && data[candidate + length] == data[i + length]) length++;
+					if (length > bestLength) {
+						bestLength = length;
+						bestDistance = i - candidate;
+						if (length == limit) break;
+					}
+				}
+				int next = previous[candidate & (DEFLATE_WINDOW - 1)];
+				if (next >= candidate) break; // The slot was reused by a newer position
+				candidate = next;
+			}
+		}
+
+		if (bestLength >= DEFLATE_MIN_MATCH) {
+			putMatch(writer, bestLength, bestDistance);
+			for (int k = 0; k < bestLength; k++) insert(i + k);
+			i += bestLength;
+		}
+		else {
+			putSymbol(writer, data[i]);
+			insert(i);
+			i++;
+		}
+	}
+	putSymbol(writer, 256); // End of block
+	writer.flush();
+}
+
+static uint32_t adler32(const std::vector<unsigned char>& data) {
+	uint32_t a = 1;
+	uint32_t b = 0;
+	size_t i = 0;
+	while (i < data.size()) {
+		// 5552 bytes is the most that can be summed before b could overflow
+		size_t end = std::min(data.size(), i + 5552);
+		for (; i < end; i++) {
+			a += data[i];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+	}
+	return (b << 16) | a;
+}
+
+static uint32_t crc32(const unsigned char* data, size_t size) {
+	static const std::vector<uint32_t> table = [] {
+		std::vector<uint32_t> entries(256);
+		for (uint32_t n = 0; n < 256; n++) {
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			entries[n] = c;
+		}
+		return entries;
+	}();
+
+	uint32_t crc = 0xFFFFFFFFu;
+	for (size_t i = 0; i < size; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return crc ^ 0xFFFFFFFFu;
+}
+
+// PNG numbers are big-endian
+static void putBigEndian(std::vector<unsigned char>& out, uint32_t value) {
+	for (int shift = 24; shift >= 0; shift -= 8) out.push_back((unsigned char)(value >> shift));
+}
+
+static void putChunk(std::vector<unsigned char>& out, const char type[4], const std::vector<unsigned char>& data) {
+	putBigEndian(out, (uint32_t)data.size());
+	size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data.begin(), data.end());
+	putBigEndian(out, crc32(out.data() + start, out.size() - start));
+}
+
+static int paeth(int left, int up, int upLeft) {
+	int estimate = left + up - upLeft;
+	int toLeft = std::abs(estimate - left);
+	int toUp = std::abs(estimate - up);
+	int toUpLeft = std::abs(estimate - upLeft);
+	if (toLeft <= toUp && toLeft <= toUpLeft) return left;
+	return toUp <= toUpLeft ? up : upLeft;
+}
+
+void encodePng(const uint32_t* pixels, int width, int height, std::vector<unsigned char>& out) {
+	const size_t stride = (size_t)width * 3;
+
+	// Rows as RGB, each preceded by the filter type that gives the smallest sum of absolute differences
+	std::vector<unsigned char> filtered;
+	filtered.reserve((stride + 1) * height);
+	std::vector<unsigned char> row(stride), above(stride, 0), candidate(stride), best(stride);
+	for (int y = 0; y < height; y++) {
+		const unsigned char* rgba = (const unsigned char*)(pixels + (size_t)y * width);
+		for (int x = 0; x < width; x++) std::memcpy(&row[(size_t)x * 3], rgba + (size_t)x * 4, 3);
+
+		long bestCost = -1;
+		int bestFilter = 0;
+		for (int filter = 0; filter < 5; filter++) {
+			long cost = 0;
+			for (size_t i = 0; i < stride; i++) {
+				int left = i >= 3 ? row[i - 3] : 0;
+				int upLeft = i >= 3 ? above[i - 3] : 0;
+				int predicted = 0;
+				if (filter == 1) predicted = left;
+				else if (filter == 2) predicted = above[i];
+				else if (filter == 3) predicted = (left + above[i]) / 2;
+				else if (filter == 4) predicted = paeth(left, above[i], upLeft);
+				candidate[i] = (unsigned char)(row[i] - predicted);
+				cost += std::abs((int)(signed char)candidate[i]);
+			}
+			if (bestCost < 0 || cost < bestCost) {
+				bestCost = cost;
+				bestFilter = filter;
+				best.swap(candidate);
+			}
+		}
+		filtered.push_back((unsigned char)bestFilter);
+		filtered.insert(filtered.end(), best.begin(), best.end());
+		above.swap(row);
+	}
+
+	// zlib stream: header, deflate data, Adler-32 of the uncompressed bytes
+	std::vector<unsigned char> compressed = { 0x78, 0x01 };
+	deflate(filtered, compressed);
+	putBigEndian(compressed, adler32(filtered));
+
+	std::vector<unsigned char> header;
+	putBigEndian(header, (uint32_t)width);
+	putBigEndian(header, (uint32_t)height);
+	header.insert(header.end(), { 8, 2, 0, 0, 0 }); // 8 bits per sample, RGB, deflate, adaptive filters, no interlace
+
+	static const unsigned char SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	out.assign(SIGNATURE, SIGNATURE + 8);
+	putChunk(out, "IHDR", header);
+	putChunk(out, "IDAT", compressed);
+	putChunk(out, "IEND", {});
+}
+
+bool writePng(const std::string& path, const uint32_t* pixels, int width, int height) {
+	std::vector<unsigned char> bytes;
+	encodePng(pixels, width, height, bytes);
+	std::ofstream file(path, std::ios::binary);
+	if (!file) return false;
+	file.write((const char*)bytes.data(), bytes.size());
+	return (bool)file;
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+const int PNG_MAX_CHAIN = 32;			// Earlier matches tried per byte by the deflate search, more compresses better but slower
+
+// Encode RGBA8 pixels (memory order, like FieldImage) as an 8-bit RGB PNG, alpha is dropped. Every row gets the
+// filter with the smallest sum of absolute values and the result is deflated with the fixed Huffman codes, which
+// compresses the dark, flat frames of the simulation well without an external library.
+void encodePng(const uint32_t* pixels, int width, int height, std::vector<unsigned char>& out);
+
+// Encode and write a PNG file, returns false if the file can't be written
+bool writePng(const std::string& path, const uint32_t* pixels, int width, int height);
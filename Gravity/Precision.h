@@ -0,0 +1,24 @@
+#pragma once
+
+// Scalar types of the physics core, picked at compile time so every precision builds as its own target:
+//   (default)                  float everywhere, the fastest
+//   GRAVITY_PRECISION_DOUBLE   double everywhere
+//   GRAVITY_PRECISION_MIXED    positions, velocities, masses and force sums in double, each pair's force in float
+// Rendering, the gravity field and the file formats' headers stay float in every build.
+#if defined(GRAVITY_PRECISION_DOUBLE) && defined(GRAVITY_PRECISION_MIXED)
+#error "Define at most one of GRAVITY_PRECISION_DOUBLE and GRAVITY_PRECISION_MIXED"
+#endif
+
+#if defined(GRAVITY_PRECISION_DOUBLE)
+typedef double Real;			// Body state, integration and force accumulation
+typedef double PairReal;		// Arithmetic of a single pair interaction in the direct summation kernels
+#define GRAVITY_PRECISION_NAME "double"
+#elif defined(GRAVITY_PRECISION_MIXED)
+typedef double Real;
+typedef float PairReal;
+#define GRAVITY_PRECISION_NAME "mixed"
+#else
+typedef float Real;
+typedef float PairReal;
+#define GRAVITY_PRECISION_NAME "float"
+#endif
@@ -0,0 +1,145 @@
+#include "Profiler.h"
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+
+// Small per-thread ID for traces
+static int threadId() {
+	static std::atomic<int> nextId{ 1 };
+	thread_local int id = nextId++;
+	return id;
+}
+
+Profiler& Profiler::get() {
+	static Profiler profiler;
+	return profiler;
+}
+
+uint64_t Profiler::now() {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Profiler::push(History& history, float value) {
+	uint32_t index = history.written.load(std::memory_order_relaxed);
+	history.samples[index % PROFILE_HISTORY].store(value, std::memory_order_relaxed);
+	history.written.store(index + 1, std::memory_order_release);
+}
+
+ProfileStats Profiler::summarize(const History& history) {
+	ProfileStats stats;
+	uint32_t written = history.written.load(std::memory_order_acquire);
+	stats.samples = (int)std::min<uint32_t>(written, PROFILE_HISTORY);
+	if (stats.samples == 0) return stats;
+
+	float sorted[PROFILE_HISTORY];
+	for (int i = 0; i < stats.samples; i++) sorted[i] = history.samples[i].load(std::memory_order_relaxed);
+	stats.last = history.samples[(written - 1) % PROFILE_HISTORY].load(std::memory_order_relaxed);
+
+	int median = stats.samples / 2;
+	int high = std::min(stats.samples - 1, (stats.samples * 99) / 100);
+	std::nth_element(sorted, sorted + median, sorted + stats.samples);
+	stats.p50 = sorted[median];
+	std::nth_element(sorted, sorted + high, sorted + stats.samples);
+	stats.p99 = sorted[high];
+	return stats;
+}
+
+void Profiler::record(Phase phase, uint64_t start, uint64_t end) {
+	push(phases[(int)phase], (float)((end - start) * 1e-6));
+	if (tracing()) trace({ (int)phase, threadId(), start, end - start, 0.0 });
+}
+
+void Profiler::count(Counter counter, double value) {
+	push(counters[(int)counter], (float)value);
+	if (tracing()) trace({ (int)Phase::COUNT + (int)counter, threadId(), now(), 0, value });
+}
+
+ProfileStats Profiler::stats(Phase phase) const {
+	return summarize(phases[(int)phase]);
+}
+
+ProfileStats Profiler::stats(Counter counter) const {
+	return summarize(counters[(int)counter]);
+}
+
+void Profiler::nameThread(const char* name) {
+	std::lock_guard<std::mutex> lock(traceMutex);
+	threadNames.push_back({ threadId(), name });
+}
+
+void Profiler::startTrace() {
+	std::lock_guard<std::mutex> lock(traceMutex);
+	events.clear();
+	traceStart = now();
+	tracingEnabled = true;
+}
+
+void Profiler::trace(const TraceEvent& event) {
+	std::lock_guard<std::mutex> lock(traceMutex);
+	if (events.size() >= PROFILE_MAX_TRACE_EVENTS) {
+		tracingEnabled = false;
+		return;
+	}
+	events.push_back(event);
+}
+
+bool Profiler::writeTrace(const std::string& path) {
+	std::lock_guard<std::mutex> lock(traceMutex);
+	tracingEnabled = false;
+
+	std::ofstream file(path);
+	if (!file) return false;
+
+	// Complete ("X") events for phases and counter ("C") events, timestamps in microseconds since the trace started
+	file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+	bool first = true;
+	for (const auto& name : threadNames) {
+		file << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << name.first
+			<< ", \"args\": {\"name\": \"" << name.second << "\"}}";
+		first = false;
+	}
+	file.precision(3);
+	file << std::fixed;
+	for (const TraceEvent& event : events) {
+		double timestamp = (double)(event.start - std::min(event.start, traceStart)) * 1e-3;
+		file << (first ? "" : ",\n");
+		if (event.series < (int)Phase::COUNT) {
+			file << "{\"name\": \"" << phaseName((Phase)event.series) << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread
+				<< ", \"ts\": " << timestamp << ", \"dur\": " << event.duration * 1e-3 << "}";
+		}
+		else {
+			const char* name = counterName((Counter)(event.series - (int)Phase::COUNT));
+			file << "{\"name\": \"" << name << "\", \"ph\": \"C\", \"pid\": 1, \"tid\": " << event.thread
+				<< ", \"ts\": " << timestamp << ", \"args\": {\"" << name << "\": " << event.value << "}}";
+		}
+		first = false;
+	}
+	file << "\n]}\n";
+	return (bool)file;
+}
+
+const char* phaseName(Phase phase) {
+	switch (phase) {
+	case Phase::COLLISIONS: return "Collisions";
+	case Phase::FORCES: return "Forces";
+	case Phase::INTEGRATE: return "Integrate";
+	case Phase::STEP: return "Step";
+	case Phase::FIELD_LEVEL: return "Field level";
+	case Phase::RECORD: return "Record";
+	case Phase::FIELD_DRAW: return "Field draw";
+	case Phase::BODIES: return "Bodies";
+	case Phase::LABELS: return "Labels";
+	case Phase::PRESENT: return "Present";
+	case Phase::FRAME: return "Frame";
+	default: return "Unknown";
+	}
+}
+
+const char* counterName(Counter counter) {
+	switch (counter) {
+	case Counter::INTERACTIONS: return "Interactions";
+	case Counter::MERGES: return "Merges";
+	case Counter::DRAW_CALLS: return "Draw calls";
+	default: return "Unknown";
+	}
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+const int PROFILE_HISTORY = 256;				// Samples kept per phase and counter for the rolling statistics
+const size_t PROFILE_MAX_TRACE_EVENTS = 1000000;	// Trace recording stops once this many events are buffered
+
+// Timed phases of the physics step, the background workers and the render loop
+enum class Phase {
+	COLLISIONS,		// Physics: broad-phase and merges
+	FORCES,			// Physics: force solver
+	INTEGRATE,		// Physics: velocity and position update
+	STEP,			// Physics: a whole step including the snapshot for the renderer
+	FIELD_LEVEL,	// Field worker: one level of the gravity field
+	RECORD,			// Recorder: encoding and writing one trajectory frame
+	FIELD_DRAW,		// Render: field rasterization, texture upload and draw
+	BODIES,			// Render: culling and drawing bodies
+	LABELS,			// Render: label text and placement
+	PRESENT,		// Render: EndDrawing, includes waiting for the frame limiter
+	FRAME,			// Render: a whole frame
+	COUNT
+};
+
+// Quantities recorded once per step or frame
+enum class Counter {
+	INTERACTIONS,	// Body-body (or body-node) interactions evaluated by the force solver in a step
+	MERGES,			// Bodies merged away in a step
+	DRAW_CALLS,		// Primitives submitted to raylib in a frame
+	COUNT
+};
+
+// Rolling statistics of one phase or counter over the last PROFILE_HISTORY samples
+struct ProfileStats {
+	float last = 0.0f;
+	float p50 = 0.0f;
+	float p99 = 0.0f;
+	int samples = 0;
+};
+
+// Collects phase timings and counters from every thread. Recording a sample is a few relaxed atomic stores,
+// so scopes can stay in release builds. Trace events are only buffered while a trace is being recorded.
+struct Profiler {
+	// Shared instance
+	static Profiler& get();
+
+	// Monotonic clock in nanoseconds
+	static uint64_t now();
+
+	// Record one run of a phase on the calling thread
+	void record(Phase phase, uint64_t start, uint64_t end);
+
+	// Record the value of a counter for the current step or frame
+	void count(Counter counter, double value);
+
+	// Rolling statistics of a phase in milliseconds
+	ProfileStats stats(Phase phase) const;
+
+	// Rolling statistics of a counter
+	ProfileStats stats(Counter counter) const;
+
+	// Name the calling thread in traces
+	void nameThread(const char* name);
+
+	// Start buffering trace events
+	void startTrace();
+
+	// True while trace events are buffered
+	bool tracing() const { return tracingEnabled.load(std::memory_order_relaxed); }
+
+	// Write the buffered events as Chrome trace_event JSON (opens in Perfetto or chrome://tracing)
+	bool writeTrace(const std::string& path);
+
+private:
+	// Ring buffer of the latest samples of one series, written by one thread at a time
+	struct History {
+		std::atomic<float> samples[PROFILE_HISTORY];
+		std::atomic<uint32_t> written{ 0 };
+	};
+
+	struct TraceEvent {
+		int series;				// Phase, or Phase::COUNT + counter
+		int thread;
+		uint64_t start;
+		uint64_t duration;
+		double value;			// Counter value
+	};
+
+	History phases[(int)Phase::COUNT];
+	History counters[(int)Counter::COUNT];
+	std::atomic<bool> tracingEnabled{ false };
+	std::mutex traceMutex;
+	std::vector<TraceEvent> events;
+	std::vector<std::pair<int, std::string>> threadNames;
+	uint64_t traceStart = 0;
+
+	static void push(History& history, float value);
+	static ProfileStats summarize(const History& history);
+	void trace(const TraceEvent& event);
+};
+
+// Times the enclosing scope as one run of a phase
+struct ProfileScope {
+	explicit ProfileScope(Phase phase) : phase(phase), start(Profiler::now()) {}
+	~ProfileScope() { Profiler::get().record(phase, start, Profiler::now()); }
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+	Phase phase;
+	uint64_t start;
+};
+
+// Display name of a phase or counter
+const char* phaseName(Phase phase);
+const char* counterName(Counter counter);
@@ -0,0 +1,161 @@
+#include "QuadTree.h"
+#include <cmath>
+#include <algorithm>
+
+void QuadTree::build(const BodyArrays& bodies, Boundary boundary) {
+	this->boundary = boundary;
+	nodes.clear();
+	nodes.reserve(bodies.size() * 2 + 1);
+
+	order.resize(bodies.size());
+	for (size_t i = 0; i < bodies.size(); i++) order[i] = (int)i;
+
+	// Root is a square covering the whole simulation space
+	QuadNode root;
+	root.halfSize = std::max(SIM_WIDTH_HALF, SIM_HEIGHT_HALF);
+	root.centerX = root.halfSize;
+	root.centerY = root.halfSize;
+
+	// Open space has no edges to cover, so the root is the smallest square around the bodies instead
+	if (boundary == Boundary::OPEN && bodies.size() > 0) {
+		Real minX = bodies.x[0], maxX = bodies.x[0], minY = bodies.y[0], maxY = bodies.y[0];
+		for (size_t i = 1; i < bodies.size(); i++) {
+			minX = std::min(minX, bodies.x[i]);
+			maxX = std::max(maxX, bodies.x[i]);
+			minY = std::min(minY, bodies.y[i]);
+			maxY = std::max(maxY, bodies.y[i]);
+		}
+		root.halfSize = std::max(std::max(maxX - minX, maxY - minY) / 2, (Real)1);
+		root.centerX = (minX + maxX) / 2;
+		root.centerY = (minY + maxY) / 2;
+	}
+	root.begin = 0;
+	root.end = (int)bodies.size();
+	nodes.push_back(root);
+
+	subdivide(bodies, 0, 0);
+}
+
+void QuadTree::subdivide(const BodyArrays& bodies, int nodeIndex, int depth) {
+	QuadNode node = nodes[nodeIndex];
+
+	// Leaf: total mass and center of mass come straight from its bodies
+	if (node.end - node.begin <= QUADTREE_LEAF_SIZE || depth >= QUADTREE_MAX_DEPTH) {
+		Real mass = 0, comX = 0, comY = 0;
+		for (int k = node.begin; k < node.end; k++) {
+			int i = order[k];
+			mass += bodies.m[i];
+			comX += bodies.m[i] * bodies.x[i];
+			comY += bodies.m[i] * bodies.y[i];
+		}
+		nodes[nodeIndex].mass = mass;
+		nodes[nodeIndex].comX = mass > 0 ? comX / mass : node.centerX;
+		nodes[nodeIndex].comY = mass > 0 ? comY / mass : node.centerY;
+		return;
+	}
+
+	// Partition the body range into quadrants: [top left, top right, bottom left, bottom right]
+	auto first = order.begin() + node.begin;
+	auto last = order.begin() + node.end;
+	auto splitY = std::partition(first, last, [&](int i) { return bodies.y[i] < node.centerY; });
+	auto splitTop = std::partition(first, splitY, [&](int i) { return bodies.x[i] < node.centerX; });
+	auto splitBottom = std::partition(splitY, last, [&](int i) { return bodies.x[i] < node.centerX; });
+	int bounds[5] = {
+		node.begin,
+		(int)(splitTop - order.begin()),
+		(int)(splitY - order.begin()),
+		(int)(splitBottom - order.begin()),
+		node.end
+	};
+
+	// Create the four children next to each other
+	int firstChild = (int)nodes.size();
+	Real quarter = node.halfSize / 2;
+	for (int q = 0; q < 4; q++) {
+		QuadNode child;
+		child.halfSize = quarter;
+		child.centerX = node.centerX + ((q & 1) ? quarter : -quarter);
+		child.centerY = node.centerY + ((q & 2) ? quarter : -quarter);
+		child.begin = bounds[q];
+		child.end = bounds[q + 1];
+		nodes.push_back(child);
+	}
+	nodes[nodeIndex].firstChild = firstChild;
+
+	// Build children, then combine their mass and center of mass
+	Real mass = 0, comX = 0, comY = 0;
+	for (int q = 0; q < 4; q++) {
+		if (nodes[firstChild + q].begin == nodes[firstChild + q].end) continue;
+		subdivide(bodies, firstChild + q, depth + 1);
+		const QuadNode& child = nodes[firstChild + q];
+		mass += child.mass;
+		comX += child.mass * child.comX;
+		comY += child.mass * child.comY;
+	}
+	nodes[nodeIndex].mass = mass;
+	nodes[nodeIndex].comX = mass > 0 ? comX / mass : node.centerX;
+	nodes[nodeIndex].comY = mass > 0 ? comY / mass : node.centerY;
+}
+
+void QuadTree::refit(const BodyArrays& bodies) {
+	// Children always come after their parent in the pool, so walking it backwards visits children first
+	for (size_t n = nodes.size(); n-- > 0;) {
+		QuadNode& node = nodes[n];
+		Real mass = 0, comX = 0, comY = 0;
+		if (node.firstChild < 0) {
+			// Bodies that drifted across the seam are taken at their image next to the leaf
+			const bool wraps = boundary == Boundary::PERIODIC;
+			for (int k = node.begin; k < node.end; k++) {
+				int i = order[k];
+				Real x = wraps ? node.centerX + PeriodicBoundary::offset(bodies.x[i] - node.centerX, (Real)SIM_WIDTH, SIM_WIDTH_HALF) : bodies.x[i];
+				Real y = wraps ? node.centerY + PeriodicBoundary::offset(bodies.y[i] - node.centerY, (Real)SIM_HEIGHT, SIM_HEIGHT_HALF) : bodies.y[i];
+				mass += bodies.m[i];
+				comX += bodies.m[i] * x;
+				comY += bodies.m[i] * y;
+			}
+		}
+		else {
+			for (int q = 0; q < 4; q++) {
+				const QuadNode& child = nodes[node.firstChild + q];
+				if (child.begin == child.end) continue;
+				mass += child.mass;
+				comX += child.mass * child.comX;
+				comY += child.mass * child.comY;
+			}
+		}
+		node.mass = mass;
+		node.comX = mass > 0 ? comX / mass : node.centerX;
+		node.comY = mass > 0 ? comY / mass : node.centerY;
+	}
+}
+
+Vec2 QuadTree::calculateForce(const BodyArrays& bodies, size_t index, float theta, size_t* interactions) const {
+	Vec2 force = { 0, 0 };
+	const Real bodyMass = bodies.m[index];
+	size_t visits = 0;
+
+	walk(bodies, bodies.x[index], bodies.y[index], theta, [&](Real dx, Real dy, Real mass) {
+		visits++;
+		Real distanceSquared = (dx * dx) + (dy * dy);
+		if (distanceSquared < MIN_DISTANCE_SQUARED) return; // Avoid division by zero, also skips the body itself
+
+		Real forceMag = G * (bodyMass * mass) / distanceSquared; // Newton's Law of Gravitation, F = (G * (m1 * m2)) / r^2
+		Real distanceMag = std::sqrt(distanceSquared);
+		force.x += forceMag * dx / distanceMag;
+		force.y += forceMag * dy / distanceMag;
+	});
+
+	if (interactions) *interactions += visits;
+	return force;
+}
+
+float QuadTree::fieldStrength(const BodyArrays& bodies, float x, float y, float theta) const {
+	float strength = 0.0f;
+
+	walk(bodies, x, y, theta, [&](Real dx, Real dy, Real mass) {
+		Real distanceSquared = (dx * dx) + (dy * dy);
+		if (distanceSquared > MIN_DISTANCE_SQUARED) strength += (float)(G * mass / distanceSquared);
+	});
+
+	return strength;
+}
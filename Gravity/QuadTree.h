@@ -0,0 +1,110 @@
+#pragma once
+#include "BodyArrays.h"
+#include <vector>
+#include <cstddef>
+#include <cmath>
+
+const int QUADTREE_LEAF_SIZE = 4;				// Bodies a leaf may hold before it is split
+const int QUADTREE_MAX_DEPTH = 32;				// Stops splitting when bodies sit on top of each other
+const float QUADTREE_SEAM_THETA_SCALE = 0.25f;	// Stricter opening angle for nodes cut by the wrap-around seam
+
+// Node of the Barnes-Hut quadtree. Children of a node are stored next to each other in the node pool.
+struct QuadNode {
+	Real centerX;				// Center of the square covered by this node
+	Real centerY;
+	Real halfSize;				// Half of the side length of the square
+	Real mass = 0;				// Total mass of all bodies below this node
+	Real comX = 0;				// Center of mass of all bodies below this node
+	Real comY = 0;
+	int firstChild = -1;		// Index of the first of four children, -1 for a leaf
+	int begin = 0;				// Range of body indices (into QuadTree::order) held by this node
+	int end = 0;
+};
+
+// Barnes-Hut quadtree over the simulation space, rebuilt every step
+struct QuadTree {
+	std::vector<QuadNode> nodes;	// Node pool, root is nodes[0]
+	std::vector<int> order;			// Body indices, grouped so every node owns a contiguous range
+	Boundary boundary = Boundary::PERIODIC;	// Boundary the tree was built for
+
+	// Rebuild the tree from the current body positions. The root covers the simulation space, or with
+	// open boundaries the square around every body.
+	void build(const BodyArrays& bodies, Boundary boundary);
+
+	// Recompute masses and centers of mass for bodies that moved a little since build(), keeping the node layout.
+	// Much cheaper than a rebuild. Bodies that left their node's square are still counted in it, which only
+	// matters for approximation quality, so use it for short drifts of the same set of bodies.
+	void refit(const BodyArrays& bodies);
+
+	// Approximate the total gravitational force on bodies[index], opening nodes whose size / distance exceeds theta.
+	// Adds the number of bodies and nodes it interacted with to *interactions if given.
+	Vec2 calculateForce(const BodyArrays& bodies, size_t index, float theta, size_t* interactions = nullptr) const;
+
+	// Approximate the summed strength of gravitational acceleration, G * m / r^2 over all bodies, at a point
+	float fieldStrength(const BodyArrays& bodies, float x, float y, float theta) const;
+
+	// Visit every mass that acts on the point (x, y): single bodies in opened leaves and far nodes as point masses.
+	// visit(dx, dy, mass) receives the offset from the point to the mass, the minimum image on a periodic tree.
+	template <typename Visit>
+	void walk(const BodyArrays& bodies, Real x, Real y, float theta, Visit&& visit) const;
+
+private:
+	// walk() for one boundary policy
+	template <typename Policy, typename Visit>
+	void walkWith(const BodyArrays& bodies, Real x, Real y, float theta, Visit& visit) const;
+
+	// Recursively split a node until it holds at most QUADTREE_LEAF_SIZE bodies
+	void subdivide(const BodyArrays& bodies, int nodeIndex, int depth);
+};
+
+template <typename Visit>
+void QuadTree::walk(const BodyArrays& bodies, Real x, Real y, float theta, Visit&& visit) const {
+	if (boundary == Boundary::PERIODIC) walkWith<PeriodicBoundary>(bodies, x, y, theta, visit);
+	else walkWith<OpenBoundary>(bodies, x, y, theta, visit);
+}
+
+template <typename Policy, typename Visit>
+void QuadTree::walkWith(const BodyArrays& bodies, Real x, Real y, float theta, Visit& visit) const {
+	if (nodes.empty()) return;
+
+	const float thetaSquared = theta * theta;
+	int stack[4 * QUADTREE_MAX_DEPTH + 4];
+	int top = 0;
+	stack[top++] = 0;
+
+	while (top > 0) {
+		const QuadNode& node = nodes[stack[--top]];
+		if (node.begin == node.end) continue;
+
+		// Leaf: visit its bodies exactly, using the same offsets as direct summation
+		if (node.firstChild < 0) {
+			for (int k = node.begin; k < node.end; k++) {
+				int j = order[k];
+				visit(Policy::offset(bodies.x[j] - x, (Real)SIM_WIDTH, SIM_WIDTH_HALF), Policy::offset(bodies.y[j] - y, (Real)SIM_HEIGHT, SIM_HEIGHT_HALF), bodies.m[j]);
+			}
+			continue;
+		}
+
+		// Offset to the node's center of mass
+		Real dx = Policy::offset(node.comX - x, (Real)SIM_WIDTH, SIM_WIDTH_HALF);
+		Real dy = Policy::offset(node.comY - y, (Real)SIM_HEIGHT, SIM_HEIGHT_HALF);
+		Real distanceSquared = (dx * dx) + (dy * dy);
+		Real size = node.halfSize * 2;
+
+		// A node cut by the wrap-around seam (as seen from this point) has part of its mass in the other image,
+		// so it must be much smaller relative to its distance before it is treated as a single point mass.
+		Real openingLimit = thetaSquared;
+		if (Policy::WRAPS) {
+			Real cellDx = Policy::offset(node.centerX - x, (Real)SIM_WIDTH, SIM_WIDTH_HALF);
+			Real cellDy = Policy::offset(node.centerY - y, (Real)SIM_HEIGHT, SIM_HEIGHT_HALF);
+			bool straddlesSeam = std::fabs(cellDx) + node.halfSize > SIM_WIDTH_HALF || std::fabs(cellDy) + node.halfSize > SIM_HEIGHT_HALF;
+			if (straddlesSeam) openingLimit = thetaSquared * QUADTREE_SEAM_THETA_SCALE * QUADTREE_SEAM_THETA_SCALE;
+		}
+		if (size * size < openingLimit * distanceSquared) {
+			visit(dx, dy, node.mass);
+			continue;
+		}
+
+		for (int q = 0; q < 4; q++) stack[top++] = node.firstChild + q;
+	}
+}
@@ -0,0 +1,198 @@
+#include "Renderer.h"
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+
+// <--- CAMERA --->
+
+void ViewCamera::update() {
+	Vector2 mouse = GetMousePosition();
+	bool overSim = mouse.x < SIM_WIDTH && mouse.y < SIM_HEIGHT;
+
+	// Zoom around the point under the cursor
+	float wheel = GetMouseWheelMove();
+	if (overSim && wheel != 0.0f) {
+		Vector2 anchor = toWorld(mouse);
+		camera.zoom = std::clamp(camera.zoom * std::pow(VIEW_ZOOM_STEP, wheel), bounded ? 1.0f : VIEW_MIN_ZOOM_OPEN, VIEW_MAX_ZOOM);
+		camera.target = { anchor.x - mouse.x / camera.zoom, anchor.y - mouse.y / camera.zoom };
+	}
+
+	// Drag to pan
+	if (IsMouseButtonDown(MOUSE_BUTTON_RIGHT) && overSim) {
+		Vector2 delta = GetMouseDelta();
+		camera.target.x -= delta.x / camera.zoom;
+		camera.target.y -= delta.y / camera.zoom;
+	}
+
+	if (IsKeyPressed(KEY_HOME)) reset();
+	clamp();
+}
+
+void ViewCamera::reset() {
+	camera.target = { 0.0f, 0.0f };
+	camera.zoom = 1.0f;
+}
+
+void ViewCamera::clamp() {
+	if (!bounded) return;
+	camera.zoom = std::max(camera.zoom, 1.0f);
+	camera.target.x = std::clamp(camera.target.x, 0.0f, SIM_WIDTH - SIM_WIDTH / camera.zoom);
+	camera.target.y = std::clamp(camera.target.y, 0.0f, SIM_HEIGHT - SIM_HEIGHT / camera.zoom);
+}
+
+Rectangle ViewCamera::visibleArea() const {
+	return { camera.target.x, camera.target.y, SIM_WIDTH / camera.zoom, SIM_HEIGHT / camera.zoom };
+}
+
+// <--- BODIES --->
+
+void BodyRenderer::drawBodies(const Snapshot& snapshot, float alpha, const ViewCamera& view, const RenderSettings& settings) {
+	const BodyArrays& bodies = snapshot.bodies;
+	const Rectangle area = view.visibleArea();
+	const float zoom = view.camera.zoom;
+
+	// Cull everything whose circle does not reach into the view
+	visible.clear();
+	locations.clear();
+	for (size_t i = 0; i < bodies.size(); i++) {
+		Vec2 location = snapshot.interpolatedLocation(i, alpha);
+		float radius = bodies.r[i];
+		if (location.x + radius < area.x || location.x - radius > area.x + area.width) continue;
+		if (location.y + radius < area.y || location.y - radius > area.y + area.height) continue;
+		visible.push_back(i);
+		locations.push_back({ (float)location.x, (float)location.y });
+	}
+	drawnBodies = visible.size();
+	drawCalls = visible.size() * (settings.showVectors ? 4 : 1);
+
+	// Small bodies first as plain quads, which raylib batches into a few draw calls, then the large ones as circles
+	for (size_t k = 0; k < visible.size(); k++) {
+		float radius = bodies.r[visible[k]];
+		if (radius * zoom >= RENDER_QUAD_MAX_RADIUS) continue;
+		DrawRectangleV({ locations[k].x - radius, locations[k].y - radius }, { radius * 2.0f, radius * 2.0f }, SIM_BDY_COL);
+	}
+	for (size_t k = 0; k < visible.size(); k++) {
+		float radius = bodies.r[visible[k]];
+		if (radius * zoom < RENDER_QUAD_MAX_RADIUS) continue;
+		DrawCircleV(locations[k], radius, SIM_BDY_COL);
+	}
+
+	if (settings.showVectors) {
+		for (size_t k = 0; k < visible.size(); k++) {
+			Vector2 location = locations[k];
+			float vx = bodies.vx[visible[k]] * settings.vectorScalar;
+			float vy = bodies.vy[visible[k]] * settings.vectorScalar;
+
+			// Draw each component velocity vector and the velocity vector
+			DrawLineV(location, { location.x + vx, location.y }, RED);
+			DrawLineV(location, { location.x, location.y + vy }, BLUE);
+			DrawLineV(location, { location.x + vx, location.y + vy }, WHITE);
+		}
+	}
+}
+
+// <--- LABELS --->
+
+// Exponent and 3 significant digits of a value as printed with %.2e
+static void displayKey(float value, int key[2]) {
+	if (!(value > 0.0f)) {
+		key[0] = 0;
+		key[1] = 0;
+		return;
+	}
+	int exponent = (int)std::floor(std::log10(value));
+	int digits = (int)std::lround(value / std::pow(10.0f, (float)exponent) * 100.0f);
+	if (digits >= 1000) {
+		exponent++;
+		digits /= 10;
+	}
+	key[0] = exponent;
+	key[1] = digits;
+}
+
+const BodyRenderer::Label& BodyRenderer::label(const Snapshot& snapshot, size_t i) {
+	// Replayed trajectories carry no handles, their bodies keep their indices between merges instead
+	BodyHandle handle = i < snapshot.handles.size() ? snapshot.handles.handleAt(i) : BodyHandle{ (uint32_t)i, 0 };
+	if (labels.size() <= handle.slot) labels.resize(handle.slot + 1);
+	Label& cached = labels[handle.slot];
+	if (cached.generation != handle.generation) {
+		cached = Label();
+		cached.generation = handle.generation;
+	}
+
+	float vx = snapshot.bodies.vx[i];
+	float vy = snapshot.bodies.vy[i];
+	int massKey[2], speedKey[2];
+	displayKey(snapshot.bodies.m[i], massKey);
+	displayKey(std::sqrt((vx * vx) + (vy * vy)), speedKey);
+
+	if (massKey[0] != cached.massKey[0] || massKey[1] != cached.massKey[1] || speedKey[0] != cached.speedKey[0] || speedKey[1] != cached.speedKey[1]) {
+		std::snprintf(cached.text, sizeof(cached.text), "M: %.2e V: %.2e", snapshot.bodies.m[i], std::sqrt((vx * vx) + (vy * vy)));
+		cached.width = MeasureText(cached.text, RENDER_LABEL_FONT);
+		std::copy(massKey, massKey + 2, cached.massKey);
+		std::copy(speedKey, speedKey + 2, cached.speedKey);
+	}
+	return cached;
+}
+
+bool BodyRenderer::place(const Rectangle& box) {
+	const int columns = SIM_WIDTH / RENDER_LABEL_GRID + 1;
+	const int rows = SIM_HEIGHT / RENDER_LABEL_GRID + 1;
+	int left = std::clamp((int)(box.x / RENDER_LABEL_GRID), 0, columns - 1);
+	int right = std::clamp((int)((box.x + box.width) / RENDER_LABEL_GRID), 0, columns - 1);
+	int top = std::clamp((int)(box.y / RENDER_LABEL_GRID), 0, rows - 1);
+	int bottom = std::clamp((int)((box.y + box.height) / RENDER_LABEL_GRID), 0, rows - 1);
+
+	for (int row = top; row <= bottom; row++) {
+		for (int column = left; column <= right; column++) {
+			for (int other : grid[row * columns + column]) {
+				const Rectangle& b = placed[other];
+				if (box.x < b.x + b.width && b.x < box.x + box.width && box.y < b.y + b.height && b.y < box.y + box.height) return true;
+			}
+		}
+	}
+
+	for (int row = top; row <= bottom; row++) {
+		for (int column = left; column <= right; column++) grid[row * columns + column].push_back((int)placed.size());
+	}
+	placed.push_back(box);
+	return false;
+}
+
+void BodyRenderer::drawLabels(const Snapshot& snapshot, const ViewCamera& view, const RenderSettings& settings) {
+	const size_t cells = (SIM_WIDTH / RENDER_LABEL_GRID + 1) * (SIM_HEIGHT / RENDER_LABEL_GRID + 1);
+	grid.resize(cells);
+	for (auto& cell : grid) cell.clear();
+	placed.clear();
+	drawnLabels = 0;
+
+	// Heaviest bodies get the first chance at a label
+	candidates.resize(visible.size());
+	for (size_t k = 0; k < visible.size(); k++) candidates[k] = k;
+	size_t count = std::min(candidates.size(), (size_t)std::max(settings.maxLabels, 0));
+	std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(),
+		[&](size_t a, size_t b) { return snapshot.bodies.m[visible[a]] > snapshot.bodies.m[visible[b]]; });
+	candidates.resize(count);
+
+	for (size_t k : candidates) {
+		size_t i = visible[k];
+		const Label& text = label(snapshot, i);
+		Vector2 location = view.toScreen(locations[k]);
+		float radius = snapshot.bodies.r[i] * view.camera.zoom;
+
+		// Up and to the right of the body, flipped left and/or down where that would leave the sim area
+		bool flipX = location.x + radius + RENDER_LABEL_OFFSET + text.width > SIM_WIDTH;
+		bool flipY = location.y - radius - RENDER_LABEL_OFFSET - RENDER_LABEL_HEIGHT < 0.0f;
+		Vector2 start = { location.x + (flipX ? -radius : radius), location.y + (flipY ? radius : -radius) };
+		Vector2 end = { start.x + (flipX ? -RENDER_LABEL_OFFSET : RENDER_LABEL_OFFSET), start.y + (flipY ? RENDER_LABEL_OFFSET : -RENDER_LABEL_OFFSET) };
+		Rectangle box = { flipX ? end.x - text.width : end.x, flipY ? end.y : end.y - RENDER_LABEL_HEIGHT, (float)text.width, (float)RENDER_LABEL_HEIGHT };
+
+		if (place(box)) continue;
+
+		DrawLineV(start, end, WHITE);
+		DrawRectangleRec(box, ColorFromNormalized({ 0.0f, 0.0f, 0.0f, 0.5f }));
+		DrawText(text.text, (int)box.x, (int)box.y + 3, RENDER_LABEL_FONT, SIM_LABEL_COL);
+		drawnLabels++;
+		drawCalls += 3;
+	}
+}
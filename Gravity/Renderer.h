@@ -0,0 +1,86 @@
+#pragma once
+#include "raylib.h"
+#include "Snapshot.h"
+#include <vector>
+#include <cstddef>
+
+const float VIEW_MAX_ZOOM = 32.0f;					// Closest zoom, 1 shows the whole simulation space
+const float VIEW_MIN_ZOOM_OPEN = 1.0f / 32.0f;		// Farthest zoom with open boundaries, where bodies may leave the simulation space
+const float VIEW_ZOOM_STEP = 1.2f;					// Zoom factor of one mouse wheel notch
+const float RENDER_QUAD_MAX_RADIUS = 2.5f;			// Bodies smaller than this on screen are drawn as plain quads
+const int RENDER_MAX_LABELS = 256;					// Labels considered per frame at full quality
+const int RENDER_LABEL_FONT = 20;					// Font size of body labels
+const int RENDER_LABEL_HEIGHT = 25;					// Height of a label box
+const float RENDER_LABEL_OFFSET = 20.0f;			// Distance from a body's edge to its label
+const int RENDER_LABEL_GRID = 50;					// Cell size of the grid used to find overlapping labels
+const Color SIM_BDY_COL = GetColor(0xC9C9C9FF);		// Sim Space body color
+const Color SIM_LABEL_COL = GetColor(0xE0E0E0FF);	// Body label text color
+
+// Pan and zoom over the SIM_WIDTH x SIM_HEIGHT simulation space, which is drawn at the top left of the window
+struct ViewCamera {
+	Camera2D camera = { { 0.0f, 0.0f }, { 0.0f, 0.0f }, 0.0f, 1.0f };
+	bool bounded = true;		// Keep the view inside the simulation space, clear it for open boundaries to zoom out and pan anywhere
+
+	// Zoom with the mouse wheel around the cursor, pan by dragging with the right mouse button, Home resets
+	void update();
+
+	// Show the whole simulation space again
+	void reset();
+
+	// Part of the simulation space that is on screen
+	Rectangle visibleArea() const;
+
+	// Simulation coordinates of a point on screen
+	Vector2 toWorld(Vector2 screen) const { return GetScreenToWorld2D(screen, camera); }
+
+	// Screen coordinates of a point in the simulation
+	Vector2 toScreen(Vector2 world) const { return GetWorldToScreen2D(world, camera); }
+
+private:
+	// Keep the view inside the simulation space when bounded
+	void clamp();
+};
+
+// What the body layer should draw on top of the bodies
+struct RenderSettings {
+	bool showVectors = false;
+	int vectorScalar = 50;
+	int maxLabels = RENDER_MAX_LABELS;		// Labels considered per frame, heaviest bodies first
+};
+
+// Draws the bodies of a snapshot: culled to the camera view, small bodies batched as quads and labels
+// cached between frames and kept from overlapping each other
+struct BodyRenderer {
+	size_t drawnBodies = 0;		// Bodies inside the view in the last frame
+	size_t drawnLabels = 0;		// Labels that fit without overlapping in the last frame
+	size_t drawCalls = 0;		// Primitives submitted to raylib by the last drawBodies and drawLabels
+
+	// Draw bodies (and vectors) in simulation space, must be called between BeginMode2D and EndMode2D of view.camera
+	void drawBodies(const Snapshot& snapshot, float alpha, const ViewCamera& view, const RenderSettings& settings);
+
+	// Draw labels in screen space for the bodies found by the last drawBodies, must be called after EndMode2D
+	void drawLabels(const Snapshot& snapshot, const ViewCamera& view, const RenderSettings& settings);
+
+private:
+	// Label text of one body, rebuilt only when a value changes at the displayed precision
+	struct Label {
+		int massKey[2] = { 0, -1 };			// Exponent and 3 significant digits of the mass as displayed
+		int speedKey[2] = { 0, -1 };
+		char text[48] = {};
+		int width = 0;						// Measured text width in pixels
+		uint32_t generation = 0;			// Generation of the body handle the text belongs to
+	};
+
+	std::vector<Label> labels;				// Indexed by body handle slot, so a label follows its body through merges
+	std::vector<Vector2> locations;			// Interpolated locations of visible bodies
+	std::vector<size_t> visible;			// Indices of bodies inside the view
+	std::vector<size_t> candidates;			// Positions in "visible" ordered by label priority
+	std::vector<Rectangle> placed;			// Label boxes drawn this frame
+	std::vector<std::vector<int>> grid;		// Placed label boxes touching each grid cell
+
+	// Update the cached text of body i, returns it
+	const Label& label(const Snapshot& snapshot, size_t i);
+
+	// True if a label box overlaps one already placed, otherwise it is placed
+	bool place(const Rectangle& box);
+};
@@ -0,0 +1,218 @@
+#include "Scenarios.h"
+#include <cmath>
+#include <random>
+#include <algorithm>
+
+const float SCENARIO_PLUMMER_RADIUS = 60.0f;		// Plummer scale length of a single sphere
+const float SCENARIO_PLUMMER_CUTOFF = 4.0f;			// Spheres are truncated at this many scale lengths
+const float SCENARIO_DISK_INNER = 40.0f;			// Inner and outer radius of the rotating disk
+const float SCENARIO_DISK_OUTER = 420.0f;
+const float SCENARIO_DISK_CENTER_MASS = 0.5f;		// Mass of the disk's center body relative to the disk
+const float SCENARIO_CLUSTER_SPEED = 0.15f;			// Speed of each cluster towards the other
+const int SCENARIO_CLUMP_SIZE = 8;					// Bodies per merge storm clump
+const int SCENARIO_EDGE_PAIRS = 4;					// Tile edge: pairs of large bodies, one across each edge between 4 strips
+const float SCENARIO_EDGE_RADIUS = 30.0f;			// Radius of the body left of an edge, wider than the cluster's ghost halo
+const float SCENARIO_EDGE_PARTNER_RADIUS = 20.0f;	// Radius of the body right of the edge, touching the other one
+const int SCENARIO_EDGE_CHAIN_BODIES = 9;			// Tile edge: bodies in each chain across an edge, longer than the ghost halo on both sides
+const float SCENARIO_EDGE_CHAIN_RADIUS = 6.0f;		// Radius of the chain bodies
+const float SCENARIO_EDGE_CHAIN_SPACING = 11.0f;	// Distance between neighbours in a chain, so each touches the next
+
+// Mass of a sphere with this radius at the standard density
+static float massOf(float radius) {
+	return (4.0f / 3.0f) * SIM_PI * (radius * radius * radius) * SCENARIO_DENSITY;
+}
+
+// Wrap a coordinate into the simulation space
+static Vec2 wrap(float x, float y) {
+	return { std::fmod(std::fmod(x, (float)SIM_WIDTH) + SIM_WIDTH, (float)SIM_WIDTH), std::fmod(std::fmod(y, (float)SIM_HEIGHT) + SIM_HEIGHT, (float)SIM_HEIGHT) };
+}
+
+float scenarioRadiusScale(size_t count) {
+	if (count <= SCENARIO_REFERENCE_BODIES) return 1.0f;
+	return std::sqrt((float)SCENARIO_REFERENCE_BODIES / (float)count);
+}
+
+// Plummer sphere of "count" bodies around (centerX, centerY), moving with (driftX, driftY).
+// Radii follow the inverse of the cumulative mass profile, speeds use Aarseth's rejection method,
+// both in 3D and projected onto the plane.
+static void addPlummer(Simulation& sim, std::mt19937& rng, size_t count, float centerX, float centerY, float driftX, float driftY) {
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::uniform_real_distribution<float> radDist(1.0f, 3.0f);
+	const float radiusScale = scenarioRadiusScale(count);
+
+	// Masses first, the velocity scale depends on the total
+	std::vector<float> radii(count);
+	double totalMass = 0.0;
+	for (size_t n = 0; n < count; n++) {
+		radii[n] = radDist(rng) * radiusScale;
+		totalMass += massOf(radii[n]);
+	}
+	const float a = SCENARIO_PLUMMER_RADIUS;
+	const float velocityScale = std::sqrt(G * (float)totalMass / a);
+
+	for (size_t n = 0; n < count; n++) {
+		// Distance from the center, rejecting the far tail
+		float r;
+		do {
+			float u = std::max(unit(rng), 1e-6f);
+			r = a / std::sqrt(std::pow(u, -2.0f / 3.0f) - 1.0f);
+		} while (r > SCENARIO_PLUMMER_CUTOFF * a);
+
+		// Random direction in 3D, keep the projection onto the plane
+		float cosPolar = 2.0f * unit(rng) - 1.0f;
+		float sinPolar = std::sqrt(1.0f - cosPolar * cosPolar);
+		float azimuth = 2.0f * SIM_PI * unit(rng);
+		float x = r * sinPolar * std::cos(azimuth);
+		float y = r * sinPolar * std::sin(azimuth);
+
+		// Speed as a fraction q of the local escape speed, with q drawn from q^2 (1 - q^2)^3.5
+		float q, g;
+		do {
+			q = unit(rng);
+			g = 0.1f * unit(rng);
+		} while (g > q * q * std::pow(1.0f - q * q, 3.5f));
+		float speed = q * std::sqrt(2.0f) * velocityScale * std::pow(1.0f + (r * r) / (a * a), -0.25f);
+
+		float cosVelocity = 2.0f * unit(rng) - 1.0f;
+		float sinVelocity = std::sqrt(1.0f - cosVelocity * cosVelocity);
+		float velocityAzimuth = 2.0f * SIM_PI * unit(rng);
+		Vec2 velocity = { driftX + speed * sinVelocity * std::cos(velocityAzimuth), driftY + speed * sinVelocity * std::sin(velocityAzimuth) };
+
+		sim.addBody(Body(massOf(radii[n]), radii[n], velocity, wrap(centerX + x, centerY + y)));
+	}
+}
+
+// Disk of bodies on circular orbits around a heavy center body
+static void addDisk(Simulation& sim, std::mt19937& rng, size_t count) {
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::uniform_real_distribution<float> radDist(1.0f, 3.0f);
+	const float radiusScale = scenarioRadiusScale(count);
+	if (count == 0) return;
+
+	std::vector<float> radii(count - 1);
+	double diskMass = 0.0;
+	for (float& radius : radii) {
+		radius = radDist(rng) * radiusScale;
+		diskMass += massOf(radius);
+	}
+
+	// Center body sized to hold SCENARIO_DISK_CENTER_MASS of the disk's mass at the standard density
+	float centerMass = std::max(SCENARIO_DISK_CENTER_MASS * (float)diskMass, massOf(3.0f));
+	float centerRadius = std::cbrt(3.0f * centerMass / (4.0f * SIM_PI * SCENARIO_DENSITY));
+	sim.addBody(Body(centerMass, centerRadius, { 0.0f, 0.0f }, { SIM_WIDTH_HALF, SIM_HEIGHT_HALF }));
+
+	// Surface density falls off as 1/r, so radii are uniform between the inner and outer edge
+	std::vector<float> orbits(radii.size());
+	for (float& orbit : orbits) orbit = SCENARIO_DISK_INNER + (SCENARIO_DISK_OUTER - SCENARIO_DISK_INNER) * unit(rng);
+	std::vector<float> sorted = orbits;
+	std::sort(sorted.begin(), sorted.end());
+
+	for (size_t n = 0; n < radii.size(); n++) {
+		// Circular speed from the center body plus the disk mass inside this orbit
+		float inside = (float)(std::lower_bound(sorted.begin(), sorted.end(), orbits[n]) - sorted.begin()) / sorted.size();
+		float enclosed = centerMass + inside * (float)diskMass;
+		float speed = std::sqrt(G * enclosed / orbits[n]);
+
+		float angle = 2.0f * SIM_PI * unit(rng);
+		float c = std::cos(angle), s = std::sin(angle);
+		Vec2 location = { SIM_WIDTH_HALF + orbits[n] * c, SIM_HEIGHT_HALF + orbits[n] * s };
+		sim.addBody(Body(massOf(radii[n]), radii[n], { -speed * s, speed * c }, location));
+	}
+}
+
+// Clumps of SCENARIO_CLUMP_SIZE small bodies, every body overlapping its clump's center
+static void addMergeStorm(Simulation& sim, std::mt19937& rng, size_t count) {
+	std::uniform_real_distribution<float> xDist(0.0f, (float)SIM_WIDTH);
+	std::uniform_real_distribution<float> yDist(0.0f, (float)SIM_HEIGHT);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::uniform_real_distribution<float> velDist(-0.2f, 0.2f);
+	const float radius = std::max(0.25f, scenarioRadiusScale(count));
+
+	float centerX = 0.0f, centerY = 0.0f;
+	Vec2 velocity = { 0.0f, 0.0f };
+	for (size_t n = 0; n < count; n++) {
+		if (n % SCENARIO_CLUMP_SIZE == 0) {
+			centerX = xDist(rng);
+			centerY = yDist(rng);
+			velocity = { velDist(rng), velDist(rng) };
+		}
+		float angle = 2.0f * SIM_PI * unit(rng);
+		float distance = radius * unit(rng);
+		sim.addBody(Body(massOf(radius), radius, velocity, wrap(centerX + distance * std::cos(angle), centerY + distance * std::sin(angle))));
+	}
+}
+
+// Pairs of touching large bodies, each with its heavier member 40 px left of a vertical edge between strips and
+// the other 5 px right of it, then chains of small touching bodies centered on the same edges 80 px lower, then
+// small random bodies. No worker sees a whole chain. The edges at multiples of SIM_WIDTH / SCENARIO_EDGE_PAIRS
+// separate the tiles of 2 or 4 workers.
+static void addTileEdge(Simulation& sim, std::mt19937& rng, size_t count) {
+	const size_t pairs = std::min((size_t)SCENARIO_EDGE_PAIRS, count / 2);
+	const size_t chains = std::min((size_t)SCENARIO_EDGE_PAIRS, (count - 2 * pairs) / SCENARIO_EDGE_CHAIN_BODIES);
+	for (size_t k = 0; k < pairs; k++) {
+		float edge = (float)SIM_WIDTH * k / SCENARIO_EDGE_PAIRS;
+		float y = (float)SIM_HEIGHT * (k + 0.5f) / SCENARIO_EDGE_PAIRS;
+		sim.addBody(Body(massOf(SCENARIO_EDGE_RADIUS), SCENARIO_EDGE_RADIUS, { 0.0f, 0.0f }, wrap(edge - 40.0f, y)));
+		sim.addBody(Body(massOf(SCENARIO_EDGE_PARTNER_RADIUS), SCENARIO_EDGE_PARTNER_RADIUS, { 0.0f, 0.0f }, wrap(edge + 5.0f, y)));
+	}
+	for (size_t k = 0; k < chains; k++) {
+		float edge = (float)SIM_WIDTH * k / SCENARIO_EDGE_PAIRS;
+		float y = (float)SIM_HEIGHT * (k + 0.5f) / SCENARIO_EDGE_PAIRS + 80.0f;
+		for (int n = 0; n < SCENARIO_EDGE_CHAIN_BODIES; n++) {
+			float x = edge + (n - SCENARIO_EDGE_CHAIN_BODIES / 2) * SCENARIO_EDGE_CHAIN_SPACING;
+			sim.addBody(Body(massOf(SCENARIO_EDGE_CHAIN_RADIUS), SCENARIO_EDGE_CHAIN_RADIUS, { 0.0f, 0.0f }, wrap(x, y)));
+		}
+	}
+	const size_t placed = 2 * pairs + chains * SCENARIO_EDGE_CHAIN_BODIES;
+	if (count > placed) sim.addRandomBodies(count - placed, rng(), scenarioRadiusScale(count));
+}
+
+void addScenario(Simulation& sim, Scenario scenario, size_t count, unsigned int seed) {
+	std::mt19937 rng(seed);
+	sim.bodies.reserve(sim.bodies.size() + count);
+
+	switch (scenario) {
+	case Scenario::UNIFORM:
+		sim.addRandomBodies(count, seed, scenarioRadiusScale(count));
+		break;
+	case Scenario::DISK:
+		addDisk(sim, rng, count);
+		break;
+	case Scenario::PLUMMER:
+		addPlummer(sim, rng, count, SIM_WIDTH_HALF, SIM_HEIGHT_HALF, 0.0f, 0.0f);
+		break;
+	case Scenario::CLUSTERS:
+		addPlummer(sim, rng, count / 2, SIM_WIDTH * 0.3f, SIM_HEIGHT * 0.45f, SCENARIO_CLUSTER_SPEED, 0.0f);
+		addPlummer(sim, rng, count - count / 2, SIM_WIDTH * 0.7f, SIM_HEIGHT * 0.55f, -SCENARIO_CLUSTER_SPEED, 0.0f);
+		break;
+	case Scenario::MERGE_STORM:
+		addMergeStorm(sim, rng, count);
+		break;
+	case Scenario::TILE_EDGE:
+		addTileEdge(sim, rng, count);
+		break;
+	}
+}
+
+const char* scenarioName(Scenario scenario) {
+	switch (scenario) {
+	case Scenario::UNIFORM: return "uniform";
+	case Scenario::DISK: return "disk";
+	case Scenario::PLUMMER: return "plummer";
+	case Scenario::CLUSTERS: return "clusters";
+	case Scenario::MERGE_STORM: return "merge-storm";
+	case Scenario::TILE_EDGE: return "tile-edge";
+	}
+	return "unknown";
+}
+
+bool parseScenario(const std::string& name, Scenario& scenario) {
+	const Scenario all[] = { Scenario::UNIFORM, Scenario::DISK, Scenario::PLUMMER, Scenario::CLUSTERS, Scenario::MERGE_STORM, Scenario::TILE_EDGE };
+	for (Scenario candidate : all) {
+		if (name == scenarioName(candidate)) {
+			scenario = candidate;
+			return true;
+		}
+	}
+	return false;
+}
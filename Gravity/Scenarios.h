@@ -0,0 +1,29 @@
+#pragma once
+#include "Simulation.h"
+#include <string>
+#include <cstddef>
+
+const size_t SCENARIO_REFERENCE_BODIES = 2000;	// Above this many bodies radii shrink so they cover the same total area
+const float SCENARIO_DENSITY = 20000.0f;		// Mass per cubic pixel, same as spawned bodies
+
+// Standard starting scenes for benchmarks and headless runs
+enum class Scenario {
+	UNIFORM,		// Random positions over the whole space with small random velocities
+	DISK,			// Flat disk rotating around a heavy center body
+	PLUMMER,		// Plummer sphere (projected to 2D) in virial equilibrium
+	CLUSTERS,		// Two Plummer spheres on a collision course
+	MERGE_STORM,	// Many clumps of small bodies that already touch each other
+	TILE_EDGE		// Large bodies and chains of small ones touching across the edges between --workers tiles, among small ones
+};
+
+// Add "count" bodies of a scenario to the simulation, reproducible by seed
+void addScenario(Simulation& sim, Scenario scenario, size_t count, unsigned int seed);
+
+// Radius multiplier that keeps the area covered by "count" bodies the same as for SCENARIO_REFERENCE_BODIES
+float scenarioRadiusScale(size_t count);
+
+// Name of a scenario, as accepted by parseScenario
+const char* scenarioName(Scenario scenario);
+
+// Scenario by name, returns false if there is none
+bool parseScenario(const std::string& name, Scenario& scenario);
@@ -0,0 +1,164 @@
+#include "SharedState.h"
+#include <atomic>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <cerrno>
+#endif
+
+// The fields readers poll, as atomics
+static std::atomic<uint64_t>& shared(uint64_t& value) {
+	return reinterpret_cast<std::atomic<uint64_t>&>(value);
+}
+
+static std::atomic<uint32_t>& shared(uint32_t& value) {
+	return reinterpret_cast<std::atomic<uint32_t>&>(value);
+}
+
+#ifndef _WIN32
+// Whether the segment "object" belongs to a publisher that is still running. A segment of another layout counts
+// as in use too, it is not ours to remove.
+static bool segmentInUse(const std::string& object) {
+	int fd = shm_open(object.c_str(), O_RDONLY, 0);
+	if (fd < 0) return false;
+	bool inUse = true;
+	struct stat status;
+	if (fstat(fd, &status) == 0 && (size_t)status.st_size >= sizeof(gravity_shm_header)) {
+		void* address = mmap(nullptr, sizeof(gravity_shm_header), PROT_READ, MAP_SHARED, fd, 0);
+		if (address != MAP_FAILED) {
+			const gravity_shm_header* header = (const gravity_shm_header*)address;
+			if (std::memcmp(header->magic, GRAVITY_SHM_MAGIC, 8) == 0) inUse = kill((pid_t)header->publisher_pid, 0) == 0 || errno != ESRCH;
+			munmap(address, sizeof(gravity_shm_header));
+		}
+	}
+	::close(fd);
+	return inUse;
+}
+#endif
+
+bool SharedStatePublisher::open(const std::string& name, size_t capacity, std::string* error) {
+	close();
+	capacity = std::max(capacity, (size_t)1);
+	const uint64_t slotOffset = gravity_shm_padded(sizeof(gravity_shm_header));
+	const uint64_t slotBytes = gravity_shm_slot_bytes(capacity);
+	bytes = (size_t)(slotOffset + GRAVITY_SHM_SLOTS * slotBytes);
+
+#ifdef _WIN32
+	objectName = "Local\\" + name;
+	HANDLE handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)bytes >> 32), (DWORD)bytes, objectName.c_str());
+	if (handle && GetLastError() == ERROR_ALREADY_EXISTS) {
+		CloseHandle(handle);
+		if (error) *error = "Shared memory " + name + " is already published by another process";
+		return false;
+	}
+	if (handle) memory = (unsigned char*)MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+	if (!memory) {
+		if (handle) CloseHandle(handle);
+		if (error) *error = "Can't create shared memory " + name;
+		return false;
+	}
+	mapping = handle;
+#else
+	// A segment left behind by a run that crashed is replaced, readers still holding it see it never change
+	objectName = "/" + name;
+	if (segmentInUse(objectName)) {
+		if (error) *error = "Shared memory " + name + " is already published by another process";
+		return false;
+	}
+	shm_unlink(objectName.c_str());
+	int fd = shm_open(objectName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	void* address = MAP_FAILED;
+	if (fd >= 0 && ftruncate(fd, (off_t)bytes) == 0) address = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	int code = errno;
+	if (fd >= 0) ::close(fd);
+	if (address == MAP_FAILED) {
+		if (fd >= 0) shm_unlink(objectName.c_str());
+		if (error) *error = "Can't create shared memory " + objectName + ": " + std::strerror(code);
+		return false;
+	}
+	memory = (unsigned char*)address;
+#endif
+
+	// The segment starts zeroed, so every slot sequence starts even and nothing is published
+	header = reinterpret_cast<gravity_shm_header*>(memory);
+	std::memcpy(header->magic, GRAVITY_SHM_MAGIC, 8);
+	header->version = GRAVITY_SHM_VERSION;
+	header->slot_count = GRAVITY_SHM_SLOTS;
+	header->capacity = capacity;
+	header->slot_offset = slotOffset;
+	header->slot_bytes = slotBytes;
+#ifdef _WIN32
+	header->publisher_pid = (int64_t)GetCurrentProcessId();
+#else
+	header->publisher_pid = (int64_t)getpid();
+#endif
+	count = 0;
+	return true;
+}
+
+void SharedStatePublisher::publish(const Simulation& sim, bool force) {
+	if (!header) return;
+	// Snapshots are due on a grid of 1 / rate, half a period early still counts so a caller stepping at the
+	// same rate (the GUI's physics thread) doesn't skip snapshots over timing jitter
+	const double now = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	const double period = rate > 0.0 ? 1.0 / rate : 0.0;
+	if (!force && count > 0 && now < due - period / 2) return;
+	due = count > 0 ? std::max(due + period, now) : now + period;
+
+	unsigned char* base = memory + header->slot_offset + (count % header->slot_count) * header->slot_bytes;
+	gravity_shm_slot* slot = reinterpret_cast<gravity_shm_slot*>(base);
+	std::atomic<uint64_t>& sequence = shared(slot->sequence);
+
+	// Odd while writing, readers that started on this slot will see the change and read again
+	const uint64_t start = sequence.load(std::memory_order_relaxed);
+	sequence.store(start + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	const BodyArrays& bodies = sim.bodies;
+	const size_t stored = std::min(bodies.size(), (size_t)header->capacity);
+	slot->step = sim.steps;
+	slot->time = sim.time;
+	slot->count = stored;
+	slot->total = bodies.size();
+
+	// Bodies added since the last step have no handle yet and share the id of BodyHandle()
+	uint64_t* ids = reinterpret_cast<uint64_t*>(base + GRAVITY_SHM_ALIGNMENT);
+	for (size_t i = 0; i < stored; i++) {
+		BodyHandle handle = i < sim.handles.size() ? sim.handles.handleAt(i) : BodyHandle();
+		ids[i] = ((uint64_t)handle.generation << 32) | handle.slot;
+	}
+	const AlignedReals* arrays[6] = { &bodies.m, &bodies.r, &bodies.x, &bodies.y, &bodies.vx, &bodies.vy };
+	for (int a = 0; a < 6; a++) {
+		float* target = reinterpret_cast<float*>(base + gravity_shm_float_offset(header->capacity, a));
+		const Real* source = arrays[a]->data();
+		for (size_t i = 0; i < stored; i++) target[i] = (float)source[i];
+	}
+
+	sequence.store(start + 2, std::memory_order_release);
+	count++;
+	shared(header->published).store(count, std::memory_order_release);
+}
+
+void SharedStatePublisher::close() {
+	if (!header) return;
+	shared(header->closed).store(1, std::memory_order_release);
+#ifdef _WIN32
+	UnmapViewOfFile(memory);
+	CloseHandle((HANDLE)mapping);
+	mapping = nullptr;
+#else
+	munmap(memory, bytes);
+	shm_unlink(objectName.c_str());
+#endif
+	memory = nullptr;
+	header = nullptr;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "Simulation.h"
+#include "GravityShm.h"
+#include <string>
+#include <cstddef>
+
+const double SHARED_STATE_RATE = 60.0;				// Snapshots per second published by default
+const size_t SHARED_STATE_MIN_CAPACITY = 65536;		// Bodies a slot holds at least, so spawned bodies fit
+
+// Publishes the bodies of a simulation to a shared memory ring that other processes read through the C API in
+// GravityShm.h. publish() copies into the next slot behind a seqlock and returns: it never waits for readers,
+// and slow readers just skip snapshots. Memory beyond the bodies actually published is never touched, so the
+// headroom in the capacity costs address space only.
+struct SharedStatePublisher {
+	SharedStatePublisher() = default;
+	~SharedStatePublisher() { close(); }
+
+	SharedStatePublisher(const SharedStatePublisher&) = delete;
+	SharedStatePublisher& operator=(const SharedStatePublisher&) = delete;
+
+	double rate = SHARED_STATE_RATE;		// Most snapshots per second, 0 publishes every call
+
+	// Create the segment "name" (a POSIX shared memory object /name, or Local\name on Windows) with slots of
+	// "capacity" bodies, replacing one a crashed run left behind. Returns false and sets *error if it can't,
+	// also when a running process publishes "name".
+	bool open(const std::string& name, size_t capacity, std::string* error);
+
+	// Copy the bodies, ids and step of "sim" into the next slot, unless the last snapshot is less than 1 / rate ago
+	// and "force" is false. Bodies beyond the capacity are left out, readers see the full count in gravity_shm_view.total.
+	void publish(const Simulation& sim, bool force = false);
+
+	// Mark the segment closed for its readers and remove its name, readers that have it mapped keep it
+	void close();
+
+	bool isOpen() const { return header != nullptr; }
+
+	// Snapshots published so far
+	unsigned long long published() const { return count; }
+
+private:
+	std::string objectName;
+	unsigned char* memory = nullptr;
+	size_t bytes = 0;
+	gravity_shm_header* header = nullptr;
+#ifdef _WIN32
+	void* mapping = nullptr;
+#endif
+	unsigned long long count = 0;
+	double due = 0.0;					// Steady clock seconds when the next snapshot is due
+};
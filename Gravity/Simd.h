@@ -0,0 +1,16 @@
+#pragma once
+
+// x86 intrinsics are only available (and only needed) when building for x86
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define GRAVITY_X86 1
+#include <immintrin.h>
+#endif
+
+// GCC and Clang only emit AVX2/SSE instructions in functions that ask for them, MSVC always allows them
+#if defined(__GNUC__) || defined(__clang__)
+#define GRAVITY_TARGET_AVX2 __attribute__((target("avx2")))
+#define GRAVITY_TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#define GRAVITY_TARGET_AVX2
+#define GRAVITY_TARGET_SSE2
+#endif
@@ -0,0 +1,549 @@
+#include "Simulation.h"
+#include "Profiler.h"
+#include <cmath>
+#include <random>
+#include <algorithm>
+#include <atomic>
+
+const size_t BODY_BLOCK_SIZE = 256;		// Bodies per task for row-wise work (rows of the pair matrix, tree walks, integration)
+const size_t PAIR_TILE_SIZE = 512;		// Side length of a pair matrix tile handed to one worker
+
+// <--- SIMULATION --->
+
+void Simulation::reset() {
+	bodies.clear();
+	handles.clear();
+	steps = 0;
+	merges = 0;
+	removals = 0;
+	interactions = 0;
+	forceEvaluations = 0;
+	time = 0.0;
+	addedBodies.clear();
+	pendingBodies.clear();
+	pendingCount = 0;
+	addedCount = 0;
+	forcesCurrent = false;
+	levels.clear();
+	blockStart.clear();
+	staleForce.clear();
+	blockTick = 0;
+	treeStep = ~0ull;
+}
+
+BodyHandle Simulation::addBody(const Body& body) {
+	bodies.push(body);
+	pendingCount++;
+	if (recordEvents) pendingBodies.push_back(body);
+	return handles.append();
+}
+
+bool Simulation::removeBody(BodyHandle handle) {
+	const size_t i = handles.indexOf(handle);
+	if (i == BodyHandles::NONE) return false;
+
+	// Swap-remove: the last body takes the freed place, along with its handle and previous position
+	const size_t last = bodies.size() - 1;
+	const bool added = i >= bodies.size() - pendingCount;
+	handles.release(i);
+	if (i != last) {
+		bodies.moveBody(last, i);
+		handles.move(last, i);
+		if (i < previousX.size()) {
+			previousX[i] = last < previousX.size() ? previousX[last] : bodies.x[i];
+			previousY[i] = last < previousY.size() ? previousY[last] : bodies.y[i];
+		}
+	}
+	bodies.resize(last);
+	handles.resize(last);
+	if (previousX.size() > last) {
+		previousX.resize(last);
+		previousY.resize(last);
+	}
+
+	// The other bodies' forces still include this one, and the reordering moved an older body among the added ones,
+	// so the next step starts the integrator over as it does after loading a checkpoint
+	if (added) pendingCount--;
+	forcesCurrent = false;
+	removals++;
+	return true;
+}
+
+void Simulation::step() {
+	addedBodies.swap(pendingBodies);
+	pendingBodies.clear();
+	addedCount = pendingCount;
+	pendingCount = 0;
+
+	size_t merged;
+	{
+		ProfileScope scope(Phase::COLLISIONS);
+		merged = resolveCollisions();
+	}
+	merges += merged;
+	Profiler::get().count(Counter::MERGES, (double)merged);
+	syncHandles();
+	syncIntegratorState();
+
+	interactions = 0;
+	switch (integrator) {
+	case Integrator::EULER: stepEuler(); break;
+	case Integrator::LEAPFROG: stepLeapfrog(); break;
+	case Integrator::BLOCK: stepBlock(); break;
+	}
+	Profiler::get().count(Counter::INTERACTIONS, (double)interactions);
+
+	steps++;
+	time += dt;
+}
+
+void Simulation::stepEuler() {
+	{
+		ProfileScope scope(Phase::FORCES);
+		computeForces();
+	}
+
+	ProfileScope scope(Phase::INTEGRATE);
+	if (recordPreviousPositions) {
+		previousX = bodies.x;
+		previousY = bodies.y;
+	}
+
+	// Update each body, this also clears the forces
+	forEachBodyBlock([&](size_t begin, size_t end) { bodies.integrate(begin, end, dt, boundary); });
+	forcesCurrent = false;
+}
+
+void Simulation::stepLeapfrog() {
+	refreshForces();
+
+	// Kick by half a step with the forces at the start, then drift a whole step
+	{
+		ProfileScope scope(Phase::INTEGRATE);
+		if (recordPreviousPositions) {
+			previousX = bodies.x;
+			previousY = bodies.y;
+		}
+		forEachBodyBlock([&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) bodies.kick(i, dt / 2.0f);
+			bodies.drift(begin, end, dt, boundary);
+		});
+	}
+
+	{
+		ProfileScope scope(Phase::FORCES);
+		computeForces();
+	}
+
+	// Kick by the other half with the forces at the end, they are reused for the first half of the next step
+	ProfileScope scope(Phase::INTEGRATE);
+	forEachBodyBlock([&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) bodies.kick(i, dt / 2.0f);
+	});
+}
+
+// Ticks of dt / 2^BLOCK_FINE_LEVELS in one step of a block level
+static unsigned long long blockTicks(int level) {
+	return 1ull << (BLOCK_LEVELS - 1 - level);
+}
+
+// Finest level whose step fits a body's acceleration (ax, ay) and jerk (jx, jy). Before there is a jerk
+// estimate (jerk zero) the step is limited by the time to fall through the body's own radius instead.
+static int blockLevelFor(float ax, float ay, float jx, float jy, float radius, float dt) {
+	float accel = std::sqrt(ax * ax + ay * ay);
+	float jerk = std::sqrt(jx * jx + jy * jy);
+	float limit = INFINITY;
+	if (jerk > 0.0f) limit = BLOCK_ETA_JERK * accel / jerk;
+	else if (accel > 0.0f) limit = std::sqrt(2.0f * BLOCK_ETA_ACCEL * radius / accel);
+
+	// Level l steps dt * 2^(BLOCK_COARSE_LEVELS - l)
+	if (!(limit < dt * (float)(1 << BLOCK_COARSE_LEVELS))) return 0;
+	int level = (int)std::ceil(BLOCK_COARSE_LEVELS - std::log2(limit / dt));
+	return std::clamp(level, 0, BLOCK_LEVELS - 1);
+}
+
+void Simulation::stepBlock() {
+	const unsigned long long ticksPerStep = 1ull << BLOCK_FINE_LEVELS;
+	const float tickDt = dt / ticksPerStep;
+	const size_t count = bodies.size();
+	refreshForces();
+
+	// Bodies starting a block take a level the current tick lines up with, and the first half of their kick
+	size_t levelCount[BLOCK_LEVELS] = {};
+	for (size_t i = 0; i < count; i++) {
+		if (blockStart[i]) {
+			while (blockTick % blockTicks(levels[i]) != 0) levels[i]++;
+			bodies.kick(i, blockTicks(levels[i]) * tickDt / 2.0f);
+			blockStart[i] = 0;
+		}
+		levelCount[levels[i]]++;
+	}
+
+	if (recordPreviousPositions) {
+		previousX = bodies.x;
+		previousY = bodies.y;
+	}
+
+	const unsigned long long end = blockTick + ticksPerStep;
+	while (blockTick < end) {
+		// Everyone drifts to the next time a block ends
+		unsigned long long next = end;
+		for (int level = 0; level < BLOCK_LEVELS; level++) {
+			if (levelCount[level] == 0) continue;
+			unsigned long long length = blockTicks(level);
+			next = std::min(next, (blockTick / length + 1) * length);
+		}
+		{
+			ProfileScope scope(Phase::INTEGRATE);
+			float drift = (next - blockTick) * tickDt;
+			forEachBodyBlock([&](size_t begin, size_t end) { bodies.drift(begin, end, drift, boundary); });
+		}
+		blockTick = next;
+
+		// Blocks of this level and every finer one end here
+		int firstActive = 0;
+		while (blockTick % blockTicks(firstActive) != 0) firstActive++;
+		activeBodies.clear();
+		oldAccelX.clear();
+		oldAccelY.clear();
+		for (size_t i = 0; i < count; i++) {
+			if (levels[i] < firstActive) continue;
+			activeBodies.push_back((unsigned int)i);
+			oldAccelX.push_back(bodies.fx[i] / bodies.m[i]);
+			oldAccelY.push_back(bodies.fy[i] / bodies.m[i]);
+		}
+		if (activeBodies.empty()) continue;
+
+		{
+			ProfileScope scope(Phase::FORCES);
+			computeForces(activeBodies);
+		}
+
+		// Second half kick, a new level from the change in acceleration, then the first half kick of the next block
+		// unless the step is over. Levels get coarser by one at most and only where the coarser block would start.
+		ProfileScope scope(Phase::INTEGRATE);
+		for (size_t k = 0; k < activeBodies.size(); k++) {
+			unsigned int i = activeBodies[k];
+			float blockDt = blockTicks(levels[i]) * tickDt;
+			bodies.kick(i, blockDt / 2.0f);
+
+			float ax = bodies.fx[i] / bodies.m[i];
+			float ay = bodies.fy[i] / bodies.m[i];
+			int level = std::max(blockLevelFor(ax, ay, (ax - oldAccelX[k]) / blockDt, (ay - oldAccelY[k]) / blockDt, bodies.r[i], dt), levels[i] - 1);
+			while (blockTick % blockTicks(level) != 0) level++;
+			levelCount[levels[i]]--;
+			levelCount[level]++;
+			levels[i] = (unsigned char)level;
+
+			if (blockTick < end) bodies.kick(i, blockTicks(level) * tickDt / 2.0f);
+			else blockStart[i] = 1;
+		}
+	}
+}
+
+void Simulation::syncIntegratorState() {
+	// Added bodies were appended, then the merge removed the absorbed ones, exactly like the body arrays
+	const size_t appended = levels.size() + addedCount;
+	levels.resize(appended, BLOCK_COARSE_LEVELS);
+	blockStart.resize(appended, 1);
+	staleForce.resize(appended, 1);
+
+	const std::vector<MergeEvent>& merged = lastMerges();
+	if (!merged.empty() && bodies.size() + merged.size() == appended) {
+		std::vector<unsigned char> removed(appended, 0);
+		for (const MergeEvent& merge : merged) {
+			// The merged body restarts its block at the finest level of its members
+			levels[merge.survivor] = std::max(levels[merge.survivor], levels[merge.absorbed]);
+			blockStart[merge.survivor] = 1;
+			staleForce[merge.survivor] |= staleForce[merge.absorbed];
+			removed[merge.absorbed] = 1;
+		}
+		size_t write = 0;
+		for (size_t i = 0; i < appended; i++) {
+			if (removed[i]) continue;
+			levels[write] = levels[i];
+			blockStart[write] = blockStart[i];
+			staleForce[write] = staleForce[i];
+			write++;
+		}
+		levels.resize(write);
+		blockStart.resize(write);
+		staleForce.resize(write);
+	}
+
+	// Bodies were replaced some other way (reset, checkpoint), start over
+	if (levels.size() != bodies.size()) forcesCurrent = false;
+	if (!forcesCurrent) {
+		levels.assign(bodies.size(), BLOCK_COARSE_LEVELS);
+		blockStart.assign(bodies.size(), 1);
+		staleForce.assign(bodies.size(), 1);
+	}
+}
+
+void Simulation::syncHandles() {
+	const std::vector<MergeEvent>& merged = lastMerges();
+	if (!merged.empty() && handles.size() == bodies.size() + merged.size()) {
+		mergedAway.assign(handles.size(), 0);
+		for (const MergeEvent& merge : merged) mergedAway[merge.absorbed] = 1;
+		handles.compact(mergedAway);
+	}
+
+	// Bodies were replaced some other way, every body gets a new handle
+	if (handles.size() != bodies.size()) handles.reset(bodies.size());
+}
+
+void Simulation::refreshForces() {
+	activeBodies.clear();
+	for (size_t i = 0; i < staleForce.size(); i++) {
+		if (staleForce[i]) activeBodies.push_back((unsigned int)i);
+	}
+
+	if (!activeBodies.empty()) {
+		ProfileScope scope(Phase::FORCES);
+		computeForces(activeBodies);
+	}
+
+	// Without a history, new bodies get a level from their acceleration alone
+	for (unsigned int i : activeBodies) {
+		if (integrator == Integrator::BLOCK) levels[i] = (unsigned char)blockLevelFor(bodies.fx[i] / bodies.m[i], bodies.fy[i] / bodies.m[i], 0.0f, 0.0f, bodies.r[i], dt);
+		staleForce[i] = 0;
+	}
+	forcesCurrent = true;
+}
+
+size_t Simulation::resolveCollisions() {
+	return collisions.resolve(bodies, boundary);
+}
+
+void Simulation::computeForces() {
+	const size_t count = bodies.size();
+	std::fill(bodies.fx.begin(), bodies.fx.end(), 0.0f);
+	std::fill(bodies.fy.begin(), bodies.fy.end(), 0.0f);
+	forceEvaluations += count;
+
+	switch (solver) {
+	case Solver::DIRECT:
+		if (pool && !reproducible) {
+			computeDirectForcesParallel();
+		}
+		else {
+			// Rows of the pair matrix, vectorized for the instruction set of this CPU. Every row is computed the
+			// same way no matter which thread runs it, so this matches the single threaded result bit for bit.
+			DirectForceKernel kernel = directForceKernel(kernelIsa, boundary);
+			forEachBodyBlock([&](size_t begin, size_t end) { kernel(bodies, begin, end, bodies.fx.data(), bodies.fy.data()); });
+		}
+		interactions += count > 0 ? (unsigned long long)count * (count - 1) : 0;
+		break;
+
+	case Solver::BARNES_HUT: {
+		std::atomic<unsigned long long> visits{ 0 };
+		tree.build(bodies, boundary);
+		treeStep = steps;
+		forEachBodyBlock([&](size_t begin, size_t end) {
+			size_t blockVisits = 0;
+			for (size_t i = begin; i < end; i++) {
+				Vec2 force = tree.calculateForce(bodies, i, theta, &blockVisits);
+				bodies.fx[i] = force.x;
+				bodies.fy[i] = force.y;
+			}
+			visits += blockVisits;
+		});
+		interactions += visits;
+		break;
+	}
+
+	case Solver::PARTICLE_MESH:
+	case Solver::P3M:
+		mesh.shortRange = solver == Solver::P3M;
+		interactions += mesh.computeForces(bodies, boundary, pool.get());
+		break;
+	}
+}
+
+void Simulation::computeForces(const std::vector<unsigned int>& active) {
+	const size_t count = bodies.size();
+	if (active.size() == count) {
+		computeForces();
+		return;
+	}
+	forceEvaluations += active.size();
+
+	switch (solver) {
+	case Solver::DIRECT: {
+		// One row of the pair matrix per active body
+		DirectForceKernel kernel = directForceKernel(kernelIsa, boundary);
+		forEachBlock(active.size(), [&](size_t begin, size_t end) {
+			for (size_t k = begin; k < end; k++) {
+				unsigned int i = active[k];
+				bodies.fx[i] = 0.0f;
+				bodies.fy[i] = 0.0f;
+				kernel(bodies, i, i + 1, bodies.fx.data(), bodies.fy.data());
+			}
+		});
+		interactions += (unsigned long long)active.size() * (count - 1);
+		break;
+	}
+
+	case Solver::BARNES_HUT: {
+		// Bodies only drift a fraction of a step between the events of one step, refitting the tree is enough
+		std::atomic<unsigned long long> visits{ 0 };
+		if (treeStep == steps) {
+			tree.refit(bodies);
+		}
+		else {
+			tree.build(bodies, boundary);
+			treeStep = steps;
+		}
+		forEachBlock(active.size(), [&](size_t begin, size_t end) {
+			size_t blockVisits = 0;
+			for (size_t k = begin; k < end; k++) {
+				Vec2 force = tree.calculateForce(bodies, active[k], theta, &blockVisits);
+				bodies.fx[active[k]] = force.x;
+				bodies.fy[active[k]] = force.y;
+			}
+			visits += blockVisits;
+		});
+		interactions += visits;
+		break;
+	}
+
+	case Solver::PARTICLE_MESH:
+	case Solver::P3M:
+		// The mesh holds every body either way, only the listed ones take its force
+		mesh.shortRange = solver == Solver::P3M;
+		interactions += mesh.computeForces(bodies, boundary, pool.get(), &active);
+		break;
+	}
+}
+
+void Simulation::setThreads(size_t count) {
+	if (count == threadCount()) return;
+	pool.reset(count > 1 ? new ThreadPool(count) : nullptr);
+	workerForceX.clear();
+	workerForceY.clear();
+}
+
+void Simulation::forEachBodyBlock(const std::function<void(size_t begin, size_t end)>& fn) {
+	forEachBlock(bodies.size(), fn);
+}
+
+void Simulation::forEachBlock(size_t count, const std::function<void(size_t begin, size_t end)>& fn) {
+	if (!pool) {
+		fn(0, count);
+		return;
+	}
+	size_t blocks = (count + BODY_BLOCK_SIZE - 1) / BODY_BLOCK_SIZE;
+	pool->run(blocks, [&](size_t block, size_t) {
+		fn(block * BODY_BLOCK_SIZE, std::min(count, (block + 1) * BODY_BLOCK_SIZE));
+	});
+}
+
+void Simulation::computeDirectForcesParallel() {
+	const size_t count = bodies.size();
+	const size_t workers = pool->size();
+
+	// Every worker accumulates into its own zeroed force arrays
+	workerForceX.resize(workers);
+	workerForceY.resize(workers);
+	for (size_t w = 0; w < workers; w++) {
+		workerForceX[w].assign(count, 0.0f);
+		workerForceY[w].assign(count, 0.0f);
+	}
+
+	// Upper triangle of the pair matrix in tiles, so each pair is computed once (Newton's third law)
+	size_t blocks = (count + PAIR_TILE_SIZE - 1) / PAIR_TILE_SIZE;
+	pairTiles.clear();
+	for (size_t row = 0; row < blocks; row++) {
+		for (size_t col = row; col < blocks; col++) pairTiles.push_back({ row, col });
+	}
+
+	PairTileKernel kernel = pairTileKernel(kernelIsa, boundary);
+	pool->run(pairTiles.size(), [&](size_t tile, size_t worker) {
+		size_t iBegin = pairTiles[tile].first * PAIR_TILE_SIZE;
+		size_t jBegin = pairTiles[tile].second * PAIR_TILE_SIZE;
+		kernel(bodies, iBegin, std::min(count, iBegin + PAIR_TILE_SIZE), jBegin, std::min(count, jBegin + PAIR_TILE_SIZE),
+			workerForceX[worker].data(), workerForceY[worker].data());
+	});
+
+	// Reduce the worker accumulators in worker order
+	forEachBodyBlock([&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			Real sumX = 0, sumY = 0;
+			for (size_t w = 0; w < workers; w++) {
+				sumX += workerForceX[w][i];
+				sumY += workerForceY[w][i];
+			}
+			bodies.fx[i] += sumX;
+			bodies.fy[i] += sumY;
+		}
+	});
+}
+
+void Simulation::addRandomBodies(size_t count, unsigned int seed, float radiusScale) {
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> xDist(0.0f, (float)SIM_WIDTH);
+	std::uniform_real_distribution<float> yDist(0.0f, (float)SIM_HEIGHT);
+	std::uniform_real_distribution<float> radDist(1.0f, 3.0f);
+	std::uniform_real_distribution<float> velDist(-0.2f, 0.2f);
+
+	bodies.reserve(bodies.size() + count);
+	for (size_t n = 0; n < count; n++) {
+		float radius = radDist(rng) * radiusScale;
+		float mass = (4.0f / 3.0f) * SIM_PI * (radius * radius * radius) * 20000.0f; // Same density as spawned bodies
+		bodies.push(Body(mass, radius, { velDist(rng), velDist(rng) }, { xDist(rng), yDist(rng) }));
+	}
+}
+
+void Simulation::adoptBodies() {
+	while (handles.size() < bodies.size()) handles.append();
+	forcesCurrent = false;
+}
+
+const char* solverName(Solver solver) {
+	switch (solver) {
+	case Solver::DIRECT: return "Direct";
+	case Solver::BARNES_HUT: return "Barnes-Hut";
+	case Solver::PARTICLE_MESH: return "Particle-Mesh";
+	case Solver::P3M: return "P3M";
+	}
+	return "Unknown";
+}
+
+const char* solverKey(Solver solver) {
+	switch (solver) {
+	case Solver::DIRECT: return "direct";
+	case Solver::BARNES_HUT: return "bh";
+	case Solver::PARTICLE_MESH: return "pm";
+	case Solver::P3M: return "p3m";
+	}
+	return "unknown";
+}
+
+bool parseSolver(const std::string& name, Solver& solver) {
+	const Solver all[] = { Solver::DIRECT, Solver::BARNES_HUT, Solver::PARTICLE_MESH, Solver::P3M };
+	for (Solver candidate : all) {
+		if (name == solverKey(candidate)) {
+			solver = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char* integratorName(Integrator integrator) {
+	switch (integrator) {
+	case Integrator::EULER: return "Euler";
+	case Integrator::LEAPFROG: return "Leapfrog";
+	case Integrator::BLOCK: return "Block leapfrog";
+	}
+	return "Unknown";
+}
+
+const char* boundaryName(Boundary boundary) {
+	switch (boundary) {
+	case Boundary::PERIODIC: return "Periodic";
+	case Boundary::OPEN: return "Open";
+	case Boundary::REFLECTIVE: return "Reflective";
+	}
+	return "Unknown";
+}
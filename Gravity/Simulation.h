@@ -0,0 +1,164 @@
+#pragma once
+#include "BodyArrays.h"
+#include "BodyHandles.h"
+#include "ForceKernels.h"
+#include "QuadTree.h"
+#include "ParticleMesh.h"
+#include "Collisions.h"
+#include "ThreadPool.h"
+#include <vector>
+#include <memory>
+#include <string>
+#include <cstddef>
+
+// Force solvers that can be selected at runtime
+enum class Solver {
+	DIRECT,			// Exact pairwise summation, O(n^2)
+	BARNES_HUT,		// Quadtree approximation, O(n log n)
+	PARTICLE_MESH,	// Cloud-in-cell mesh and FFT convolution, O(n + m log m) for m mesh cells
+	P3M				// Particle-mesh plus direct summation over close neighbors
+};
+
+// Time integration schemes
+enum class Integrator {
+	EULER,			// Semi-implicit Euler, first order, the original update
+	LEAPFROG,		// Kick-drift-kick leapfrog, second order and symplectic, one force evaluation per step
+	BLOCK			// Leapfrog with power-of-two timesteps per body, only bodies finishing their step get new forces
+};
+
+const int BLOCK_COARSE_LEVELS = 4;		// Block timesteps: the slowest bodies step up to 2^4 times dt at once
+const int BLOCK_FINE_LEVELS = 10;		// and the fastest down to dt / 2^10
+const int BLOCK_LEVELS = BLOCK_COARSE_LEVELS + BLOCK_FINE_LEVELS + 1;	// Level 0 steps 16 * dt, level BLOCK_COARSE_LEVELS steps dt
+const float BLOCK_ETA_JERK = 0.05f;		// A body's step stays below this fraction of |acceleration| / |jerk|
+const float BLOCK_ETA_ACCEL = 0.02f;	// Until its jerk is known: below sqrt(2 * eta * radius / |acceleration|)
+
+// Owns all bodies and advances them, without any dependency on rendering
+struct Simulation {
+	BodyArrays bodies;					// Arrays containing all existing bodies
+	BodyHandles handles;				// Stable handle of every body, index-aligned with bodies
+	unsigned long long steps = 0;		// Number of steps taken since the last reset
+	unsigned long long merges = 0;		// Number of merges since the last reset
+	unsigned long long removals = 0;	// Number of removeBody() calls that removed a body since the last reset
+	unsigned long long interactions = 0;	// Body-body (or body-node) interactions evaluated by the last step
+	double time = 0.0;					// Simulated time since the last reset
+	float dt = SIM_DT;					// Timestep of one step
+	Solver solver = Solver::DIRECT;		// Force solver used by step()
+	Integrator integrator = Integrator::LEAPFROG;	// Time integration used by step()
+	Boundary boundary = Boundary::PERIODIC;	// What happens at the edges of the simulation space
+	bool forcesCurrent = false;			// bodies.fx / fy hold the forces at the current positions, clear it when replacing bodies wholesale
+	unsigned long long forceEvaluations = 0;	// Bodies whose force was computed since the last reset
+	float theta = 0.5f;					// Barnes-Hut opening angle, smaller is more accurate
+	KernelIsa kernelIsa = KernelIsa::AUTO;	// Instruction set of the direct summation kernel
+	QuadTree tree;						// Barnes-Hut tree, rebuilt every step when in use
+	ParticleMesh mesh;					// Particle-mesh solver state, mesh.gridSize sets its resolution
+	CollisionResolver collisions;		// Broad-phase grid and merge bookkeeping
+	bool reproducible = false;			// Multithreaded results identical to the serial path, bit for bit
+	bool recordPreviousPositions = false;	// Keep every body's position from before the last integration
+	AlignedReals previousX;				// Positions before the last integration, index-aligned with bodies
+	AlignedReals previousY;
+	bool recordEvents = false;			// Keep copies of the bodies added before the last step, for the trajectory recorder
+	std::vector<Body> addedBodies;		// With recordEvents: bodies addBody() appended between the previous step and the last one, in order
+
+	// Add a body to the simulation, the handle stays valid until the body is merged into another or removed
+	BodyHandle addBody(const Body& body);
+
+	// Remove a body in O(1) by moving the last body into its place, returns false if the handle is stale.
+	// Every other body keeps its handle, and the next step recomputes the forces it still holds.
+	bool removeBody(BodyHandle handle);
+
+	// Merges performed by the last step, indices from before the merged bodies were removed
+	const std::vector<MergeEvent>& lastMerges() const { return collisions.lastMerges(); }
+
+	// Remove every body and reset counters
+	void reset();
+
+	// Advance the simulation by one step: collisions, forces, then integration
+	void step();
+
+	// Merge every group of touching bodies, returns the number of bodies removed
+	size_t resolveCollisions();
+
+	// Replace the force on every body with the gravitational force from the selected solver
+	void computeForces();
+
+	// Replace the force on the listed bodies only, all others are left as they are
+	void computeForces(const std::vector<unsigned int>& active);
+
+	// Block timestep level of body i (see BLOCK_LEVELS), only meaningful with Integrator::BLOCK
+	int blockLevel(size_t i) const { return i < levels.size() ? levels[i] : BLOCK_COARSE_LEVELS; }
+
+	// Use "count" threads for the force phase (1 runs everything on the calling thread)
+	void setThreads(size_t count);
+
+	// Number of threads used for the force phase
+	size_t threadCount() const { return pool ? pool->size() : 1; }
+
+	// Workers of the force phase, null when single threaded
+	ThreadPool* threadPool() const { return pool.get(); }
+
+	// Add "count" bodies at random positions with small random velocities, reproducible by seed.
+	// Radii (1 to 3) are multiplied by radiusScale, masses follow from the radius.
+	void addRandomBodies(size_t count, unsigned int seed, float radiusScale = 1.0f);
+
+	// Take in bodies a bulk loader wrote straight into the end of the arrays: issue their handles and, since they
+	// are not reported as added bodies like addBody() ones, start the integrator over at the next step
+	void adoptBodies();
+
+private:
+	std::unique_ptr<ThreadPool> pool;					// Workers for the force phase, null when single threaded
+	std::vector<AlignedReals> workerForceX;				// Per-worker force accumulators for the pair tiles
+	std::vector<AlignedReals> workerForceY;
+	std::vector<std::pair<size_t, size_t>> pairTiles;	// (row block, column block) of every tile in the upper triangle
+	std::vector<Body> pendingBodies;					// Bodies added since the last step, become addedBodies when it runs
+	size_t pendingCount = 0;							// Number of bodies added since the last step
+	size_t addedCount = 0;								// Number of bodies added before the last step
+
+	// Block timestep state, index-aligned with bodies
+	std::vector<unsigned char> levels;					// Timestep level of every body
+	std::vector<unsigned char> blockStart;				// Body is at the start of a block and still needs its first half kick
+	std::vector<unsigned char> staleForce;				// Body was added since its force was last computed
+	unsigned long long blockTick = 0;					// Time in units of dt / 2^BLOCK_FINE_LEVELS since the last reset
+	unsigned long long treeStep = ~0ull;				// Step the Barnes-Hut tree was last built in, later events of it only refit
+	std::vector<unsigned char> mergedAway;				// Scratch: bodies absorbed by this step's merges
+	std::vector<unsigned int> activeBodies;				// Scratch: bodies whose force is recomputed at this event
+	std::vector<float> oldAccelX;						// Scratch: their acceleration before it, for the jerk
+	std::vector<float> oldAccelY;
+
+	// Integrators behind step()
+	void stepEuler();
+	void stepLeapfrog();
+	void stepBlock();
+
+	// Bring the per-body integrator state in line with the additions and merges of this step
+	void syncIntegratorState();
+
+	// Release the handles of bodies merged away this step and slide the others down with their bodies
+	void syncHandles();
+
+	// Compute forces for bodies added since the last step, or for everyone if the forces are out of date
+	void refreshForces();
+
+	// Call fn(begin, end) over blocks of bodies, in parallel when a pool is running
+	void forEachBodyBlock(const std::function<void(size_t begin, size_t end)>& fn);
+
+	// Call fn(begin, end) over blocks of "count" items, in parallel when a pool is running
+	void forEachBlock(size_t count, const std::function<void(size_t begin, size_t end)>& fn);
+
+	// Direct summation split across the pool
+	void computeDirectForcesParallel();
+};
+
+// Name of a solver for display
+const char* solverName(Solver solver);
+
+// Short name of a solver as accepted on the command line: direct, bh, pm or p3m
+const char* solverKey(Solver solver);
+
+// Solver by short name, returns false if there is none
+bool parseSolver(const std::string& name, Solver& solver);
+
+// Name of an integrator for display
+const char* integratorName(Integrator integrator);
+
+// Name of a boundary for display
+const char* boundaryName(Boundary boundary);
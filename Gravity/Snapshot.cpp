@@ -0,0 +1,70 @@
+#include "Snapshot.h"
+#include <cmath>
+
+void Snapshot::capture(const Simulation& sim, double now) {
+	bodies.x = sim.bodies.x;
+	bodies.y = sim.bodies.y;
+	bodies.vx = sim.bodies.vx;
+	bodies.vy = sim.bodies.vy;
+	bodies.m = sim.bodies.m;
+	bodies.r = sim.bodies.r;
+	bodies.fx.clear();
+	bodies.fy.clear();
+
+	// Bodies added since the last step have no previous position yet, they start where they are
+	previousX = sim.previousX;
+	previousY = sim.previousY;
+	for (size_t i = previousX.size(); i < bodies.size(); i++) {
+		previousX.push_back(bodies.x[i]);
+		previousY.push_back(bodies.y[i]);
+	}
+	previousX.resize(bodies.size());
+	previousY.resize(bodies.size());
+
+	handles = sim.handles;
+
+	steps = sim.steps;
+	merges = sim.merges;
+	removals = sim.removals;
+	time = sim.time;
+	publishedAt = now;
+	solver = sim.solver;
+	boundary = sim.boundary;
+	integrator = sim.integrator;
+	meshSize = sim.mesh.gridSize;
+	theta = sim.theta;
+	dt = sim.dt;
+
+	// The mesh solvers leave the field of the bodies' last force computation behind at no extra tree walk
+	if ((sim.solver == Solver::PARTICLE_MESH || sim.solver == Solver::P3M) && !sim.mesh.strength.empty()) {
+		meshStrength = sim.mesh.strength;
+		meshCellSize = sim.mesh.strengthCellSize;
+	}
+	else {
+		meshStrength.clear();
+	}
+}
+
+Vec2 Snapshot::interpolatedLocation(size_t i, float alpha) const {
+	if (boundary != Boundary::PERIODIC) {
+		return { previousX[i] + (bodies.x[i] - previousX[i]) * alpha, previousY[i] + (bodies.y[i] - previousY[i]) * alpha };
+	}
+
+	// A body that crossed the screen edge moved the short way around
+	Real dx = PeriodicBoundary::offset(bodies.x[i] - previousX[i], (Real)SIM_WIDTH, SIM_WIDTH_HALF);
+	Real dy = PeriodicBoundary::offset(bodies.y[i] - previousY[i], (Real)SIM_HEIGHT, SIM_HEIGHT_HALF);
+	Real x = previousX[i] + dx * alpha;
+	Real y = previousY[i] + dy * alpha;
+	return { std::fmod(SIM_WIDTH + x, (Real)SIM_WIDTH), std::fmod(SIM_HEIGHT + y, (Real)SIM_HEIGHT) };
+}
+
+void SnapshotBuffer::publish() {
+	back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & ~FRESH;
+}
+
+const Snapshot& SnapshotBuffer::read() {
+	if (middle.load(std::memory_order_acquire) & FRESH) {
+		front = middle.exchange(front, std::memory_order_acq_rel) & ~FRESH;
+	}
+	return buffers[front];
+}
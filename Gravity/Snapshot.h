@@ -0,0 +1,51 @@
+#pragma once
+#include "Simulation.h"
+#include <atomic>
+
+// Immutable copy of the simulation state published by the physics thread for the renderer
+struct Snapshot {
+	BodyArrays bodies;					// Bodies at the end of the step (forces are not copied)
+	AlignedReals previousX;				// Positions at the start of the step, index-aligned with bodies
+	AlignedReals previousY;
+	BodyHandles handles;				// Handle table of the bodies, empty for replayed trajectories
+	unsigned long long steps = 0;		// Simulation step this snapshot was taken after
+	unsigned long long merges = 0;
+	unsigned long long removals = 0;
+	double time = 0.0;					// Simulated time
+	double publishedAt = 0.0;			// Wall clock time (seconds) when the step finished
+	Solver solver = Solver::DIRECT;
+	Boundary boundary = Boundary::PERIODIC;
+	Integrator integrator = Integrator::LEAPFROG;
+	float theta = 0.5f;
+	float dt = SIM_DT;
+	std::vector<float> meshStrength;	// Gravity field from the particle-mesh solver's last mesh (see ParticleMesh::strength), empty if none
+	float meshCellSize = 0.0f;
+	int meshSize = PM_GRID_SIZE;		// Particle-mesh cells per side
+
+	// Copy the current state of a simulation recorded with recordPreviousPositions
+	void capture(const Simulation& sim, double now);
+
+	// Location of body i "alpha" of the way from the start to the end of the step, following the shortest wrapped path
+	// when the boundary is periodic
+	Vec2 interpolatedLocation(size_t i, float alpha) const;
+};
+
+// Lock-free triple buffer: one writer publishes snapshots while one reader always has a complete one to read.
+// Neither side ever waits for the other, the reader simply skips snapshots it was too slow to see.
+struct SnapshotBuffer {
+	// Buffer the writer may fill, not visible to the reader until publish()
+	Snapshot& writeBuffer() { return buffers[back]; }
+
+	// Hand the filled write buffer to the reader
+	void publish();
+
+	// Latest published snapshot. Stays valid and unchanged until the next call to read().
+	const Snapshot& read();
+
+private:
+	static const int FRESH = 4;		// Set on "middle" when it holds a snapshot the reader has not taken yet
+	Snapshot buffers[3];
+	int back = 0;					// Owned by the writer
+	int front = 1;					// Owned by the reader
+	std::atomic<int> middle{ 2 };	// Shared, index plus FRESH flag
+};
@@ -0,0 +1,113 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(size_t threads) : workerCount(threads > 0 ? threads : 1) {
+	ranges.reset(new TaskRange[workerCount]);
+	for (size_t worker = 1; worker < workerCount; worker++) {
+		this->threads.emplace_back(&ThreadPool::workerLoop, this, worker);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeWorkers.notify_all();
+	for (std::thread& thread : threads) thread.join();
+}
+
+size_t ThreadPool::hardwareThreads() {
+	unsigned int count = std::thread::hardware_concurrency();
+	return count > 0 ? count : 1;
+}
+
+void ThreadPool::run(size_t taskCount, const std::function<void(size_t task, size_t worker)>& task) {
+	if (taskCount == 0) return;
+
+	// Single worker: no synchronization needed
+	if (workerCount == 1) {
+		for (size_t index = 0; index < taskCount; index++) task(index, 0);
+		return;
+	}
+
+	// Give every worker an equal contiguous share to start with
+	for (size_t worker = 0; worker < workerCount; worker++) {
+		uint64_t begin = taskCount * worker / workerCount;
+		uint64_t end = taskCount * (worker + 1) / workerCount;
+		ranges[worker].range.store((end << 32) | begin, std::memory_order_relaxed);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		currentTask = &task;
+		busyWorkers = workerCount - 1;
+		generation++;
+	}
+	wakeWorkers.notify_all();
+
+	// The calling thread is worker 0
+	runTasks(0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	batchDone.wait(lock, [&] { return busyWorkers == 0; });
+	currentTask = nullptr;
+}
+
+void ThreadPool::workerLoop(size_t worker) {
+	uint64_t seenGeneration = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeWorkers.wait(lock, [&] { return stopping || generation != seenGeneration; });
+			if (stopping) return;
+			seenGeneration = generation;
+		}
+
+		runTasks(worker);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			busyWorkers--;
+		}
+		batchDone.notify_one();
+	}
+}
+
+void ThreadPool::runTasks(size_t worker) {
+	const std::function<void(size_t, size_t)>& task = *currentTask;
+	size_t index;
+	while (popOwn(worker, index) || steal(worker, index)) {
+		task(index, worker);
+	}
+}
+
+bool ThreadPool::popOwn(size_t worker, size_t& task) {
+	std::atomic<uint64_t>& range = ranges[worker].range;
+	uint64_t current = range.load(std::memory_order_acquire);
+	while (true) {
+		uint64_t begin = current & 0xFFFFFFFFull;
+		uint64_t end = current >> 32;
+		if (begin >= end) return false;
+		if (range.compare_exchange_weak(current, (end << 32) | (begin + 1), std::memory_order_acq_rel)) {
+			task = (size_t)begin;
+			return true;
+		}
+	}
+}
+
+bool ThreadPool::steal(size_t thief, size_t& task) {
+	for (size_t offset = 1; offset < workerCount; offset++) {
+		std::atomic<uint64_t>& range = ranges[(thief + offset) % workerCount].range;
+		uint64_t current = range.load(std::memory_order_acquire);
+		while (true) {
+			uint64_t begin = current & 0xFFFFFFFFull;
+			uint64_t end = current >> 32;
+			if (begin >= end) break;
+			if (range.compare_exchange_weak(current, ((end - 1) << 32) | begin, std::memory_order_acq_rel)) {
+				task = (size_t)(end - 1);
+				return true;
+			}
+		}
+	}
+	return false;
+}
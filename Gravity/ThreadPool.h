@@ -0,0 +1,62 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+// Fixed set of worker threads that run batches of independent tasks. Each worker starts on its own
+// contiguous share of the batch and steals single tasks from the back of other workers' shares once
+// it runs out, so uneven tiles (e.g. the triangle of the pair matrix) still keep every core busy.
+struct ThreadPool {
+	// Start a pool where "threads" workers take part in every batch, including the calling thread
+	explicit ThreadPool(size_t threads);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Number of workers, including the calling thread
+	size_t size() const { return workerCount; }
+
+	// Run task(index, worker) for every index in [0, taskCount) and wait for all of them to finish.
+	// "worker" is in [0, size()) and never runs two tasks at once, so it can select per-worker scratch space.
+	void run(size_t taskCount, const std::function<void(size_t task, size_t worker)>& task);
+
+	// Number of hardware threads, at least 1
+	static size_t hardwareThreads();
+
+private:
+	// Remaining tasks of one worker packed as (end << 32) | begin, so owner and thieves can race with one CAS
+	struct alignas(64) TaskRange {
+		std::atomic<uint64_t> range{ 0 };
+	};
+
+	size_t workerCount;
+	std::vector<std::thread> threads;
+	std::unique_ptr<TaskRange[]> ranges;
+
+	std::mutex mutex;
+	std::condition_variable wakeWorkers;
+	std::condition_variable batchDone;
+	const std::function<void(size_t, size_t)>* currentTask = nullptr;
+	uint64_t generation = 0;		// Incremented for every batch
+	size_t busyWorkers = 0;			// Background workers still running the current batch
+	bool stopping = false;
+
+	// Background worker main loop
+	void workerLoop(size_t worker);
+
+	// Run own tasks, then steal until every range is empty
+	void runTasks(size_t worker);
+
+	// Take the next task from the front of a worker's own range
+	bool popOwn(size_t worker, size_t& task);
+
+	// Take a task from the back of another worker's range
+	bool steal(size_t thief, size_t& task);
+};
@@ -0,0 +1,451 @@
+#include "Trajectory.h"
+#include "ByteOrder.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+static const char TRAJECTORY_MAGIC[8] = { 'G', 'R', 'A', 'V', 'T', 'R', 'A', 'J' };
+static const char TRAJECTORY_INDEX_MAGIC[8] = { 'G', 'R', 'A', 'V', 'T', 'I', 'D', 'X' };
+static const size_t FRAME_HEADER_BYTES = 36;		// Size, type, step, merges, time and body count
+static const size_t INDEX_ENTRY_BYTES = 24;
+static const int QUANTIZED_LIMIT = 32767;			// Largest change an i16 delta can hold
+
+// Body arrays stored in keyframes and added bodies, in file order
+static AlignedReals BodyArrays::* const TRAJECTORY_ARRAYS[6] = {
+	&BodyArrays::x, &BodyArrays::y, &BodyArrays::vx, &BodyArrays::vy, &BodyArrays::m, &BodyArrays::r
+};
+
+// Set *error if the caller asked for it, always returns false
+static bool fail(std::string* error, const std::string& message) {
+	if (error) *error = message;
+	return false;
+}
+
+// <--- SHARED BY ENCODER AND DECODER --->
+// The recorder runs exactly the same code as the reader, so its reconstructed state matches what a reader
+// will decode bit for bit and quantization errors never accumulate from one delta to the next.
+
+// Append the added bodies and remove the absorbed ones, leaving survivors in order like the merge did
+static void applyEvents(BodyArrays& bodies, const std::vector<Body>& added, const std::vector<MergeEvent>& merged, std::vector<unsigned char>& removed) {
+	for (const Body& body : added) bodies.push(body);
+	if (merged.empty()) return;
+
+	removed.assign(bodies.size(), 0);
+	for (const MergeEvent& merge : merged) removed[merge.absorbed] = 1;
+	size_t write = 0;
+	for (size_t i = 0; i < bodies.size(); i++) {
+		if (removed[i]) continue;
+		bodies.moveBody(i, write);
+		write++;
+	}
+	bodies.resize(write);
+}
+
+// Move a coordinate that left [0, size) by less than one size back in, only a periodic boundary wraps
+static Real wrapCoordinate(Real value, Real size, bool wraps) {
+	if (!wraps) return value;
+	if (value >= size) return value - size;
+	if (value < 0) return value + size;
+	return value;
+}
+
+// Add one body's quantized changes
+static void applyDelta(BodyArrays& bodies, size_t i, int dx, int dy, int dvx, int dvy, bool wraps) {
+	bodies.x[i] = wrapCoordinate(bodies.x[i] + dx * TRAJECTORY_POSITION_QUANTUM, (Real)SIM_WIDTH, wraps);
+	bodies.y[i] = wrapCoordinate(bodies.y[i] + dy * TRAJECTORY_POSITION_QUANTUM, (Real)SIM_HEIGHT, wraps);
+	bodies.vx[i] += dvx * TRAJECTORY_VELOCITY_QUANTUM;
+	bodies.vy[i] += dvy * TRAJECTORY_VELOCITY_QUANTUM;
+}
+
+// Nearest multiple of quantum, false if it doesn't fit an i16
+static bool quantize(Real delta, Real quantum, int& value) {
+	Real steps = std::round(delta / quantum);
+	if (!(std::fabs(steps) <= QUANTIZED_LIMIT)) return false;
+	value = (int)steps;
+	return true;
+}
+
+// <--- RECORDER --->
+
+TrajectoryRecorder::TrajectoryRecorder(const std::string& path, float dt, Boundary boundary) : boundary(boundary) {
+	file.open(path, std::ios::binary | std::ios::trunc);
+	opened = (bool)file;
+
+	std::vector<unsigned char> header;
+	header.insert(header.end(), TRAJECTORY_MAGIC, TRAJECTORY_MAGIC + 8);
+	putU32(header, TRAJECTORY_VERSION);
+	putU32(header, (uint32_t)TRAJECTORY_HEADER_BYTES);
+	putF32(header, (float)SIM_WIDTH);
+	putF32(header, (float)SIM_HEIGHT);
+	putF32(header, TRAJECTORY_POSITION_QUANTUM);
+	putF32(header, TRAJECTORY_VELOCITY_QUANTUM);
+	putU32(header, TRAJECTORY_KEYFRAME_INTERVAL);
+	putF32(header, dt);
+	putU64(header, 0);
+	putU64(header, 0);
+	putU32(header, (uint32_t)boundary);
+	header.resize(TRAJECTORY_HEADER_BYTES, 0);
+	if (opened) file.write((const char*)header.data(), header.size());
+	offset = TRAJECTORY_HEADER_BYTES;
+
+	thread = std::thread(&TrajectoryRecorder::run, this);
+}
+
+TrajectoryRecorder::~TrajectoryRecorder() {
+	close();
+}
+
+void TrajectoryRecorder::record(const Simulation& sim) {
+	TrajectoryFrame frame;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (!dropWhenBehind) drained.wait(lock, [&] { return queue.size() < TRAJECTORY_MAX_QUEUED_FRAMES || !running; });
+		if (!running) return;
+		if (queue.size() >= TRAJECTORY_MAX_QUEUED_FRAMES) {
+			dropped++;
+			gap = true;
+			return;
+		}
+		if (!spare.empty()) {
+			frame = std::move(spare.back());
+			spare.pop_back();
+		}
+		// Removed or bulk loaded bodies are not events a delta can describe, the frame after them is stored in full
+		frame.forceKeyframe = gap || sim.removals != removals || sim.bodies.size() != count + sim.addedBodies.size() - sim.lastMerges().size();
+		removals = sim.removals;
+		count = sim.bodies.size();
+		gap = false;
+	}
+
+	// Copy outside the lock, reusing the buffers of an already written frame
+	frame.step = sim.steps;
+	frame.merges = sim.merges;
+	frame.time = sim.time;
+	// The file stores f32, so the frame is rounded to it here and the encoder's reconstructed state matches
+	// a reader's in every precision (a plain copy in the float build)
+	for (auto array : TRAJECTORY_ARRAYS) {
+		const AlignedReals& source = sim.bodies.*array;
+		AlignedReals& target = frame.bodies.*array;
+		target.resize(source.size());
+		for (size_t i = 0; i < source.size(); i++) target[i] = (float)source[i];
+	}
+	frame.added.clear();
+	for (const Body& body : sim.addedBodies) {
+		frame.added.push_back(Body((float)body.mass, (float)body.radius, { (float)body.velocity.x, (float)body.velocity.y }, { (float)body.location.x, (float)body.location.y }));
+	}
+	frame.merged.assign(sim.lastMerges().begin(), sim.lastMerges().end());
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back(std::move(frame));
+	}
+	wake.notify_one();
+}
+
+void TrajectoryRecorder::close() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!running) return;
+		running = false;
+	}
+	wake.notify_one();
+	thread.join();
+	if (!opened) return;
+
+	// Index at the end, then point the header at it
+	uint64_t indexOffset = offset;
+	bytes.clear();
+	bytes.insert(bytes.end(), TRAJECTORY_INDEX_MAGIC, TRAJECTORY_INDEX_MAGIC + 8);
+	putU64(bytes, index.size());
+	for (const IndexEntry& entry : index) {
+		putU64(bytes, entry.offset);
+		putU64(bytes, entry.step);
+		putU32(bytes, entry.keyframe);
+		putU32(bytes, 0);
+	}
+	file.write((const char*)bytes.data(), bytes.size());
+
+	bytes.clear();
+	putU64(bytes, index.size());
+	putU64(bytes, indexOffset);
+	file.seekp(40);
+	file.write((const char*)bytes.data(), bytes.size());
+	file.close();
+}
+
+unsigned long long TrajectoryRecorder::framesWritten() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return written;
+}
+
+unsigned long long TrajectoryRecorder::framesDropped() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return dropped;
+}
+
+void TrajectoryRecorder::run() {
+	Profiler::get().nameThread("Recorder");
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		// Queued frames are written before shutting down
+		wake.wait(lock, [&] { return !queue.empty() || !running; });
+		if (queue.empty()) return;
+
+		TrajectoryFrame frame = std::move(queue.front());
+		queue.pop_front();
+		lock.unlock();
+		drained.notify_one();
+
+		{
+			ProfileScope scope(Phase::RECORD);
+			if (opened) write(frame);
+		}
+
+		lock.lock();
+		spare.push_back(std::move(frame));
+		written++;
+	}
+}
+
+void TrajectoryRecorder::write(const TrajectoryFrame& frame) {
+	const size_t count = frame.bodies.size();
+	const uint32_t frameNumber = (uint32_t)index.size();
+
+	// A delta needs the previous step, consistent events and changes small enough to quantize
+	bool keyframe = frame.forceKeyframe || index.empty() || frame.step != lastStep + 1 || frameNumber - lastKeyframe >= (uint32_t)TRAJECTORY_KEYFRAME_INTERVAL ||
+		reconstructed.size() + frame.added.size() != count + frame.merged.size();
+	for (const MergeEvent& merge : frame.merged) {
+		if (keyframe) break;
+		keyframe = merge.absorbed >= reconstructed.size() + frame.added.size() || merge.survivor >= reconstructed.size() + frame.added.size();
+	}
+
+	std::vector<unsigned char> removed;
+	std::vector<uint32_t> changedMass;
+	std::vector<int> quantized;
+	const bool wraps = boundary == Boundary::PERIODIC;
+	if (!keyframe) {
+		applyEvents(reconstructed, frame.added, frame.merged, removed);
+		for (size_t i = 0; i < count; i++) {
+			if (reconstructed.m[i] != frame.bodies.m[i] || reconstructed.r[i] != frame.bodies.r[i]) changedMass.push_back((uint32_t)i);
+		}
+
+		// Quantize against the reconstructed state rather than the previous true state
+		quantized.resize(count * 4);
+		for (size_t i = 0; i < count && !keyframe; i++) {
+			Real dx = frame.bodies.x[i] - reconstructed.x[i];
+			Real dy = frame.bodies.y[i] - reconstructed.y[i];
+			if (wraps) {
+				dx = PeriodicBoundary::offset(dx, (Real)SIM_WIDTH, SIM_WIDTH_HALF);
+				dy = PeriodicBoundary::offset(dy, (Real)SIM_HEIGHT, SIM_HEIGHT_HALF);
+			}
+			keyframe = !quantize(dx, TRAJECTORY_POSITION_QUANTUM, quantized[i]) ||
+				!quantize(dy, TRAJECTORY_POSITION_QUANTUM, quantized[count + i]) ||
+				!quantize(frame.bodies.vx[i] - reconstructed.vx[i], TRAJECTORY_VELOCITY_QUANTUM, quantized[2 * count + i]) ||
+				!quantize(frame.bodies.vy[i] - reconstructed.vy[i], TRAJECTORY_VELOCITY_QUANTUM, quantized[3 * count + i]);
+		}
+	}
+
+	bytes.clear();
+	putU32(bytes, 0);
+	putU8(bytes, (uint8_t)(keyframe ? FrameType::KEYFRAME : FrameType::DELTA));
+	putBytes(bytes, 0, 3);
+	putU64(bytes, frame.step);
+	putU64(bytes, frame.merges);
+	putF64(bytes, frame.time);
+	putU32(bytes, (uint32_t)count);
+
+	if (keyframe) {
+		for (auto array : TRAJECTORY_ARRAYS) {
+			putF32Array(bytes, (frame.bodies.*array).data(), count);
+			(reconstructed.*array).assign((frame.bodies.*array).begin(), (frame.bodies.*array).end());
+		}
+		reconstructed.fx.assign(count, 0.0f);
+		reconstructed.fy.assign(count, 0.0f);
+		lastKeyframe = frameNumber;
+	}
+	else {
+		putU32(bytes, (uint32_t)frame.added.size());
+		putU32(bytes, (uint32_t)frame.merged.size());
+		putU32(bytes, (uint32_t)changedMass.size());
+		for (const Body& body : frame.added) {
+			for (Real value : { body.location.x, body.location.y, body.velocity.x, body.velocity.y, body.mass, body.radius }) putF32(bytes, (float)value);
+		}
+		for (const MergeEvent& merge : frame.merged) {
+			putU32(bytes, merge.survivor);
+			putU32(bytes, merge.absorbed);
+		}
+		for (uint32_t i : changedMass) {
+			putU32(bytes, i);
+			putF32(bytes, (float)frame.bodies.m[i]);
+			putF32(bytes, (float)frame.bodies.r[i]);
+			reconstructed.m[i] = frame.bodies.m[i];
+			reconstructed.r[i] = frame.bodies.r[i];
+		}
+		for (int value : quantized) putU16(bytes, (uint16_t)(int16_t)value);
+		for (size_t i = 0; i < count; i++) applyDelta(reconstructed, i, quantized[i], quantized[count + i], quantized[2 * count + i], quantized[3 * count + i], wraps);
+	}
+
+	uint32_t size = (uint32_t)bytes.size();
+	for (int b = 0; b < 4; b++) bytes[b] = (unsigned char)(size >> (8 * b));
+	file.write((const char*)bytes.data(), bytes.size());
+
+	index.push_back({ offset, frame.step, lastKeyframe });
+	offset += bytes.size();
+	lastStep = frame.step;
+}
+
+// <--- READER --->
+
+bool TrajectoryReader::open(const std::string& path, std::string* error) {
+	offsets.clear();
+	steps.clear();
+	keyframes.clear();
+	decoded = false;
+	if (!file.open(path)) return fail(error, "Could not open " + path);
+
+	const unsigned char* bytes = file.data();
+	if (file.size() < TRAJECTORY_HEADER_BYTES || std::memcmp(bytes, TRAJECTORY_MAGIC, 8) != 0) return fail(error, "Not a trajectory file");
+	if (getU32(bytes + 8) != TRAJECTORY_VERSION) return fail(error, "Unsupported trajectory version " + std::to_string(getU32(bytes + 8)));
+	if (getF32(bytes + 16) != (float)SIM_WIDTH || getF32(bytes + 20) != (float)SIM_HEIGHT ||
+		getF32(bytes + 24) != TRAJECTORY_POSITION_QUANTUM || getF32(bytes + 28) != TRAJECTORY_VELOCITY_QUANTUM) {
+		return fail(error, "Trajectory was recorded with a different simulation size or quantization");
+	}
+	dt = getF32(bytes + 36);
+	boundary = (Boundary)getU32(bytes + 56);
+	if (boundary != Boundary::PERIODIC && boundary != Boundary::OPEN && boundary != Boundary::REFLECTIVE) return fail(error, "Trajectory has an unknown boundary");
+
+	if (!readIndex(getU64(bytes + 48)) || offsets.empty()) return fail(error, "Trajectory holds no readable frames");
+	return seek(0) || fail(error, "First frame of the trajectory is corrupt");
+}
+
+bool TrajectoryReader::readIndex(uint64_t indexOffset) {
+	const unsigned char* bytes = file.data();
+
+	// Written by close(): read it as it is
+	if (indexOffset >= TRAJECTORY_HEADER_BYTES && indexOffset + 16 <= file.size() && std::memcmp(bytes + indexOffset, TRAJECTORY_INDEX_MAGIC, 8) == 0) {
+		uint64_t count = getU64(bytes + indexOffset + 8);
+		if (count <= (file.size() - indexOffset - 16) / INDEX_ENTRY_BYTES) {
+			for (uint64_t f = 0; f < count; f++) {
+				const unsigned char* entry = bytes + indexOffset + 16 + f * INDEX_ENTRY_BYTES;
+				offsets.push_back(getU64(entry));
+				steps.push_back(getU64(entry + 8));
+				keyframes.push_back(getU32(entry + 16));
+				if (offsets.back() + FRAME_HEADER_BYTES > indexOffset || keyframes.back() > f) return false;
+			}
+			return true;
+		}
+	}
+
+	// Recording was cut short: walk the frames, keeping everything from the first keyframe to the first damaged frame
+	uint64_t offset = TRAJECTORY_HEADER_BYTES;
+	bool haveKeyframe = false;
+	uint32_t keyframe = 0;
+	while (offset + FRAME_HEADER_BYTES <= file.size()) {
+		uint32_t size = getU32(bytes + offset);
+		if (size < FRAME_HEADER_BYTES || offset + size > file.size()) break;
+		if (getU8(bytes + offset + 4) == (uint8_t)FrameType::KEYFRAME) {
+			haveKeyframe = true;
+			keyframe = (uint32_t)offsets.size();
+		}
+		if (haveKeyframe) {
+			offsets.push_back(offset);
+			steps.push_back(getU64(bytes + offset + 8));
+			keyframes.push_back(keyframe);
+		}
+		offset += size;
+	}
+	return true;
+}
+
+bool TrajectoryReader::seek(size_t frame) {
+	if (frame >= offsets.size()) return false;
+	if (decoded && current == frame) return true;
+
+	// Continue from the current frame when it lies on the way, otherwise start at the keyframe
+	size_t start = keyframes[frame];
+	if (decoded && current < frame && keyframes[current] == keyframes[frame]) start = current + 1;
+
+	for (size_t f = start; f <= frame; f++) {
+		if (!decode(f)) {
+			decoded = false;
+			return false;
+		}
+		current = f;
+	}
+	decoded = true;
+	return true;
+}
+
+bool TrajectoryReader::decode(size_t frame) {
+	const unsigned char* in = file.data() + offsets[frame];
+	const uint64_t size = getU32(in);
+	const size_t count = getU32(in + 32);
+	BodyArrays& bodies = state.bodies;
+
+	if (getU8(in + 4) == (uint8_t)FrameType::KEYFRAME) {
+		if (size < FRAME_HEADER_BYTES + 6 * count * sizeof(float)) return false;
+		bodies.resize(count);
+		for (int k = 0; k < 6; k++) getF32Array(in + FRAME_HEADER_BYTES + k * count * sizeof(float), (bodies.*TRAJECTORY_ARRAYS[k]).data(), count);
+	}
+	else {
+		if (size < FRAME_HEADER_BYTES + 12) return false;
+		const size_t addedCount = getU32(in + FRAME_HEADER_BYTES);
+		const size_t mergedCount = getU32(in + FRAME_HEADER_BYTES + 4);
+		const size_t changedCount = getU32(in + FRAME_HEADER_BYTES + 8);
+		if (size != FRAME_HEADER_BYTES + 12 + addedCount * 24 + mergedCount * 8 + changedCount * 12 + count * 8) return false;
+		if (bodies.size() + addedCount != count + mergedCount) return false;
+		const unsigned char* read = in + FRAME_HEADER_BYTES + 12;
+
+		std::vector<Body> added;
+		for (size_t n = 0; n < addedCount; n++, read += 24) {
+			added.push_back(Body(getF32(read + 16), getF32(read + 20), { getF32(read + 8), getF32(read + 12) }, { getF32(read), getF32(read + 4) }));
+		}
+		std::vector<MergeEvent> merged;
+		for (size_t n = 0; n < mergedCount; n++, read += 8) {
+			merged.push_back({ getU32(read), getU32(read + 4) });
+			if (merged.back().absorbed >= count + mergedCount) return false;
+		}
+
+		std::vector<unsigned char> removed;
+		applyEvents(bodies, added, merged, removed);
+
+		for (size_t n = 0; n < changedCount; n++, read += 12) {
+			uint32_t i = getU32(read);
+			if (i >= count) return false;
+			bodies.m[i] = getF32(read + 4);
+			bodies.r[i] = getF32(read + 8);
+		}
+		for (size_t i = 0; i < count; i++) {
+			applyDelta(bodies, i, (int16_t)getU16(read + 2 * i), (int16_t)getU16(read + 2 * (count + i)),
+				(int16_t)getU16(read + 2 * (2 * count + i)), (int16_t)getU16(read + 2 * (3 * count + i)), boundary == Boundary::PERIODIC);
+		}
+	}
+
+	state.previousX = bodies.x;
+	state.previousY = bodies.y;
+	state.steps = getU64(in + 8);
+	state.merges = getU64(in + 16);
+	state.time = getF64(in + 24);
+	state.dt = dt;
+	state.boundary = boundary;
+	return true;
+}
+
+// <--- PLAYER --->
+
+void TrajectoryPlayer::advance(double seconds) {
+	if (paused || reader.frameCount() == 0) return;
+	double target = position + direction * speed * stepsPerSecond * seconds;
+
+	// Stop at either end of the recording
+	double last = (double)(reader.frameCount() - 1);
+	if (target <= 0.0 || target >= last) paused = true;
+	seek(target);
+}
+
+void TrajectoryPlayer::seek(double frame) {
+	if (reader.frameCount() == 0) return;
+	position = std::clamp(frame, 0.0, (double)(reader.frameCount() - 1));
+	reader.seek((size_t)position);
+}
@@ -0,0 +1,172 @@
+#pragma once
+#include "Simulation.h"
+#include "Snapshot.h"
+#include "MappedFile.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <cstdint>
+
+const uint32_t TRAJECTORY_VERSION = 1;					// Bumped whenever the layout changes
+const size_t TRAJECTORY_HEADER_BYTES = 64;				// Fixed header size, the first frame starts right after it
+const int TRAJECTORY_KEYFRAME_INTERVAL = 120;			// Frames from one keyframe to the next, bounds the cost of a seek
+const float TRAJECTORY_POSITION_QUANTUM = 1.0f / 1024.0f;	// Position delta resolution, deltas up to 32 pixels per step fit
+const float TRAJECTORY_VELOCITY_QUANTUM = 1.0f / 65536.0f;	// Velocity delta resolution, changes up to 0.5 per step fit
+const size_t TRAJECTORY_MAX_QUEUED_FRAMES = 120;		// Frames waiting for the I/O thread before new ones are dropped
+
+// Kind of a recorded frame
+enum class FrameType {
+	KEYFRAME,		// Every body array stored in full
+	DELTA			// Events and quantized changes against the previous frame
+};
+
+// Body state of one recorded step, the unit the recorder hands to its I/O thread
+struct TrajectoryFrame {
+	unsigned long long step = 0;
+	unsigned long long merges = 0;
+	double time = 0.0;
+	BodyArrays bodies;					// State after the step (forces are not copied)
+	std::vector<Body> added;			// Bodies appended before the step
+	std::vector<MergeEvent> merged;		// Merges performed by the step
+	bool forceKeyframe = false;			// Frames before this one were dropped or bodies were removed, so it can't be stored as a delta
+};
+
+// Streams every step of a simulation to a trajectory file. Each file holds
+//   0   magic "GRAVTRAJ"   8   version   12  header bytes   16  SIM_WIDTH   20  SIM_HEIGHT (f32)
+//   24  position quantum   28  velocity quantum (f32)   32  keyframe interval (u32)   36  dt (f32)
+//   40  frame count (u64)   48  offset of the frame index (u64, 0 until the recording is closed)   56  Boundary (u32)
+// followed by the frames and finally the index, all little-endian. A frame starts with its size in bytes
+// (u32), its FrameType (u8, 3 bytes padding), step (u64), merges (u64), time (f64) and body count (u32).
+// Keyframes continue with the arrays x, y, vx, vy, m, r. Deltas continue with the counts of added bodies,
+// merges and mass changes (u32 each), the added bodies (x, y, vx, vy, m, r), the merges (survivor, absorbed),
+// the mass changes (index, m, r), then the quantized changes of x, y, vx and vy as i16 arrays.
+// The index is the magic "GRAVTIDX", the frame count (u64) and per frame its offset (u64), step (u64) and
+// the frame number of the keyframe it builds on (u32, 4 bytes padding).
+struct TrajectoryRecorder {
+	// Create "path" and start the I/O thread, check isOpen() before recording. Position changes are stored the
+	// short way around when the boundary is periodic.
+	TrajectoryRecorder(const std::string& path, float dt = SIM_DT, Boundary boundary = Boundary::PERIODIC);
+	~TrajectoryRecorder();
+
+	TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+	TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+	bool dropWhenBehind = true;		// Drop frames instead of waiting when the I/O thread falls behind
+
+	// True if the file was created
+	bool isOpen() const { return opened; }
+
+	// Queue the state after the last step of a simulation running with recordEvents. Only copies the
+	// bodies, encoding and writing happen on the I/O thread. If that thread falls behind by more than
+	// TRAJECTORY_MAX_QUEUED_FRAMES this waits for it, or with dropWhenBehind drops the frame and
+	// makes the next one a keyframe.
+	void record(const Simulation& sim);
+
+	// Write every queued frame and the index, then close the file
+	void close();
+
+	// Frames written and dropped so far
+	unsigned long long framesWritten() const;
+	unsigned long long framesDropped() const;
+
+private:
+	// Where a frame starts in the file
+	struct IndexEntry {
+		uint64_t offset;
+		uint64_t step;
+		uint32_t keyframe;
+	};
+
+	std::ofstream file;
+	bool opened = false;
+	Boundary boundary;
+	uint64_t offset = 0;
+	std::vector<IndexEntry> index;
+
+	// Shared with the I/O thread
+	mutable std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable drained;		// Signalled whenever the I/O thread takes a frame
+	std::deque<TrajectoryFrame> queue;
+	std::vector<TrajectoryFrame> spare;		// Frames whose buffers can be reused
+	bool running = true;
+	bool gap = false;						// A frame was dropped, the next one must be a keyframe
+	unsigned long long written = 0;
+	unsigned long long dropped = 0;
+	unsigned long long removals = 0;		// Simulation::removals at the last recorded frame
+	size_t count = 0;						// Bodies in the last recorded frame
+	std::thread thread;
+
+	// Owned by the I/O thread: state a reader has after the last written frame
+	BodyArrays reconstructed;
+	uint64_t lastStep = 0;
+	uint32_t lastKeyframe = 0;
+	std::vector<unsigned char> bytes;
+
+	// I/O thread main loop
+	void run();
+
+	// Encode a frame against the reconstructed state and append it to the file
+	void write(const TrajectoryFrame& frame);
+};
+
+// Random access to the steps of a trajectory file, memory-mapped. Any frame is decoded from its
+// keyframe with at most TRAJECTORY_KEYFRAME_INTERVAL - 1 deltas, moving forward reuses the current frame.
+struct TrajectoryReader {
+	// Map a trajectory, returns false with a message in *error if it can't be read
+	bool open(const std::string& path, std::string* error = nullptr);
+
+	// Number of recorded frames
+	size_t frameCount() const { return offsets.size(); }
+
+	// Simulation step of a frame
+	unsigned long long frameStep(size_t frame) const { return steps[frame]; }
+
+	// Decode a frame into snapshot(), returns false if the frame is out of range or corrupt
+	bool seek(size_t frame);
+
+	// Frame currently held by snapshot()
+	size_t currentFrame() const { return current; }
+
+	// State of the current frame, ready for the renderer (no interpolation, previous positions equal the current ones)
+	const Snapshot& snapshot() const { return state; }
+
+private:
+	MappedFile file;
+	float dt = SIM_DT;
+	Boundary boundary = Boundary::PERIODIC;
+	std::vector<uint64_t> offsets;		// Per frame: where it starts, its step and its keyframe
+	std::vector<unsigned long long> steps;
+	std::vector<uint32_t> keyframes;
+	size_t current = 0;
+	bool decoded = false;
+	Snapshot state;
+
+	// Read the index at the end of the file, or rebuild it by walking the frames if the recording wasn't closed
+	bool readIndex(uint64_t indexOffset);
+
+	// Apply one frame to the state
+	bool decode(size_t frame);
+};
+
+// Plays a trajectory forward or backward at any speed, one recorded step per physics period at speed 1
+struct TrajectoryPlayer {
+	TrajectoryReader reader;
+	double position = 0.0;			// Fractional frame being shown
+	double speed = 1.0;				// Multiple of the recording's real time rate
+	int direction = 1;				// 1 plays forward, -1 backward
+	bool paused = false;
+	double stepsPerSecond;
+
+	TrajectoryPlayer(double stepsPerSecond) : stepsPerSecond(stepsPerSecond) {}
+
+	// Move "seconds" of wall clock time forward and decode the frame reached
+	void advance(double seconds);
+
+	// Jump to a frame (clamped to the recording) and decode it
+	void seek(double frame);
+};
@@ -0,0 +1,334 @@
+#include "Transport.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+#include <algorithm>
+#include <cstdlib>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef SOCKET SocketHandle;
+static const SocketHandle NO_SOCKET = INVALID_SOCKET;
+static void closeSocket(SocketHandle socket) { closesocket(socket); }
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+typedef int SocketHandle;
+static const SocketHandle NO_SOCKET = -1;
+static void closeSocket(SocketHandle socket) { ::close(socket); }
+#endif
+
+#ifdef MSG_NOSIGNAL
+static const int SEND_FLAGS = MSG_NOSIGNAL;		// A peer that went away is reported as an error, not SIGPIPE
+#else
+static const int SEND_FLAGS = 0;
+#endif
+
+static const size_t FRAME_HEADER_BYTES = 12;	// Message type (u32) and payload length (u64)
+
+// Set *error if the caller asked for it, always returns null
+static std::nullptr_t fail(std::string* error, const std::string& message) {
+	if (error) *error = message;
+	return nullptr;
+}
+
+// Wait up to timeoutMs (-1 forever) until the socket has something to read or accept
+static bool waitReadable(SocketHandle socket, int timeoutMs) {
+#ifdef _WIN32
+	WSAPOLLFD entry = { socket, POLLRDNORM, 0 };
+	return WSAPoll(&entry, 1, timeoutMs) > 0;
+#else
+	pollfd entry = { socket, POLLIN, 0 };
+	return poll(&entry, 1, timeoutMs) > 0;
+#endif
+}
+
+// Write every byte, returns false if the connection broke
+static bool sendAll(SocketHandle socket, const unsigned char* data, size_t size) {
+	while (size > 0) {
+		int chunk = (int)std::min<size_t>(size, 1 << 30);
+		auto written = ::send(socket, (const char*)data, chunk, SEND_FLAGS);
+		if (written <= 0) return false;
+		data += written;
+		size -= (size_t)written;
+	}
+	return true;
+}
+
+// Read exactly "size" bytes, returns false if the connection closed first
+static bool receiveAll(SocketHandle socket, unsigned char* data, size_t size) {
+	while (size > 0) {
+		int chunk = (int)std::min<size_t>(size, 1 << 30);
+		auto received = ::recv(socket, (char*)data, chunk, 0);
+		if (received <= 0) return false;
+		data += received;
+		size -= (size_t)received;
+	}
+	return true;
+}
+
+// Stream socket carrying framed messages. A writer thread drains the send queue, so send() returns at once.
+struct SocketChannel : Channel {
+	explicit SocketChannel(SocketHandle socket) : socket(socket), writer(&SocketChannel::writeLoop, this) {}
+
+	~SocketChannel() override {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		writer.join(); // Writes out whatever is still queued, unless the peer is gone
+		closeSocket(socket);
+	}
+
+	bool send(uint32_t type, std::vector<unsigned char> payload) override {
+		if (broken) return false;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queued += payload.size() + FRAME_HEADER_BYTES;
+			queue.push_back({ type, std::move(payload) });
+		}
+		wake.notify_one();
+		return true;
+	}
+
+	bool receive(Message& message) override {
+		unsigned char header[FRAME_HEADER_BYTES];
+		if (!receiveAll(socket, header, sizeof(header))) return false;
+		uint64_t length;
+		std::memcpy(&message.type, header, 4);
+		std::memcpy(&length, header + 4, 8);
+		if (length > TRANSPORT_MAX_MESSAGE_BYTES) return false;
+		message.payload.resize((size_t)length);
+		return receiveAll(socket, message.payload.data(), message.payload.size());
+	}
+
+	size_t queuedBytes() const override {
+		std::lock_guard<std::mutex> lock(mutex);
+		return queued;
+	}
+
+	void close() override {
+#ifdef _WIN32
+		shutdown(socket, SD_BOTH);
+#else
+		shutdown(socket, SHUT_RDWR);
+#endif
+	}
+
+private:
+	SocketHandle socket;
+	mutable std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<Message> queue;
+	size_t queued = 0;
+	bool stopping = false;
+	std::atomic<bool> broken{ false };
+	std::thread writer;
+
+	void writeLoop() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			wake.wait(lock, [&] { return stopping || !queue.empty(); });
+			if (queue.empty()) return;
+
+			Message message = std::move(queue.front());
+			queue.pop_front();
+			lock.unlock();
+
+			unsigned char header[FRAME_HEADER_BYTES];
+			uint64_t length = message.payload.size();
+			std::memcpy(header, &message.type, 4);
+			std::memcpy(header + 4, &length, 8);
+			bool sent = !broken && sendAll(socket, header, sizeof(header)) && sendAll(socket, message.payload.data(), message.payload.size());
+
+			lock.lock();
+			queued -= message.payload.size() + FRAME_HEADER_BYTES;
+			if (!sent) {
+				broken = true;
+				queue.clear();
+				queued = 0;
+			}
+		}
+	}
+};
+
+// Listening stream socket, removes its socket file when it is a Unix one
+struct SocketListener : Listener {
+	SocketListener(SocketHandle socket, const std::string& address, const std::string& socketFile, bool noDelay)
+		: socket(socket), boundAddress(address), socketFile(socketFile), noDelay(noDelay) {}
+
+	~SocketListener() override {
+		closeSocket(socket);
+#ifndef _WIN32
+		if (!socketFile.empty()) unlink(socketFile.c_str());
+#endif
+	}
+
+	std::string address() const override { return boundAddress; }
+
+	std::unique_ptr<Channel> accept(int timeoutMs) override {
+		if (!waitReadable(socket, timeoutMs)) return nullptr;
+		SocketHandle connection = ::accept(socket, nullptr, nullptr);
+		if (connection == NO_SOCKET) return nullptr;
+		if (noDelay) {
+			int on = 1;
+			setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+		}
+		return std::unique_ptr<Channel>(new SocketChannel(connection));
+	}
+
+private:
+	SocketHandle socket;
+	std::string boundAddress;
+	std::string socketFile;
+	bool noDelay;
+};
+
+// Split "tcp:host:port" after its scheme into host and port, returns false if malformed
+static bool splitHostPort(const std::string& rest, std::string& host, std::string& port) {
+	size_t colon = rest.rfind(':');
+	if (colon == std::string::npos || colon == 0 || colon + 1 == rest.size()) return false;
+	host = rest.substr(0, colon);
+	port = rest.substr(colon + 1);
+	return true;
+}
+
+// IPv4 address of "host:port", returns false if it can't be resolved
+static bool resolveTcp(const std::string& rest, sockaddr_in& address) {
+	std::string host, port;
+	if (!splitHostPort(rest, host, port)) return false;
+	addrinfo hints = {};
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* found = nullptr;
+	if (getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0 || !found) return false;
+	std::memcpy(&address, found->ai_addr, sizeof(address));
+	freeaddrinfo(found);
+	return true;
+}
+
+// TCP, meant for the loopback interface but any reachable host works
+struct TcpTransport : Transport {
+	std::unique_ptr<Listener> listen(const std::string& address, std::string* error) override {
+		std::string host, port;
+		sockaddr_in bound;
+		if (!splitHostPort(address.substr(4), host, port) || !resolveTcp(address.substr(4), bound)) return fail(error, "Invalid address " + address);
+
+		SocketHandle socket = ::socket(AF_INET, SOCK_STREAM, 0);
+		if (socket == NO_SOCKET) return fail(error, "Could not create a socket");
+		int on = 1;
+		setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));
+		socklen_t length = sizeof(bound);
+		if (::bind(socket, (const sockaddr*)&bound, sizeof(bound)) != 0 || ::listen(socket, SOMAXCONN) != 0 || getsockname(socket, (sockaddr*)&bound, &length) != 0) {
+			closeSocket(socket);
+			return fail(error, "Could not listen on " + address);
+		}
+		std::string actual = "tcp:" + host + ":" + std::to_string(ntohs(bound.sin_port));
+		return std::unique_ptr<Listener>(new SocketListener(socket, actual, std::string(), true));
+	}
+
+	std::unique_ptr<Channel> connect(const std::string& address, std::string* error) override {
+		sockaddr_in peer;
+		if (!resolveTcp(address.substr(4), peer)) return fail(error, "Invalid address " + address);
+		SocketHandle socket = ::socket(AF_INET, SOCK_STREAM, 0);
+		if (socket == NO_SOCKET) return fail(error, "Could not create a socket");
+		if (::connect(socket, (const sockaddr*)&peer, sizeof(peer)) != 0) {
+			closeSocket(socket);
+			return fail(error, "Could not connect to " + address);
+		}
+		int on = 1;
+		setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+		return std::unique_ptr<Channel>(new SocketChannel(socket));
+	}
+
+	std::string siblingAddress(const std::string& address, int) const override {
+		std::string host, port;
+		splitHostPort(address.substr(4), host, port);
+		return "tcp:" + host + ":0";
+	}
+};
+
+#ifndef _WIN32
+// Unix domain sockets, the socket file is created by listen() and removed with the listener
+struct UnixTransport : Transport {
+	std::unique_ptr<Listener> listen(const std::string& address, std::string* error) override {
+		sockaddr_un bound;
+		std::string path = address.substr(5);
+		if (!fill(path, bound)) return fail(error, "Invalid address " + address);
+
+		SocketHandle socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if (socket == NO_SOCKET) return fail(error, "Could not create a socket");
+		unlink(path.c_str()); // Left behind by a run that did not exit cleanly
+		if (::bind(socket, (const sockaddr*)&bound, sizeof(bound)) != 0 || ::listen(socket, SOMAXCONN) != 0) {
+			closeSocket(socket);
+			return fail(error, "Could not listen on " + address);
+		}
+		return std::unique_ptr<Listener>(new SocketListener(socket, address, path, false));
+	}
+
+	std::unique_ptr<Channel> connect(const std::string& address, std::string* error) override {
+		sockaddr_un peer;
+		if (!fill(address.substr(5), peer)) return fail(error, "Invalid address " + address);
+		SocketHandle socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if (socket == NO_SOCKET) return fail(error, "Could not create a socket");
+		if (::connect(socket, (const sockaddr*)&peer, sizeof(peer)) != 0) {
+			closeSocket(socket);
+			return fail(error, "Could not connect to " + address);
+		}
+		return std::unique_ptr<Channel>(new SocketChannel(socket));
+	}
+
+	std::string siblingAddress(const std::string& address, int index) const override {
+		return address + "." + std::to_string(index);
+	}
+
+private:
+	// Socket address of a path, false if it is empty or too long
+	static bool fill(const std::string& path, sockaddr_un& address) {
+		std::memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if (path.empty() || path.size() >= sizeof(address.sun_path)) return false;
+		std::memcpy(address.sun_path, path.c_str(), path.size());
+		return true;
+	}
+};
+#endif
+
+Transport* transportFor(const std::string& address) {
+#ifdef _WIN32
+	static const bool started = [] {
+		WSADATA data;
+		return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}();
+	if (!started) return nullptr;
+#else
+	static UnixTransport unixSockets;
+	if (address.compare(0, 5, "unix:") == 0) return &unixSockets;
+#endif
+	static TcpTransport tcp;
+	if (address.compare(0, 4, "tcp:") == 0) return &tcp;
+	return nullptr;
+}
+
+std::string defaultListenAddress() {
+#ifdef _WIN32
+	return "tcp:127.0.0.1:0";
+#else
+	const char* directory = std::getenv("TMPDIR");
+	std::string base = directory && *directory ? directory : "/tmp";
+	if (base.back() == '/') base.pop_back();
+	return "unix:" + base + "/gravity-" + std::to_string((long long)getpid()) + ".sock";
+#endif
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+const uint64_t TRANSPORT_MAX_MESSAGE_BYTES = 1ull << 34;	// Larger length prefixes are taken as a corrupt stream
+
+// One framed message: a type chosen by the protocol on top and its payload
+struct Message {
+	uint32_t type = 0;
+	std::vector<unsigned char> payload;
+};
+
+// Ordered, reliable message stream to one peer. send() never waits for the peer to read, messages are queued and
+// written in the background, so every process may send to every other one before receiving without deadlocking.
+struct Channel {
+	virtual ~Channel() = default;
+
+	// Queue a message, returns false once the connection is known to be broken
+	virtual bool send(uint32_t type, std::vector<unsigned char> payload) = 0;
+
+	// Wait for the next message, returns false when the peer is gone or the stream is corrupt
+	virtual bool receive(Message& message) = 0;
+
+	// Bytes queued by send() and not yet written, lets a sender skip optional messages to a slow peer
+	virtual size_t queuedBytes() const = 0;
+
+	// Shut the connection down in both directions, a receive() waiting on another thread returns false
+	virtual void close() = 0;
+};
+
+// Accepts connections on one address
+struct Listener {
+	virtual ~Listener() = default;
+
+	// Address peers connect to, with any port the system picked filled in
+	virtual std::string address() const = 0;
+
+	// Wait up to timeoutMs (-1 forever, 0 not at all) for the next connection, null if none arrived
+	virtual std::unique_ptr<Channel> accept(int timeoutMs) = 0;
+};
+
+// A way of connecting processes. Addresses are "scheme:rest", e.g. "unix:/tmp/gravity.sock" or "tcp:127.0.0.1:5000"
+// (port 0 lets the system pick one), and the scheme picks the transport.
+struct Transport {
+	virtual ~Transport() = default;
+
+	// Start accepting connections on "address", null and *error set on failure
+	virtual std::unique_ptr<Listener> listen(const std::string& address, std::string* error) = 0;
+
+	// Connect to a listener, null and *error set on failure
+	virtual std::unique_ptr<Channel> connect(const std::string& address, std::string* error) = 0;
+
+	// Address for another listener of the same kind next to "address", e.g. for worker "index" of a coordinator
+	virtual std::string siblingAddress(const std::string& address, int index) const = 0;
+};
+
+// Transport for the scheme of an address, null if it is not supported on this platform
+Transport* transportFor(const std::string& address);
+
+// Default address of a coordinator: a socket file in the temporary directory where Unix sockets exist,
+// otherwise TCP on the loopback interface with a port picked by the system
+std::string defaultListenAddress();
+
+// Builds a message payload. Numbers are written in the host's byte order, every process of a run is the same build.
+struct MessageWriter {
+	std::vector<unsigned char> bytes;
+
+	template <typename T>
+	void put(T value) { putArray(&value, 1); }
+
+	template <typename T>
+	void putArray(const T* values, size_t count) {
+		size_t start = bytes.size();
+		bytes.resize(start + count * sizeof(T));
+		if (count > 0) std::memcpy(bytes.data() + start, values, count * sizeof(T));
+	}
+
+	void putString(const std::string& text) {
+		put<uint32_t>((uint32_t)text.size());
+		putArray(text.data(), text.size());
+	}
+};
+
+// Reads a payload written by MessageWriter. Reading past the end fails once and leaves ok() false for good.
+struct MessageReader {
+	explicit MessageReader(const std::vector<unsigned char>& bytes) : bytes(bytes) {}
+
+	template <typename T>
+	T get() {
+		T value{};
+		getArray(&value, 1);
+		return value;
+	}
+
+	template <typename T>
+	bool getArray(T* values, size_t count) {
+		if (!valid || count > (bytes.size() - offset) / sizeof(T)) return valid = false;
+		if (count > 0) std::memcpy(values, bytes.data() + offset, count * sizeof(T));
+		offset += count * sizeof(T);
+		return true;
+	}
+
+	std::string getString() {
+		uint32_t length = get<uint32_t>();
+		if (!valid || length > bytes.size() - offset) {
+			valid = false;
+			return std::string();
+		}
+		std::string text((const char*)bytes.data() + offset, length);
+		offset += length;
+		return text;
+	}
+
+	// Bytes left to read
+	size_t remaining() const { return bytes.size() - offset; }
+
+	// False once any read ran past the end
+	bool ok() const { return valid; }
+
+private:
+	const std::vector<unsigned char>& bytes;
+	size_t offset = 0;
+	bool valid = true;
+};
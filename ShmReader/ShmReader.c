@@ -0,0 +1,102 @@
+// Example reader of the shared memory a simulation publishes with --publish NAME. Prints a summary of the newest
+// snapshot every interval until the simulation stops, reading the bodies in place through the C API in GravityShm.h.
+//
+//     ShmReader NAME [INTERVAL_MS]
+#include "GravityShm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define READER_CONNECT_ATTEMPTS 100		// Tries of INTERVAL_MS each for the simulation to start publishing
+
+static void sleepMs(int ms) {
+#ifdef _WIN32
+	Sleep(ms);
+#else
+	struct timespec duration = { ms / 1000, (ms % 1000) * 1000000L };
+	nanosleep(&duration, NULL);
+#endif
+}
+
+// What a dashboard would show, computed straight from the shared arrays
+typedef struct Summary {
+	double totalMass;
+	double centerX, centerY;
+	double kineticEnergy;
+	uint64_t heaviestId;
+	double heaviestMass;
+} Summary;
+
+static void summarize(const gravity_shm_view* view, Summary* summary) {
+	uint64_t i;
+	summary->totalMass = summary->centerX = summary->centerY = summary->kineticEnergy = summary->heaviestMass = 0.0;
+	summary->heaviestId = 0;
+	for (i = 0; i < view->count; i++) {
+		double m = view->mass[i];
+		summary->totalMass += m;
+		summary->centerX += m * view->x[i];
+		summary->centerY += m * view->y[i];
+		summary->kineticEnergy += 0.5 * m * ((double)view->vx[i] * view->vx[i] + (double)view->vy[i] * view->vy[i]);
+		if (m > summary->heaviestMass) {
+			summary->heaviestMass = m;
+			summary->heaviestId = view->id[i];
+		}
+	}
+	if (summary->totalMass > 0.0) {
+		summary->centerX /= summary->totalMass;
+		summary->centerY /= summary->totalMass;
+	}
+}
+
+int main(int argc, char** argv) {
+	gravity_shm_reader* reader = NULL;
+	int interval = argc > 2 ? atoi(argv[2]) : 1000;
+	int attempt;
+	uint64_t lastStep = (uint64_t)-1;
+	if (argc < 2 || interval <= 0) {
+		fprintf(stderr, "Usage: %s NAME [INTERVAL_MS]\n", argv[0]);
+		return 1;
+	}
+
+	for (attempt = 0; attempt < READER_CONNECT_ATTEMPTS && !reader; attempt++) {
+		reader = gravity_shm_open(argv[1]);
+		if (!reader) sleepMs(interval);
+	}
+	if (!reader) {
+		fprintf(stderr, "Nothing is published as %s\n", argv[1]);
+		return 1;
+	}
+
+	for (;;) {
+		gravity_shm_view view;
+		Summary summary;
+		int status;
+
+		// Read in place, and again if the simulation overwrote the snapshot meanwhile
+		do {
+			status = gravity_shm_begin(reader, &view);
+			if (status != GRAVITY_SHM_OK && status != GRAVITY_SHM_CLOSED) break;
+			summarize(&view, &summary);
+		} while (!gravity_shm_validate(reader, &view));
+
+		if ((status == GRAVITY_SHM_OK || status == GRAVITY_SHM_CLOSED) && view.step != lastStep) {
+			printf("step %llu  t %.1f  bodies %llu", (unsigned long long)view.step, view.time, (unsigned long long)view.total);
+			if (view.count < view.total) printf(" (%llu shared)", (unsigned long long)view.count);
+			printf("  mass %.4e  center (%.1f, %.1f)  kinetic %.4e  heaviest #%u:%u %.4e\n", summary.totalMass, summary.centerX, summary.centerY,
+				summary.kineticEnergy, (unsigned)(summary.heaviestId & 0xFFFFFFFFu), (unsigned)(summary.heaviestId >> 32), summary.heaviestMass);
+			fflush(stdout);
+			lastStep = view.step;
+		}
+		if (status == GRAVITY_SHM_CLOSED) break;
+		sleepMs(interval);
+	}
+
+	printf("Simulation stopped after %llu snapshots\n", (unsigned long long)gravity_shm_published(reader));
+	gravity_shm_close(reader);
+	return 0;
+}